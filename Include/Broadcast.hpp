@@ -0,0 +1,112 @@
+/*
+rF2 Delta Best Plugin
+
+UDP broadcast of the delta.
+
+With "[Broadcast] Enabled=1" the plugin sends the live delta state
+(the same snapshot as SharedDelta.hpp) as small UDP datagrams, at a
+fixed rate, to an address of the local network or the loopback, for
+displays and devices on the sim rig.
+
+The simulation thread only copies a snapshot into a single producer,
+single consumer queue, when one is due, and wakes up a background
+thread. That thread owns the socket: it empties the queue and sends
+one BroadcastPacket for each snapshot, then sleeps until woken up
+again. If the thread falls behind, snapshots are dropped (and
+counted) rather than blocking the game.
+
+Datagrams are one BroadcastPacket each, little endian as on the PC
+that sends them. Every packet has the next sequence number, so that
+receivers can count the lost ones. sample_time and send_time are
+SharedDeltaClock() values, only comparable on the same machine (see
+Tools/BroadcastReceiver.cpp).
+
+*/
+
+#ifndef _BROADCAST_H
+#define _BROADCAST_H
+
+#include "SharedDelta.hpp"
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define BROADCAST_MAGIC             0x50554244      /* "DBUP" */
+#define BROADCAST_VERSION           3
+
+/* Must be a power of two */
+#define BROADCAST_QUEUE_SIZE        64
+
+#define BROADCAST_ADDRESS_MAXLEN    64      /* Same as ADDRESS_MAXLEN in PluginConfig.hpp */
+
+struct BroadcastPacket {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t flags;                    /* SHARED_DELTA_REALTIME, ... */
+	uint32_t sequence;                 /* One more for every packet sent */
+	int32_t split_sector;              /* As SharedDeltaData */
+	uint64_t sample_time;              /* When the snapshot was taken */
+	uint64_t send_time;                /* When the packet was sent */
+	double session_et;
+	float delta;
+	float delta_rate;
+	float lap_distance;
+	float lap_elapsed;
+	float best_lap;
+	float predicted_lap;
+	float split_delta;
+	float track_length;
+	float distance_gap;                /* Since version 2 */
+	float delta_slope;                 /* Since version 3 */
+};
+
+struct BroadcastQueue {
+	SharedDeltaData samples[BROADCAST_QUEUE_SIZE];
+	std::atomic<unsigned int> head;      /* Next slot to write, only changed by the producer */
+	std::atomic<unsigned int> tail;      /* Next slot to read, only changed by the consumer */
+};
+
+struct Broadcast {
+	char address[BROADCAST_ADDRESS_MAXLEN];
+	unsigned int port;
+	unsigned int rate;                 /* Snapshots a second */
+	uint64_t interval;                 /* Nanoseconds between snapshots */
+
+	/* Simulation thread only */
+	uint64_t last_push;
+	unsigned long dropped;
+
+	BroadcastQueue queue;
+	std::atomic<bool> running;
+	std::thread thread;
+
+	/* The sender thread waits on it for the next snapshot */
+	std::mutex lock;
+	std::condition_variable pushed;
+
+	/* Counted by the sender thread */
+	std::atomic<unsigned long> sent;
+	std::atomic<unsigned long> errors;
+};
+
+/* Starts the sender thread, sending rate packets a second to address
+   (IPv4, broadcast addresses included) and port. Any error with the
+   socket is only counted in errors. */
+void BroadcastStart(Broadcast *broadcast, const char *address, unsigned int port, unsigned int rate);
+
+/* Sends what's left and stops the thread. Safe to call if not started. */
+void BroadcastStop(Broadcast *broadcast);
+
+/* Whether a new snapshot should be pushed by now */
+bool BroadcastDue(const Broadcast *broadcast);
+
+/* Queues a snapshot for sending, if due. Only to be called from one
+   thread, the simulation thread. */
+void BroadcastPush(Broadcast *broadcast, const SharedDeltaData &data);
+
+/* Checks a datagram and copies it out. Returns false if it's not a packet of this version. */
+bool BroadcastDecode(const void *datagram, size_t size, BroadcastPacket *packet);
+
+#endif /* _BROADCAST_H */
@@ -0,0 +1,377 @@
+/*
+rF2 Delta Best Plugin
+
+Binary capture of the plugin callbacks.
+
+Writes the ScoringInfoV01 (followed by its mVehicle array) and
+TelemInfoV01 structures the game passes to the plugin, the session
+lifecycle callbacks, control commands, config changes and the best
+lap loaded from disk, to an append-only file. Everything that can
+change what the DeltaEngine computes is in there, so a capture can
+be played back byte by byte (see Tools/CapturePlayer.cpp).
+
+The simulation thread only copies each record into a memory buffer.
+A background thread writes the buffer out every CAPTURE_FLUSH_MS,
+storing scoring and telemetry as the bytes that changed since the
+previous record of the same type, which is most of the time a small
+fraction of the structure. If the disk can't keep up, records are
+dropped (and counted) rather than blocking the game.
+
+File layout: a sequence of records, each a CaptureRecordHeader and
+"size" bytes of payload. Every capture appended to the file starts
+with a CAPTURE_OPEN record, describing the structure sizes of the
+build that wrote it. The game structures are stored in one layout
+whatever the build (see CaptureScoringInfo), without their pointers:
+mResultsStream is not captured.
+
+*/
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include "InternalsPlugin.hpp"
+#include "DeltaEngine.hpp"
+#include "PluginConfig.hpp"
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CAPTURE_MAGIC               "DBCAPTUR"
+#define CAPTURE_VERSION             3
+
+/* How often the writer thread empties the buffer */
+#define CAPTURE_FLUSH_MS            250
+
+/* Records are dropped when this much is waiting to be written */
+#define CAPTURE_MAX_PENDING         (16 * 1024 * 1024)
+
+enum CaptureRecordType {
+	CAPTURE_OPEN = 1,           /* CaptureInfo */
+	CAPTURE_START_SESSION,      /* No payload */
+	CAPTURE_END_SESSION,
+	CAPTURE_ENTER_REALTIME,
+	CAPTURE_EXIT_REALTIME,
+	CAPTURE_SCORING,            /* CaptureScoringInfo, then mNumVehicles CaptureVehicleInfo */
+	CAPTURE_TELEMETRY,          /* CaptureTelemInfo */
+	CAPTURE_COMMAND,            /* unsigned int, a PluginCommand about to be executed */
+	CAPTURE_CONFIG,             /* PluginConfig, whenever it changes */
+	CAPTURE_BEST_LAP,           /* CaptureBestLap, the best lap as loaded from disk */
+	CAPTURE_RECORD_TYPES
+};
+
+/* Payload holds the changes from the previous record of the same type */
+#define CAPTURE_FLAG_DIFF           0x0001
+
+struct CaptureRecordHeader {
+	unsigned short type;
+	unsigned short flags;
+	unsigned int size;          /* Bytes of payload that follow, as stored */
+	double timestamp;           /* Seconds since the capture was started */
+};
+
+struct CaptureInfo {
+	char magic[8];
+	unsigned int version;
+	unsigned int pointer_size;  /* Of the build that wrote it, only for information */
+	unsigned int scoring_size;
+	unsigned int vehicle_size;
+	unsigned int telemetry_size;
+	unsigned int config_size;
+	unsigned int best_lap_size;
+};
+
+/* Followed by elapsed[meters] (double), pos_x[meters] and
+   pos_z[meters] (float) when has_positions is set, and
+   odometry[ODOMETRY_SEGMENTS] (float) when has_odometry is set */
+struct CaptureBestLap {
+	double final;
+	double started;
+	double ended;
+	double interval_offset;
+	uint32_t meters;
+	uint32_t has_positions;
+	uint32_t has_odometry;
+	uint32_t reserved;          /* 0, pads to a multiple of 8 under any packing */
+};
+
+/* The plugin is built with 4 byte packing and the tools without: the
+   header must be laid out the same either way */
+static_assert(sizeof(CaptureBestLap) == 48, "CaptureBestLap must be 48 bytes under any packing");
+
+/* The game structures as stored in a capture, whatever the build.
+   The plugin is built with 4 byte packing and 32 bit longs, and its
+   pointers are 4 or 8 bytes. These mirror the structures of the 64
+   bit plugin field by field with fixed width types, laid out the same
+   by any compiler, and are converted from and to the game structures
+   on writing and reading (see CaptureEncodeScoring() and
+   CaptureGetScoring()). Pointers are stored as 0. */
+#pragma pack(push, 4)
+
+struct CaptureWheelInfo {
+	double mSuspensionDeflection;
+	double mRideHeight;
+	double mSuspForce;
+	double mBrakeTemp;
+	double mBrakePressure;
+	double mRotation;
+	double mLateralPatchVel;
+	double mLongitudinalPatchVel;
+	double mLateralGroundVel;
+	double mLongitudinalGroundVel;
+	double mCamber;
+	double mLateralForce;
+	double mLongitudinalForce;
+	double mTireLoad;
+	double mGripFract;
+	double mPressure;
+	double mTemperature[3];
+	double mWear;
+	char mTerrainName[16];
+	uint8_t mSurfaceType;
+	bool mFlat;
+	bool mDetached;
+	double mVerticalTireDeflection;
+	double mWheelYLocation;
+	double mToe;
+	double mTireCarcassTemperature;
+	double mTireInnerLayerTemperature[3];
+	uint8_t mExpansion[24];
+};
+
+struct CaptureTelemInfo {
+	int32_t mID;
+	double mDeltaTime;
+	double mElapsedTime;
+	int32_t mLapNumber;
+	double mLapStartET;
+	char mVehicleName[64];
+	char mTrackName[64];
+	TelemVect3 mPos;
+	TelemVect3 mLocalVel;
+	TelemVect3 mLocalAccel;
+	TelemVect3 mOri[3];
+	TelemVect3 mLocalRot;
+	TelemVect3 mLocalRotAccel;
+	int32_t mGear;
+	double mEngineRPM;
+	double mEngineWaterTemp;
+	double mEngineOilTemp;
+	double mClutchRPM;
+	double mUnfilteredThrottle;
+	double mUnfilteredBrake;
+	double mUnfilteredSteering;
+	double mUnfilteredClutch;
+	double mFilteredThrottle;
+	double mFilteredBrake;
+	double mFilteredSteering;
+	double mFilteredClutch;
+	double mSteeringShaftTorque;
+	double mFront3rdDeflection;
+	double mRear3rdDeflection;
+	double mFrontWingHeight;
+	double mFrontRideHeight;
+	double mRearRideHeight;
+	double mDrag;
+	double mFrontDownforce;
+	double mRearDownforce;
+	double mFuel;
+	double mEngineMaxRPM;
+	uint8_t mScheduledStops;
+	bool mOverheating;
+	bool mDetached;
+	bool mHeadlights;
+	uint8_t mDentSeverity[8];
+	double mLastImpactET;
+	double mLastImpactMagnitude;
+	TelemVect3 mLastImpactPos;
+	double mEngineTorque;
+	int32_t mCurrentSector;
+	uint8_t mSpeedLimiter;
+	uint8_t mMaxGears;
+	uint8_t mFrontTireCompoundIndex;
+	uint8_t mRearTireCompoundIndex;
+	double mFuelCapacity;
+	uint8_t mFrontFlapActivated;
+	uint8_t mRearFlapActivated;
+	uint8_t mRearFlapLegalStatus;
+	uint8_t mIgnitionStarter;
+	char mFrontTireCompoundName[18];
+	char mRearTireCompoundName[18];
+	uint8_t mSpeedLimiterAvailable;
+	uint8_t mAntiStallActivated;
+	uint8_t mUnused[6];
+	double mRearBrakeBias;
+	double mTurboBoostPressure;
+	uint8_t mExpansion[168];
+	CaptureWheelInfo mWheel[4];
+};
+
+struct CaptureVehicleInfo {
+	int32_t mID;
+	char mDriverName[32];
+	char mVehicleName[64];
+	int16_t mTotalLaps;
+	int8_t mSector;
+	int8_t mFinishStatus;
+	double mLapDist;
+	double mPathLateral;
+	double mTrackEdge;
+	double mBestSector1;
+	double mBestSector2;
+	double mBestLapTime;
+	double mLastSector1;
+	double mLastSector2;
+	double mLastLapTime;
+	double mCurSector1;
+	double mCurSector2;
+	int16_t mNumPitstops;
+	int16_t mNumPenalties;
+	bool mIsPlayer;
+	int8_t mControl;
+	bool mInPits;
+	uint8_t mPlace;
+	char mVehicleClass[32];
+	double mTimeBehindNext;
+	int32_t mLapsBehindNext;
+	double mTimeBehindLeader;
+	int32_t mLapsBehindLeader;
+	double mLapStartET;
+	TelemVect3 mPos;
+	TelemVect3 mLocalVel;
+	TelemVect3 mLocalAccel;
+	TelemVect3 mOri[3];
+	TelemVect3 mLocalRot;
+	TelemVect3 mLocalRotAccel;
+	uint8_t mHeadlights;
+	uint8_t mPitState;
+	uint8_t mServerScored;
+	uint8_t mIndividualPhase;
+	int32_t mQualification;
+	double mTimeIntoLap;
+	double mEstimatedLapTime;
+	char mPitGroup[24];
+	uint8_t mFlag;
+	uint8_t mUnused1;
+	uint8_t mUnused2;
+	uint8_t mUnused3;
+	uint8_t mUpgradePack[16];
+	uint8_t mExpansion[60];
+};
+
+struct CaptureScoringInfo {
+	char mTrackName[64];
+	int32_t mSession;
+	double mCurrentET;
+	double mEndET;
+	int32_t mMaxLaps;
+	double mLapDist;
+	uint64_t mResultsStream;
+	int32_t mNumVehicles;
+	uint8_t mGamePhase;
+	int8_t mYellowFlagState;
+	int8_t mSectorFlag[3];
+	uint8_t mStartLight;
+	uint8_t mNumRedLights;
+	bool mInRealtime;
+	char mPlayerName[32];
+	char mPlrFileName[64];
+	double mDarkCloud;
+	double mRaining;
+	double mAmbientTemp;
+	double mTrackTemp;
+	TelemVect3 mWind;
+	double mOnPathWetness;
+	double mOffPathWetness;
+	uint8_t mExpansion[256];
+	uint64_t mVehicle;
+};
+
+#pragma pack(pop)
+
+/* The sizes of the structures of the 64 bit plugin */
+static_assert(sizeof(CaptureWheelInfo) == 260, "CaptureWheelInfo must mirror TelemWheelV01 of the plugin");
+static_assert(sizeof(CaptureTelemInfo) == 1888, "CaptureTelemInfo must mirror TelemInfoV01 of the plugin");
+static_assert(sizeof(CaptureVehicleInfo) == 584, "CaptureVehicleInfo must mirror VehicleScoringInfoV01 of the plugin");
+static_assert(sizeof(CaptureScoringInfo) == 548, "CaptureScoringInfo must mirror ScoringInfoV01 of the plugin");
+
+/* What's needed to store records as changes from the previous ones */
+struct CaptureEncoder {
+	std::vector<char> encoded;
+	std::vector<char> previous[CAPTURE_RECORD_TYPES];
+};
+
+struct Capture {
+	FILE *file;
+	std::chrono::high_resolution_clock::time_point started;
+	unsigned long records;
+	unsigned long dropped;
+
+	/* Records waiting for the writer thread */
+	std::mutex lock;
+	std::vector<char> pending;
+
+	/* Only used by the simulation thread */
+	std::vector<char> encoding;
+
+	/* Only used by the writer thread */
+	std::atomic<bool> running;
+	std::thread thread;
+	std::vector<char> writing;
+	CaptureEncoder encoder;
+};
+
+/* Appends to the file, creating it if needed. Returns false if it can't be opened. */
+bool CaptureStart(Capture *capture, const char *path);
+
+/* Writes out what's left and closes the file. Safe to call if not started. */
+void CaptureStop(Capture *capture);
+
+/* All of these do nothing when the capture isn't started. Only
+   to be called from one thread, the simulation thread. */
+void CaptureEvent(Capture *capture, CaptureRecordType type);
+void CaptureScoring(Capture *capture, const ScoringInfoV01 &info);
+void CaptureTelemetry(Capture *capture, const TelemInfoV01 &info);
+void CaptureCommand(Capture *capture, unsigned int command);
+void CaptureConfig(Capture *capture, const PluginConfig &config);
+void CaptureLap(Capture *capture, const LapTime *lap);
+
+/* Scoring and telemetry as stored in a capture */
+void CaptureEncodeScoring(const ScoringInfoV01 &info, std::vector<char> *payload);
+void CaptureEncodeTelemetry(const TelemInfoV01 &info, CaptureTelemInfo *payload);
+
+/* Structure sizes of this build, for the CAPTURE_OPEN record */
+void CaptureGetInfo(CaptureInfo *info);
+
+/* Writes one record right away, for tools that write their own
+   captures. Use a new encoder, or one that has seen CAPTURE_OPEN,
+   for every file. */
+void CaptureWriteRecord(CaptureEncoder *encoder, FILE *file, const CaptureRecordHeader &header, const void *payload);
+
+struct CaptureReader {
+	FILE *file;
+	CaptureInfo info;           /* From the last CAPTURE_OPEN record */
+	std::vector<char> stored;
+	std::vector<char> previous[CAPTURE_RECORD_TYPES];
+};
+
+bool CaptureReaderOpen(CaptureReader *reader, const char *path);
+void CaptureReaderClose(CaptureReader *reader);
+
+/* Reads the next record, and its payload as it was captured. Returns
+   false at the end of the file, or if the file is damaged. */
+bool CaptureReadRecord(CaptureReader *reader, CaptureRecordHeader *header, std::vector<char> *payload);
+
+/* Whether the last CAPTURE_OPEN record matches the structures of this build */
+bool CaptureReaderCompatible(const CaptureReader *reader);
+
+/* Decoding of the payloads. Return false if the size doesn't match. */
+bool CaptureGetScoring(const std::vector<char> &payload, ScoringInfoV01 *info,
+	std::vector<VehicleScoringInfoV01> *vehicles);
+bool CaptureGetTelemetry(const std::vector<char> &payload, TelemInfoV01 *info);
+bool CaptureGetLap(const std::vector<char> &payload, LapTime *lap);
+
+#endif /* _CAPTURE_H */
@@ -0,0 +1,41 @@
+/*
+rF2 Delta Best Plugin
+
+Queue of user commands (display toggle, best lap reset...).
+
+Controls are registered with rF2 as custom controls, and their
+presses arrive through CheckHWControl(). Each press is pushed here
+once, and the commands are then executed by the simulation callbacks.
+Single producer, single consumer, no locks.
+
+*/
+
+#ifndef _COMMAND_QUEUE_H
+#define _COMMAND_QUEUE_H
+
+#include <atomic>
+
+/* Must be a power of two */
+#define COMMAND_QUEUE_SIZE      16
+
+enum PluginCommand {
+	CMD_NONE = 0,
+	CMD_TOGGLE_DISPLAY,
+	CMD_RESET_BEST_LAP
+};
+
+struct CommandQueue {
+	PluginCommand commands[COMMAND_QUEUE_SIZE];
+	std::atomic<unsigned int> head;      /* Next slot to write, only changed by the producer */
+	std::atomic<unsigned int> tail;      /* Next slot to read, only changed by the consumer */
+};
+
+void CommandQueueInit(CommandQueue *queue);
+
+/* Returns false if the queue is full, and the command is dropped */
+bool CommandQueuePush(CommandQueue *queue, PluginCommand command);
+
+/* Returns false if there's nothing in the queue */
+bool CommandQueuePop(CommandQueue *queue, PluginCommand *command);
+
+#endif /* _COMMAND_QUEUE_H */
@@ -11,65 +11,75 @@ URL:    http://isiforums.net/f/showthread.php/19517-Delta-Best-plugin-for-rFacto
 #define _INTERNALS_EXAMPLE_H
 
 #include "InternalsPlugin.hpp"
+#include "DeltaEngine.hpp"
+#include "PluginConfig.hpp"
+#include "OverlayGeometry.hpp"
+#include "GlyphAtlas.hpp"
+#include "PluginStats.hpp"
+#include "CommandQueue.hpp"
+#include "IniFile.hpp"
+#include "FileWatcher.hpp"
+#include "Capture.hpp"
+#include "SharedDelta.hpp"
+#include "Broadcast.hpp"
+#include "LapAnalysis.hpp"
+#include "LapArchive.hpp"
 #include <assert.h>
 #include <math.h>               /* for rand() */
 #include <stdio.h>              /* for sample output */
+#include <string.h>             /* for memcpy() */
 #include <d3dx9.h>              /* DirectX9 main header */
 #include <cmath>
 
 #define PLUGIN_NAME             "rF2 Delta Best - 2017.02.25"
 #define DELTA_BEST_VERSION      "v24/Nola"
 
-#undef ENABLE_LOG               /* To enable file logging */
-
 #if _WIN64
   #define LOG_FILE              "Bin64\\Plugins\\DeltaBest.log"
   #define CONFIG_FILE           "Bin64\\Plugins\\DeltaBest.ini"
   #define TEXTURE_BACKGROUND    "Bin64\\Plugins\\DeltaBestBackground.png"
+  #define STATS_FILE            "Bin64\\Plugins\\DeltaBest.stats"
+  #define CAPTURE_FILE          "Bin64\\Plugins\\DeltaBest.capture"
 #else
   #define LOG_FILE              "Bin32\\Plugins\\DeltaBest.log"
   #define CONFIG_FILE           "Bin32\\Plugins\\DeltaBest.ini"
   #define TEXTURE_BACKGROUND    "Bin32\\Plugins\\DeltaBestBackground.png"
+  #define STATS_FILE            "Bin32\\Plugins\\DeltaBest.stats"
+  #define CAPTURE_FILE          "Bin32\\Plugins\\DeltaBest.capture"
 #endif
 
-/* Maximum length of a track in meters */
-#define MAX_TRACK_LENGTH		100000
-
 #define DATA_PATH_FILE			"Core\\data.path"
 #define BEST_LAP_DIR			"%s\\Userdata\\player\\Settings\\DeltaBest"
-#define BEST_LAP_FILE			"%s\\%s_%s.lap"
-
-/* Game phases -> info.mGamePhase */
-#define GP_GREEN_FLAG           5
-#define GP_YELLOW_FLAG		    6
-#define GP_SESSION_OVER			8
+#define BEST_LAP_FILE			"%s\\%s_%s.lap"        /* Before the archive, imported once */
+#define LAP_ARCHIVE_FILE		"%s\\%s_%s"            /* .laps and .index */
+#define SEGMENT_STATS_FILE		"%s\\%s_%s.segments"
 
 #define COLOR_INTENSITY         0xF0
 
-#define DEFAULT_FONT_SIZE       48
-#define DEFAULT_FONT_NAME       "Arial Black"
+/* Seconds per 100m of delta slope, below that the bar fades to white */
+#define SLOPE_COLOR_CUTOFF      0.05
 
-#define DEFAULT_BAR_WIDTH       580
-#define DEFAULT_BAR_HEIGHT      20
-#define DEFAULT_BAR_TOP         130
-#define DEFAULT_BAR_TIME_GUTTER 5
 
-#define DEFAULT_TIME_WIDTH      128
-#define DEFAULT_TIME_HEIGHT     35
 
-/* Whether to use UpdateTelemetry() to achieve a better precision and
-   faster updates to the delta time instead of every 0.2s that
-   UpdateScoring() allows */
-#define DEFAULT_HIRES_UPDATES   1
+/* DeltaBest.ini reloads kept in the ring of snapshots. A reload
+   only comes once the file stayed the same for a watcher interval,
+   so a snapshot is reused seconds after it was replaced. */
+#define CONFIG_SNAPSHOTS        8
 
+/* Custom controls, registered with rF2 and bound by the user
+   in the Controls screen, like any other game control */
+#define CONTROL_TOGGLE_NAME     "DeltaBest Toggle"
+#define CONTROL_RESET_NAME      "DeltaBest Reset Best Lap"
 
-/* Toggle plugin with CTRL + a magic key. Reference:
-http://msdn.microsoft.com/en-us/library/windows/desktop/dd375731%28v=vs.85%29.aspx */
-#define DEFAULT_MAGIC_KEY       (0x44)      /* "D" */
-#define DEFAULT_RESET_KEY		(0x5A)      /* "Z" */
-#define KEY_DOWN(k)             ((GetAsyncKeyState(k) & 0x8000) && (GetAsyncKeyState(VK_CONTROL) & 0x8000))
+/* Vertex format of the overlay batch, see OverlayVertex */
+#define OVERLAY_FVF             (D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1)
 
-#define FONT_NAME_MAXLEN 32
+/* DeltaBest.ini as parsed at one reload. The generation tells a newer
+   snapshot from an older one, even once its slot in the ring is reused. */
+struct ConfigSnapshot {
+	PluginConfig config;
+	unsigned long generation;           /* One more at every reload, from 1 */
+};
 
 // This is used for the app to use the plugin for its intended purpose
 class DeltaBestPlugin : public InternalsPluginV06
@@ -84,7 +94,7 @@ public:
     // These are the functions derived from base class InternalsPlugin
     // that can be implemented.
     void Startup(long version);    // game startup
-    void Shutdown() {};            // game shutdown
+    void Shutdown();               // game shutdown
 
     void EnterRealtime();          // entering realtime
     void ExitRealtime();           // exiting realtime
@@ -105,16 +115,16 @@ public:
     bool WantsToDisplayMessage(MessageInfoV01 &msgInfo);
 
     // GAME INPUT
-    bool HasHardwareInputs() { return false; }
-    void UpdateHardware(const float fDT) { mET += fDT; }   // update the hardware with the time between frames
+    bool HasHardwareInputs() { return true; }
+    void UpdateHardware(const double fDT) { mET += (float) fDT; } // update the hardware with the time between frames
     void EnableHardware() { mEnabled = true; }             // message from game to enable hardware
     void DisableHardware() { mEnabled = false; }           // message from game to disable hardware
 
     // See if the plugin wants to take over a hardware control.  If the plugin takes over the
-    // control, this method returns true and sets the value of the float pointed to by the
-    // second arg.  Otherwise, it returns false and leaves the float unmodified.
-    bool CheckHWControl(const char * const controlName, float &fRetVal);
-    bool ForceFeedback(float &forceValue) { return false; }
+    // control, this method returns true and sets the value of the double pointed to by the
+    // second arg.  Otherwise, it returns false and leaves the double unmodified.
+    bool CheckHWControl(const char * const controlName, double &fRetVal);
+    bool ForceFeedback(double &forceValue) { return false; }
 
     // SCORING OUTPUT
     bool WantsScoringUpdates() { return true; }
@@ -150,20 +160,46 @@ public:
     void ThreadStarted(long type) {}                             // called just after a primary thread is started (type is 0=multimedia or 1=simulation)
     void ThreadStopping(long type) {}                            // called just before a primary thread is stopped (type is 0=multimedia or 1=simulation)
 
+    // CUSTOM CONTROLS
+    bool InitCustomControl(CustomControlInfoV01 &info);          // called repeatedly at startup until false is returned
+
 private:
 
-    double CalculateDeltaBest();
-    void DrawDeltaBar(const ScreenInfoV01 &info, double delta, double delta_diff);
-    void LoadConfig(struct PluginConfig &config, const char *ini_file);
+    void ProcessCommands();
+    void UpdateCapture(const struct ConfigSnapshot &snapshot);
+    void UpdateShared(const struct PluginConfig &config);
+    void UpdateBroadcast(const struct ConfigSnapshot &snapshot);
+    void PublishLive();
+    void DrawDeltaBar(const ScreenInfoV01 &info, double delta, double delta_slope, int readout, double readout_value);
+    void CreateOverlayTexture(LPDIRECT3DDEVICE9 d3d, const struct PluginConfig &config);
+    void UpdateOverlayLayout(const ScreenInfoV01 &info, const struct PluginConfig &config);
+    void CreateOverlayBuffers(LPDIRECT3DDEVICE9 d3d);
+    void ReleaseOverlayBuffers();
+    void SetOverlayState(LPDIRECT3DDEVICE9 d3d);
+    void SubmitOverlayBatch(LPDIRECT3DDEVICE9 d3d, bool upload);
+    static void ReloadConfig(void *context);
 	const char * GetRF2DataPath();
 	const char * GetBestLapFileName(const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+	static void LoadBestLapCallback(void *context, LapTime *lap,
+		const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+	static void SaveBestLapCallback(void *context, const LapTime *lap,
+		const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+	static long ArchiveLapCallback(void *context, const LapTime *lap, bool ended_at_line,
+		const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+	static void LapCompletedCallback(void *context, const CornerMap &corners,
+		const InputTrace &lap, const InputTrace &reference, double lap_time, double reference_time);
+	static void NewReferenceCallback(void *context, const LapTime &lap, const InputTrace &inputs,
+		unsigned long reference);
 	void LoadBestLap(struct LapTime *lap, const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
 	bool SaveBestLap(const struct LapTime *lap, const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+	long ArchiveLap(const struct LapTime *lap, bool ended_at_line, const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+	bool LoadLegacyBestLap(struct LapTime *lap, const char *path);
     bool NeedToDisplay();
-    void ResetLap(struct LapTime *lap);
     void WriteLog(const char * const msg);
+    void WriteStats();
+    void SaveSegmentStats();
     D3DCOLOR TextColor(double delta);
-    D3DCOLOR BarColor(double delta, double delta_diff);
+    D3DCOLOR BarColor(double delta, double delta_slope);
 
     //
     // Current status
@@ -174,5 +210,4 @@ private:
 
 };
 
-inline int round(float x) { return int(floor(x + 0.5)); }
 #endif // _INTERNALS_EXAMPLE_H
\ No newline at end of file
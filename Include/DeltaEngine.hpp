@@ -0,0 +1,361 @@
+/*
+rF2 Delta Best Plugin
+
+Delta best engine.
+
+Follows the player laps from the rF2 scoring and telemetry updates,
+and computes the delta time against the best lap. All the state of
+a session lives in one DeltaEngine, so any number of engines can run
+side by side in the same process, f.ex. to replay many sessions at
+once. There's no file or screen access in here: loading the best lap
+and saving the laps is left to the owner of the engine, through
+callbacks.
+
+*/
+
+#ifndef _DELTA_ENGINE_H
+#define _DELTA_ENGINE_H
+
+#include "InternalsPlugin.hpp"
+#include "PluginConfig.hpp"
+#include "DeltaGraph.hpp"
+#include "TrackMap.hpp"
+#include "InputTrace.hpp"
+#include "SegmentStats.hpp"
+#include <stdio.h>
+
+#undef ENABLE_LOG               /* To enable file logging */
+
+/* Maximum length of a track in meters */
+#define MAX_TRACK_LENGTH		100000
+
+/* Telemetry distance calibration, learned for every segment of
+   the track of that many meters */
+#define ODOMETRY_SEGMENT_LENGTH 50
+#define ODOMETRY_SEGMENTS       (MAX_TRACK_LENGTH / ODOMETRY_SEGMENT_LENGTH)
+
+/* How much every new lap counts in the calibration, 0..1 */
+#define ODOMETRY_WEIGHT         0.3
+
+/* Ratios outside these are bad samples (reset, spin...) and ignored */
+#define ODOMETRY_MIN_SCALE      0.8
+#define ODOMETRY_MAX_SCALE      1.25
+
+/* How much every new crossing counts in the sector boundary positions, 0..1 */
+#define SECTOR_POSITION_WEIGHT  0.3
+
+/* Meters, beyond that the estimate isn't moved to a sector boundary */
+#define SECTOR_RESYNC_MAX       30
+
+/* Seconds, between the lap time and the time from one lap start to
+   the next, for a lap that ended at the line (not with a reset) */
+#define LAP_END_TOLERANCE       0.5
+
+/* How fast the drift correction follows the latest errors, 0..1 */
+#define DRIFT_CORRECTION_WEIGHT 0.25
+
+/* Errors measured closer than this to the start of the lap (fraction
+   of the lap) are too small to tell the drift */
+#define DRIFT_MIN_FRACTION      0.1
+
+/* Trend of the delta for the predicted lap time: measured over at least
+   that many seconds of the best lap, smoothed with that weight (0..1),
+   and that much of it carried over the rest of the lap */
+#define PREDICTION_TREND_INTERVAL   0.5
+#define PREDICTION_TREND_WEIGHT     0.2
+#define PREDICTION_TREND_GAIN       0.75
+
+/* Time to distance index of the best lap: seconds per bucket, and
+   buckets, enough for an hour long lap */
+#define LAP_INDEX_STEP          0.1
+#define LAP_INDEX_BUCKETS       36000
+
+/* Slope of the delta over distance: at most one sample per meter, so
+   that many samples make the longest window, and the fewest samples
+   to fit a line. Sums are kept relative to an origin moved forward
+   every SLOPE_REBASE meters, to keep them small. */
+#define SLOPE_MAX_SAMPLES       512
+#define SLOPE_MIN_SAMPLES       5
+#define SLOPE_MIN_WINDOW        10
+#define SLOPE_REBASE            1000
+
+/* Game phases -> info.mGamePhase */
+#define GP_GREEN_FLAG           5
+#define GP_YELLOW_FLAG		    6
+#define GP_SESSION_OVER			8
+
+/* Keeps information about last and best laps */
+struct LapTime {
+	double elapsed[MAX_TRACK_LENGTH];
+	float pos_x[MAX_TRACK_LENGTH];         /* World position at every meter, for the track map */
+	float pos_z[MAX_TRACK_LENGTH];
+	bool has_positions;
+	double final;
+	double started;
+	double ended;
+	double interval_offset;
+	double sector[2];                      /* Official time at the end of sectors 1 and 2, 0 if unknown */
+	float odometry[ODOMETRY_SEGMENTS];     /* Calibration in use when the lap was set, 0 if unknown */
+	CornerMap corners;                     /* As a reference, found in the background */
+	long archive_entry;                    /* In the lap archive of the owner, -1 if not archived */
+};
+
+/* Inverse of LapTime.elapsed, from time into the lap to meters, for
+   the distance gap. Built once for a reference lap. Queries for times
+   that only go forward (as the current lap goes on) walk on from the
+   previous answer, and only look up the buckets when going back. */
+struct LapTimeIndex {
+	unsigned int first[LAP_INDEX_BUCKETS]; /* Last meter reached at (bucket * LAP_INDEX_STEP) seconds */
+	unsigned int buckets;                  /* 0 if there's no reference lap */
+	unsigned int meters;                   /* Meters [0, meters) of the lap have a time */
+	unsigned int cursor;                   /* Meter of the last query, */
+	double cursor_time;                    /*     and its time */
+};
+
+/* Least squares line through the (meters, delta) samples of the last
+   window meters of the lap, updated as samples come in and go out of
+   the window: O(1) amortised per sample */
+struct DeltaSlope {
+	double x[SLOPE_MAX_SAMPLES];           /* Ring of samples, meters into the lap */
+	double y[SLOPE_MAX_SAMPLES];           /*     and delta there */
+	unsigned int first;
+	unsigned int count;
+	double origin;                         /* Meters the sums are relative to */
+	double sum_x;
+	double sum_y;
+	double sum_xx;
+	double sum_xy;
+	double window;                         /* Meters, "[Bar] SlopeWindow" */
+	double slope;                          /* Seconds of delta per 100m, 0 until enough samples */
+};
+
+/* Running statistics of the delta error at a timing line: the
+   displayed delta minus the delta from the official times */
+struct DeltaAccuracy {
+	unsigned long count;
+	double mean;
+	double m2;                             /* Sum of squared differences from the mean */
+	double max_error;                      /* Absolute */
+};
+
+/* Seconds lost (+) or gained (-) in every corner of the best lap, by
+   the last lap that ended at the line */
+struct CornerTimes {
+	CornerMap corners;                     /* Of the best lap, none if not found yet */
+	float delta[INPUT_MAX_CORNERS];
+	double lap_time;
+	double reference_time;
+	unsigned long laps;                    /* One more for every table */
+};
+
+/* Time at a timing line, against the same time of the best lap */
+struct SectorSplit {
+	int sector;                            /* 1 or 2, 3 for the whole lap, 0 if none yet */
+	double delta;                          /* Seconds, negative when faster */
+	double et;                             /* Session time the line was crossed */
+	bool official;                         /* From the scoring split times, not the telemetry clock */
+};
+
+typedef void (*LoadBestLapCallback)(void *context, LapTime *lap,
+	const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+typedef void (*SaveBestLapCallback)(void *context, const LapTime *lap,
+	const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+
+/* A timed lap, ended at the line or not, with the calibration in
+   use. Called before the lap can become the best lap. Returns where
+   the lap was archived, kept in LapTime.archive_entry, -1 if not. */
+typedef long (*ArchiveLapCallback)(void *context, const LapTime *lap, bool ended_at_line,
+	const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh);
+
+/* A lap ended at the line, with a best lap to compare its inputs with.
+   Called before the lap can become the best lap. */
+typedef void (*LapCompletedCallback)(void *context, const CornerMap &corners,
+	const InputTrace &lap, const InputTrace &reference, double lap_time, double reference_time);
+
+/* New best lap with no corners yet, to be cut into corners and handed
+   back with DeltaEngineSetCorners(). The inputs are empty for a best
+   lap loaded from disk. */
+typedef void (*NewReferenceCallback)(void *context, const LapTime &lap, const InputTrace &inputs,
+	unsigned long reference);
+
+struct DeltaEngine {
+
+	bool in_realtime;                  /* Are we in cockpit? As opposed to monitor */
+	bool session_started;              /* Is a Practice/Race/Q session started or are we in spectator mode, f.ex.? */
+	bool lap_was_timed;                /* If current/last lap that ended was timed or not */
+	bool green_flag;                   /* Is the race in green flag condition? */
+	bool loaded_best_in_session;       /* Did we already load the best lap in this session? */
+	bool player_in_pits;               /* Is the player currently in the pits? */
+	unsigned int prev_pos;             /* Meters around the track of the current lap (previous interval) */
+	unsigned int last_pos;             /* Meters around the track of the current lap */
+	unsigned int laps_since_realtime;  /* Number of laps completed since entering realtime last time */
+	double current_delta_best;         /* Current calculated delta best time */
+	double prev_delta_best;
+	double prev_lap_dist;              /* Used to accurately calculate dt and */
+	double prev_current_et;            /*     speed of last interval */
+	double inbtw_scoring_traveled;     /* Distance traveled (m) between successive UpdateScoring() calls */
+	double inbtw_scoring_elapsed;
+	double prev_world_x;               /* World position at the previous UpdateScoring() */
+	double prev_world_z;
+	long render_ticks;
+	long render_ticks_int;
+	double track_length;               /* Meters, from the last UpdateScoring() */
+	signed char player_sector;         /* vinfo.mSector at the last UpdateScoring() */
+
+	/* Delta as calculated at the last update, to compare with the official
+	   times at the next sector boundary or at the line */
+	bool estimate_valid;
+	double estimate;                   /* Delta displayed, drift correction included */
+	double estimate_raw;               /* Before drift correction */
+	double estimate_fraction;          /* Of the lap, where it was calculated */
+	double estimate_lap;               /* last_lap.started when it was calculated */
+
+	/* Error of the delta at the line and at the end of sectors 1 and 2 */
+	DeltaAccuracy line_accuracy;
+	DeltaAccuracy sector_accuracy[2];
+
+	/* The speed from the telemetry is along the path the car drives,
+	   mLapDist along the centre of the track: through corners they
+	   differ. For every segment of the track, mLapDist traveled per
+	   meter of telemetry distance, learned from the completed laps.
+	   0 for segments not driven yet. */
+	float odometry[ODOMETRY_SEGMENTS];
+	double odometry_traveled;          /* Telemetry distance since the last UpdateScoring(), not calibrated */
+	float lap_track[ODOMETRY_SEGMENTS];     /* mLapDist and telemetry distance of the current lap, per segment */
+	float lap_odometer[ODOMETRY_SEGMENTS];
+
+	/* Sector boundaries: where they are, as learned from the official
+	   split times, and the last sector seen by UpdateTelemetry() */
+	double sector_position[2];         /* Meters at the end of sectors 1 and 2, 0 if unknown */
+	long telemetry_sector;             /* mCurrentSector, -1 if unknown */
+	double current_et;                 /* Latest session time, from scoring or telemetry */
+
+	/* Latest split, at telemetry rate, then corrected with the official time */
+	SectorSplit split;
+
+	/* Lap time if the rest of the lap goes like the best lap, with the
+	   delta still changing as it has lately, 0 if there's no delta. The
+	   trend is seconds of delta per second of the best lap. */
+	double predicted_lap;
+	double trend;
+	double trend_reference;            /* Best lap time and delta where the trend was last measured, */
+	double trend_delta;                /*     reference < 0 to start over */
+
+	/* Meters ahead of the best lap (negative when behind) at the same
+	   time into the lap, 0 if there's no delta */
+	double distance_gap;
+	LapTimeIndex best_index;
+
+	/* How fast the delta changes along the track, positive when losing time */
+	DeltaSlope delta_slope;
+
+	/* Time gained or lost over the last meters or seconds of the lap,
+	   "[Time] RollingMeters" or "RollingSeconds", 0 if there's no delta */
+	double rolling_delta;
+	unsigned int rolling_meters;
+	unsigned int rolling_seconds;      /* Instead of meters if not 0 */
+	unsigned int rolling_cursor;       /* Meter of the lap rolling_seconds ago */
+
+	/* Seconds of error for a whole lap, as learned from the errors at the
+	   timing lines, and how much of it is taken off the delta (0 unless
+	   "[Time] DriftCorrection=1") */
+	double drift_rate;
+	double drift_correction;
+
+	LapTime best_lap;
+	LapTime last_lap;
+
+	/* Driver inputs of the current lap and of the best lap, when it
+	   was set in this session (best laps loaded from disk have none) */
+	InputTrace last_inputs;
+	InputTrace best_inputs;
+
+	/* Best laps so far, to tell which one corners are handed back
+	   for, and whether the corners of the best lap are to be saved */
+	unsigned long reference;
+	bool corners_unsaved;
+	CornerTimes corner_times;
+
+	/* Times of all the laps of the session that ended at the line, per segment */
+	SegmentStats segment_stats;
+
+	/* Delta over lap distance, current and previous lap */
+	DeltaGraph delta_graph;
+
+	/* Simplified reference lap map, colored by time gained/lost */
+	TrackMap track_map;
+
+	/* Lap persistence and lap analysis, all optional */
+	LoadBestLapCallback load_best_lap;
+	SaveBestLapCallback save_best_lap;
+	ArchiveLapCallback archive_lap;
+	LapCompletedCallback lap_completed;
+	NewReferenceCallback new_reference;
+	void *callback_context;
+
+	FILE *log;                         /* Only used with ENABLE_LOG */
+};
+
+/* Engines are a few MB each, always allocated on the heap */
+DeltaEngine *DeltaEngineCreate();
+void DeltaEngineDestroy(DeltaEngine *engine);
+
+void ResetLap(LapTime *lap);
+
+/* Indexes the times of a completed lap, O(lap length) */
+void LapTimeIndexBuild(LapTimeIndex *index, const LapTime &lap);
+
+/* Meters into the lap at that time, interpolated, O(1) amortised for
+   increasing times. 0 if the lap isn't indexed. */
+double LapTimeIndexDistance(LapTimeIndex *index, const LapTime &lap, double elapsed);
+
+void DeltaEngineStartSession(DeltaEngine *engine);
+void DeltaEngineEndSession(DeltaEngine *engine);
+void DeltaEngineEnterRealtime(DeltaEngine *engine);
+void DeltaEngineExitRealtime(DeltaEngine *engine);
+
+void DeltaEngineUpdateScoring(DeltaEngine *engine, const PluginConfig &config, const ScoringInfoV01 &info);
+void DeltaEngineUpdateTelemetry(DeltaEngine *engine, const PluginConfig &config, const TelemInfoV01 &info);
+
+/* Forget the best lap of the session */
+void DeltaEngineResetBestLap(DeltaEngine *engine);
+
+/* Corners of a best lap, from the NewReferenceCallback. Ignored if
+   there's been a new best lap since. The best lap is saved again at
+   the next UpdateScoring(). */
+bool DeltaEngineSetCorners(DeltaEngine *engine, const CornerMap &corners, unsigned long reference);
+
+/* Whether there's a meaningful delta to show right now */
+bool DeltaEngineHasDelta(const DeltaEngine *engine);
+
+/* Predicted lap time, 0 if there's no delta to predict it from */
+double DeltaEnginePredictedLap(const DeltaEngine *engine);
+
+/* Slope of the delta over the last "[Bar] SlopeWindow" meters, in
+   seconds per 100m, positive when losing time. 0 if there's no delta. */
+double DeltaEngineDeltaSlope(const DeltaEngine *engine);
+
+/* Change of the delta over the last "[Time] RollingMeters" meters,
+   or "RollingSeconds" seconds, of the lap. 0 if there's no delta. */
+double DeltaEngineRollingDelta(const DeltaEngine *engine);
+
+/* Meters ahead of the best lap at the same time, 0 if there's no delta */
+double DeltaEngineDistanceGap(const DeltaEngine *engine);
+
+/* Meters into the lap, where the delta is calculated */
+double DeltaEngineLapDistance(const DeltaEngine *engine);
+
+/* Delta time at the current position, drift correction included, clamped to +/-99s */
+double DeltaEngineCalculateDelta(const DeltaEngine *engine);
+
+/* Delta to display this frame, smoothed over a few frames, and the
+   change since the last calculated delta. Called once per frame. */
+double DeltaEngineDisplayDelta(DeltaEngine *engine, const PluginConfig &config, double *diff);
+
+/* The latest split, if the line was crossed less than that many seconds ago */
+bool DeltaEngineLastSplit(const DeltaEngine *engine, double seconds, SectorSplit *split);
+
+/* Standard deviation of the errors so far */
+double DeltaAccuracyStdDev(const DeltaAccuracy &accuracy);
+
+#endif /* _DELTA_ENGINE_H */
@@ -0,0 +1,56 @@
+/*
+rF2 Delta Best Plugin
+
+Delta over lap distance graph ("sparkline").
+
+The lap is mapped onto one pixel column per (track length / width)
+meters. Each column only keeps the minimum and maximum delta seen
+while the car was in that stretch of track, updated as the car
+advances, so drawing is always O(width) whatever the track length.
+
+*/
+
+#ifndef _DELTA_GRAPH_H
+#define _DELTA_GRAPH_H
+
+#include "OverlayGeometry.hpp"
+
+/* Widest graph we can draw, in pixels */
+#define DELTA_GRAPH_MAX_COLUMNS 512
+
+struct DeltaGraphTrace {
+	float min[DELTA_GRAPH_MAX_COLUMNS];
+	float max[DELTA_GRAPH_MAX_COLUMNS];
+	unsigned int filled;                /* Columns [0, filled) have data */
+};
+
+struct DeltaGraph {
+	unsigned int columns;
+	double track_length;
+	DeltaGraphTrace traces[2];
+	unsigned int current;               /* Index of the current lap trace, the other is the previous lap */
+	unsigned long version;              /* Changes whenever the graph would draw differently */
+};
+
+struct DeltaGraphColors {
+	unsigned int background;
+	unsigned int zero_line;
+	unsigned int previous_lap;
+	unsigned int gaining;
+	unsigned int losing;
+};
+
+void DeltaGraphInit(DeltaGraph *graph, unsigned int columns, double track_length);
+
+/* Current lap becomes the previous lap */
+void DeltaGraphNewLap(DeltaGraph *graph);
+
+/* Adds a delta sample at the given lap distance, O(1) */
+void DeltaGraphAdd(DeltaGraph *graph, double lap_dist, double delta);
+
+/* Adds background, zero line and one quad per filled column of
+   the current (and optionally previous) lap, O(width) */
+void BuildDeltaGraph(OverlayBatch *batch, const OverlayLayout &layout,
+	const DeltaGraph &graph, const DeltaGraphColors &colors);
+
+#endif /* _DELTA_GRAPH_H */
@@ -0,0 +1,38 @@
+/*
+rF2 Delta Best Plugin
+
+Background watcher for changes to a file.
+
+A thread checks the file modification time and size every
+FILE_WATCHER_INTERVAL_MS, and calls back when any of them changed,
+including the file being created or deleted. Only once they are the
+same at two checks in a row, not while an editor is still writing
+the file. The callback runs on the watcher thread.
+
+*/
+
+#ifndef _FILE_WATCHER_H
+#define _FILE_WATCHER_H
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+#define FILE_WATCHER_INTERVAL_MS    500
+
+typedef void (*FileChangedCallback)(void *context);
+
+struct FileWatcher {
+	char path[FILENAME_MAX];
+	FileChangedCallback callback;
+	void *context;
+	std::atomic<bool> running;
+	std::thread thread;
+};
+
+void FileWatcherStart(FileWatcher *watcher, const char *path, FileChangedCallback callback, void *context);
+
+/* Waits for the watcher thread to finish. Safe to call if not started. */
+void FileWatcherStop(FileWatcher *watcher);
+
+#endif /* _FILE_WATCHER_H */
@@ -0,0 +1,85 @@
+/*
+rF2 Delta Best Plugin
+
+Glyph atlas for the delta time readout.
+
+The readout only ever shows a sign, up to two digits, a decimal point
+and two decimals, a lap time in minutes, seconds and hundredths, or
+a distance in meters, so the few characters needed are rasterised once
+into the overlay texture at InitScreen(), and the delta value is turned
+directly into textured quads, without sprintf() or font layout.
+
+The rasterisation itself is done by the plugin (GDI). Everything here
+is plain arithmetic on glyph rectangles.
+
+*/
+
+#ifndef _GLYPH_ATLAS_H
+#define _GLYPH_ATLAS_H
+
+#include "OverlayGeometry.hpp"
+
+/* Characters needed by the "%+2.2f" delta, "m:ss.ss" lap time and "+12.3m" gap readouts */
+#define GLYPH_ATLAS_CHARS       "+-.0123456789:m"
+#define GLYPH_ATLAS_NUM_CHARS   15
+
+/* Empty pixels around each glyph cell, avoids bleeding with filtering */
+#define GLYPH_ATLAS_PADDING     1
+
+/* "-99.99" */
+#define DELTA_TEXT_MAXLEN       6
+
+/* "99:59.99" */
+#define LAP_TIME_TEXT_MAXLEN    8
+
+/* "-99.9m", "-9999m" */
+#define GAP_TEXT_MAXLEN         6
+
+/* Where the glyph is in the overlay texture, in pixels */
+struct GlyphInfo {
+	float x;
+	float y;
+	float width;
+	float height;
+};
+
+struct GlyphAtlas {
+	GlyphInfo glyphs[GLYPH_ATLAS_NUM_CHARS];
+	float texture_width;
+	float texture_height;
+	bool ready;
+};
+
+/* Index of the character in the atlas, or -1 if not available */
+int GlyphAtlasIndex(char c);
+
+/* Places glyph cells (widths in pixels, all line_height high) in rows
+   starting at the "top" pixel row of a texture of the given width.
+   Returns the number of pixel rows below "top" used by the glyphs. */
+unsigned int GlyphAtlasPack(GlyphAtlas *atlas, const unsigned int widths[GLYPH_ATLAS_NUM_CHARS],
+	unsigned int line_height, unsigned int texture_width, unsigned int top);
+
+/* Same output as sprintf("%+2.2f"), but as glyph indexes. Returns the glyph count. */
+unsigned int DeltaToGlyphs(double delta, int glyphs[DELTA_TEXT_MAXLEN]);
+
+/* Lap time as "m:ss.ss", or "mm:ss.ss" from 10 minutes. Returns the glyph count. */
+unsigned int LapTimeToGlyphs(double seconds, int glyphs[LAP_TIME_TEXT_MAXLEN]);
+
+/* Distance gap in meters, with one decimal below 100m, as "+12.3m"
+   or "-123m", up to 9999m. Returns the glyph count. */
+unsigned int GapToGlyphs(double meters, int glyphs[GAP_TEXT_MAXLEN]);
+
+/* Adds the delta text quads, horizontally centered and top-aligned in
+   the box, with a drop shadow offset by (shadow_offset, shadow_offset) */
+void LayoutDeltaText(OverlayBatch *batch, const GlyphAtlas &atlas, double delta,
+	const OverlayRect &box, unsigned int color, unsigned int shadow_color, float shadow_offset);
+
+/* Same as LayoutDeltaText(), for a lap time */
+void LayoutLapTimeText(OverlayBatch *batch, const GlyphAtlas &atlas, double seconds,
+	const OverlayRect &box, unsigned int color, unsigned int shadow_color, float shadow_offset);
+
+/* Same as LayoutDeltaText(), for a distance gap */
+void LayoutGapText(OverlayBatch *batch, const GlyphAtlas &atlas, double meters,
+	const OverlayRect &box, unsigned int color, unsigned int shadow_color, float shadow_offset);
+
+#endif /* _GLYPH_ATLAS_H */
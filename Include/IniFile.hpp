@@ -0,0 +1,49 @@
+/*
+rF2 Delta Best Plugin
+
+Minimal INI file parser.
+
+The whole file is read and split into section/key/value entries in
+a single pass, then values are looked up from memory. Follows the
+same rules as GetPrivateProfileInt/String(): ";" starts a comment
+line, section and key names are case insensitive, the first
+occurrence of a key wins and quotes around values are removed.
+
+*/
+
+#ifndef _INI_FILE_H
+#define _INI_FILE_H
+
+#include <stddef.h>
+#include <vector>
+
+#define INI_NAME_MAXLEN     64
+#define INI_VALUE_MAXLEN    256
+
+/* Largest file we're willing to read */
+#define INI_FILE_MAXSIZE    (256 * 1024)
+
+struct IniEntry {
+	char section[INI_NAME_MAXLEN];
+	char key[INI_NAME_MAXLEN];
+	char value[INI_VALUE_MAXLEN];
+};
+
+struct IniFile {
+	std::vector<IniEntry> entries;
+};
+
+/* Replaces the contents of ini with the entries found in text */
+void IniParse(IniFile *ini, const char *text, size_t length);
+
+/* Returns false if the file can't be read. ini is left empty,
+   so all lookups will return their default values. */
+bool IniLoad(IniFile *ini, const char *path);
+
+/* Like GetPrivateProfileInt(), negative values are returned as zero */
+unsigned int IniGetInt(const IniFile &ini, const char *section, const char *key, unsigned int default_value);
+
+void IniGetString(const IniFile &ini, const char *section, const char *key, const char *default_value,
+	char *value, size_t size);
+
+#endif /* _INI_FILE_H */
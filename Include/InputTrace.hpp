@@ -0,0 +1,127 @@
+/*
+rF2 Delta Best Plugin
+
+Driver inputs along the lap, and their comparison per corner.
+
+Throttle, brake, steering, gear, speed and lateral acceleration from
+the telemetry are kept for every INPUT_BIN_LENGTH meters of the lap,
+averaged over the samples that fell in the bin. Each channel is its
+own contiguous array (structure of arrays), so that the comparison
+only ever runs simple loops over plain float arrays, that the compiler
+can turn into vector instructions.
+
+The reference lap is cut into corners (a CornerMap) where the car
+turns: lateral acceleration or steering past a threshold. A reference
+with no inputs, only times (a best lap loaded from disk), is cut at its
+speed minima instead. Each corner runs from the fastest point before it
+to the start of the next one, the last one to the line.
+
+The comparison tells for each corner how much later or earlier the lap
+braked and got back on the throttle, how much more or less it steered
+into the corner, how much faster or slower it was at the slowest point,
+and the time gained or lost. Both are O(bins),
+and are meant to run away from the simulation thread, see
+LapAnalysis.hpp.
+
+*/
+
+#ifndef _INPUT_TRACE_H
+#define _INPUT_TRACE_H
+
+#include "InternalsPlugin.hpp"
+
+/* Meters per bin, and bins for the longest track (MAX_TRACK_LENGTH) */
+#define INPUT_BIN_LENGTH        5
+#define INPUT_MAX_BINS          20000
+
+/* Pedal positions (0..1) taken as braking and as back on the throttle */
+#define INPUT_BRAKE_ON          0.1f
+#define INPUT_THROTTLE_ON       0.5f
+
+/* Turning: lateral acceleration (m/s^2) or steering (-1..1) past
+   that. Turns less than CORNER_MERGE_BINS apart are the same corner,
+   turns shorter than CORNER_MIN_BINS aren't corners. */
+#define CORNER_LATERAL_ON       4.0f
+#define CORNER_STEERING_ON      0.1f
+#define CORNER_MERGE_BINS       4
+#define CORNER_MIN_BINS         3
+
+/* Without inputs: the slowest point within that many bins either
+   side, at least that fraction slower than the fastest point since
+   the previous corner */
+#define CORNER_APEX_BINS        10
+#define CORNER_MIN_DROP         0.1f
+
+/* Speeds from times only are measured over that many meters */
+#define TIMES_SPEED_METERS      60
+
+#define INPUT_MAX_CORNERS       64
+
+struct InputTrace {
+	float elapsed[INPUT_MAX_BINS];     /* Seconds into the lap at the last sample of the bin */
+	float speed[INPUT_MAX_BINS];       /* Meters per second */
+	float throttle[INPUT_MAX_BINS];    /* 0..1 */
+	float brake[INPUT_MAX_BINS];       /* 0..1 */
+	float steering[INPUT_MAX_BINS];    /* -1..1, left to right */
+	float lateral[INPUT_MAX_BINS];     /* Meters per second squared */
+	signed char gear[INPUT_MAX_BINS];  /* Last gear seen in the bin */
+	unsigned short samples[INPUT_MAX_BINS];
+	unsigned int bins;                 /* Bins [0, bins) have data */
+};
+
+/* Corners of a reference lap, meters into the lap */
+struct CornerMap {
+	float start[INPUT_MAX_CORNERS];    /* Fastest point before the corner */
+	float apex[INPUT_MAX_CORNERS];     /* Slowest point */
+	float end[INPUT_MAX_CORNERS];      /* Start of the next corner, or the line */
+	unsigned int count;                /* 0 if not cut into corners yet */
+};
+
+/* One corner, lap against the reference. Distances are meters into
+   the lap, differences are lap minus reference. */
+struct InputCorner {
+	float start;                       /* Fastest point before the corner */
+	float apex;                        /* Slowest point of the reference */
+	float end;                         /* Start of the next corner, or the line */
+	float time_delta;                  /* Seconds lost (+) or gained (-) from start to end */
+	float brake_point;                 /* Meters later (+) or earlier (-) on the brakes */
+	float min_speed;                   /* Meters per second faster (+) or slower (-) at the slowest point */
+	float throttle_point;              /* Meters later (+) or earlier (-) back on the throttle */
+	float steering;                    /* More (+) or less (-) steering at its peak from start to apex, 0..1 of full lock */
+	signed char gear;                  /* At the slowest point of the lap, */
+	signed char reference_gear;        /*     and of the reference */
+	bool braked;                       /* Both laps braked, otherwise brake_point is 0 */
+	bool throttled;                    /* Both laps got back on the throttle, otherwise throttle_point is 0 */
+	bool steered;                      /* Both laps have steering, otherwise steering is 0 */
+};
+
+struct InputComparison {
+	InputCorner corners[INPUT_MAX_CORNERS];
+	unsigned int count;
+	double lap_time;
+	double reference_time;
+};
+
+void InputTraceClear(InputTrace *trace);
+
+/* Adds a telemetry sample at that many meters and seconds into the
+   lap. Bins skipped since the last sample get the same values. Going
+   back is ignored, only a new lap (after InputTraceClear()) does. */
+void InputTraceAdd(InputTrace *trace, double meters, double elapsed, const TelemInfoV01 &info);
+
+/* Copies the bins with data only, O(bins) */
+void InputTraceCopy(InputTrace *to, const InputTrace &from);
+
+/* Times and speeds only, from the time at every meter of a lap (as
+   LapTime.elapsed), for a reference with no inputs. O(meters). */
+void InputTraceFromTimes(InputTrace *trace, const double *elapsed, unsigned int meters);
+
+/* Cuts the reference into corners. Returns the number of corners. */
+unsigned int FindCorners(const InputTrace &reference, CornerMap *map);
+
+/* Compares the lap with the reference, corner by corner. The corners
+   are found first if the map has none. Returns the number of corners. */
+unsigned int CompareInputTraces(const CornerMap &map, const InputTrace &reference, const InputTrace &lap,
+	InputComparison *comparison);
+
+#endif /* _INPUT_TRACE_H */
@@ -0,0 +1,88 @@
+/*
+rF2 Delta Best Plugin
+
+Background corner finding and comparison of the driver inputs.
+
+For every new best lap, the simulation thread only copies its input
+trace under a lock held just for the copy, and at the end of every lap
+the lap and best lap traces. Only the bins driven are copied (see
+InputTraceCopy()), 27 bytes each: about 5KB per km of track, and
+540KB at most (INPUT_MAX_BINS) for each trace. A worker
+thread looks for work every LAP_ANALYSIS_POLL_MS, takes it over, cuts
+the best lap into corners or compares the traces per corner (see
+InputTrace.hpp), and publishes the results, that the plugin reads back
+when it needs them.
+
+If a lap ends while the previous one is still waiting, the waiting
+one is replaced, and counted as dropped. Same for best laps.
+
+*/
+
+#ifndef _LAP_ANALYSIS_H
+#define _LAP_ANALYSIS_H
+
+#include "InputTrace.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#define LAP_ANALYSIS_POLL_MS        50
+
+struct LapAnalysisJob {
+	CornerMap corners;                 /* Of the reference, found by the worker if none */
+	InputTrace *lap;
+	InputTrace *reference;
+	double lap_time;
+	double reference_time;
+};
+
+struct LapAnalysis {
+	std::mutex lock;
+
+	/* Under the lock */
+	LapAnalysisJob submitted;
+	bool pending;
+	InputComparison result;
+	unsigned long version;             /* One more for every result published */
+
+	/* Same for the best laps to cut into corners */
+	InputTrace *segment_submitted;
+	unsigned long segment_reference;   /* DeltaEngine.reference of the best lap */
+	bool segment_pending;
+	CornerMap corners;
+	unsigned long corners_reference;
+	unsigned long corners_version;
+
+	/* Worker thread only */
+	LapAnalysisJob working;
+	InputTrace *segment_working;
+
+	std::atomic<bool> running;
+	std::thread thread;
+
+	/* Simulation thread only */
+	unsigned long submitted_count;
+	unsigned long dropped;
+};
+
+/* Allocates the job traces and starts the worker thread */
+void LapAnalysisStart(LapAnalysis *analysis);
+
+/* Waits for the worker thread to finish. Safe to call if not started. */
+void LapAnalysisStop(LapAnalysis *analysis);
+
+/* Queues the comparison of a completed lap with the reference, O(bins) */
+void LapAnalysisSubmit(LapAnalysis *analysis, const CornerMap &corners, const InputTrace &lap,
+	const InputTrace &reference, double lap_time, double reference_time);
+
+/* Queues a best lap to cut into corners, O(bins) */
+void LapAnalysisSegment(LapAnalysis *analysis, const InputTrace &reference, unsigned long id);
+
+/* Copies the latest result if newer than *version, and updates it.
+   Returns false if there's nothing new. */
+bool LapAnalysisLatest(LapAnalysis *analysis, InputComparison *result, unsigned long *version);
+
+/* Same for the corners of the latest best lap, and its id */
+bool LapAnalysisCorners(LapAnalysis *analysis, CornerMap *corners, unsigned long *reference, unsigned long *version);
+
+#endif /* _LAP_ANALYSIS_H */
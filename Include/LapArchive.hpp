@@ -0,0 +1,131 @@
+/*
+rF2 Delta Best Plugin
+
+Archive of all the laps driven, per track and vehicle class.
+
+Every timed lap is appended to two files, with the same name but the
+extension:
+
+- ".laps", the laps one after the other, in the same compact layout
+  as the best lap of a capture (see CaptureBestLap): the time at every
+  meter, then the positions and the odometry calibration if there are
+  any, then the corners, once found.
+
+- ".index", one fixed size LapArchiveEntry per lap: lap time, date,
+  session, weather, whether it ended at the line, driver, and where
+  the lap is in the ".laps" file.
+
+Picking a reference lap (the fastest, the fastest in the same
+conditions, the fastest of a teammate) only looks at the index, then
+maps the ".laps" file and copies that one lap out. No other lap is
+ever read.
+
+Neither file is rewritten, except for the corners of a lap: they are
+found in the background once the lap is archived, appended to the
+".laps" file, and the entry of the lap then points to them.
+
+*/
+
+#ifndef _LAP_ARCHIVE_H
+#define _LAP_ARCHIVE_H
+
+#include "DeltaEngine.hpp"
+#include <stdint.h>
+
+#define LAP_ARCHIVE_DATA_MAGIC      "DBLAPDAT"
+#define LAP_ARCHIVE_INDEX_MAGIC     "DBLAPIDX"
+#define LAP_ARCHIVE_VERSION         1
+
+#define LAP_ARCHIVE_DATA_EXT        ".laps"
+#define LAP_ARCHIVE_INDEX_EXT       ".index"
+
+/* LapArchiveEntry.flags */
+#define LAP_ARCHIVE_VALID           0x0001     /* Ended at the line, not with a reset */
+#define LAP_ARCHIVE_POSITIONS       0x0002     /* Positions follow the times */
+#define LAP_ARCHIVE_ODOMETRY        0x0004     /* Calibration follows the positions */
+#define LAP_ARCHIVE_IMPORTED        0x0008     /* From a best lap file, date and conditions unknown */
+
+/* Same conditions: rain and wetness (0..1), and track temperature
+   (Celsius) no further apart than that */
+#define LAP_ARCHIVE_RAIN_TOLERANCE  0.2f
+#define LAP_ARCHIVE_TEMP_TOLERANCE  5.0f
+
+#define LAP_ARCHIVE_DRIVER_MAXLEN   32
+
+/* Both files start with it */
+struct LapArchiveHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;                    /* sizeof(LapArchiveEntry) of the writer */
+};
+
+struct LapArchiveEntry {
+	double lap_time;
+	double sector[2];                       /* Official time at the end of sectors 1 and 2, 0 if unknown */
+	int64_t date;                           /* Seconds since 1970, 0 if unknown */
+	uint64_t offset;                        /* Of the lap in the ".laps" file */
+	uint64_t corners_offset;                /* Of its corners, 0 if none yet */
+	uint32_t size;                          /* Bytes of the lap */
+	uint32_t meters;                        /* Times, and positions if any */
+	uint32_t corners;                       /* Corners at corners_offset, start then apex then end */
+	uint32_t flags;
+	int32_t session;                        /* ScoringInfoV01.mSession, -1 if unknown */
+	float raining;                          /* 0..1 */
+	float wetness;                          /* On the racing line, 0..1 */
+	float ambient_temp;                     /* Celsius */
+	float track_temp;
+	char driver[LAP_ARCHIVE_DRIVER_MAXLEN];
+	uint32_t reserved;                      /* 0, pads to a multiple of 8 under any packing */
+};
+
+/* The plugin is built with 4 byte packing and the tools without: the
+   entries must be laid out the same either way */
+static_assert(sizeof(LapArchiveEntry) == 120, "LapArchiveEntry must be 120 bytes under any packing");
+
+/* An ".index" file, mapped read-only */
+struct LapArchiveIndex {
+	const LapArchiveEntry *entries;
+	unsigned int count;
+	const void *view;
+	size_t size;
+	void *file;
+	void *mapping;
+};
+
+/* What to pick as the reference lap, see LapArchiveFind() */
+struct LapArchiveQuery {
+	const char *driver;                     /* Only the laps of that driver, if not NULL */
+	bool same_conditions;                   /* Only the laps driven in these conditions: */
+	float raining;
+	float wetness;
+	float track_temp;
+};
+
+/* Date, session, weather and driver of a lap that just ended */
+void LapArchiveEntryInit(LapArchiveEntry *entry, bool ended_at_line, const ScoringInfoV01 &scoring,
+	const VehicleScoringInfoV01 &veh);
+
+/* The archive is at "<base>.laps" and "<base>.index" */
+
+/* Appends a lap, timed and archived as in the entry (lap time, layout
+   and offsets are filled in). The corners go along if it has any.
+   Returns the entry of the lap, or -1 if it can't be written. */
+long LapArchiveAppend(const char *base, const LapTime &lap, const LapArchiveEntry &entry);
+
+/* Appends the corners of an archived lap, and points its entry to them */
+bool LapArchiveSetCorners(const char *base, long entry, const CornerMap &corners);
+
+/* Maps the index. Returns false if there's none, or it was written
+   by an incompatible version. */
+bool LapArchiveOpenIndex(LapArchiveIndex *index, const char *base);
+void LapArchiveCloseIndex(LapArchiveIndex *index);
+
+/* Fastest valid lap that matches, O(entries) over the index only.
+   Returns its entry, or -1 if none. */
+long LapArchiveFind(const LapArchiveIndex &index, const LapArchiveQuery &query);
+
+/* Copies one lap out of the mapped ".laps" file. Times past the lap
+   time are cut, as the lap time is what it's compared with. */
+bool LapArchiveLoad(const char *base, const LapArchiveIndex &index, long entry, LapTime *lap);
+
+#endif /* _LAP_ARCHIVE_H */
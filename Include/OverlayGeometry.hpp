@@ -0,0 +1,145 @@
+/*
+rF2 Delta Best Plugin
+
+Overlay geometry generation.
+
+All the quads of the overlay (background bar, colored delta bar,
+time box) are generated here into a plain vertex array, which is then
+copied into a single dynamic vertex buffer and drawn with one call.
+
+Nothing in here depends on Direct3D, so the geometry can be generated
+and inspected without a graphics device.
+
+*/
+
+#ifndef _OVERLAY_GEOMETRY_H
+#define _OVERLAY_GEOMETRY_H
+
+/* Maximum number of quads in a single overlay batch. Enough for the bar,
+   the text, two laps of a 512 pixels wide graph and the track map. */
+#define OVERLAY_MAX_QUADS       1400
+#define OVERLAY_VERTS_PER_QUAD  6
+#define OVERLAY_MAX_VERTICES    (OVERLAY_MAX_QUADS * OVERLAY_VERTS_PER_QUAD)
+
+/* What the time box shows -> "[Time] Readout" */
+#define READOUT_DELTA           0
+#define READOUT_PREDICTED_LAP   1
+#define READOUT_DISTANCE_GAP    2
+#define READOUT_ROLLING_DELTA   3
+
+/* Same layout as (D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1) */
+struct OverlayVertex {
+	float x, y, z, rhw;
+	unsigned int color;
+	float u, v;
+};
+
+/* Pre-transformed vertices, drawn as a D3DPT_TRIANGLELIST */
+struct OverlayBatch {
+	OverlayVertex vertices[OVERLAY_MAX_VERTICES];
+	unsigned int num_vertices;
+};
+
+struct OverlayRect {
+	float left;
+	float top;
+	float width;
+	float height;
+};
+
+/* Everything needed to place the delta bar on screen.
+   Filled in by the plugin from PluginConfig and ScreenInfoV01. */
+struct OverlayLayout {
+	float screen_width;
+	float screen_height;
+
+	bool bar_enabled;
+	float bar_top;
+	float bar_width;
+	float bar_height;
+	float bar_gutter;
+
+	bool time_enabled;
+	float time_width;
+	float time_height;
+
+	bool graph_enabled;
+	bool graph_previous_lap;
+	float graph_left;
+	float graph_top;
+	float graph_width;
+	float graph_height;
+	float graph_range;                  /* Seconds at the top/bottom edge of the graph */
+
+	bool map_enabled;
+	float map_left;
+	float map_top;
+	float map_size;
+	float map_thickness;
+
+	/* Size in pixels of the overlay texture, and of the background
+	   image region in its top-left corner the plain quads are mapped on */
+	float texture_width;
+	float texture_height;
+	float background_width;
+	float background_height;
+};
+
+/* Everything, besides the layout, the generated geometry depends on.
+   Geometry only needs to be generated again when the key changes. */
+struct OverlayKey {
+	unsigned int delta_hundredths;
+	bool delta_negative;
+	int readout;                       /* READOUT_DELTA, ... what the time box shows */
+	unsigned int readout_units;        /* Hundredths of a second or tenths of a meter, unless the delta */
+	bool readout_negative;
+	float delta_left;
+	float delta_width;
+	unsigned int bar_color;
+	unsigned int text_color;
+	float screen_width;
+	float screen_height;
+	unsigned long graph_version;
+	unsigned long map_version;
+};
+
+void OverlayBatchReset(OverlayBatch *batch);
+unsigned int OverlayBatchPrimitives(const OverlayBatch *batch);
+
+/* Adds a quad textured with the top-left (width x height) pixels of the background */
+bool OverlayBatchAddQuad(OverlayBatch *batch, const OverlayLayout &layout,
+	float left, float top, float width, float height, unsigned int color);
+
+/* Adds a quad with explicit texture coordinates */
+bool OverlayBatchAddTexturedQuad(OverlayBatch *batch,
+	float left, float top, float width, float height, unsigned int color,
+	float u0, float v0, float u1, float v1);
+
+/* Adds already generated vertices, in multiples of OVERLAY_VERTS_PER_QUAD */
+bool OverlayBatchAddVertices(OverlayBatch *batch, const OverlayVertex *vertices, unsigned int count);
+
+/* Generates a line segment as a quad, mapped on the top-left texel of the background */
+void MakeLineQuad(OverlayVertex v[OVERLAY_VERTS_PER_QUAD],
+	float x0, float y0, float x1, float y1, float thickness, unsigned int color);
+
+/* Position and width in pixels of the colored part of the bar */
+void DeltaBarExtent(const OverlayLayout &layout, double delta, float *left, float *width);
+
+/* Generates the bar and time box quads for the given delta value.
+   Returns the time box rectangle in text_box, used to place the delta text. */
+void BuildDeltaBar(OverlayBatch *batch, const OverlayLayout &layout,
+	double delta, unsigned int bar_color, unsigned int box_color, OverlayRect *text_box);
+
+/* value * scale (up to 100) rounded the way printf() does it: from the
+   exact binary value, halfway cases to even. value is not negative. */
+unsigned int ReadoutUnits(double value, unsigned int scale);
+
+/* Whether printf() shows a "-", including for -0.0 */
+bool ReadoutNegative(double value);
+
+/* readout_value is the lap time or gap the time box shows instead of the delta */
+void MakeOverlayKey(OverlayKey *key, const OverlayLayout &layout, double delta, int readout, double readout_value,
+	unsigned int bar_color, unsigned int text_color, unsigned long graph_version, unsigned long map_version);
+bool OverlayKeyEquals(const OverlayKey &a, const OverlayKey &b);
+
+#endif /* _OVERLAY_GEOMETRY_H */
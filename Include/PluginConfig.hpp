@@ -0,0 +1,123 @@
+/*
+rF2 Delta Best Plugin
+
+Plugin configuration, as read from DeltaBest.ini.
+
+A PluginConfig is filled once from the ini file and never modified
+afterwards, so it can be shared between threads as is.
+
+*/
+
+#ifndef _PLUGIN_CONFIG_H
+#define _PLUGIN_CONFIG_H
+
+#include "IniFile.hpp"
+#include "OverlayGeometry.hpp"
+
+#define DEFAULT_FONT_SIZE       48
+#define DEFAULT_FONT_NAME       "Arial Black"
+
+#define DEFAULT_BAR_WIDTH       580
+#define DEFAULT_BAR_HEIGHT      20
+#define DEFAULT_BAR_TOP         130
+#define DEFAULT_BAR_TIME_GUTTER 5
+
+#define DEFAULT_TIME_WIDTH      128
+#define DEFAULT_TIME_HEIGHT     35
+
+#define DEFAULT_GRAPH_WIDTH     300
+#define DEFAULT_GRAPH_HEIGHT    60
+#define DEFAULT_GRAPH_RANGE     2          /* seconds */
+
+#define DEFAULT_MAP_SIZE        200
+#define DEFAULT_MAP_THICKNESS   3
+#define DEFAULT_MAP_MARGIN      20
+
+/* Whether to use UpdateTelemetry() to achieve a better precision and
+   faster updates to the delta time instead of every 0.2s that
+   UpdateScoring() allows */
+#define DEFAULT_HIRES_UPDATES   1
+
+/* Meters of track the gaining/losing color of the bar is measured over */
+#define DEFAULT_SLOPE_WINDOW    100
+
+/* Seconds the split is shown instead of the delta, after a timing line */
+#define DEFAULT_SPLIT_SECONDS   3
+
+/* What the time box shows -> "[Time] Readout", READOUT_DELTA, ...
+   see OverlayGeometry.hpp */
+
+/* Stretch of track behind the car the rolling delta is measured over */
+#define DEFAULT_ROLLING_METERS  200
+
+/* Which lap of the archive the delta is against -> "[Reference] Lap" */
+#define REFERENCE_FASTEST       0
+#define REFERENCE_CONDITIONS    1          /* Same rain and track temperature */
+#define REFERENCE_DRIVER        2          /* "[Reference] Driver" */
+
+/* Where and how often the delta is sent, with "[Broadcast] Enabled=1" */
+#define DEFAULT_BROADCAST_ADDRESS "127.0.0.1"
+#define DEFAULT_BROADCAST_PORT  27184
+#define DEFAULT_BROADCAST_RATE  30         /* packets per second */
+
+#define FONT_NAME_MAXLEN 32
+#define ADDRESS_MAXLEN   64
+#define DRIVER_NAME_MAXLEN 32
+
+struct PluginConfig {
+
+	bool bar_enabled;
+	unsigned int bar_left;
+	unsigned int bar_top;
+	unsigned int bar_width;
+	unsigned int bar_height;
+	unsigned int bar_gutter;
+	unsigned int slope_window;
+
+	bool time_enabled;
+	bool hires_updates;
+	bool drift_correction;
+	bool odometry_calibration;
+	bool sector_resync;
+	unsigned int split_seconds;
+	unsigned int time_readout;
+	unsigned int rolling_meters;
+	unsigned int rolling_seconds;
+	unsigned int time_top;
+	unsigned int time_width;
+	unsigned int time_height;
+	unsigned int time_font_size;
+	char time_font_name[FONT_NAME_MAXLEN];
+
+	bool graph_enabled;
+	bool graph_previous_lap;
+	unsigned int graph_left;
+	unsigned int graph_top;
+	unsigned int graph_width;
+	unsigned int graph_height;
+	unsigned int graph_range;
+
+	bool map_enabled;
+	unsigned int map_left;
+	unsigned int map_top;
+	unsigned int map_size;
+	unsigned int map_thickness;
+
+	bool corner_summary;
+
+	unsigned int reference_lap;
+	char reference_driver[DRIVER_NAME_MAXLEN];
+
+	bool stats_enabled;
+	bool capture_enabled;
+	bool shared_enabled;
+
+	bool broadcast_enabled;
+	char broadcast_address[ADDRESS_MAXLEN];
+	unsigned int broadcast_port;
+	unsigned int broadcast_rate;
+};
+
+void LoadPluginConfig(PluginConfig &config, const IniFile &ini);
+
+#endif /* _PLUGIN_CONFIG_H */
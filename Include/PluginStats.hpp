@@ -0,0 +1,52 @@
+/*
+rF2 Delta Best Plugin
+
+Runtime statistics.
+
+Plain counters, updated by the plugin as it goes, and written
+to the stats file at the end of each session when enabled
+with "[Stats] Enabled=1" in the ini file.
+
+*/
+
+#ifndef _PLUGIN_STATS_H
+#define _PLUGIN_STATS_H
+
+#include "DeltaEngine.hpp"
+#include <stdio.h>
+
+struct PluginStats {
+
+	/* Overlay geometry cache */
+	unsigned long overlay_frames;
+	unsigned long overlay_cache_hits;
+	unsigned long overlay_rebuilds;
+
+	/* Callback capture, since it was started */
+	unsigned long capture_records;
+	unsigned long capture_dropped;
+
+	/* UDP broadcast, since it was started */
+	unsigned long broadcast_sent;
+	unsigned long broadcast_dropped;
+	unsigned long broadcast_errors;
+
+	/* Delta error at the line and at the end of sectors 1 and 2,
+	   copied from the engine */
+	DeltaAccuracy line_accuracy;
+	DeltaAccuracy sector_accuracy[2];
+	double drift_rate;
+
+	/* Time of the last lap against the best lap per corner, from the
+	   engine, its inputs compared with the best lap's, if they were,
+	   and laps handed to the lap analysis since startup */
+	CornerTimes corner_times;
+	InputComparison corners;
+	unsigned long analysis_submitted;
+	unsigned long analysis_dropped;
+};
+
+void ResetPluginStats(PluginStats *stats);
+void WritePluginStats(FILE *f, const PluginStats &stats);
+
+#endif /* _PLUGIN_STATS_H */
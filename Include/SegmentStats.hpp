@@ -0,0 +1,53 @@
+/*
+rF2 Delta Best Plugin
+
+Lap to lap statistics per segment of the track.
+
+The track is cut into segments of SEGMENT_STATS_LENGTH meters, the last
+one up to the line. At the end of every lap timed at the line, the time
+spent in each segment goes into running statistics: count, mean and
+variance (Welford's method, so no lap is ever stored or scanned again),
+fastest time, and the last SEGMENT_STATS_LAST times. That's O(segments)
+per lap, over arrays of one value per segment.
+
+Where the standard deviation is high, the driver isn't consistent.
+The sum of the fastest times is the best lap within reach.
+
+The table is kept for a session and written to a ".segments" file next
+to the best lap at the end of it, read back by Tools/SegmentReport.
+
+*/
+
+#ifndef _SEGMENT_STATS_H
+#define _SEGMENT_STATS_H
+
+#define SEGMENT_STATS_LENGTH    100
+#define SEGMENT_STATS_MAX       1000   /* For MAX_TRACK_LENGTH */
+#define SEGMENT_STATS_LAST      5
+
+struct SegmentStats {
+	unsigned long count[SEGMENT_STATS_MAX];
+	double mean[SEGMENT_STATS_MAX];                 /* Seconds */
+	double m2[SEGMENT_STATS_MAX];                   /* Sum of squared differences from the mean */
+	float min[SEGMENT_STATS_MAX];
+	float last[SEGMENT_STATS_LAST][SEGMENT_STATS_MAX]; /* One row per lap, the latest at (laps - 1) % SEGMENT_STATS_LAST */
+	unsigned int segments;                          /* 0 until the first lap */
+	unsigned int track_length;                      /* Meters, the segments were cut for */
+	unsigned long laps;
+};
+
+void SegmentStatsClear(SegmentStats *stats);
+
+/* Adds a lap, from the time at every meter (as LapTime.elapsed) and its
+   final time. Starts over if the track length changed. */
+void SegmentStatsAddLap(SegmentStats *stats, const double *elapsed, unsigned int track_length, double final);
+
+/* Standard deviation of the times in a segment, 0 with less than 2 laps */
+double SegmentStatsStdDev(const SegmentStats &stats, unsigned int segment);
+
+/* The file, with the track and vehicle class it was for. Returns false
+   if it can't be written or read. */
+bool SegmentStatsWrite(const SegmentStats &stats, const char *path, const char *track, const char *vehicle_class);
+bool SegmentStatsRead(SegmentStats *stats, const char *path, char *track, char *vehicle_class, unsigned int name_size);
+
+#endif /* _SEGMENT_STATS_H */
@@ -0,0 +1,128 @@
+/*
+rF2 Delta Best Plugin
+
+Live delta state in shared memory.
+
+With "[Shared] Enabled=1" the plugin publishes a snapshot of what it
+knows about the current lap (delta, how fast it changes, the best lap
+it compares with, sector splits, predicted lap time, distance gap, lap distance) to
+a named shared memory region, at every scoring and telemetry update.
+Dashboards, button box displays and broadcast tools can read it from
+another process. On Windows the region is a named file mapping, and
+a POSIX shared memory object elsewhere, so that the portable tools
+can read it the same way (see Tools/SharedDeltaReader.cpp).
+
+The layout is fixed: only types of the same size on every platform,
+naturally aligned, no pointers. Readers should check magic, version
+and size before trusting the rest. New fields only ever go at the end
+of SharedDeltaData, with a new version.
+
+The snapshot is guarded by a sequence lock. The writer makes the
+sequence odd while it's writing, and even again when it's done. A
+reader copies the data, and keeps the copy only if the sequence was
+the same even number before and after. The writer never waits for
+readers and never allocates.
+
+*/
+
+#ifndef _SHARED_DELTA_H
+#define _SHARED_DELTA_H
+
+#include "DeltaEngine.hpp"
+#include <stdint.h>
+#include <atomic>
+
+#ifdef _WIN32
+  #define SHARED_DELTA_NAME         "Local\\rF2DeltaBest"
+#else
+  #define SHARED_DELTA_NAME         "/rF2DeltaBest"
+#endif
+
+#define SHARED_DELTA_MAGIC          0x54534244      /* "DBST" */
+#define SHARED_DELTA_VERSION        3
+
+/* SharedDeltaData.flags */
+#define SHARED_DELTA_REALTIME       0x0001          /* Player in the cockpit */
+#define SHARED_DELTA_VALID          0x0002          /* There's a delta to show, see DeltaEngineHasDelta() */
+#define SHARED_DELTA_IN_PITS        0x0004
+
+/* Seconds over which the rate of change of the delta is measured */
+#define SHARED_DELTA_RATE_INTERVAL  0.2
+
+/* Copies a reader attempts before giving up, if the writer keeps writing */
+#define SHARED_DELTA_READ_TRIES     100
+
+struct SharedDeltaHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;                     /* sizeof(SharedDeltaRegion) of the writer */
+	std::atomic<uint32_t> sequence;    /* Odd while the data is being written */
+};
+
+struct SharedDeltaData {
+	uint64_t publish_time;             /* SharedDeltaClock() when published, for the readers' latency */
+	double session_et;                 /* Session time of the latest scoring or telemetry update */
+	uint32_t flags;
+	int32_t split_sector;              /* Latest split, as SectorSplit: 1, 2, 3 for the line, 0 if none */
+	double delta;                      /* Seconds against the best lap, drift correction included, 0 unless valid */
+	double delta_rate;                 /* Seconds of delta per second, positive when losing time */
+	double lap_distance;               /* Meters into the lap */
+	double track_length;
+	double lap_elapsed;                /* Seconds into the lap */
+	double best_lap;                   /* Reference lap time, 0 if none */
+	double predicted_lap;              /* As DeltaEnginePredictedLap(), 0 if unknown */
+	double best_sector[2];             /* Sector 1 and 2 split times of the best lap, 0 if unknown */
+	double lap_sector[2];              /* Same for the current lap, 0 until crossed */
+	double split_delta;
+	double split_et;                   /* Session time the split line was crossed */
+	uint32_t split_official;           /* 1 once the split comes from the official times */
+	uint32_t reserved;
+	double distance_gap;               /* As DeltaEngineDistanceGap(), since version 2 */
+	double delta_slope;                /* As DeltaEngineDeltaSlope(), seconds per 100m, since version 3 */
+};
+
+struct SharedDeltaRegion {
+	SharedDeltaHeader header;
+	SharedDeltaData data;
+};
+
+/* One end of the region, writer or reader */
+struct SharedDelta {
+	SharedDeltaRegion *region;         /* NULL when not open */
+	void *mapping;                     /* Windows file mapping handle */
+	bool writer;
+};
+
+/* What SharedDeltaSnapshot() remembers between calls, for delta_rate */
+struct SharedDeltaRate {
+	double et;
+	double delta;
+	double rate;
+};
+
+/* Creates the region, or takes over an existing one. Returns false if it can't. */
+bool SharedDeltaCreate(SharedDelta *shared, const char *name);
+
+/* Opens an existing region, read only. Returns false if there's none,
+   or if it has a different layout. */
+bool SharedDeltaOpen(SharedDelta *shared, const char *name);
+
+/* Safe to call if not open */
+void SharedDeltaClose(SharedDelta *shared);
+
+/* The engine state right now, in the published layout. Also what
+   the UDP broadcast sends, see Broadcast.hpp. */
+void SharedDeltaSnapshot(SharedDeltaRate *rate, const DeltaEngine *engine, SharedDeltaData *data);
+
+/* Publishes a snapshot. Does nothing when not open as writer.
+   Only to be called from one thread, the simulation thread. */
+void SharedDeltaPublish(SharedDelta *shared, const SharedDeltaData &data);
+
+/* Copies a consistent snapshot, and its sequence number. Returns
+   false if the writer was busy for all the tries. */
+bool SharedDeltaRead(const SharedDelta *shared, SharedDeltaData *data, uint32_t *sequence);
+
+/* Monotonic nanoseconds, the same clock in every process */
+uint64_t SharedDeltaClock();
+
+#endif /* _SHARED_DELTA_H */
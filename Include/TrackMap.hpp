@@ -0,0 +1,76 @@
+/*
+rF2 Delta Best Plugin
+
+Track map with a delta "heat map".
+
+The reference lap world positions (one per meter) are simplified with
+Douglas-Peucker into at most TRACK_MAP_MAX_POINTS points, once per
+reference lap. The screen-space segments are generated from those
+points and cached; while driving, only the color of each segment is
+updated, once, when the car reaches the end of the segment.
+
+*/
+
+#ifndef _TRACK_MAP_H
+#define _TRACK_MAP_H
+
+#include "OverlayGeometry.hpp"
+
+#define TRACK_MAP_MAX_POINTS        256
+#define TRACK_MAP_MAX_SEGMENTS      (TRACK_MAP_MAX_POINTS - 1)
+
+/* Simplification tolerance, in meters. Doubled until the
+   simplified line fits into TRACK_MAP_MAX_POINTS. */
+#define TRACK_MAP_EPSILON           1.0
+
+/* Time lost/gained per 100m that gets the full red/green color */
+#define TRACK_MAP_FULL_COLOR_LOSS   0.2
+
+#define TRACK_MAP_COLOR_NOT_DRIVEN  0xA0A0A0A0
+
+struct TrackMapPoint {
+	float x;
+	float z;
+	unsigned int meter;
+};
+
+struct TrackMap {
+
+	/* Simplified reference lap, built once per reference lap */
+	TrackMapPoint points[TRACK_MAP_MAX_POINTS];
+	unsigned int num_points;
+	float min_x, min_z, max_x, max_z;
+	unsigned long points_version;
+
+	/* Screen-space segments, regenerated when points or layout change */
+	OverlayVertex vertices[TRACK_MAP_MAX_SEGMENTS * OVERLAY_VERTS_PER_QUAD];
+	unsigned long vertices_version;
+	float vertices_left, vertices_top, vertices_size, vertices_thickness;
+
+	/* Color stream, one per segment, updated as the lap progresses */
+	unsigned int colors[TRACK_MAP_MAX_SEGMENTS];
+	unsigned int next_segment;
+
+	/* Changes whenever the map would draw differently */
+	unsigned long version;
+};
+
+/* Douglas-Peucker. Marks in keep[] the points to keep, returns their count. */
+unsigned int SimplifyPolyline(const float *x, const float *z, unsigned int count,
+	double epsilon, unsigned char *keep);
+
+/* Builds the simplified map from one position per meter of the reference lap */
+void TrackMapBuild(TrackMap *map, const float *x, const float *z, unsigned int meters);
+void TrackMapClear(TrackMap *map);
+
+/* All segments back to "not driven" color */
+void TrackMapNewLap(TrackMap *map);
+
+/* Colors all the segments completed up to the given meter, comparing the
+   current lap and reference lap elapsed times. Amortized O(1) per call. */
+void TrackMapUpdate(TrackMap *map, const double *current_elapsed,
+	const double *reference_elapsed, unsigned int meters);
+
+void BuildTrackMap(OverlayBatch *batch, const OverlayLayout &layout, TrackMap *map);
+
+#endif /* _TRACK_MAP_H */
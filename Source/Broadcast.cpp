@@ -0,0 +1,200 @@
+/*
+rF2 Delta Best Plugin
+
+UDP broadcast of the delta.
+
+*/
+
+/* winsock2.h has to come before windows.h, that the plugin headers include */
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET      -1
+#define closesocket         close
+#endif
+
+#include "Broadcast.hpp"
+#include <string.h>
+#include <chrono>
+
+static bool QueuePush(BroadcastQueue *queue, const SharedDeltaData &data)
+{
+	unsigned int head = queue->head.load(std::memory_order_relaxed);
+	unsigned int tail = queue->tail.load(std::memory_order_acquire);
+
+	if (head - tail >= BROADCAST_QUEUE_SIZE)
+		return false;
+
+	queue->samples[head & (BROADCAST_QUEUE_SIZE - 1)] = data;
+	queue->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+static bool QueueEmpty(const BroadcastQueue *queue)
+{
+	return queue->tail.load(std::memory_order_relaxed) == queue->head.load(std::memory_order_acquire);
+}
+
+static bool QueuePop(BroadcastQueue *queue, SharedDeltaData *data)
+{
+	unsigned int tail = queue->tail.load(std::memory_order_relaxed);
+	unsigned int head = queue->head.load(std::memory_order_acquire);
+
+	if (tail == head)
+		return false;
+
+	*data = queue->samples[tail & (BROADCAST_QUEUE_SIZE - 1)];
+	queue->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+static void Encode(const SharedDeltaData &data, uint32_t sequence, BroadcastPacket *packet)
+{
+	memset(packet, 0, sizeof(*packet));
+	packet->magic = BROADCAST_MAGIC;
+	packet->version = BROADCAST_VERSION;
+	packet->flags = (uint16_t) data.flags;
+	packet->sequence = sequence;
+	packet->split_sector = data.split_sector;
+	packet->sample_time = data.publish_time;
+	packet->session_et = data.session_et;
+	packet->delta = (float) data.delta;
+	packet->delta_rate = (float) data.delta_rate;
+	packet->lap_distance = (float) data.lap_distance;
+	packet->lap_elapsed = (float) data.lap_elapsed;
+	packet->best_lap = (float) data.best_lap;
+	packet->predicted_lap = (float) data.predicted_lap;
+	packet->split_delta = (float) data.split_delta;
+	packet->track_length = (float) data.track_length;
+	packet->distance_gap = (float) data.distance_gap;
+	packet->delta_slope = (float) data.delta_slope;
+}
+
+/* Returns false if it isn't an IPv4 address */
+static bool ParseAddress(const char *address, unsigned int port, sockaddr_in *to)
+{
+	memset(to, 0, sizeof(*to));
+	to->sin_family = AF_INET;
+	to->sin_port = htons((unsigned short) port);
+	to->sin_addr.s_addr = inet_addr(address);
+
+	/* Same value as the limited broadcast address */
+	return to->sin_addr.s_addr != INADDR_NONE || strcmp(address, "255.255.255.255") == 0;
+}
+
+static void SendBroadcast(Broadcast *broadcast)
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	bool started = WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#endif
+
+	sockaddr_in to;
+	SOCKET s = INVALID_SOCKET;
+	if (ParseAddress(broadcast->address, broadcast->port, &to)) {
+		s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		int yes = 1;
+		if (s != INVALID_SOCKET)
+			setsockopt(s, SOL_SOCKET, SO_BROADCAST, (const char *) &yes, sizeof(yes));
+	}
+
+	uint32_t sequence = 0;
+	for (;;) {
+		/* Before emptying the queue, so that nothing pushed before BroadcastStop() is left */
+		bool running = broadcast->running.load();
+
+		SharedDeltaData data;
+		while (QueuePop(&broadcast->queue, &data)) {
+			BroadcastPacket packet;
+			Encode(data, sequence++, &packet);
+			packet.send_time = SharedDeltaClock();
+			if (s != INVALID_SOCKET
+				&& sendto(s, (const char *) &packet, sizeof(packet), 0, (const sockaddr *) &to, sizeof(to)) == sizeof(packet))
+				broadcast->sent++;
+			else
+				broadcast->errors++;
+		}
+
+		if (! running)
+			break;
+
+		/* Until the next snapshot is pushed. BroadcastPush() doesn't take
+		   the lock, not to wait for this thread: if it wakes this thread
+		   up just before it waits, the snapshot is only sent at the end
+		   of the wait, one interval later at worst. */
+		std::unique_lock<std::mutex> guard(broadcast->lock);
+		if (QueueEmpty(&broadcast->queue) && broadcast->running.load())
+			broadcast->pushed.wait_for(guard, std::chrono::nanoseconds(broadcast->interval));
+	}
+
+	if (s != INVALID_SOCKET)
+		closesocket(s);
+#ifdef _WIN32
+	if (started)
+		WSACleanup();
+#endif
+}
+
+void BroadcastStart(Broadcast *broadcast, const char *address, unsigned int port, unsigned int rate)
+{
+	if (broadcast->running.load())
+		return;
+
+	strncpy(broadcast->address, address, BROADCAST_ADDRESS_MAXLEN - 1);
+	broadcast->address[BROADCAST_ADDRESS_MAXLEN - 1] = '\0';
+	broadcast->port = port;
+	broadcast->rate = rate;
+	broadcast->interval = 1000000000ULL / (rate > 0 ? rate : 1);
+	broadcast->last_push = 0;
+	broadcast->dropped = 0;
+	broadcast->sent.store(0);
+	broadcast->errors.store(0);
+	broadcast->queue.head.store(0);
+	broadcast->queue.tail.store(0);
+
+	broadcast->running.store(true);
+	broadcast->thread = std::thread(SendBroadcast, broadcast);
+}
+
+void BroadcastStop(Broadcast *broadcast)
+{
+	broadcast->running.store(false);
+	broadcast->pushed.notify_one();
+	if (broadcast->thread.joinable())
+		broadcast->thread.join();
+}
+
+bool BroadcastDue(const Broadcast *broadcast)
+{
+	return broadcast->running.load(std::memory_order_relaxed)
+		&& SharedDeltaClock() - broadcast->last_push >= broadcast->interval;
+}
+
+void BroadcastPush(Broadcast *broadcast, const SharedDeltaData &data)
+{
+	if (! broadcast->running.load(std::memory_order_relaxed))
+		return;
+	if (data.publish_time - broadcast->last_push < broadcast->interval)
+		return;
+
+	broadcast->last_push = data.publish_time;
+	if (QueuePush(&broadcast->queue, data))
+		broadcast->pushed.notify_one();
+	else
+		broadcast->dropped++;
+}
+
+bool BroadcastDecode(const void *datagram, size_t size, BroadcastPacket *packet)
+{
+	if (size != sizeof(*packet))
+		return false;
+
+	memcpy(packet, datagram, sizeof(*packet));
+	return packet->magic == BROADCAST_MAGIC && packet->version == BROADCAST_VERSION;
+}
@@ -0,0 +1,567 @@
+/*
+rF2 Delta Best Plugin
+
+Binary capture of the plugin callbacks.
+
+*/
+
+#include "Capture.hpp"
+#include <string.h>
+
+/* How often the writer thread looks at the running flag, to stop quickly */
+#define CAPTURE_SLEEP_MS            50
+
+/* Equal bytes needed to end a run of changes, about the cost of a new run */
+#define CAPTURE_DIFF_MIN_GAP        8
+
+static bool IsDiffable(unsigned int type)
+{
+	return type == CAPTURE_SCORING || type == CAPTURE_TELEMETRY;
+}
+
+static void AppendBytes(std::vector<char> *out, const void *data, size_t size)
+{
+	if (size == 0)
+		return;
+	size_t at = out->size();
+	out->resize(at + size);
+	memcpy(&(*out)[at], data, size);
+}
+
+/* Runs of changed bytes: offset from the end of the previous run
+   and length of the run (both unsigned int), then the new bytes */
+static void EncodeDiff(const char *previous, const char *current, unsigned int size, std::vector<char> *out)
+{
+	unsigned int i = 0, last_end = 0;
+
+	out->clear();
+	while (i < size) {
+		if (previous[i] == current[i]) {
+			i++;
+			continue;
+		}
+
+		unsigned int start = i, equal = 0;
+		while (i < size && equal < CAPTURE_DIFF_MIN_GAP) {
+			equal = previous[i] == current[i] ? equal + 1 : 0;
+			i++;
+		}
+
+		unsigned int end = i - equal;
+		unsigned int skip = start - last_end, length = end - start;
+		AppendBytes(out, &skip, sizeof(skip));
+		AppendBytes(out, &length, sizeof(length));
+		AppendBytes(out, current + start, length);
+		last_end = end;
+	}
+}
+
+static bool ApplyDiff(const std::vector<char> &diff, std::vector<char> *payload)
+{
+	size_t at = 0, pos = 0;
+
+	while (at < diff.size()) {
+		unsigned int skip, length;
+		if (at + sizeof(skip) + sizeof(length) > diff.size())
+			return false;
+		memcpy(&skip, &diff[at], sizeof(skip));
+		memcpy(&length, &diff[at + sizeof(skip)], sizeof(length));
+		at += sizeof(skip) + sizeof(length);
+
+		pos += skip;
+		if (at + length > diff.size() || pos + length > payload->size())
+			return false;
+		memcpy(&(*payload)[pos], &diff[at], length);
+		at += length;
+		pos += length;
+	}
+
+	return true;
+}
+
+/* Fields of the game structures and of their mirrors, in order, but
+   the pointers */
+#define WHEEL_FIELDS(F) \
+	F(mSuspensionDeflection) F(mRideHeight) F(mSuspForce) F(mBrakeTemp) F(mBrakePressure) \
+	F(mRotation) F(mLateralPatchVel) F(mLongitudinalPatchVel) F(mLateralGroundVel) \
+	F(mLongitudinalGroundVel) F(mCamber) F(mLateralForce) F(mLongitudinalForce) F(mTireLoad) \
+	F(mGripFract) F(mPressure) F(mTemperature) F(mWear) F(mTerrainName) F(mSurfaceType) \
+	F(mFlat) F(mDetached) F(mVerticalTireDeflection) F(mWheelYLocation) F(mToe) \
+	F(mTireCarcassTemperature) F(mTireInnerLayerTemperature) F(mExpansion)
+
+#define TELEMETRY_FIELDS(F) \
+	F(mID) F(mDeltaTime) F(mElapsedTime) F(mLapNumber) F(mLapStartET) F(mVehicleName) \
+	F(mTrackName) F(mPos) F(mLocalVel) F(mLocalAccel) F(mOri) F(mLocalRot) F(mLocalRotAccel) \
+	F(mGear) F(mEngineRPM) F(mEngineWaterTemp) F(mEngineOilTemp) F(mClutchRPM) \
+	F(mUnfilteredThrottle) F(mUnfilteredBrake) F(mUnfilteredSteering) F(mUnfilteredClutch) \
+	F(mFilteredThrottle) F(mFilteredBrake) F(mFilteredSteering) F(mFilteredClutch) \
+	F(mSteeringShaftTorque) F(mFront3rdDeflection) F(mRear3rdDeflection) F(mFrontWingHeight) \
+	F(mFrontRideHeight) F(mRearRideHeight) F(mDrag) F(mFrontDownforce) F(mRearDownforce) \
+	F(mFuel) F(mEngineMaxRPM) F(mScheduledStops) F(mOverheating) F(mDetached) F(mHeadlights) \
+	F(mDentSeverity) F(mLastImpactET) F(mLastImpactMagnitude) F(mLastImpactPos) \
+	F(mEngineTorque) F(mCurrentSector) F(mSpeedLimiter) F(mMaxGears) F(mFrontTireCompoundIndex) \
+	F(mRearTireCompoundIndex) F(mFuelCapacity) F(mFrontFlapActivated) F(mRearFlapActivated) \
+	F(mRearFlapLegalStatus) F(mIgnitionStarter) F(mFrontTireCompoundName) \
+	F(mRearTireCompoundName) F(mSpeedLimiterAvailable) F(mAntiStallActivated) F(mUnused) \
+	F(mRearBrakeBias) F(mTurboBoostPressure) F(mExpansion) F(mWheel)
+
+#define VEHICLE_FIELDS(F) \
+	F(mID) F(mDriverName) F(mVehicleName) F(mTotalLaps) F(mSector) F(mFinishStatus) F(mLapDist) \
+	F(mPathLateral) F(mTrackEdge) F(mBestSector1) F(mBestSector2) F(mBestLapTime) \
+	F(mLastSector1) F(mLastSector2) F(mLastLapTime) F(mCurSector1) F(mCurSector2) \
+	F(mNumPitstops) F(mNumPenalties) F(mIsPlayer) F(mControl) F(mInPits) F(mPlace) \
+	F(mVehicleClass) F(mTimeBehindNext) F(mLapsBehindNext) F(mTimeBehindLeader) \
+	F(mLapsBehindLeader) F(mLapStartET) F(mPos) F(mLocalVel) F(mLocalAccel) F(mOri) \
+	F(mLocalRot) F(mLocalRotAccel) F(mHeadlights) F(mPitState) F(mServerScored) \
+	F(mIndividualPhase) F(mQualification) F(mTimeIntoLap) F(mEstimatedLapTime) F(mPitGroup) \
+	F(mFlag) F(mUnused1) F(mUnused2) F(mUnused3) F(mUpgradePack) F(mExpansion)
+
+#define SCORING_FIELDS(F) \
+	F(mTrackName) F(mSession) F(mCurrentET) F(mEndET) F(mMaxLaps) F(mLapDist) F(mNumVehicles) \
+	F(mGamePhase) F(mYellowFlagState) F(mSectorFlag) F(mStartLight) F(mNumRedLights) \
+	F(mInRealtime) F(mPlayerName) F(mPlrFileName) F(mDarkCloud) F(mRaining) F(mAmbientTemp) \
+	F(mTrackTemp) F(mWind) F(mOnPathWetness) F(mOffPathWetness) F(mExpansion)
+
+/* Copies a field from a game structure to its mirror or back,
+   converting its type: arrays element by element, and the wheels
+   field by field */
+template <typename To, typename From>
+static void CopyField(To *to, const From &from)
+{
+	*to = (To) from;
+}
+
+static void CopyField(CaptureWheelInfo *to, const TelemWheelV01 &from);
+static void CopyField(TelemWheelV01 *to, const CaptureWheelInfo &from);
+
+template <typename To, typename From, size_t N>
+static void CopyField(To (*to)[N], const From (&from)[N])
+{
+	for (size_t i = 0; i < N; i++)
+		CopyField(&(*to)[i], from[i]);
+}
+
+/* In a function copying "from" to "to" */
+#define COPY_FIELD(name)            CopyField(&to->name, from.name);
+
+static void CopyField(CaptureWheelInfo *to, const TelemWheelV01 &from)
+{
+	WHEEL_FIELDS(COPY_FIELD)
+}
+
+static void CopyField(TelemWheelV01 *to, const CaptureWheelInfo &from)
+{
+	WHEEL_FIELDS(COPY_FIELD)
+}
+
+static void CopyField(CaptureVehicleInfo *to, const VehicleScoringInfoV01 &from)
+{
+	VEHICLE_FIELDS(COPY_FIELD)
+}
+
+static void CopyField(VehicleScoringInfoV01 *to, const CaptureVehicleInfo &from)
+{
+	VEHICLE_FIELDS(COPY_FIELD)
+}
+
+static void CopyField(CaptureScoringInfo *to, const ScoringInfoV01 &from)
+{
+	SCORING_FIELDS(COPY_FIELD)
+}
+
+static void CopyField(ScoringInfoV01 *to, const CaptureScoringInfo &from)
+{
+	SCORING_FIELDS(COPY_FIELD)
+}
+
+static void CopyField(CaptureTelemInfo *to, const TelemInfoV01 &from)
+{
+	TELEMETRY_FIELDS(COPY_FIELD)
+}
+
+static void CopyField(TelemInfoV01 *to, const CaptureTelemInfo &from)
+{
+	TELEMETRY_FIELDS(COPY_FIELD)
+}
+
+void CaptureEncodeScoring(const ScoringInfoV01 &info, std::vector<char> *payload)
+{
+	CaptureScoringInfo scoring;
+	CaptureVehicleInfo vehicle;
+	int32_t vehicles = info.mVehicle != NULL && info.mNumVehicles > 0 ? info.mNumVehicles : 0;
+
+	/* Padding included, a record only differs from the previous one
+	   where the game structures do */
+	memset(&scoring, 0, sizeof(scoring));
+	CopyField(&scoring, info);
+	scoring.mNumVehicles = vehicles;
+
+	payload->clear();
+	AppendBytes(payload, &scoring, sizeof(scoring));
+	for (int32_t i = 0; i < vehicles; i++) {
+		memset(&vehicle, 0, sizeof(vehicle));
+		CopyField(&vehicle, info.mVehicle[i]);
+		AppendBytes(payload, &vehicle, sizeof(vehicle));
+	}
+}
+
+void CaptureEncodeTelemetry(const TelemInfoV01 &info, CaptureTelemInfo *payload)
+{
+	memset(payload, 0, sizeof(*payload));
+	CopyField(payload, info);
+}
+
+void CaptureWriteRecord(CaptureEncoder *encoder, FILE *file, const CaptureRecordHeader &header, const void *payload)
+{
+	CaptureRecordHeader out = header;
+	const char *bytes = (const char *) payload;
+	const char *data = bytes;
+
+	/* A new capture in the same file, the reader starts over too */
+	if (header.type == CAPTURE_OPEN) {
+		for (unsigned int i = 0; i < CAPTURE_RECORD_TYPES; i++)
+			encoder->previous[i].clear();
+	}
+
+	if (IsDiffable(header.type)) {
+		std::vector<char> &previous = encoder->previous[header.type];
+
+		if (header.size > 0 && previous.size() == header.size) {
+			EncodeDiff(&previous[0], bytes, header.size, &encoder->encoded);
+			if (encoder->encoded.size() < header.size) {
+				out.flags |= CAPTURE_FLAG_DIFF;
+				out.size = (unsigned int) encoder->encoded.size();
+				data = encoder->encoded.empty() ? NULL : &encoder->encoded[0];
+			}
+		}
+		previous.assign(bytes, bytes + header.size);
+	}
+
+	fwrite(&out, sizeof(out), 1, file);
+	if (out.size > 0)
+		fwrite(data, out.size, 1, file);
+}
+
+static void Flush(Capture *capture)
+{
+	{
+		std::lock_guard<std::mutex> guard(capture->lock);
+		capture->writing.swap(capture->pending);
+	}
+
+	size_t at = 0;
+	while (at + sizeof(CaptureRecordHeader) <= capture->writing.size()) {
+		CaptureRecordHeader header;
+		memcpy(&header, &capture->writing[at], sizeof(header));
+		CaptureWriteRecord(&capture->encoder, capture->file, header, &capture->writing[at] + sizeof(header));
+		at += sizeof(header) + header.size;
+	}
+
+	capture->writing.clear();
+	fflush(capture->file);
+}
+
+static void WriteCapture(Capture *capture)
+{
+	unsigned int slept = 0;
+
+	while (capture->running.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_SLEEP_MS));
+		slept += CAPTURE_SLEEP_MS;
+		if (slept < CAPTURE_FLUSH_MS)
+			continue;
+		slept = 0;
+		Flush(capture);
+	}
+
+	Flush(capture);
+}
+
+static void Append(Capture *capture, CaptureRecordType type, const void *data, size_t size,
+	const void *extra, size_t extra_size)
+{
+	if (capture->file == NULL)
+		return;
+
+	CaptureRecordHeader header;
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - capture->started;
+	header.type = (unsigned short) type;
+	header.flags = 0;
+	header.size = (unsigned int) (size + extra_size);
+	header.timestamp = elapsed.count();
+
+	std::lock_guard<std::mutex> guard(capture->lock);
+
+	if (capture->pending.size() + sizeof(header) + header.size > CAPTURE_MAX_PENDING) {
+		capture->dropped++;
+		return;
+	}
+
+	AppendBytes(&capture->pending, &header, sizeof(header));
+	AppendBytes(&capture->pending, data, size);
+	AppendBytes(&capture->pending, extra, extra_size);
+	capture->records++;
+}
+
+void CaptureGetInfo(CaptureInfo *info)
+{
+	memset(info, 0, sizeof(*info));
+	memcpy(info->magic, CAPTURE_MAGIC, sizeof(info->magic));
+	info->version = CAPTURE_VERSION;
+	info->pointer_size = sizeof(void *);
+	info->scoring_size = sizeof(CaptureScoringInfo);
+	info->vehicle_size = sizeof(CaptureVehicleInfo);
+	info->telemetry_size = sizeof(CaptureTelemInfo);
+	info->config_size = sizeof(PluginConfig);
+	info->best_lap_size = sizeof(CaptureBestLap);
+}
+
+bool CaptureStart(Capture *capture, const char *path)
+{
+	if (capture->file != NULL)
+		return true;
+
+	capture->file = fopen(path, "ab");
+	if (capture->file == NULL)
+		return false;
+
+	capture->started = std::chrono::high_resolution_clock::now();
+	capture->records = 0;
+	capture->dropped = 0;
+	capture->pending.clear();
+	capture->pending.reserve(1024 * 1024);
+
+	CaptureInfo info;
+	CaptureGetInfo(&info);
+	Append(capture, CAPTURE_OPEN, &info, sizeof(info), NULL, 0);
+
+	capture->running.store(true);
+	capture->thread = std::thread(WriteCapture, capture);
+	return true;
+}
+
+void CaptureStop(Capture *capture)
+{
+	capture->running.store(false);
+	if (capture->thread.joinable())
+		capture->thread.join();
+
+	if (capture->file != NULL) {
+		fclose(capture->file);
+		capture->file = NULL;
+	}
+}
+
+void CaptureEvent(Capture *capture, CaptureRecordType type)
+{
+	Append(capture, type, NULL, 0, NULL, 0);
+}
+
+void CaptureScoring(Capture *capture, const ScoringInfoV01 &info)
+{
+	if (capture->file == NULL)
+		return;
+
+	CaptureEncodeScoring(info, &capture->encoding);
+	Append(capture, CAPTURE_SCORING, &capture->encoding[0], capture->encoding.size(), NULL, 0);
+}
+
+void CaptureTelemetry(Capture *capture, const TelemInfoV01 &info)
+{
+	if (capture->file == NULL)
+		return;
+
+	CaptureTelemInfo telemetry;
+	CaptureEncodeTelemetry(info, &telemetry);
+	Append(capture, CAPTURE_TELEMETRY, &telemetry, sizeof(telemetry), NULL, 0);
+}
+
+void CaptureCommand(Capture *capture, unsigned int command)
+{
+	Append(capture, CAPTURE_COMMAND, &command, sizeof(command), NULL, 0);
+}
+
+void CaptureConfig(Capture *capture, const PluginConfig &config)
+{
+	Append(capture, CAPTURE_CONFIG, &config, sizeof(config), NULL, 0);
+}
+
+void CaptureLap(Capture *capture, const LapTime *lap)
+{
+	if (capture->file == NULL)
+		return;
+
+	CaptureBestLap header;
+	header.final = lap->final;
+	header.started = lap->started;
+	header.ended = lap->ended;
+	header.interval_offset = lap->interval_offset;
+	header.has_positions = lap->has_positions ? 1 : 0;
+	header.reserved = 0;
+	header.has_odometry = 0;
+	for (unsigned int i = 0; i < ODOMETRY_SEGMENTS && ! header.has_odometry; i++)
+		header.has_odometry = lap->odometry[i] > 0;
+
+	/* Only up to the last meter driven, not the whole MAX_TRACK_LENGTH */
+	header.meters = MAX_TRACK_LENGTH;
+	while (header.meters > 0 && lap->elapsed[header.meters - 1] == 0
+		&& lap->pos_x[header.meters - 1] == 0 && lap->pos_z[header.meters - 1] == 0)
+		header.meters--;
+
+	std::vector<char> data;
+	AppendBytes(&data, lap->elapsed, header.meters * sizeof(lap->elapsed[0]));
+	if (header.has_positions) {
+		AppendBytes(&data, lap->pos_x, header.meters * sizeof(lap->pos_x[0]));
+		AppendBytes(&data, lap->pos_z, header.meters * sizeof(lap->pos_z[0]));
+	}
+	if (header.has_odometry)
+		AppendBytes(&data, lap->odometry, sizeof(lap->odometry));
+
+	Append(capture, CAPTURE_BEST_LAP, &header, sizeof(header), data.empty() ? NULL : &data[0], data.size());
+}
+
+bool CaptureReaderOpen(CaptureReader *reader, const char *path)
+{
+	memset(&reader->info, 0, sizeof(reader->info));
+	for (unsigned int i = 0; i < CAPTURE_RECORD_TYPES; i++)
+		reader->previous[i].clear();
+
+	reader->file = fopen(path, "rb");
+	return reader->file != NULL;
+}
+
+void CaptureReaderClose(CaptureReader *reader)
+{
+	if (reader->file != NULL) {
+		fclose(reader->file);
+		reader->file = NULL;
+	}
+}
+
+bool CaptureReadRecord(CaptureReader *reader, CaptureRecordHeader *header, std::vector<char> *payload)
+{
+	if (fread(header, sizeof(*header), 1, reader->file) != 1)
+		return false;
+	if (header->type == 0 || header->type >= CAPTURE_RECORD_TYPES || header->size > CAPTURE_MAX_PENDING)
+		return false;
+
+	reader->stored.resize(header->size);
+	if (header->size > 0 && fread(&reader->stored[0], header->size, 1, reader->file) != 1)
+		return false;
+
+	if (header->type == CAPTURE_OPEN) {
+		/* Older versions have less in there, up to the version they're at */
+		if (header->size < sizeof(reader->info.magic) + sizeof(reader->info.version)
+			|| memcmp(&reader->stored[0], CAPTURE_MAGIC, sizeof(reader->info.magic)) != 0)
+			return false;
+		memset(&reader->info, 0, sizeof(reader->info));
+		memcpy(&reader->info, &reader->stored[0], header->size < sizeof(reader->info) ? header->size : sizeof(reader->info));
+		for (unsigned int i = 0; i < CAPTURE_RECORD_TYPES; i++)
+			reader->previous[i].clear();
+	}
+
+	if (IsDiffable(header->type)) {
+		std::vector<char> &previous = reader->previous[header->type];
+		if (header->flags & CAPTURE_FLAG_DIFF) {
+			if (! ApplyDiff(reader->stored, &previous))
+				return false;
+		}
+		else {
+			previous = reader->stored;
+		}
+		*payload = previous;
+	}
+	else {
+		if (header->flags & CAPTURE_FLAG_DIFF)
+			return false;
+		payload->swap(reader->stored);
+	}
+
+	header->flags &= ~CAPTURE_FLAG_DIFF;
+	header->size = (unsigned int) payload->size();
+	return true;
+}
+
+bool CaptureReaderCompatible(const CaptureReader *reader)
+{
+	return reader->info.version == CAPTURE_VERSION
+		&& reader->info.scoring_size == sizeof(CaptureScoringInfo)
+		&& reader->info.vehicle_size == sizeof(CaptureVehicleInfo)
+		&& reader->info.telemetry_size == sizeof(CaptureTelemInfo)
+		&& reader->info.best_lap_size == sizeof(CaptureBestLap);
+}
+
+bool CaptureGetScoring(const std::vector<char> &payload, ScoringInfoV01 *info,
+	std::vector<VehicleScoringInfoV01> *vehicles)
+{
+	CaptureScoringInfo scoring;
+	CaptureVehicleInfo vehicle;
+
+	if (payload.size() < sizeof(scoring))
+		return false;
+
+	memcpy(&scoring, &payload[0], sizeof(scoring));
+	size_t n = scoring.mNumVehicles > 0 ? scoring.mNumVehicles : 0;
+	if (payload.size() != sizeof(scoring) + n * sizeof(vehicle))
+		return false;
+
+	CopyField(info, scoring);
+	vehicles->resize(n);
+	for (size_t i = 0; i < n; i++) {
+		memcpy(&vehicle, &payload[sizeof(scoring) + i * sizeof(vehicle)], sizeof(vehicle));
+		CopyField(&(*vehicles)[i], vehicle);
+	}
+
+	info->mVehicle = n > 0 ? &(*vehicles)[0] : NULL;
+	info->mResultsStream = NULL;
+	return true;
+}
+
+bool CaptureGetTelemetry(const std::vector<char> &payload, TelemInfoV01 *info)
+{
+	CaptureTelemInfo telemetry;
+
+	if (payload.size() != sizeof(telemetry))
+		return false;
+
+	memcpy(&telemetry, &payload[0], sizeof(telemetry));
+	CopyField(info, telemetry);
+	return true;
+}
+
+bool CaptureGetLap(const std::vector<char> &payload, LapTime *lap)
+{
+	CaptureBestLap header;
+
+	if (payload.size() < sizeof(header))
+		return false;
+	memcpy(&header, &payload[0], sizeof(header));
+
+	size_t per_meter = sizeof(lap->elapsed[0]);
+	if (header.has_positions)
+		per_meter += sizeof(lap->pos_x[0]) + sizeof(lap->pos_z[0]);
+	size_t odometry_size = header.has_odometry ? sizeof(lap->odometry) : 0;
+	if (header.meters > MAX_TRACK_LENGTH || payload.size() != sizeof(header) + header.meters * per_meter + odometry_size)
+		return false;
+
+	ResetLap(lap);
+	lap->final = header.final;
+	lap->started = header.started;
+	lap->ended = header.ended;
+	lap->interval_offset = header.interval_offset;
+	lap->has_positions = header.has_positions != 0;
+
+	const char *p = &payload[0] + sizeof(header);
+	memcpy(lap->elapsed, p, header.meters * sizeof(lap->elapsed[0]));
+	p += header.meters * sizeof(lap->elapsed[0]);
+	if (lap->has_positions) {
+		memcpy(lap->pos_x, p, header.meters * sizeof(lap->pos_x[0]));
+		p += header.meters * sizeof(lap->pos_x[0]);
+		memcpy(lap->pos_z, p, header.meters * sizeof(lap->pos_z[0]));
+		p += header.meters * sizeof(lap->pos_z[0]);
+	}
+	if (header.has_odometry)
+		memcpy(lap->odometry, p, sizeof(lap->odometry));
+
+	return true;
+}
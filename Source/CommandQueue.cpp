@@ -0,0 +1,40 @@
+/*
+rF2 Delta Best Plugin
+
+Queue of user commands (display toggle, best lap reset...).
+
+*/
+
+#include "CommandQueue.hpp"
+
+void CommandQueueInit(CommandQueue *queue)
+{
+	queue->head.store(0);
+	queue->tail.store(0);
+}
+
+bool CommandQueuePush(CommandQueue *queue, PluginCommand command)
+{
+	unsigned int head = queue->head.load(std::memory_order_relaxed);
+	unsigned int tail = queue->tail.load(std::memory_order_acquire);
+
+	if (head - tail >= COMMAND_QUEUE_SIZE)
+		return false;
+
+	queue->commands[head & (COMMAND_QUEUE_SIZE - 1)] = command;
+	queue->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool CommandQueuePop(CommandQueue *queue, PluginCommand *command)
+{
+	unsigned int tail = queue->tail.load(std::memory_order_relaxed);
+	unsigned int head = queue->head.load(std::memory_order_acquire);
+
+	if (tail == head)
+		return false;
+
+	*command = queue->commands[tail & (COMMAND_QUEUE_SIZE - 1)];
+	queue->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
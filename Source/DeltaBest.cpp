@@ -27,74 +27,85 @@ extern "C" __declspec(dllexport)
 extern "C" __declspec(dllexport)
 	void __cdecl DestroyPluginObject(PluginObject *obj)    { delete((DeltaBestPlugin *)obj); }
 
-bool in_realtime = false;              /* Are we in cockpit? As opposed to monitor */
-bool session_started = false;          /* Is a Practice/Race/Q session started or are we in spectator mode, f.ex.? */
-bool lap_was_timed = false;            /* If current/last lap that ended was timed or not */
-bool green_flag = false;               /* Is the race in green flag condition? */
-bool key_switch = true;                /* Enabled/disabled state by keyboard action */
+/* Lap tracking and delta calculation for the current session */
+DeltaEngine *engine = NULL;
+
+bool key_switch = true;                /* Enabled/disabled state by the toggle control */
 bool displayed_welcome = false;        /* Whether we displayed the "plugin enabled" welcome message */
-bool loaded_best_in_session = false;   /* Did we already load the best lap in this session? */
 bool shown_best_in_session = false;    /* Did we show a message for the best lap restored from file? */
-bool player_in_pits = false;           /* Is the player currently in the pits? */
-unsigned int prev_pos = 0;             /* Meters around the track of the current lap (previous interval) */
-unsigned int last_pos = 0;             /* Meters around the track of the current lap */
-unsigned int scoring_ticks = 0;        /* Advances every time UpdateScoring() is called */
-unsigned int laps_since_realtime = 0;  /* Number of laps completed since entering realtime last time */
-double current_delta_best = NULL;      /* Current calculated delta best time */
-double prev_delta_best = NULL;
-double prev_lap_dist = 0;              /* Used to accurately calculate dt and */
-double prev_current_et = 0;            /*     speed of last interval */
-double inbtw_scoring_traveled = 0;     /* Distance traveled (m) between successive UpdateScoring() calls */
-double inbtw_scoring_elapsed = 0;
-long render_ticks = 0;
-long render_ticks_int = 12;
+unsigned long shown_corner_laps = 0;   /* Last table of corner times shown after a lap */
 char datapath[FILENAME_MAX] = "";
 char bestlap_dir[FILENAME_MAX] = "";
 char bestlap_filename[FILENAME_MAX] = "";
-
-/* Keeps information about last and best laps */
-struct LapTime {
-	double elapsed[MAX_TRACK_LENGTH];
-	double final;
-	double started;
-	double ended;
-	double interval_offset;
-} best_lap, last_lap;
-
-struct PluginConfig {
-
-	bool bar_enabled;
-	unsigned int bar_left;
-	unsigned int bar_top;
-	unsigned int bar_width;
-	unsigned int bar_height;
-	unsigned int bar_gutter;
-
-	bool time_enabled;
-	bool hires_updates;
-	unsigned int time_top;
-	unsigned int time_width;
-	unsigned int time_height;
-	unsigned int time_font_size;
-	char time_font_name[FONT_NAME_MAXLEN];
-
-	unsigned int keyboard_magic;
-	unsigned int keyboard_reset;
-} config;
+char archive_base[FILENAME_MAX] = "";   /* Lap archive, without the extension */
+
+/* Where the statistics per segment of the session go, and what for */
+char segments_filename[FILENAME_MAX] = "";
+char segments_track[64] = "";
+char segments_class[32] = "";
+
+/* DeltaBest.ini, parsed into an immutable snapshot. When the file changes,
+   the next snapshot of the ring is filled in the background and swapped
+   in. The render and sim threads only use a snapshot for the length of a
+   callback, anything kept longer is copied or compared by generation. */
+std::atomic<const ConfigSnapshot *> current_config;
+ConfigSnapshot config_snapshots[CONFIG_SNAPSHOTS];
+unsigned long config_generation = 0;
+FileWatcher config_watcher;
+
+PluginStats stats;
+
+/* Control presses, pushed by CheckHWControl() and executed by
+   the simulation callbacks. Controls are only edge-triggered. */
+CommandQueue commands;
+unsigned int controls_registered = 0;
+bool control_toggle_down = false;
+bool control_reset_down = false;
+
+/* Raw callbacks written to CAPTURE_FILE, when "[Capture] Enabled=1".
+   Started and stopped only at the start of a session. */
+Capture capture;
+unsigned long captured_generation = 0;
+
+/* Live state for other processes, when "[Shared] Enabled=1", and
+   for other devices, when "[Broadcast] Enabled=1" */
+SharedDelta shared_delta;
+SharedDeltaRate live_rate;
+Broadcast broadcast;
+unsigned long broadcast_generation = 0;
+
+/* Corners of each best lap, found in the background, and inputs of
+   each lap against the best lap, compared in the background. Best laps
+   loaded from disk only have times, turned into speeds to find corners. */
+LapAnalysis lap_analysis;
+unsigned long lap_analysis_version = 0;
+unsigned long corners_version = 0;
+InputTrace loaded_speeds;
 
 #ifdef ENABLE_LOG
 FILE* out_file = NULL;
 #endif
 
-// DirectX 9 objects, to render some text on screen
-LPD3DXFONT g_Font = NULL;
-D3DXFONT_DESC FontDesc = {
-	DEFAULT_FONT_SIZE, 0, 400, 0, false, DEFAULT_CHARSET,
-	OUT_TT_PRECIS, CLIP_DEFAULT_PRECIS, DEFAULT_PITCH, DEFAULT_FONT_NAME
-};
-RECT FontPosition, ShadowPosition;
-LPD3DXSPRITE bar = NULL;
+// DirectX 9 objects. One texture holds both the background image
+// and the pre-rasterised glyphs of the delta time text.
 LPDIRECT3DTEXTURE9 texture = NULL;
+D3DSURFACE_DESC background_desc;
+GlyphAtlas glyph_atlas;
+
+// All overlay quads go through one dynamic vertex buffer, drawn in a single call
+LPDIRECT3DVERTEXBUFFER9 overlay_vb = NULL;
+LPDIRECT3DSTATEBLOCK9 overlay_state = NULL;
+OverlayBatch overlay_batch;
+
+// Overlay layout only changes with the screen or the config, and the
+// vertex buffer is only refilled when the displayed geometry changes
+OverlayLayout overlay_layout;
+OverlayKey overlay_key;
+bool overlay_key_valid = false;
+
+// Config the overlay layout and glyph atlas were built from, and its generation (0 if none)
+PluginConfig overlay_config;
+unsigned long overlay_generation = 0;
 
 //
 // DeltaBestPlugin class
@@ -108,41 +119,123 @@ void DeltaBestPlugin::WriteLog(const char * const msg)
 
 	if (out_file != NULL)
 		fprintf(out_file, "%s\n", msg);
+	if (engine != NULL)
+		engine->log = out_file;
 #endif /* ENABLE_LOG */
 }
 
+void DeltaBestPlugin::WriteStats()
+{
+	const PluginConfig &config = current_config.load()->config;
+
+	if (! config.stats_enabled)
+		return;
+
+	stats.capture_records = capture.records;
+	stats.capture_dropped = capture.dropped;
+	stats.broadcast_sent = broadcast.sent.load();
+	stats.broadcast_dropped = broadcast.dropped;
+	stats.broadcast_errors = broadcast.errors.load();
+	stats.line_accuracy = engine->line_accuracy;
+	stats.sector_accuracy[0] = engine->sector_accuracy[0];
+	stats.sector_accuracy[1] = engine->sector_accuracy[1];
+	stats.drift_rate = engine->drift_rate;
+	stats.analysis_submitted = lap_analysis.submitted_count;
+	stats.analysis_dropped = lap_analysis.dropped;
+	stats.corner_times = engine->corner_times;
+	LapAnalysisLatest(&lap_analysis, &stats.corners, &lap_analysis_version);
+
+	FILE* stats_file = fopen(STATS_FILE, "a");
+	if (stats_file != NULL) {
+		WritePluginStats(stats_file, stats);
+		fclose(stats_file);
+	}
+}
+
+/* Overwrites the statistics of the previous session on the same track
+   with the same class, if there are laps to write */
+void DeltaBestPlugin::SaveSegmentStats()
+{
+	if (engine->segment_stats.laps == 0 || segments_filename[0] == '\0')
+		return;
+
+	if (! SegmentStatsWrite(engine->segment_stats, segments_filename, segments_track, segments_class)) {
+#ifdef ENABLE_LOG
+		fprintf(out_file, "[SAVE] Couldn't save segment statistics to '%s'\n", segments_filename);
+#endif /* ENABLE_LOG */
+	}
+}
+
 void DeltaBestPlugin::Startup(long version)
 {
 	// default HW control enabled to true
 	mEnabled = true;
+	CommandQueueInit(&commands);
+
+	if (engine == NULL) {
+		engine = DeltaEngineCreate();
+		engine->load_best_lap = LoadBestLapCallback;
+		engine->save_best_lap = SaveBestLapCallback;
+		engine->archive_lap = ArchiveLapCallback;
+		engine->lap_completed = LapCompletedCallback;
+		engine->new_reference = NewReferenceCallback;
+		engine->callback_context = this;
+	}
+	LapAnalysisStart(&lap_analysis);
+
+	/* Load the config now, then again whenever it's edited */
+	ReloadConfig(NULL);
+	FileWatcherStart(&config_watcher, CONFIG_FILE, ReloadConfig, NULL);
+
 #ifdef ENABLE_LOG
 	WriteLog("--STARTUP--");
 #endif /* ENABLE_LOG */
 }
 
+void DeltaBestPlugin::Shutdown()
+{
+	FileWatcherStop(&config_watcher);
+	CaptureStop(&capture);
+	captured_generation = 0;
+	SharedDeltaClose(&shared_delta);
+	BroadcastStop(&broadcast);
+	broadcast_generation = 0;
+	LapAnalysisStop(&lap_analysis);
+
+	current_config.store(NULL);
+
+	DeltaEngineDestroy(engine);
+	engine = NULL;
+}
+
 void DeltaBestPlugin::StartSession()
 {
 #ifdef ENABLE_LOG
 	WriteLog("--STARTSESSION--");
 #endif /* ENABLE_LOG */
-	session_started = true;
-	loaded_best_in_session = false;
+	UpdateCapture(*current_config.load());
+	CaptureEvent(&capture, CAPTURE_START_SESSION);
+
+	DeltaEngineStartSession(engine);
 	shown_best_in_session = false;
-	lap_was_timed = false;
-	player_in_pits = false;
-	ResetLap(&last_lap);
-	ResetLap(&best_lap);
+	shown_corner_laps = 0;
+	ResetPluginStats(&stats);
 }
 
 void DeltaBestPlugin::EndSession()
 {
 	mET = 0.0f;
-	session_started = false;
+	CaptureEvent(&capture, CAPTURE_END_SESSION);
+	DeltaEngineEndSession(engine);
+	PublishLive();
+	WriteStats();
+	SaveSegmentStats();
 #ifdef ENABLE_LOG
 	WriteLog("--ENDSESSION--");
 	if (out_file) {
 		fclose(out_file);
 		out_file = NULL;
+		engine->log = NULL;
 	}
 #endif /* ENABLE_LOG */
 }
@@ -165,8 +258,8 @@ void DeltaBestPlugin::EnterRealtime()
 {
 	// start up timer every time we enter realtime
 	mET = 0.0f;
-	in_realtime = true;
-	laps_since_realtime = 0;
+	CaptureEvent(&capture, CAPTURE_ENTER_REALTIME);
+	DeltaEngineEnterRealtime(engine);
 
 #ifdef ENABLE_LOG
 	WriteLog("---ENTERREALTIME---");
@@ -175,318 +268,204 @@ void DeltaBestPlugin::EnterRealtime()
 
 void DeltaBestPlugin::ExitRealtime()
 {
-	in_realtime = false;
-
-	/* Reset delta best state */
-	last_pos = 0;
-	prev_lap_dist = 0;
-	current_delta_best = 0;
-	prev_delta_best = 0;
+	CaptureEvent(&capture, CAPTURE_EXIT_REALTIME);
+	DeltaEngineExitRealtime(engine);
+	PublishLive();
 
 #ifdef ENABLE_LOG
 	WriteLog("---EXITREALTIME---");
 #endif /* ENABLE_LOG */
 }
 
-void DeltaBestPlugin::ResetLap(struct LapTime *lap)
-{
-	if (lap == NULL)
-		return;
-
-	lap->ended = 0;
-	lap->final = 0;
-	lap->started = 0;
-	lap->interval_offset = 0;
-
-	unsigned int i = 0, n = sizeof(lap->elapsed) / sizeof(lap->elapsed[0]);
-	for (i = 0; i < n; i++)
-		lap->elapsed[i] = 0;
-
-}
-
 bool DeltaBestPlugin::NeedToDisplay()
 {
-	// If we're in the monitor or replay, or no session has started yet,
-	// no delta best should be displayed
-	if (! in_realtime)
-		return false;
-
 	// Option might be disabled by the user (TAB)
 	if (! key_switch)
 		return false;
 
-	// If we are in any race/practice phase that's not
-	// green flag, we don't need or want Delta Best displayed
-	if (! green_flag)
-		return false;
+	return DeltaEngineHasDelta(engine);
+}
 
-	if (player_in_pits)
-		return false;
+bool DeltaBestPlugin::InitCustomControl(CustomControlInfoV01 &info)
+{
+	static const char *control_names[] = { CONTROL_TOGGLE_NAME, CONTROL_RESET_NAME };
+	const unsigned int n = sizeof(control_names) / sizeof(control_names[0]);
 
-	/* Don't display anything if current lap isn't timed */
-	if (! lap_was_timed)
+	/* All registered, start over in case the game asks again */
+	if (controls_registered >= n) {
+		controls_registered = 0;
 		return false;
+	}
 
-	/* We can't display a delta best until we have a best lap recorded */
-	if (! best_lap.final)
-		return false;
+	strncpy(info.mUntranslatedName, control_names[controls_registered], sizeof(info.mUntranslatedName) - 1);
+	info.mUntranslatedName[sizeof(info.mUntranslatedName) - 1] = '\0';
+	info.mRepeat = 0;
+	controls_registered++;
 
 	return true;
 }
 
-void DeltaBestPlugin::UpdateScoring(const ScoringInfoV01 &info)
+/* Queues the command once when the control goes down, holding it does nothing */
+static void ControlEdge(bool *was_down, double value, PluginCommand command)
 {
+	bool down = value > 0.5;
+	if (down && ! *was_down)
+		CommandQueuePush(&commands, command);
+	*was_down = down;
+}
 
-	/* No scoring updates should take place if we're
-	in the monitor as opposed to the cockpit mode */
-	if (! in_realtime)
-		return;
+bool DeltaBestPlugin::CheckHWControl(const char * const controlName, double &fRetVal)
+{
+	/* Custom control names come prefixed with an underscore */
+	if (controlName[0] != '_')
+		return false;
 
-	/* Toggle shortcut key. Turns off/on the display of delta time */
-	if (KEY_DOWN(config.keyboard_magic))
-		key_switch = ! key_switch;
+	if (strcmp(controlName + 1, CONTROL_TOGGLE_NAME) == 0)
+		ControlEdge(&control_toggle_down, fRetVal, CMD_TOGGLE_DISPLAY);
+	else if (strcmp(controlName + 1, CONTROL_RESET_NAME) == 0)
+		ControlEdge(&control_reset_down, fRetVal, CMD_RESET_BEST_LAP);
 
-	/* Reset the best lap time to none for the session */
-	else if (KEY_DOWN(config.keyboard_reset)) {
-		ResetLap(&best_lap);
-	}
+	/* We only listen, never take over the control */
+	return false;
+}
 
-	/* Update plugin context information, used by NeedToDisplay() */
-	green_flag = ((info.mGamePhase == GP_GREEN_FLAG)
-		       || (info.mGamePhase == GP_YELLOW_FLAG)
-		       || (info.mGamePhase == GP_SESSION_OVER));
+void DeltaBestPlugin::ProcessCommands()
+{
+	PluginCommand command;
 
-	for (long i = 0; i < info.mNumVehicles; ++i) {
-		VehicleScoringInfoV01 &vinfo = info.mVehicle[i];
+	while (CommandQueuePop(&commands, &command)) {
+		CaptureCommand(&capture, command);
 
-		// Player's car? If not, skip
-		if (! vinfo.mIsPlayer || vinfo.mControl != 0)
-			continue;
+		switch (command) {
 
-		player_in_pits = vinfo.mInPits;
+		/* Turns off/on the display of delta time */
+		case CMD_TOGGLE_DISPLAY:
+			key_switch = ! key_switch;
+			break;
 
-#ifdef ENABLE_LOG
-		fprintf(out_file, "mLapStartET=%.3f mLastLapTime=%.3f mCurrentET=%.3f Elapsed=%.3f mLapDist=%.3f/%.3f prevLapDist=%.3f prevCurrentET=%.3f deltaBest=%+2.2f lastPos=%d prevPos=%d\n",
-			vinfo.mLapStartET,
-			vinfo.mLastLapTime,
-			info.mCurrentET,
-			(info.mCurrentET - vinfo.mLapStartET),
-			vinfo.mLapDist,
-			info.mLapDist,
-			prev_lap_dist,
-			prev_current_et,
-			current_delta_best,
-			last_pos,
-			prev_pos);
-#endif /* ENABLE_LOG */
+		/* Reset the best lap time to none for the session */
+		case CMD_RESET_BEST_LAP:
+			DeltaEngineResetBestLap(engine);
+			break;
 
-		if (! loaded_best_in_session) {
-#ifdef ENABLE_LOG
-			fprintf(out_file, "Trying to load best lap for this session\n");
-#endif
-			LoadBestLap(&best_lap, info, vinfo);
-			loaded_best_in_session = true;
+		default:
+			break;
 		}
+	}
+}
 
-		/* Check if we started a new lap just now */
-		bool new_lap = (vinfo.mLapStartET != last_lap.started);
-		double curr_lap_dist = vinfo.mLapDist >= 0 ? vinfo.mLapDist : 0;
-
-		if (new_lap) {
-
-			/* mLastLapTime is -1 when lap wasn't timed */
-			lap_was_timed = ! (vinfo.mLapStartET == 0.0 && vinfo.mLastLapTime == 0.0);
-
-			if (lap_was_timed) {
-				last_lap.final = vinfo.mLastLapTime;
-				last_lap.ended = info.mCurrentET;
-
-#ifdef ENABLE_LOG
-				fprintf(out_file, "New LAP: Last = %.3f, started = %.3f, ended = %.3f interval_offset = %.3f\n",
-					last_lap.final, last_lap.started, last_lap.ended, last_lap.interval_offset);
-#endif /* ENABLE_LOG */
-
-				/* Was it the best lap so far? */
-				/* .final == -1.0 is the first lap of the session, can't be timed */
-				bool valid_timed_lap = last_lap.final > 0.0;
-				bool best_so_far = valid_timed_lap && (
-						(best_lap.final == NULL)
-					 || (best_lap.final != NULL && last_lap.final < best_lap.final));
-
-				if (best_so_far) {
-#ifdef ENABLE_LOG
-					fprintf(out_file, "Last lap was the best so far (final time = %.3f, previous best = %.3f)\n",
-						last_lap.final, best_lap.final);
-#endif /* ENABLE_LOG */
+void DeltaBestPlugin::UpdateScoring(const ScoringInfoV01 &info)
+{
+	const ConfigSnapshot &snapshot = *current_config.load();
+	const PluginConfig &config = snapshot.config;
+
+	ProcessCommands();
+	UpdateCapture(snapshot);
+
+	/* Corners of the best lap, if found since the last update */
+	CornerMap corners;
+	unsigned long reference;
+	if (LapAnalysisCorners(&lap_analysis, &corners, &reference, &corners_version))
+		DeltaEngineSetCorners(engine, corners, reference);
+
+	DeltaEngineUpdateScoring(engine, config, info);
+	UpdateShared(config);
+	UpdateBroadcast(snapshot);
+	PublishLive();
+
+	/* After the update, so that a best lap loaded during
+	   the update comes first in the capture */
+	CaptureScoring(&capture, info);
+}
 
-					/**
-					 * Complete the mileage of the last lap.
-                     * This avoids nasty jumps into empty space (+50.xx) when later comparing with best lap.
-					 */
-					for (unsigned int i = last_pos + 1 ; i <= (unsigned int) info.mLapDist; i++) {
-						/* FIXME: Inaccurate. Should extrapolate last interval */
-						last_lap.elapsed[i] = last_lap.elapsed[i - 1];
-					}
-
-					best_lap = last_lap;
-					SaveBestLap(&best_lap, info, vinfo);
-				}
+void DeltaBestPlugin::UpdateTelemetry(const TelemInfoV01 &info)
+{
+	const ConfigSnapshot &snapshot = *current_config.load();
+	const PluginConfig &config = snapshot.config;
+
+	ProcessCommands();
+	UpdateCapture(snapshot);
+	DeltaEngineUpdateTelemetry(engine, config, info);
+	PublishLive();
+	CaptureTelemetry(&capture, info);
+}
 
-#ifdef ENABLE_LOG
-				fprintf(out_file, "Best LAP yet  = %.3f, started = %.3f, ended = %.3f\n",
-					best_lap.final, best_lap.started, best_lap.ended);
-#endif /* ENABLE_LOG */
-			}
+/* Starts or stops the capture as configured, at the start of a session,
+   and records every new config snapshot while capturing */
+void DeltaBestPlugin::UpdateCapture(const ConfigSnapshot &snapshot)
+{
+	const PluginConfig &config = snapshot.config;
 
-			/* Prepare to archive the new lap */
-			last_lap.started = vinfo.mLapStartET;
-			last_lap.final = NULL;
-			last_lap.ended = NULL;
-			last_lap.interval_offset = info.mCurrentET - vinfo.mLapStartET;
-			last_lap.elapsed[0] = 0;
-			last_pos = prev_pos = 0;
-			prev_lap_dist = 0;
-			/* Leave prev_current_et alone, or you have hyper-jumps */
+	if (! engine->session_started) {
+		if (config.capture_enabled && capture.file == NULL) {
+			CaptureStart(&capture, CAPTURE_FILE);
+			captured_generation = 0;
 		}
-
-		/* If there's a lap in progress, save the delta updates */
-		if (last_lap.started > 0.0) {
-			unsigned int meters = round(vinfo.mLapDist >= 0 ? vinfo.mLapDist : 0);
-
-			/* It could be that we have stopped our vehicle.
-			In that case (same array position), we want to
-			overwrite the previous value anyway */
-			if (meters >= last_pos) {
-				double distance_traveled = (vinfo.mLapDist - prev_lap_dist);
-				if (distance_traveled < 0)
-					distance_traveled = 0;
-				double time_interval = (info.mCurrentET - prev_current_et);
-
-				if (meters == last_pos) {
-					last_lap.elapsed[meters] = info.mCurrentET - vinfo.mLapStartET;
-#ifdef ENABLE_LOG
-					fprintf(out_file, "[DELTA]     elapsed[%d] = %.3f [same position]\n", meters, last_lap.elapsed[meters]);
-#endif /* ENABLE_LOG */
-				}
-				else {
-					for (unsigned int i = last_pos; i < meters; i++) {
-						/* Elapsed time at this position already filled in by UpdateTelemetry()? */
-						if (last_lap.elapsed[i] > 0.0)
-							continue;
-						/* Linear interpolation of elapsed time in relation to physical position */
-						double interval_fraction = meters == last_pos ? 1.0 : (1.0 * i - last_pos) / (1.0 * meters - last_pos);
-						last_lap.elapsed[i] = prev_current_et + (interval_fraction * time_interval) - vinfo.mLapStartET;
-#ifdef ENABLE_LOG
-						fprintf(out_file, "[DELTA]     elapsed[%d] = %.3f (interval_fraction=%.3f)\n", i, last_lap.elapsed[i], interval_fraction);
-#endif /* ENABLE_LOG */
-					}
-					last_lap.elapsed[meters] = info.mCurrentET - vinfo.mLapStartET;
-				}
-
-#ifdef ENABLE_LOG
-				fprintf(out_file, "[DELTA] distance_traveled=%.3f time_interval=%.3f [%d .. %d]\n",
-					distance_traveled, time_interval, last_pos, meters);
-#endif /* ENABLE_LOG */
-			}
-
-			prev_pos = last_pos;
-			last_pos = meters;
+		else if (! config.capture_enabled && capture.file != NULL) {
+			CaptureStop(&capture);
 		}
-
-		if (curr_lap_dist > prev_lap_dist)
-			prev_lap_dist = curr_lap_dist;
-
-		prev_current_et = info.mCurrentET;
-
-		inbtw_scoring_traveled = 0;
-		inbtw_scoring_elapsed = 0;
 	}
 
+	if (capture.file != NULL && captured_generation != snapshot.generation) {
+		CaptureConfig(&capture, config);
+		captured_generation = snapshot.generation;
+	}
 }
 
-/* We use UpdateTelemetry() to gain notable precision in position updates.
-We assume that (-1.0 * LocalVelocity.z) is the forward speed of the
-vehicle, which seems to be confirmed by observed data.
-
-Having forward speed means that with a delta-t we can directly measure
-the distance traveled at 20hz instead of 5hz of UpdateScoring().
-
-We use this data to complete information on vehicle lap progress
-between successive UpdateScoring() calls.
-
-This behaviour can be disabled by the "HiresUpdates=0" option
-in the ini file.
-
-*/
-
-void DeltaBestPlugin::UpdateTelemetry(const TelemInfoV01 &info)
+/* Creates or closes the shared memory region as configured */
+void DeltaBestPlugin::UpdateShared(const PluginConfig &config)
 {
-	if (! in_realtime)
-		return;
+	if (config.shared_enabled && shared_delta.region == NULL)
+		SharedDeltaCreate(&shared_delta, SHARED_DELTA_NAME);
+	else if (! config.shared_enabled && shared_delta.region != NULL)
+		SharedDeltaClose(&shared_delta);
+}
 
-	if (! config.hires_updates)
+/* Starts or stops the broadcast as configured, and restarts it
+   when the destination or rate change */
+void DeltaBestPlugin::UpdateBroadcast(const ConfigSnapshot &snapshot)
+{
+	if (snapshot.generation == broadcast_generation)
 		return;
 
-	double dt = info.mDeltaTime;
-	double forward_speed = - info.mLocalVel.z;
-
-	/* Ignore movement in reverse gear
-	   Causes crashes down the line but don't know why :-| */
-	if (forward_speed <= 0)
-		return;
+	/* Against the broadcast as started, when it's running */
+	const PluginConfig &config = snapshot.config;
+	bool running = broadcast.running.load();
+	bool changed = strcmp(config.broadcast_address, broadcast.address) != 0
+		|| config.broadcast_port != broadcast.port
+		|| config.broadcast_rate != broadcast.rate;
 
-	double distance = forward_speed * dt;
+	if (running && (! config.broadcast_enabled || changed))
+		BroadcastStop(&broadcast);
+	if (config.broadcast_enabled && (! running || changed))
+		BroadcastStart(&broadcast, config.broadcast_address, config.broadcast_port, config.broadcast_rate);
 
-	inbtw_scoring_traveled += distance;
-	inbtw_scoring_elapsed  += dt;
+	broadcast_generation = snapshot.generation;
+}
 
-	unsigned int inbtw_pos = round(last_pos + inbtw_scoring_traveled);
-	if (inbtw_pos > last_pos) {
-		last_lap.elapsed[inbtw_pos] = last_lap.elapsed[last_pos] + inbtw_scoring_elapsed;
-#ifdef ENABLE_LOG
-		fprintf(out_file, "\tNEW inbtw pos=%d elapsed=%.3f (last_pos=%d, t=%.3f, acc_t=%.3f)\n",
-			inbtw_pos, inbtw_scoring_elapsed, last_pos, last_lap.elapsed[last_pos], last_lap.elapsed[inbtw_pos]);
-#endif /* ENABLE_LOG */
-	}
+/* Snapshot of the engine for the shared memory and the broadcast, if anyone wants it */
+void DeltaBestPlugin::PublishLive()
+{
+	if (shared_delta.region == NULL && ! BroadcastDue(&broadcast))
+		return;
 
-#ifdef ENABLE_LOG
-	fprintf(out_file, "\tdt=%.3f fwd_speed=%.3f dist=%.3f inbtw_scoring_traveled=%.3f last_pos(m)=%d\n",
-		dt, forward_speed, distance, inbtw_scoring_traveled, last_pos);
-#endif /* ENABLE_LOG */
+	SharedDeltaData data;
+	SharedDeltaSnapshot(&live_rate, engine, &data);
+	SharedDeltaPublish(&shared_delta, data);
+	BroadcastPush(&broadcast, data);
 }
 
 void DeltaBestPlugin::InitScreen(const ScreenInfoV01& info)
 {
-	long screen_width = info.mWidth;
-	long screen_height = info.mHeight;
-
-	LoadConfig(config, CONFIG_FILE);
-
-	/* Now we know screen X/Y, we can place the text somewhere specific (in height).
-	If everything is zero then apply our defaults. */
-
-	if (config.time_width == 0)
-		config.time_width = screen_width;
-	if (config.time_height == 0)
-		config.time_height = screen_height;
-	if (config.time_top == 0)
-		config.time_top = screen_height / 6.0;
-
-	//config.bar_left = GetPrivateProfileInt("Bar", "Left", 0, ini_file);
-	//config.bar_top = GetPrivateProfileInt("Bar", "Top", 0, ini_file);
-	//config.time_top = GetPrivateProfileInt("Time", "Top", 0, ini_file);
-
-	FontDesc.Height = config.time_font_size;
-	sprintf(FontDesc.FaceName, config.time_font_name);
-
-	D3DXCreateFontIndirect((LPDIRECT3DDEVICE9) info.mDevice, &FontDesc, &g_Font);
-	assert(g_Font != NULL);
-
-	D3DXCreateTextureFromFile((LPDIRECT3DDEVICE9) info.mDevice, TEXTURE_BACKGROUND, &texture);
-	D3DXCreateSprite((LPDIRECT3DDEVICE9) info.mDevice, &bar);
+	const ConfigSnapshot &snapshot = *current_config.load();
+	const PluginConfig &config = snapshot.config;
 
+	CreateOverlayTexture((LPDIRECT3DDEVICE9) info.mDevice, config);
 	assert(texture != NULL);
-	assert(bar != NULL);
+	UpdateOverlayLayout(info, config);
+	overlay_generation = snapshot.generation;
+
+	CreateOverlayBuffers((LPDIRECT3DDEVICE9) info.mDevice);
 
 #ifdef ENABLE_LOG
 	WriteLog("---INIT SCREEN---");
@@ -496,18 +475,13 @@ void DeltaBestPlugin::InitScreen(const ScreenInfoV01& info)
 
 void DeltaBestPlugin::UninitScreen(const ScreenInfoV01& info)
 {
-	if (g_Font) {
-		g_Font->Release();
-		g_Font = NULL;
-	}
-	if (bar) {
-		bar->Release();
-		bar = NULL;
-	}
 	if (texture) {
 		texture->Release();
 		texture = NULL;
 	}
+	glyph_atlas.ready = false;
+	overlay_generation = 0;
+	ReleaseOverlayBuffers();
 #ifdef ENABLE_LOG
 	WriteLog("---UNINIT SCREEN---");
 #endif /* ENABLE_LOG */
@@ -527,50 +501,28 @@ void DeltaBestPlugin::ReactivateScreen(const ScreenInfoV01& info)
 #endif /* ENABLE_LOG */
 }
 
-double DeltaBestPlugin::CalculateDeltaBest()
-{
-	/* Shouldn't really happen */
-	if (! best_lap.final)
-		return 0;
-
-	/* Current position in meters around the track */
-	int m = round(last_pos + inbtw_scoring_traveled);
-
-	/* By using meters, and backfilling all the missing information,
-	it shouldn't be possible to not have the exact same position in the best lap */
-	double last_time_at_pos = last_lap.elapsed[m];
-	double best_time_at_pos = best_lap.elapsed[m];
-	double delta_best = last_time_at_pos - best_time_at_pos;
-
-	if (delta_best > 99.0)
-		delta_best = 99.0;
-	else if (delta_best < -99)
-		delta_best = -99.0;
-
-	return delta_best;
-}
-
 bool DeltaBestPlugin::WantsToDisplayMessage( MessageInfoV01 &msgInfo )
 {
 	/* Wait until we're in realtime, otherwise
 	the message is lost in space */
-	if (! in_realtime)
+	if (! engine->in_realtime)
 		return false;
 
 	/* We just want to display this message once in this rF2 session */
 	if (! displayed_welcome) {
 
-		/* Tell how to toggle display through keyboard */
+		/* Tell how to toggle display through the controls */
 		msgInfo.mDestination = 0;
 		msgInfo.mTranslate = 0;
-		sprintf(msgInfo.mText, "DeltaBest " DELTA_BEST_VERSION " plugin enabled (CTRL + D to toggle)");
+		sprintf(msgInfo.mText, "DeltaBest " DELTA_BEST_VERSION " plugin enabled (bind \"" CONTROL_TOGGLE_NAME "\" to toggle)");
 
 		/* Don't do it anymore, just once per session */
 		displayed_welcome = true;
 		return true;
 	}
 
-	if (loaded_best_in_session && best_lap.final > 0.0 && ! shown_best_in_session) {
+	const LapTime &best_lap = engine->best_lap;
+	if (engine->loaded_best_in_session && best_lap.final > 0.0 && ! shown_best_in_session) {
 		msgInfo.mDestination = 0;
 		msgInfo.mTranslate = 0;
 
@@ -585,147 +537,337 @@ bool DeltaBestPlugin::WantsToDisplayMessage( MessageInfoV01 &msgInfo )
 		return true;
 	}
 
+	/* Where the last lap lost and gained the most against the best lap */
+	const CornerTimes &times = engine->corner_times;
+	if (current_config.load()->config.corner_summary && times.laps != shown_corner_laps && times.corners.count > 0) {
+		msgInfo.mDestination = 0;
+		msgInfo.mTranslate = 0;
+
+		unsigned int lost = 0, gained = 0;
+		for (unsigned int i = 1; i < times.corners.count; i++) {
+			if (times.delta[i] > times.delta[lost])
+				lost = i;
+			if (times.delta[i] < times.delta[gained])
+				gained = i;
+		}
+
+		double lap_delta = times.lap_time - times.reference_time;
+		if (times.delta[gained] >= 0)
+			sprintf(msgInfo.mText, "Lap %+.3f: slower in every corner, most in corner %u (%+.3f)",
+				lap_delta, lost + 1, times.delta[lost]);
+		else if (times.delta[lost] <= 0)
+			sprintf(msgInfo.mText, "Lap %+.3f: faster in every corner, most in corner %u (%+.3f)",
+				lap_delta, gained + 1, times.delta[gained]);
+		else
+			sprintf(msgInfo.mText, "Lap %+.3f: lost most in corner %u (%+.3f), gained most in corner %u (%+.3f)",
+				lap_delta, lost + 1, times.delta[lost], gained + 1, times.delta[gained]);
+		shown_corner_laps = times.laps;
+		return true;
+	}
+
 	return false;
 }
 
-void DeltaBestPlugin::DrawDeltaBar(const ScreenInfoV01 &info, double delta, double delta_diff)
+void DeltaBestPlugin::CreateOverlayTexture(LPDIRECT3DDEVICE9 d3d, const PluginConfig &config)
 {
-	LPDIRECT3DDEVICE9 d3d = (LPDIRECT3DDEVICE9) info.mDevice;
+	LPDIRECT3DTEXTURE9 background = NULL;
 
-	const float SCREEN_WIDTH    = info.mWidth;
-	const float SCREEN_HEIGHT   = info.mHeight;
-	const float SCREEN_CENTER   = SCREEN_WIDTH / 2.0;
+	glyph_atlas.ready = false;
 
-	const float BAR_WIDTH       = config.bar_width;
-	const float BAR_TOP         = config.bar_top;
-	const float BAR_HEIGHT      = config.bar_height;
-	const float BAR_TIME_GUTTER = config.bar_gutter;
-	const float TIME_WIDTH      = config.time_width;
-	const float TIME_HEIGHT     = config.time_height;
+	/* Background image, read back on the CPU to be copied into the overlay texture */
+	D3DXCreateTextureFromFileEx(d3d, TEXTURE_BACKGROUND, D3DX_DEFAULT_NONPOW2, D3DX_DEFAULT_NONPOW2,
+		1, 0, D3DFMT_A8R8G8B8, D3DPOOL_SCRATCH, D3DX_FILTER_NONE, D3DX_FILTER_NONE, 0, NULL, NULL,
+		&background);
+	if (background == NULL)
+		return;
+	background->GetLevelDesc(0, &background_desc);
+
+	/* Rasterise the glyphs with GDI, white on black. Any channel
+	   of the resulting bitmap is then the glyph coverage (alpha). */
+	HDC dc = CreateCompatibleDC(NULL);
+	HFONT font = CreateFont(config.time_font_size, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+		DEFAULT_CHARSET, OUT_TT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH,
+		config.time_font_name);
+	HGDIOBJ old_font = SelectObject(dc, font);
+
+	TEXTMETRIC metrics;
+	GetTextMetrics(dc, &metrics);
+
+	unsigned int widths[GLYPH_ATLAS_NUM_CHARS];
+	for (unsigned int i = 0; i < GLYPH_ATLAS_NUM_CHARS; i++) {
+		SIZE size;
+		GetTextExtentPoint32(dc, &GLYPH_ATLAS_CHARS[i], 1, &size);
+		widths[i] = size.cx;
+	}
 
-	// Computed positions, sizes
-	const float BAR_LEFT        = (SCREEN_WIDTH - BAR_WIDTH) / 2.0;
-	// The -5 "compensates" for font height vs time box height difference
-	const float TIME_TOP        = (BAR_TOP + BAR_HEIGHT + BAR_TIME_GUTTER);
+	unsigned int tex_width = background_desc.Width;
+	unsigned int glyph_rows = GlyphAtlasPack(&glyph_atlas, widths, metrics.tmHeight,
+		tex_width, background_desc.Height);
+	unsigned int tex_height = 1;
+	while (tex_height < background_desc.Height + glyph_rows)
+		tex_height <<= 1;
+
+	BITMAPINFO bmi;
+	memset(&bmi, 0, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = tex_width;
+	bmi.bmiHeader.biHeight = - (LONG) tex_height;     /* Top-down */
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	DWORD *pixels = NULL;
+	HBITMAP bitmap = CreateDIBSection(dc, &bmi, DIB_RGB_COLORS, (void **) &pixels, NULL, 0);
+	HGDIOBJ old_bitmap = SelectObject(dc, bitmap);
+
+	if (pixels != NULL) {
+		SetBkMode(dc, TRANSPARENT);
+		SetTextColor(dc, RGB(0xFF, 0xFF, 0xFF));
+		for (unsigned int i = 0; i < GLYPH_ATLAS_NUM_CHARS; i++)
+			TextOut(dc, (int) glyph_atlas.glyphs[i].x, (int) glyph_atlas.glyphs[i].y, &GLYPH_ATLAS_CHARS[i], 1);
+		GdiFlush();
+
+		d3d->CreateTexture(tex_width, tex_height, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture, NULL);
+	}
 
-	const D3DCOLOR BAR_COLOR    = D3DCOLOR_RGBA(0x50, 0x50, 0x50, 0xFF);
+	if (texture != NULL) {
+		D3DLOCKED_RECT src, dst;
+		background->LockRect(0, &src, NULL, D3DLOCK_READONLY);
+		texture->LockRect(0, &dst, NULL, 0);
 
-	D3DCOLOR bar_grey = BAR_COLOR;
-	D3DXVECTOR3 delta_pos;
-	RECT delta_size = { 0, 0, 0, BAR_HEIGHT - 2 };
+		for (unsigned int y = 0; y < tex_height; y++) {
+			DWORD *row = (DWORD *) ((BYTE *) dst.pBits + y * dst.Pitch);
+			if (y < background_desc.Height) {
+				memcpy(row, (BYTE *) src.pBits + y * src.Pitch, background_desc.Width * sizeof(DWORD));
+				continue;
+			}
+			for (unsigned int x = 0; x < tex_width; x++) {
+				DWORD coverage = pixels[y * tex_width + x] & 0xFF;
+				row[x] = (coverage << 24) | 0x00FFFFFF;
+			}
+		}
 
-	// Provide a default centered position in case user
-	// disabled drawing of the bar
-	delta_pos.x = SCREEN_WIDTH / 2.0;
-	delta_pos.y = BAR_TOP + 1;
-	delta_pos.z = 0;
-	delta_size.right = 1;
+		texture->UnlockRect(0);
+		background->UnlockRect(0);
 
-	bar->Begin(D3DXSPRITE_ALPHABLEND);
+		glyph_atlas.texture_width = (float) tex_width;
+		glyph_atlas.texture_height = (float) tex_height;
+		glyph_atlas.ready = true;
+	}
 
-	if (config.bar_enabled) {
+	SelectObject(dc, old_bitmap);
+	SelectObject(dc, old_font);
+	DeleteObject(bitmap);
+	DeleteObject(font);
+	DeleteDC(dc);
+	background->Release();
+}
 
-		D3DXVECTOR3 bar_pos;
-		bar_pos.x = BAR_LEFT;
-		bar_pos.y = BAR_TOP;
-		bar_pos.z = 0;
+void DeltaBestPlugin::CreateOverlayBuffers(LPDIRECT3DDEVICE9 d3d)
+{
+	/* D3DPOOL_DEFAULT is required for dynamic buffers, so these
+	   have to be released before a device reset and recreated after */
+	if (overlay_vb == NULL)
+		d3d->CreateVertexBuffer(OVERLAY_MAX_VERTICES * sizeof(OverlayVertex),
+			D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, OVERLAY_FVF,
+			D3DPOOL_DEFAULT, &overlay_vb, NULL);
+
+	/* Recorded rather than D3DSBT_ALL, so that it only holds the few
+	   states the overlay changes: capturing the whole device every
+	   frame would cost more than all the drawing */
+	if (overlay_state == NULL && overlay_vb != NULL) {
+		d3d->BeginStateBlock();
+		SetOverlayState(d3d);
+		d3d->EndStateBlock(&overlay_state);
+	}
 
-		RECT bar_rect = { 0, 0, BAR_WIDTH, BAR_HEIGHT };
+	assert(overlay_vb != NULL);
+	assert(overlay_state != NULL);
 
-#ifdef ENABLE_LOG
-		fprintf(out_file, "[DRAW] bar at (%.2f, %.2f) width: %.2f height: %.2f\n",
-			bar_pos.x, bar_pos.y, bar_rect.right, bar_rect.bottom);
-#endif /* ENABLE_LOG */
+	/* Nothing in the new vertex buffer yet */
+	overlay_key_valid = false;
+}
 
-		bar->Draw(texture, &bar_rect,  NULL, &bar_pos,  bar_grey);
+void DeltaBestPlugin::ReleaseOverlayBuffers()
+{
+	if (overlay_vb) {
+		overlay_vb->Release();
+		overlay_vb = NULL;
+	}
+	if (overlay_state) {
+		overlay_state->Release();
+		overlay_state = NULL;
+	}
+}
 
-		// Draw delta bar
-		D3DCOLOR delta_bar_color;
+/* Every state the overlay sets, and so the ones overlay_state restores */
+void DeltaBestPlugin::SetOverlayState(LPDIRECT3DDEVICE9 d3d)
+{
+	d3d->SetVertexShader(NULL);
+	d3d->SetPixelShader(NULL);
+	d3d->SetFVF(OVERLAY_FVF);
+	d3d->SetStreamSource(0, overlay_vb, 0, sizeof(OverlayVertex));
+	d3d->SetTexture(0, texture);
+
+	d3d->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+	d3d->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+	d3d->SetRenderState(D3DRS_FILLMODE, D3DFILL_SOLID);
+	d3d->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+	d3d->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+	d3d->SetRenderState(D3DRS_BLENDOP, D3DBLENDOP_ADD);
+	d3d->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+	d3d->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+	d3d->SetRenderState(D3DRS_FOGENABLE, FALSE);
+	d3d->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+
+	d3d->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_MODULATE);
+	d3d->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+	d3d->SetTextureStageState(0, D3DTSS_COLORARG2, D3DTA_DIFFUSE);
+	d3d->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_MODULATE);
+	d3d->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+	d3d->SetTextureStageState(0, D3DTSS_ALPHAARG2, D3DTA_DIFFUSE);
+	d3d->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_DISABLE);
+	d3d->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+	d3d->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+	d3d->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+	d3d->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+}
 
-		delta_bar_color = BarColor(delta, delta_diff);
-		delta_pos.x = SCREEN_CENTER;
+void DeltaBestPlugin::SubmitOverlayBatch(LPDIRECT3DDEVICE9 d3d, bool upload)
+{
+	unsigned int primitives = OverlayBatchPrimitives(&overlay_batch);
+	if (primitives == 0 || overlay_vb == NULL || overlay_state == NULL)
+		return;
 
-		// Delta is negative: colored bar is in the right-hand half.
-		if (delta < 0) {
-			delta_size.right = (BAR_WIDTH / 2.0) * (-delta / 2.0);
+	/* Without upload, the vertex buffer still holds the last batch */
+	if (upload) {
+		void *vertices = NULL;
+		if (FAILED(overlay_vb->Lock(0, overlay_batch.num_vertices * sizeof(OverlayVertex), &vertices, D3DLOCK_DISCARD))) {
+			overlay_key_valid = false;
+			return;
 		}
+		memcpy(vertices, overlay_batch.vertices, overlay_batch.num_vertices * sizeof(OverlayVertex));
+		overlay_vb->Unlock();
+	}
 
-		// Delta non-negative, colored bar is in the left-hand half
-		else if (delta > 0) {
-			delta_pos.x -= (BAR_WIDTH / 2.0) * (delta / 2.0);
-			delta_size.right = SCREEN_CENTER - delta_pos.x;
-		}
+	/* Leave the states we change exactly as rF2 gave them to us */
+	overlay_state->Capture();
 
-		// Don't allow positive (green) bar to start before the -2.0s position
-		delta_pos.x = max(delta_pos.x, SCREEN_CENTER - (BAR_WIDTH / 2.0));
+	SetOverlayState(d3d);
 
-		// Max width is always half of bar width (left or right half)
-		delta_size.right = min(delta_size.right, BAR_WIDTH / 2.0);
+	d3d->DrawPrimitive(D3DPT_TRIANGLELIST, 0, primitives);
 
-		// Min width is 1, as zero doesn't make sense to draw
-		if (delta_size.right < 1)
-			delta_size.right = 1;
+	overlay_state->Apply();
+}
 
-#ifdef ENABLE_LOG
-		fprintf(out_file, "[DRAW] colored-bar at (%.2f, %.2f) width: %.2f height: %.2f\n",
-			delta_pos.x, delta_pos.y, delta_size.right, delta_size.bottom);
-#endif /* ENABLE_LOG */
+void DeltaBestPlugin::UpdateOverlayLayout(const ScreenInfoV01 &info, const PluginConfig &config)
+{
+	overlay_layout.screen_width = info.mWidth;
+	overlay_layout.screen_height = info.mHeight;
+	overlay_layout.bar_enabled = config.bar_enabled;
+	overlay_layout.bar_top = config.bar_top;
+	overlay_layout.bar_width = config.bar_width;
+	overlay_layout.bar_height = config.bar_height;
+	overlay_layout.bar_gutter = config.bar_gutter;
+	overlay_layout.time_enabled = config.time_enabled;
+	overlay_layout.time_width = config.time_width > 0 ? config.time_width : info.mWidth;
+	overlay_layout.time_height = config.time_height > 0 ? config.time_height : info.mHeight;
+	overlay_layout.graph_enabled = config.graph_enabled;
+	overlay_layout.graph_previous_lap = config.graph_previous_lap;
+	overlay_layout.graph_width = min(config.graph_width, DELTA_GRAPH_MAX_COLUMNS);
+	overlay_layout.graph_height = config.graph_height;
+	overlay_layout.graph_range = config.graph_range;
+
+	/* Graph defaults to centered, right below the time box */
+	overlay_layout.graph_left = config.graph_left > 0
+		? config.graph_left
+		: (info.mWidth - overlay_layout.graph_width) / 2.0f;
+	overlay_layout.graph_top = config.graph_top > 0
+		? config.graph_top
+		: config.bar_top + config.bar_height + config.bar_gutter + overlay_layout.time_height + config.bar_gutter;
+
+	/* Track map defaults to the right-hand side of the screen, level with the bar */
+	overlay_layout.map_enabled = config.map_enabled;
+	overlay_layout.map_size = config.map_size;
+	overlay_layout.map_thickness = config.map_thickness;
+	overlay_layout.map_left = config.map_left > 0
+		? config.map_left
+		: info.mWidth - config.map_size - DEFAULT_MAP_MARGIN;
+	overlay_layout.map_top = config.map_top > 0
+		? config.map_top
+		: config.bar_top;
+
+	overlay_layout.texture_width = glyph_atlas.texture_width;
+	overlay_layout.texture_height = glyph_atlas.texture_height;
+	overlay_layout.background_width = background_desc.Width;
+	overlay_layout.background_height = background_desc.Height;
+
+	overlay_config = config;
+	overlay_key_valid = false;
+}
 
-		bar->Draw(texture, &delta_size, NULL, &delta_pos, delta_bar_color);
+void DeltaBestPlugin::DrawDeltaBar(const ScreenInfoV01 &info, double delta, double delta_slope, int readout, double readout_value)
+{
+	LPDIRECT3DDEVICE9 d3d = (LPDIRECT3DDEVICE9) info.mDevice;
 
-	}
+	const D3DCOLOR BAR_COLOR    = D3DCOLOR_RGBA(0x50, 0x50, 0x50, 0xFF);
+	const D3DCOLOR SHADOW_COLOR = 0xC0585858;
 
-	// Draw the time text ("-0.18")
-	if (config.time_enabled) {
+	D3DCOLOR bar_color = BarColor(delta, delta_slope);
+	D3DCOLOR text_color = TextColor(readout == READOUT_ROLLING_DELTA ? readout_value : delta);
 
-		D3DCOLOR shadowColor = 0xC0585858;
-		D3DCOLOR textColor = TextColor(delta);
+	OverlayKey key;
+	MakeOverlayKey(&key, overlay_layout, delta, readout, readout_value, bar_color, text_color,
+		engine->delta_graph.version, engine->track_map.version);
+	stats.overlay_frames++;
 
-		char lp_deltaBest[15] = "";
+	/* Same thing on screen as last frame, just draw it again */
+	if (overlay_key_valid && OverlayKeyEquals(key, overlay_key)) {
+		stats.overlay_cache_hits++;
+		SubmitOverlayBatch(d3d, false);
+		return;
+	}
 
-		float time_rect_center = delta < 0
-			? (delta_pos.x + delta_size.right)
-			: delta_pos.x;
-		float left_edge = (SCREEN_WIDTH - BAR_WIDTH) / 2.0;
-		float right_edge = (SCREEN_WIDTH + BAR_WIDTH) / 2.0;
-		if (time_rect_center <= left_edge)
-			time_rect_center = left_edge + 1;
-		else if (time_rect_center >= right_edge)
-			time_rect_center = right_edge - 1;
+	OverlayRect time_box;
+	OverlayBatchReset(&overlay_batch);
+	BuildDeltaBar(&overlay_batch, overlay_layout, delta, bar_color, BAR_COLOR, &time_box);
+
+	// Add the time text ("-0.18", "1:42.37" or "+12.3m") to the same batch
+	if (overlay_layout.time_enabled) {
+		OverlayRect text_box = time_box;
+		text_box.top -= 5;                  // To vertically align text and box
+		if (readout == READOUT_PREDICTED_LAP)
+			LayoutLapTimeText(&overlay_batch, glyph_atlas, readout_value, text_box, text_color, SHADOW_COLOR, 2);
+		else if (readout == READOUT_DISTANCE_GAP)
+			LayoutGapText(&overlay_batch, glyph_atlas, readout_value, text_box, text_color, SHADOW_COLOR, 2);
+		else if (readout == READOUT_ROLLING_DELTA)
+			LayoutDeltaText(&overlay_batch, glyph_atlas, readout_value, text_box, text_color, SHADOW_COLOR, 2);
+		else
+			LayoutDeltaText(&overlay_batch, glyph_atlas, delta, text_box, text_color, SHADOW_COLOR, 2);
+	}
+
+	if (overlay_layout.graph_enabled) {
+		DeltaGraphColors graph_colors;
+		graph_colors.background = D3DCOLOR_RGBA(0x50, 0x50, 0x50, 0xA0);
+		graph_colors.zero_line = D3DCOLOR_RGBA(0xC0, 0xC0, 0xC0, 0xE0);
+		graph_colors.previous_lap = D3DCOLOR_RGBA(0xA0, 0xA0, 0xA0, 0x80);
+		graph_colors.gaining = 0xE0000000 | (COLOR_INTENSITY << 8);
+		graph_colors.losing = 0xE0000000 | (COLOR_INTENSITY << 16);
+		BuildDeltaGraph(&overlay_batch, overlay_layout, engine->delta_graph, graph_colors);
+	}
 
-		RECT time_rect = { 0, 0, TIME_WIDTH, TIME_HEIGHT };
-		D3DXVECTOR3 time_pos;
-		time_pos.x = time_rect_center - TIME_WIDTH / 2.0;
-		time_pos.y = TIME_TOP;
-		time_pos.z = 0;
-		time_rect.right = TIME_WIDTH;
+	if (overlay_layout.map_enabled)
+		BuildTrackMap(&overlay_batch, overlay_layout, &engine->track_map);
 
 #ifdef ENABLE_LOG
-		fprintf(out_file, "[DRAW] delta-box at (%.2f, %.2f) width: %d height: %d value: %.2f\n",
-			time_pos.x, time_pos.y, time_rect.right, time_rect.bottom, delta);
+	fprintf(out_file, "[DRAW] overlay batch: %d quads value: %.2f\n",
+		overlay_batch.num_vertices / OVERLAY_VERTS_PER_QUAD, delta);
 #endif /* ENABLE_LOG */
 
-		bar->Draw(texture, &time_rect, NULL, &time_pos, bar_grey);
-		bar->End();
-
-		FontPosition.left = time_pos.x;
-		FontPosition.top = time_pos.y - 5;   // To vertically align text and box
-		FontPosition.right = FontPosition.left + TIME_WIDTH;
-		FontPosition.bottom = FontPosition.top + TIME_HEIGHT + 5;
-
-		ShadowPosition.left = FontPosition.left + 2;
-		ShadowPosition.top = FontPosition.top + 2;
-		ShadowPosition.right = FontPosition.right;
-		ShadowPosition.bottom = FontPosition.bottom;
-
-		sprintf(lp_deltaBest, "%+2.2f", delta);
-		g_Font->DrawText(NULL, (LPCSTR)lp_deltaBest, -1, &ShadowPosition, DT_CENTER, shadowColor);
-		g_Font->DrawText(NULL, (LPCSTR)lp_deltaBest, -1, &FontPosition,   DT_CENTER, textColor);
-	}
-	else {
-		bar->End();
-	}
-
+	stats.overlay_rebuilds++;
+	overlay_key = key;
+	overlay_key_valid = true;
+	SubmitOverlayBatch(d3d, true);
 }
 
 void DeltaBestPlugin::RenderScreenAfterOverlays(const ScreenInfoV01 &info)
@@ -733,49 +875,65 @@ void DeltaBestPlugin::RenderScreenAfterOverlays(const ScreenInfoV01 &info)
 	return;
 }
 
+/* Font changes need the glyph atlas to be rasterised again */
+static bool SameFont(const PluginConfig &a, const PluginConfig &b)
+{
+	return a.time_font_size == b.time_font_size
+		&& strcmp(a.time_font_name, b.time_font_name) == 0;
+}
+
 void DeltaBestPlugin::RenderScreenBeforeOverlays(const ScreenInfoV01 &info)
 {
+	const ConfigSnapshot &snapshot = *current_config.load();
+	const PluginConfig &config = snapshot.config;
+
+	/* DeltaBest.ini was reloaded, pick up the new layout */
+	if (snapshot.generation != overlay_generation && overlay_generation != 0) {
+		if (! SameFont(config, overlay_config)) {
+			if (texture) {
+				texture->Release();
+				texture = NULL;
+			}
+			CreateOverlayTexture((LPDIRECT3DDEVICE9) info.mDevice, config);
+		}
+		UpdateOverlayLayout(info, config);
+		overlay_generation = snapshot.generation;
+	}
 
 	/* If we're not in realtime, not in green flag, etc...
 	there's no need to display the Delta Best time */
 	if (! NeedToDisplay())
 		return;
 
-	/* Can't draw without a font object */
-	if (g_Font == NULL)
+	/* Can't draw without the overlay texture */
+	if (! glyph_atlas.ready)
 		return;
 
-	double delta = current_delta_best;
-	double diff = current_delta_best - prev_delta_best;
-
-	/* Calculate the new delta best every n ticks
-	and display a suitable value to get there in n ticks */
-	if (render_ticks % render_ticks_int == 0) {
-		prev_delta_best = current_delta_best;
-		current_delta_best = CalculateDeltaBest();
-		diff = current_delta_best - delta;
-		double abs_diff = abs(diff);
-
-		if (abs_diff > 1.0) {
-			delta = current_delta_best;
-		}
-		else {
-			if (config.hires_updates) {
-				render_ticks_int = 16;
-				if (abs_diff > 0.25)
-					render_ticks_int = 1;
-				else if (abs_diff > 0.1)
-					render_ticks_int = 8;
-			}
-			if (abs_diff > 0.01) {
-				delta += diff < 0 ? -0.01 : 0.01;
-			}
-			current_delta_best = delta;
-		}
+	double diff;
+	double delta = DeltaEngineDisplayDelta(engine, config, &diff);
+	double slope = DeltaEngineDeltaSlope(engine);
+	int readout = config.time_readout;
+	double readout_value = 0;
+	if (readout == READOUT_PREDICTED_LAP)
+		readout_value = DeltaEnginePredictedLap(engine);
+	else if (readout == READOUT_DISTANCE_GAP)
+		readout_value = DeltaEngineDistanceGap(engine);
+	else if (readout == READOUT_ROLLING_DELTA)
+		readout_value = DeltaEngineRollingDelta(engine);
+
+	/* Until there's a prediction, and while holding a split, show the delta */
+	if (readout == READOUT_PREDICTED_LAP && readout_value <= 0)
+		readout = READOUT_DELTA;
+
+	/* Hold the split for a few seconds after each timing line */
+	SectorSplit split;
+	if (config.split_seconds > 0 && DeltaEngineLastSplit(engine, config.split_seconds, &split)) {
+		delta = split.delta;
+		slope = 0;
+		readout = READOUT_DELTA;
 	}
 
-	render_ticks++;
-	DrawDeltaBar(info, delta, diff);
+	DrawDeltaBar(info, delta, slope, readout, readout_value);
 }
 
 /* Simple style: negative delta = green, positive delta = red */
@@ -802,15 +960,17 @@ D3DCOLOR DeltaBestPlugin::TextColor(double delta)
 	return text_color;
 }
 
-D3DCOLOR DeltaBestPlugin::BarColor(double delta, double delta_diff)
+/* Red while losing time, green while gaining, by the slope of the
+   delta over the last meters rather than its change between frames */
+D3DCOLOR DeltaBestPlugin::BarColor(double delta, double delta_slope)
 {
 	static const D3DCOLOR ALPHA = 0xE0000000;
-	bool is_gaining = delta_diff > 0;
+	bool is_gaining = delta_slope > 0;
 	D3DCOLOR bar_color = ALPHA;
 	bar_color |= is_gaining ? (COLOR_INTENSITY << 16) : (COLOR_INTENSITY << 8);
 
-	double abs_val = abs(delta_diff);
-	double cutoff_val = 0.02;
+	double abs_val = abs(delta_slope);
+	double cutoff_val = SLOPE_COLOR_CUTOFF;
 
 	if (abs_val <= cutoff_val) {
 		unsigned int col_val = int(COLOR_INTENSITY * (1 / cutoff_val) * (cutoff_val - abs_val));
@@ -825,79 +985,123 @@ D3DCOLOR DeltaBestPlugin::BarColor(double delta, double delta_diff)
 
 void DeltaBestPlugin::PreReset(const ScreenInfoV01 &info)
 {
-	if (g_Font)
-		g_Font->OnLostDevice();
-	if (bar)
-		bar->OnLostDevice();
+	/* The overlay texture is in D3DPOOL_MANAGED, and survives device resets */
+	ReleaseOverlayBuffers();
 }
 
 void DeltaBestPlugin::PostReset(const ScreenInfoV01 &info)
 {
-	if (g_Font)
-		g_Font->OnResetDevice();
-	if (bar)
-		bar->OnResetDevice();
+	CreateOverlayBuffers((LPDIRECT3DDEVICE9) info.mDevice);
+	if (overlay_generation != 0)
+		UpdateOverlayLayout(info, overlay_config);
 }
 
-void DeltaBestPlugin::LoadConfig(struct PluginConfig &config, const char *ini_file)
+/* Called at startup, and by the watcher thread whenever DeltaBest.ini changes */
+void DeltaBestPlugin::ReloadConfig(void *context)
 {
+	IniFile ini;
+	IniLoad(&ini, CONFIG_FILE);
 
-	// [Bar] section
-	config.bar_left = GetPrivateProfileInt("Bar", "Left", 0, ini_file);
-	config.bar_top = GetPrivateProfileInt("Bar", "Top", DEFAULT_BAR_TOP, ini_file);
-	config.bar_width = GetPrivateProfileInt("Bar", "Width", DEFAULT_BAR_WIDTH, ini_file);
-	config.bar_height = GetPrivateProfileInt("Bar", "Height", DEFAULT_BAR_HEIGHT, ini_file);
-	config.bar_gutter = GetPrivateProfileInt("Bar", "Gutter", DEFAULT_BAR_TIME_GUTTER, ini_file);
-	config.bar_enabled = GetPrivateProfileInt("Bar", "Enabled", 1, ini_file) == 1 ? true : false;
+	/* The oldest snapshot of the ring, long retired */
+	ConfigSnapshot *snapshot = &config_snapshots[config_generation % CONFIG_SNAPSHOTS];
+	LoadPluginConfig(snapshot->config, ini);
+	snapshot->generation = ++config_generation;
 
-	// [Time] section
-	config.time_top = GetPrivateProfileInt("Time", "Top", 0, ini_file);
-	config.time_width = GetPrivateProfileInt("Time", "Width", DEFAULT_TIME_WIDTH, ini_file);
-	config.time_height = GetPrivateProfileInt("Time", "Height", DEFAULT_TIME_HEIGHT, ini_file);
-	config.time_font_size = GetPrivateProfileInt("Time", "FontSize", DEFAULT_FONT_SIZE, ini_file);
-	config.time_enabled = GetPrivateProfileInt("Time", "Enabled", 1, ini_file) == 1 ? true : false;
-	config.hires_updates = GetPrivateProfileInt("Time", "HiresUpdates", DEFAULT_HIRES_UPDATES, ini_file) == 1 ? true : false;
-	GetPrivateProfileString("Time", "FontName", DEFAULT_FONT_NAME, config.time_font_name, FONT_NAME_MAXLEN, ini_file);
+	current_config.store(snapshot);
+}
 
-	// [Keyboard] section
-	config.keyboard_magic = GetPrivateProfileInt("Keyboard", "MagicKey", DEFAULT_MAGIC_KEY, ini_file);
-	config.keyboard_reset = GetPrivateProfileInt("Keyboard", "ResetKey", DEFAULT_RESET_KEY, ini_file);
+void DeltaBestPlugin::LoadBestLapCallback(void *context, LapTime *lap,
+	const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
+{
+	((DeltaBestPlugin *) context)->LoadBestLap(lap, scoring, veh);
+	CaptureLap(&capture, lap);
+}
 
+void DeltaBestPlugin::SaveBestLapCallback(void *context, const LapTime *lap,
+	const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
+{
+	((DeltaBestPlugin *) context)->SaveBestLap(lap, scoring, veh);
 }
 
-void DeltaBestPlugin::LoadBestLap(struct LapTime *lap, const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
+long DeltaBestPlugin::ArchiveLapCallback(void *context, const LapTime *lap, bool ended_at_line,
+	const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
 {
-#ifdef ENABLE_LOG
-	fprintf(out_file, "[LOAD] Loading best lap\n");
-#endif /* ENABLE_LOG */
+	return ((DeltaBestPlugin *) context)->ArchiveLap(lap, ended_at_line, scoring, veh);
+}
 
-	/* Get file name for the best lap */
-	const char *szBestLapFile = GetBestLapFileName(scoring, veh);
-	if (szBestLapFile == NULL) {
+void DeltaBestPlugin::LapCompletedCallback(void *context, const CornerMap &corners,
+	const InputTrace &lap, const InputTrace &reference, double lap_time, double reference_time)
+{
+	LapAnalysisSubmit(&lap_analysis, corners, lap, reference, lap_time, reference_time);
+}
+
+void DeltaBestPlugin::NewReferenceCallback(void *context, const LapTime &lap, const InputTrace &inputs,
+	unsigned long reference)
+{
+	if (inputs.bins > 0) {
+		LapAnalysisSegment(&lap_analysis, inputs, reference);
 		return;
 	}
 
-	FILE* fBestLap = fopen(szBestLapFile, "r");
+	InputTraceFromTimes(&loaded_speeds, lap.elapsed, MAX_TRACK_LENGTH);
+	LapAnalysisSegment(&lap_analysis, loaded_speeds, reference);
+}
+
+/* Best lap file of the versions before the archive: "<meters>=<elapsed>"
+   lines, then the calibration and the corners */
+bool DeltaBestPlugin::LoadLegacyBestLap(struct LapTime *lap, const char *path)
+{
+	FILE* fBestLap = fopen(path, "r");
 	if (fBestLap) {
 
 		double final_time = 0.0;
-		unsigned int i = 0, max = sizeof(lap->elapsed) / sizeof(lap->elapsed[0]);
-
-		/* Reset elapsed array to zeros */
-		for (i = 0; i < max; i++) {
-			lap->elapsed[i] = 0.0;
-		}
+		unsigned int max = sizeof(lap->elapsed) / sizeof(lap->elapsed[0]);
+		char line[128];
 
-		i = 0;
-		while (! feof(fBestLap)) {
+		ResetLap(lap);
+		while (fgets(line, sizeof(line), fBestLap) != NULL) {
 			unsigned int meters = -1;
 			double elapsed = 0.0;
-			fscanf(fBestLap, "%u=%lf\n", &meters, &elapsed);
+			float pos_x = 0.0, pos_z = 0.0;
+			unsigned int segment = 0;
+			float scale = 0.0;
+			unsigned int corner = 0;
+			float start = 0.0, apex = 0.0, end = 0.0;
+
+			/* "odometry <segment>=<scale>", the telemetry calibration */
+			if (sscanf(line, "odometry %u=%f", &segment, &scale) == 2) {
+				if (segment < ODOMETRY_SEGMENTS)
+					lap->odometry[segment] = scale;
+				continue;
+			}
+
+			/* "corner <n>=<start> <apex> <end>", in order from 1 */
+			if (sscanf(line, "corner %u=%f %f %f", &corner, &start, &apex, &end) == 4) {
+				unsigned int c = lap->corners.count;
+				if (corner == c + 1 && c < INPUT_MAX_CORNERS) {
+					lap->corners.start[c] = start;
+					lap->corners.apex[c] = apex;
+					lap->corners.end[c] = end;
+					lap->corners.count++;
+				}
+				continue;
+			}
+
+			/* "<meters>=<elapsed>", optionally followed by world X and Z
+			   position (saved since the track map was introduced) */
+			int fields = sscanf(line, "%u=%lf %f %f", &meters, &elapsed, &pos_x, &pos_z);
+			if (fields < 2)
+				continue;
 			if (meters >= 0 && meters < max) {
 				lap->elapsed[meters] = elapsed;
 				if (elapsed > 0.0 && elapsed > final_time) {
 					final_time = elapsed;
 				}
+				if (fields == 4) {
+					lap->pos_x[meters] = pos_x;
+					lap->pos_z[meters] = pos_z;
+					lap->has_positions = true;
+				}
 			}
 			if (meters && meters >= max) {
 				break;
@@ -910,73 +1114,123 @@ void DeltaBestPlugin::LoadBestLap(struct LapTime *lap, const ScoringInfoV01 &sco
 		}
 
 		fclose(fBestLap);
+		lap->final = final_time > 0.0 ? final_time : 0;
+		return true;
+	}
 
-		/* Pretend best lap was achieved at the start of this session */
-		if (final_time > 0.0) {
-			lap->started = scoring.mCurrentET;
-			lap->ended = scoring.mCurrentET;
-			lap->interval_offset = scoring.mCurrentET;
-			lap->final = final_time;
-		}
-		/* Invalid lap? */
-		else {
-			lap->final = NULL;
-		}
+	return false;
+}
 
+void DeltaBestPlugin::LoadBestLap(struct LapTime *lap, const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
+{
 #ifdef ENABLE_LOG
-		fprintf(out_file, "[LOAD] Load from file completed\n");
+	fprintf(out_file, "[LOAD] Loading best lap\n");
 #endif /* ENABLE_LOG */
+
+	/* Get file name for the best lap */
+	const char *szBestLapFile = GetBestLapFileName(scoring, veh);
+	if (szBestLapFile == NULL) {
+		return;
 	}
 
-	else {
+	const PluginConfig &config = current_config.load()->config;
+	LapArchiveIndex index;
+	bool loaded = false;
+
+	if (LapArchiveOpenIndex(&index, archive_base)) {
+		LapArchiveQuery query;
+		query.driver = config.reference_lap == REFERENCE_DRIVER && config.reference_driver[0] != '\0'
+			? config.reference_driver : NULL;
+		query.same_conditions = config.reference_lap == REFERENCE_CONDITIONS;
+		query.raining = (float) scoring.mRaining;
+		query.wetness = (float) scoring.mOnPathWetness;
+		query.track_temp = (float) scoring.mTrackTemp;
+
+		/* Nothing in these conditions or by that driver yet: the fastest lap */
+		long entry = LapArchiveFind(index, query);
+		if (entry < 0 && (query.driver != NULL || query.same_conditions)) {
+			query.driver = NULL;
+			query.same_conditions = false;
+			entry = LapArchiveFind(index, query);
+		}
+
+		loaded = LapArchiveLoad(archive_base, index, entry, lap);
 #ifdef ENABLE_LOG
-		fprintf(out_file, "[LOAD] No file to load or couldn't load from '%s'\n", szBestLapFile);
+		fprintf(out_file, "[LOAD] Lap %ld of %u in the archive '%s'\n", entry, index.count, archive_base);
 #endif /* ENABLE_LOG */
+		LapArchiveCloseIndex(&index);
 	}
-}
 
-bool DeltaBestPlugin::SaveBestLap(const struct LapTime *lap, const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
-{
+	/* No archive yet, start it from the best lap file */
+	else if (LoadLegacyBestLap(lap, szBestLapFile)) {
+		loaded = true;
+		if (lap->final > 0.0) {
+			LapArchiveEntry entry;
+			LapArchiveEntryInit(&entry, true, scoring, veh);
+			entry.flags |= LAP_ARCHIVE_IMPORTED;
+			entry.date = 0;
+			entry.session = -1;
+			lap->archive_entry = LapArchiveAppend(archive_base, *lap, entry);
+		}
+#ifdef ENABLE_LOG
+		fprintf(out_file, "[LOAD] Imported '%s' into the archive '%s'\n", szBestLapFile, archive_base);
+#endif /* ENABLE_LOG */
+	}
 
+	if (! loaded) {
 #ifdef ENABLE_LOG
-	fprintf(out_file, "[SAVE] Saving best lap of %.2f\n", lap->final);
+		fprintf(out_file, "[LOAD] No lap to load from '%s' or '%s'\n", archive_base, szBestLapFile);
 #endif /* ENABLE_LOG */
+		return;
+	}
 
-	/* Get file name for the best lap */
-	const char *szBestLapFile = GetBestLapFileName(scoring, veh);
-	if (szBestLapFile == NULL) {
-		return false;
+	/* Pretend best lap was achieved at the start of this session */
+	if (lap->final > 0.0) {
+		lap->started = scoring.mCurrentET;
+		lap->ended = scoring.mCurrentET;
+		lap->interval_offset = scoring.mCurrentET;
 	}
 
-	FILE* fBestLap = fopen(szBestLapFile, "w");
-	if (fBestLap) {
-		//fprintf(fBestLap, "[Elapsed]\n");
-		unsigned int i = 0, max = sizeof(lap->elapsed) / sizeof(lap->elapsed[0]);
-		for (i = 0; i < max; i++) {
-			/* Occasionally, first few meters of the track
-			   could set elapsed to 0.0, or even negative. */
-			if (i > 100 && lap->elapsed[i] == 0.0) {
-				break;
-			}
-			/* Don't store values greater than official final time.
-			   On restore we'd get a different lap time. */
-			double time_value = min(lap->elapsed[i], lap->final);
-			fprintf(fBestLap, "%d=%f\n", i, time_value);
-		}
-		fclose(fBestLap);
 #ifdef ENABLE_LOG
-		fprintf(out_file, "[SAVE] Write to file completed\n");
+	fprintf(out_file, "[LOAD] Load from file completed\n");
 #endif /* ENABLE_LOG */
+}
+
+/* Every lap is archived as it ends, only the corners of the best lap
+   are left to save, once they are found */
+bool DeltaBestPlugin::SaveBestLap(const struct LapTime *lap, const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
+{
+	if (lap->corners.count == 0 || lap->archive_entry < 0)
 		return true;
-	}
 
-	else {
 #ifdef ENABLE_LOG
-		fprintf(out_file, "[SAVE] Couldn't save to file '%s'\n", szBestLapFile);
+	fprintf(out_file, "[SAVE] Saving %u corners of the best lap of %.2f\n", lap->corners.count, lap->final);
+#endif /* ENABLE_LOG */
+
+	GetBestLapFileName(scoring, veh);
+	if (! LapArchiveSetCorners(archive_base, lap->archive_entry, lap->corners)) {
+#ifdef ENABLE_LOG
+		fprintf(out_file, "[SAVE] Couldn't save to the archive '%s'\n", archive_base);
 #endif /* ENABLE_LOG */
 		return false;
 	}
 
+	return true;
+}
+
+long DeltaBestPlugin::ArchiveLap(const struct LapTime *lap, bool ended_at_line, const ScoringInfoV01 &scoring,
+	const VehicleScoringInfoV01 &veh)
+{
+	LapArchiveEntry entry;
+	LapArchiveEntryInit(&entry, ended_at_line, scoring, veh);
+
+	GetBestLapFileName(scoring, veh);
+	long archived = LapArchiveAppend(archive_base, *lap, entry);
+#ifdef ENABLE_LOG
+	if (archived < 0)
+		fprintf(out_file, "[SAVE] Couldn't archive the lap of %.2f to '%s'\n", lap->final, archive_base);
+#endif /* ENABLE_LOG */
+	return archived;
 }
 
 const char * DeltaBestPlugin::GetBestLapFileName(const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
@@ -984,6 +1238,10 @@ const char * DeltaBestPlugin::GetBestLapFileName(const ScoringInfoV01 &scoring,
 	sprintf(bestlap_dir, BEST_LAP_DIR, GetRF2DataPath());
 	CreateDirectory((LPCSTR) bestlap_dir, NULL);
 	sprintf(bestlap_filename, BEST_LAP_FILE, bestlap_dir, scoring.mTrackName, veh.mVehicleClass);
+	sprintf(archive_base, LAP_ARCHIVE_FILE, bestlap_dir, scoring.mTrackName, veh.mVehicleClass);
+	sprintf(segments_filename, SEGMENT_STATS_FILE, bestlap_dir, scoring.mTrackName, veh.mVehicleClass);
+	strcpy(segments_track, scoring.mTrackName);
+	strcpy(segments_class, veh.mVehicleClass);
 	return bestlap_filename;
 }
 
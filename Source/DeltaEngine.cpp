@@ -0,0 +1,1050 @@
+/*
+rF2 Delta Best Plugin
+
+Delta best engine.
+
+*/
+
+#include "DeltaEngine.hpp"
+#include <math.h>
+#include <string.h>
+
+/* Same rounding the plugin always used, through a float */
+static unsigned int RoundMeters(float x)
+{
+	return (unsigned int) int(floor(x + 0.5));
+}
+
+DeltaEngine *DeltaEngineCreate()
+{
+	DeltaEngine *engine = new DeltaEngine;
+
+	memset(engine, 0, sizeof(*engine));
+	engine->render_ticks_int = 12;
+	engine->telemetry_sector = -1;
+	engine->trend_reference = -1;
+
+	return engine;
+}
+
+void DeltaEngineDestroy(DeltaEngine *engine)
+{
+	delete engine;
+}
+
+void ResetLap(LapTime *lap)
+{
+	if (lap == NULL)
+		return;
+
+	lap->ended = 0;
+	lap->final = 0;
+	lap->started = 0;
+	lap->interval_offset = 0;
+
+	unsigned int i = 0, n = sizeof(lap->elapsed) / sizeof(lap->elapsed[0]);
+	for (i = 0; i < n; i++) {
+		lap->elapsed[i] = 0;
+		lap->pos_x[i] = 0;
+		lap->pos_z[i] = 0;
+	}
+	lap->has_positions = false;
+	lap->sector[0] = lap->sector[1] = 0;
+	memset(lap->odometry, 0, sizeof(lap->odometry));
+	lap->corners.count = 0;
+	lap->archive_entry = -1;
+
+}
+
+void LapTimeIndexBuild(LapTimeIndex *index, const LapTime &lap)
+{
+	index->buckets = index->meters = 0;
+	index->cursor = 0;
+	index->cursor_time = 0;
+	if (lap.final <= 0)
+		return;
+
+	/* Up to the line, where the times stop */
+	unsigned int n = MAX_TRACK_LENGTH;
+	while (n > 1 && lap.elapsed[n - 1] <= 0)
+		n--;
+	if (n < 2)
+		return;
+
+	/* Times are interpolated between updates and may step back a
+	   little: the index goes by the latest time reached so far */
+	double reached = lap.elapsed[0];
+	unsigned int m = 0;
+	unsigned int buckets = (unsigned int) (lap.elapsed[n - 1] / LAP_INDEX_STEP) + 1;
+	if (buckets > LAP_INDEX_BUCKETS)
+		buckets = LAP_INDEX_BUCKETS;
+
+	for (unsigned int b = 0; b < buckets; b++) {
+		double t = b * LAP_INDEX_STEP;
+		while (m + 1 < n && (lap.elapsed[m + 1] > reached ? lap.elapsed[m + 1] : reached) <= t) {
+			m++;
+			if (lap.elapsed[m] > reached)
+				reached = lap.elapsed[m];
+		}
+		index->first[b] = m;
+	}
+
+	index->buckets = buckets;
+	index->meters = n;
+}
+
+double LapTimeIndexDistance(LapTimeIndex *index, const LapTime &lap, double elapsed)
+{
+	if (index->buckets == 0 || elapsed <= 0)
+		return 0;
+
+	/* Went on from the last query, or start over from the bucket */
+	unsigned int m;
+	if (elapsed >= index->cursor_time) {
+		m = index->cursor;
+	}
+	else {
+		unsigned int b = (unsigned int) (elapsed / LAP_INDEX_STEP);
+		m = index->first[b < index->buckets ? b : index->buckets - 1];
+	}
+
+	while (m + 1 < index->meters && lap.elapsed[m + 1] <= elapsed)
+		m++;
+	index->cursor = m;
+	index->cursor_time = elapsed;
+
+	if (m + 1 >= index->meters)
+		return m;
+
+	double span = lap.elapsed[m + 1] - lap.elapsed[m];
+	double fraction = span > 0 ? (elapsed - lap.elapsed[m]) / span : 0;
+	if (fraction < 0)
+		fraction = 0;
+	else if (fraction > 1)
+		fraction = 1;
+	return m + fraction;
+}
+
+static void ClearSlope(DeltaSlope *s)
+{
+	s->first = s->count = 0;
+	s->origin = 0;
+	s->sum_x = s->sum_y = s->sum_xx = s->sum_xy = 0;
+	s->slope = 0;
+}
+
+static void RemoveOldestSample(DeltaSlope *s)
+{
+	double x = s->x[s->first] - s->origin, y = s->y[s->first];
+	s->sum_x -= x;
+	s->sum_y -= y;
+	s->sum_xx -= x * x;
+	s->sum_xy -= x * y;
+	s->first = (s->first + 1) % SLOPE_MAX_SAMPLES;
+	s->count--;
+}
+
+/* One sample per meter driven. The position estimated from the
+   telemetry can be a little ahead of the next scoring update: those
+   steps back are skipped, a new lap starts over. */
+static void AddSlopeSample(DeltaSlope *s, double meters, double delta)
+{
+	if (s->count > 0) {
+		double newest = s->x[(s->first + s->count - 1) % SLOPE_MAX_SAMPLES];
+		if (meters < newest - s->window)
+			ClearSlope(s);
+		else if (meters - newest < 1.0)
+			return;
+	}
+	if (s->count == 0)
+		s->origin = meters;
+
+	while (s->count > 0 && (meters - s->x[s->first] > s->window || s->count == SLOPE_MAX_SAMPLES))
+		RemoveOldestSample(s);
+
+	/* Same sums, relative to the oldest sample */
+	if (meters - s->origin > SLOPE_REBASE && s->count > 0) {
+		double shift = s->x[s->first] - s->origin;
+		s->sum_xx -= 2 * shift * s->sum_x - s->count * shift * shift;
+		s->sum_xy -= shift * s->sum_y;
+		s->sum_x -= s->count * shift;
+		s->origin += shift;
+	}
+
+	double x = meters - s->origin;
+	s->x[(s->first + s->count) % SLOPE_MAX_SAMPLES] = meters;
+	s->y[(s->first + s->count) % SLOPE_MAX_SAMPLES] = delta;
+	s->count++;
+	s->sum_x += x;
+	s->sum_y += delta;
+	s->sum_xx += x * x;
+	s->sum_xy += x * delta;
+
+	double n = s->count;
+	double denominator = n * s->sum_xx - s->sum_x * s->sum_x;
+	if (s->count >= SLOPE_MIN_SAMPLES && denominator > 0)
+		s->slope = 100.0 * (n * s->sum_xy - s->sum_x * s->sum_y) / denominator;
+}
+
+/* Welford's running mean and variance */
+static void AddError(DeltaAccuracy *accuracy, double error)
+{
+	accuracy->count++;
+	double diff = error - accuracy->mean;
+	accuracy->mean += diff / accuracy->count;
+	accuracy->m2 += diff * (error - accuracy->mean);
+	if (fabs(error) > accuracy->max_error)
+		accuracy->max_error = fabs(error);
+}
+
+double DeltaAccuracyStdDev(const DeltaAccuracy &accuracy)
+{
+	return accuracy.count > 1 ? sqrt(accuracy.m2 / (accuracy.count - 1)) : 0;
+}
+
+/* Time of the lap at that meter, or at the last meter before with a time */
+static double LapElapsed(const LapTime &lap, unsigned int meters)
+{
+	if (meters >= MAX_TRACK_LENGTH)
+		meters = MAX_TRACK_LENGTH - 1;
+	while (meters > 0 && lap.elapsed[meters] <= 0)
+		meters--;
+	return lap.elapsed[meters];
+}
+
+/* The current lap ended at the line, the time it lost or gained in each
+   corner of the best lap: two lookups per corner, the last corner ends
+   with the lap times */
+static void UpdateCornerTimes(DeltaEngine *engine)
+{
+	const LapTime &lap = engine->last_lap, &best = engine->best_lap;
+	CornerTimes &times = engine->corner_times;
+
+	if (best.corners.count == 0)
+		return;
+
+	for (unsigned int c = 0; c < best.corners.count; c++) {
+		unsigned int start = (unsigned int) best.corners.start[c];
+		unsigned int end = (unsigned int) best.corners.end[c];
+		bool last = c + 1 == best.corners.count;
+		double lap_time = (last ? lap.final : LapElapsed(lap, end)) - LapElapsed(lap, start);
+		double best_time = (last ? best.final : LapElapsed(best, end)) - LapElapsed(best, start);
+		times.delta[c] = (float) (lap_time - best_time);
+	}
+	times.corners = best.corners;
+	times.lap_time = lap.final;
+	times.reference_time = best.final;
+	times.laps++;
+}
+
+/* The current lap ended at the line, learn the calibration from it */
+static void LearnOdometry(DeltaEngine *engine)
+{
+	for (unsigned int i = 0; i < ODOMETRY_SEGMENTS; i++) {
+		/* Not enough of the segment seen with telemetry */
+		if (engine->lap_odometer[i] < ODOMETRY_SEGMENT_LENGTH / 2)
+			continue;
+
+		float scale = engine->lap_track[i] / engine->lap_odometer[i];
+		if (scale < ODOMETRY_MIN_SCALE || scale > ODOMETRY_MAX_SCALE)
+			continue;
+
+		if (engine->odometry[i] > 0)
+			engine->odometry[i] += (float) ODOMETRY_WEIGHT * (scale - engine->odometry[i]);
+		else
+			engine->odometry[i] = scale;
+	}
+}
+
+static void ClearLapOdometry(DeltaEngine *engine)
+{
+	memset(engine->lap_track, 0, sizeof(engine->lap_track));
+	memset(engine->lap_odometer, 0, sizeof(engine->lap_odometer));
+	engine->odometry_traveled = 0;
+}
+
+static void SetSplit(DeltaEngine *engine, int sector, double delta, double et, bool official)
+{
+	engine->split.sector = sector;
+	engine->split.delta = delta;
+	engine->split.et = et;
+	engine->split.official = official;
+}
+
+bool DeltaEngineLastSplit(const DeltaEngine *engine, double seconds, SectorSplit *split)
+{
+	if (engine->split.sector == 0 || engine->current_et - engine->split.et >= seconds)
+		return false;
+
+	*split = engine->split;
+	return true;
+}
+
+/* The end of a sector was crossed between the last two scoring updates,
+   at split_time into the lap: learn where the sector ends, and fix the
+   time there, interpolated so far, to the official one */
+static void AnchorSplit(DeltaEngine *engine, const PluginConfig &config, int sector,
+	unsigned int from, unsigned int to, double from_time, double to_time, double split_time)
+{
+	if (to <= from || split_time <= from_time || split_time > to_time)
+		return;
+
+	double fraction = (split_time - from_time) / (to_time - from_time);
+	double position = from + fraction * (to - from);
+	double &learned = engine->sector_position[sector];
+	learned = learned > 0 ? learned + SECTOR_POSITION_WEIGHT * (position - learned) : position;
+
+	if (! config.sector_resync)
+		return;
+
+	/* Two straight lines through the official time, instead of one */
+	unsigned int boundary = RoundMeters((float) position);
+	if (boundary <= from || boundary >= to)
+		return;
+	for (unsigned int i = from + 1; i <= boundary; i++)
+		engine->last_lap.elapsed[i] = from_time + (split_time - from_time) * (i - from) / (boundary - from);
+	for (unsigned int i = boundary + 1; i < to; i++)
+		engine->last_lap.elapsed[i] = split_time + (to_time - split_time) * (i - boundary) / (to - boundary);
+}
+
+/* Sectors change at telemetry rate, a few ticks before the scoring
+   update that has the official split. Returns the sector that just
+   ended (0 or 1), -1 if none. */
+static int TelemetrySector(DeltaEngine *engine, const TelemInfoV01 &info)
+{
+	long sector = info.mCurrentSector;
+	long previous = engine->telemetry_sector;
+	engine->telemetry_sector = sector;
+
+	/* Pit lane is in the sign bit */
+	if (sector < 1 || sector > 2 || previous != sector - 1)
+		return -1;
+	if (engine->last_lap.started <= 0.0 || info.mLapStartET != engine->last_lap.started)
+		return -1;
+
+	int ended = sector - 1;
+	double split_time = info.mElapsedTime - info.mLapStartET;
+	if (engine->best_lap.sector[ended] > 0.0)
+		SetSplit(engine, ended + 1, split_time - engine->best_lap.sector[ended], info.mElapsedTime, false);
+
+	return ended;
+}
+
+/* The official delta at a timing line is known: compare the delta
+   calculated at the last update, in the same lap, with it */
+static void CheckEstimate(DeltaEngine *engine, DeltaAccuracy *accuracy, double official_delta)
+{
+	if (! engine->estimate_valid || engine->estimate_lap != engine->last_lap.started)
+		return;
+
+	AddError(accuracy, engine->estimate - official_delta);
+
+	/* Drift is learned from the delta before correction, or the
+	   correction would end up chasing itself. A delta clamped
+	   to 99s tells nothing about the drift. */
+	if (engine->estimate_fraction >= DRIFT_MIN_FRACTION && fabs(engine->estimate_raw) < 99.0) {
+		double rate = (engine->estimate_raw - official_delta) / engine->estimate_fraction;
+		engine->drift_rate += DRIFT_CORRECTION_WEIGHT * (rate - engine->drift_rate);
+	}
+}
+
+static void ResetPrediction(DeltaEngine *engine)
+{
+	engine->predicted_lap = 0;
+	engine->trend = 0;
+	engine->trend_reference = -1;
+	engine->distance_gap = 0;
+	ClearSlope(&engine->delta_slope);
+	engine->rolling_delta = 0;
+	engine->rolling_cursor = 0;
+}
+
+void DeltaEngineStartSession(DeltaEngine *engine)
+{
+	engine->session_started = true;
+	engine->loaded_best_in_session = false;
+	engine->lap_was_timed = false;
+	engine->player_in_pits = false;
+	ResetLap(&engine->last_lap);
+	ResetLap(&engine->best_lap);
+	LapTimeIndexBuild(&engine->best_index, engine->best_lap);
+	InputTraceClear(&engine->last_inputs);
+	InputTraceClear(&engine->best_inputs);
+	engine->reference++;
+	engine->corners_unsaved = false;
+	memset(&engine->corner_times, 0, sizeof(engine->corner_times));
+	SegmentStatsClear(&engine->segment_stats);
+	engine->estimate_valid = false;
+	memset(&engine->line_accuracy, 0, sizeof(engine->line_accuracy));
+	memset(engine->sector_accuracy, 0, sizeof(engine->sector_accuracy));
+	engine->drift_rate = 0;
+	engine->drift_correction = 0;
+	memset(engine->odometry, 0, sizeof(engine->odometry));
+	ClearLapOdometry(engine);
+	engine->sector_position[0] = engine->sector_position[1] = 0;
+	engine->telemetry_sector = -1;
+	memset(&engine->split, 0, sizeof(engine->split));
+	ResetPrediction(engine);
+	DeltaGraphInit(&engine->delta_graph, engine->delta_graph.columns, engine->delta_graph.track_length);
+	TrackMapClear(&engine->track_map);
+}
+
+void DeltaEngineEndSession(DeltaEngine *engine)
+{
+	engine->session_started = false;
+}
+
+void DeltaEngineEnterRealtime(DeltaEngine *engine)
+{
+	engine->in_realtime = true;
+	engine->laps_since_realtime = 0;
+}
+
+void DeltaEngineExitRealtime(DeltaEngine *engine)
+{
+	engine->in_realtime = false;
+
+	/* Reset delta best state */
+	engine->last_pos = 0;
+	engine->prev_lap_dist = 0;
+	engine->current_delta_best = 0;
+	engine->prev_delta_best = 0;
+	engine->estimate_valid = false;
+	engine->telemetry_sector = -1;
+	ResetPrediction(engine);
+	ClearLapOdometry(engine);
+}
+
+void DeltaEngineResetBestLap(DeltaEngine *engine)
+{
+	ResetLap(&engine->best_lap);
+	LapTimeIndexBuild(&engine->best_index, engine->best_lap);
+	InputTraceClear(&engine->best_inputs);
+	engine->reference++;
+	engine->corners_unsaved = false;
+}
+
+bool DeltaEngineSetCorners(DeltaEngine *engine, const CornerMap &corners, unsigned long reference)
+{
+	if (reference != engine->reference || engine->best_lap.final <= 0.0)
+		return false;
+
+	engine->best_lap.corners = corners;
+	engine->corners_unsaved = true;
+	return true;
+}
+
+bool DeltaEngineHasDelta(const DeltaEngine *engine)
+{
+	// If we're in the monitor or replay, or no session has started yet,
+	// no delta best should be displayed
+	if (! engine->in_realtime)
+		return false;
+
+	// If we are in any race/practice phase that's not
+	// green flag, we don't need or want Delta Best displayed
+	if (! engine->green_flag)
+		return false;
+
+	if (engine->player_in_pits)
+		return false;
+
+	/* Don't display anything if current lap isn't timed */
+	if (! engine->lap_was_timed)
+		return false;
+
+	/* We can't display a delta best until we have a best lap recorded */
+	if (! engine->best_lap.final)
+		return false;
+
+	return true;
+}
+
+/* Where we are around the track, in meters, including the distance
+   estimated from the telemetry since the last scoring update */
+static double CurrentPosition(const DeltaEngine *engine)
+{
+	return engine->last_pos + engine->inbtw_scoring_traveled;
+}
+
+static double RawDelta(const DeltaEngine *engine)
+{
+	/* Current position in meters around the track */
+	int m = RoundMeters(CurrentPosition(engine));
+
+	/* By using meters, and backfilling all the missing information,
+	it shouldn't be possible to not have the exact same position in the best lap */
+	double last_time_at_pos = engine->last_lap.elapsed[m];
+	double best_time_at_pos = engine->best_lap.elapsed[m];
+	return last_time_at_pos - best_time_at_pos;
+}
+
+/* Best lap time, plus the delta so far, plus the trend of the delta
+   over the time left in the best lap. Constant time, from the delta
+   just calculated. */
+static void UpdatePrediction(DeltaEngine *engine)
+{
+	double reference = engine->best_lap.elapsed[RoundMeters(CurrentPosition(engine))];
+	double delta = engine->estimate;
+
+	/* New lap, or back from the pits */
+	if (engine->trend_reference < 0 || reference < engine->trend_reference) {
+		engine->trend = 0;
+		engine->trend_reference = reference;
+		engine->trend_delta = delta;
+	}
+	else if (reference - engine->trend_reference >= PREDICTION_TREND_INTERVAL) {
+		double slope = (delta - engine->trend_delta) / (reference - engine->trend_reference);
+		engine->trend += PREDICTION_TREND_WEIGHT * (slope - engine->trend);
+		engine->trend_reference = reference;
+		engine->trend_delta = delta;
+	}
+
+	double remaining = engine->best_lap.final - reference;
+	if (remaining < 0)
+		remaining = 0;
+	engine->predicted_lap = engine->best_lap.final + delta + PREDICTION_TREND_GAIN * engine->trend * remaining;
+}
+
+/* Where the best lap was at the time we are into this lap. The
+   time goes forward with every update, so does the index cursor. */
+static void UpdateDistanceGap(DeltaEngine *engine)
+{
+	double position = CurrentPosition(engine);
+	double elapsed = engine->last_lap.elapsed[RoundMeters(position)];
+	engine->distance_gap = position - LapTimeIndexDistance(&engine->best_index, engine->best_lap, elapsed);
+}
+
+/* Delta at a meter the current lap went through, drift correction included */
+static double DeltaAt(const DeltaEngine *engine, unsigned int m)
+{
+	double delta = engine->last_lap.elapsed[m] - engine->best_lap.elapsed[m];
+	if (engine->drift_correction != 0 && engine->track_length > 0)
+		delta -= engine->drift_correction * m / engine->track_length;
+	return delta;
+}
+
+/* Delta now minus the delta at the start of the window. For a window
+   in seconds, the start follows the current lap with its own cursor,
+   that only ever moves forward during a lap. */
+static void UpdateRollingDelta(DeltaEngine *engine)
+{
+	unsigned int m = RoundMeters(CurrentPosition(engine));
+	unsigned int start = 0;
+
+	if (engine->rolling_seconds > 0) {
+		if (engine->rolling_cursor > engine->last_pos)
+			engine->rolling_cursor = 0;
+
+		/* Times filled in from the telemetry are rewritten by the next
+		   scoring update, the cursor may have to step back a little */
+		double target = engine->last_lap.elapsed[m] - engine->rolling_seconds;
+		while (engine->rolling_cursor > 0 && engine->last_lap.elapsed[engine->rolling_cursor] > target)
+			engine->rolling_cursor--;
+		while (engine->rolling_cursor < engine->last_pos && engine->last_lap.elapsed[engine->rolling_cursor + 1] <= target)
+			engine->rolling_cursor++;
+		start = engine->rolling_cursor;
+	}
+	else if (m > engine->rolling_meters) {
+		start = m - engine->rolling_meters;
+		if (start > engine->last_pos)
+			start = engine->last_pos;
+	}
+
+	engine->rolling_delta = engine->estimate - DeltaAt(engine, start);
+}
+
+/* Remember the delta at this update, to be checked at the next timing line */
+static void UpdateEstimate(DeltaEngine *engine)
+{
+	engine->estimate_valid = DeltaEngineHasDelta(engine);
+	if (! engine->estimate_valid) {
+		ResetPrediction(engine);
+		return;
+	}
+
+	engine->estimate_raw = RawDelta(engine);
+	engine->estimate = DeltaEngineCalculateDelta(engine);
+	engine->estimate_fraction = engine->track_length > 0 ? CurrentPosition(engine) / engine->track_length : 0;
+	engine->estimate_lap = engine->last_lap.started;
+	UpdatePrediction(engine);
+	UpdateDistanceGap(engine);
+	AddSlopeSample(&engine->delta_slope, CurrentPosition(engine), engine->estimate);
+	UpdateRollingDelta(engine);
+}
+
+double DeltaEnginePredictedLap(const DeltaEngine *engine)
+{
+	return engine->estimate_valid ? engine->predicted_lap : 0;
+}
+
+double DeltaEngineDeltaSlope(const DeltaEngine *engine)
+{
+	return engine->estimate_valid ? engine->delta_slope.slope : 0;
+}
+
+double DeltaEngineRollingDelta(const DeltaEngine *engine)
+{
+	return engine->estimate_valid ? engine->rolling_delta : 0;
+}
+
+double DeltaEngineDistanceGap(const DeltaEngine *engine)
+{
+	return engine->estimate_valid ? engine->distance_gap : 0;
+}
+
+void DeltaEngineUpdateScoring(DeltaEngine *engine, const PluginConfig &config, const ScoringInfoV01 &info)
+{
+	/* No scoring updates should take place if we're
+	in the monitor as opposed to the cockpit mode */
+	if (! engine->in_realtime)
+		return;
+
+	/* Update session information, used by DeltaEngineHasDelta() */
+	engine->green_flag = ((info.mGamePhase == GP_GREEN_FLAG)
+		       || (info.mGamePhase == GP_YELLOW_FLAG)
+		       || (info.mGamePhase == GP_SESSION_OVER));
+
+	for (long i = 0; i < info.mNumVehicles; ++i) {
+		VehicleScoringInfoV01 &vinfo = info.mVehicle[i];
+
+		// Player's car? If not, skip
+		if (! vinfo.mIsPlayer || vinfo.mControl != 0)
+			continue;
+
+		engine->player_in_pits = vinfo.mInPits;
+
+#ifdef ENABLE_LOG
+		fprintf(engine->log, "mLapStartET=%.3f mLastLapTime=%.3f mCurrentET=%.3f Elapsed=%.3f mLapDist=%.3f/%.3f prevLapDist=%.3f prevCurrentET=%.3f deltaBest=%+2.2f lastPos=%d prevPos=%d\n",
+			vinfo.mLapStartET,
+			vinfo.mLastLapTime,
+			info.mCurrentET,
+			(info.mCurrentET - vinfo.mLapStartET),
+			vinfo.mLapDist,
+			info.mLapDist,
+			engine->prev_lap_dist,
+			engine->prev_current_et,
+			engine->current_delta_best,
+			engine->last_pos,
+			engine->prev_pos);
+#endif /* ENABLE_LOG */
+
+		if (! engine->loaded_best_in_session) {
+#ifdef ENABLE_LOG
+			fprintf(engine->log, "Trying to load best lap for this session\n");
+#endif
+			if (engine->load_best_lap != NULL)
+				engine->load_best_lap(engine->callback_context, &engine->best_lap, info, vinfo);
+			engine->loaded_best_in_session = true;
+			LapTimeIndexBuild(&engine->best_index, engine->best_lap);
+			InputTraceClear(&engine->best_inputs);
+			engine->reference++;
+
+			/* Start from the calibration saved with the best lap */
+			if (engine->best_lap.final > 0.0)
+				memcpy(engine->odometry, engine->best_lap.odometry, sizeof(engine->odometry));
+
+			/* Saved before corners were found, or by an older version */
+			if (engine->best_lap.final > 0.0 && engine->best_lap.corners.count == 0 && engine->new_reference != NULL)
+				engine->new_reference(engine->callback_context, engine->best_lap, engine->best_inputs, engine->reference);
+		}
+
+		/* Corners of the best lap came in since the last update */
+		if (engine->corners_unsaved) {
+			if (engine->save_best_lap != NULL)
+				engine->save_best_lap(engine->callback_context, &engine->best_lap, info, vinfo);
+			engine->corners_unsaved = false;
+		}
+
+		/* Map of the loaded best lap, or map just enabled in the config */
+		if (config.map_enabled && engine->track_map.num_points == 0 && engine->best_lap.final > 0.0 && engine->best_lap.has_positions)
+			TrackMapBuild(&engine->track_map, engine->best_lap.pos_x, engine->best_lap.pos_z, (unsigned int) info.mLapDist);
+
+		/* Track length is only known here, graph needs it to map distance to columns */
+		unsigned int graph_columns = config.graph_width < DELTA_GRAPH_MAX_COLUMNS ? config.graph_width : DELTA_GRAPH_MAX_COLUMNS;
+		if (config.graph_enabled && (engine->delta_graph.track_length != info.mLapDist
+				|| engine->delta_graph.columns != graph_columns))
+			DeltaGraphInit(&engine->delta_graph, config.graph_width, info.mLapDist);
+
+		/* Check if we started a new lap just now */
+		bool new_lap = (vinfo.mLapStartET != engine->last_lap.started);
+		double curr_lap_dist = vinfo.mLapDist >= 0 ? vinfo.mLapDist : 0;
+
+		/* End of sector 1 or 2 (mSector is 1, 2, then 0 for sector 3):
+		   official times to check the delta against */
+		int anchor_sector = -1;
+		double anchor_time = 0;
+		if (! new_lap && vinfo.mSector != engine->player_sector && engine->last_lap.started > 0.0) {
+			int sector = -1;
+			double official = 0;
+			if (engine->player_sector == 1 && vinfo.mSector == 2) {
+				sector = 0;
+				official = vinfo.mCurSector1;
+			}
+			else if (engine->player_sector == 2 && vinfo.mSector == 0) {
+				sector = 1;
+				official = vinfo.mCurSector2;
+			}
+			if (sector >= 0 && official > 0.0) {
+				engine->last_lap.sector[sector] = official;
+				if (engine->best_lap.sector[sector] > 0.0) {
+					CheckEstimate(engine, &engine->sector_accuracy[sector], official - engine->best_lap.sector[sector]);
+					SetSplit(engine, sector + 1, official - engine->best_lap.sector[sector], vinfo.mLapStartET + official, true);
+				}
+				anchor_sector = sector;
+				anchor_time = official;
+			}
+		}
+		engine->player_sector = vinfo.mSector;
+
+		if (new_lap) {
+
+			/* mLastLapTime is -1 when lap wasn't timed */
+			engine->lap_was_timed = ! (vinfo.mLapStartET == 0.0 && vinfo.mLastLapTime == 0.0);
+
+			if (engine->lap_was_timed) {
+				engine->last_lap.final = vinfo.mLastLapTime;
+				engine->last_lap.ended = info.mCurrentET;
+
+				/* Lap ended at the line: how far off was the delta, against a best lap? */
+				bool ended_at_line = engine->last_lap.final > 0.0
+					&& fabs(vinfo.mLapStartET - engine->last_lap.started - engine->last_lap.final) < LAP_END_TOLERANCE;
+				if (ended_at_line && engine->best_lap.final > 0.0) {
+					CheckEstimate(engine, &engine->line_accuracy, engine->last_lap.final - engine->best_lap.final);
+					SetSplit(engine, 3, engine->last_lap.final - engine->best_lap.final, vinfo.mLapStartET, true);
+				}
+				if (ended_at_line) {
+					LearnOdometry(engine);
+					SegmentStatsAddLap(&engine->segment_stats, engine->last_lap.elapsed, (unsigned int) info.mLapDist,
+						engine->last_lap.final);
+				}
+
+				/* Compare with the best lap, while it's still the best lap */
+				if (ended_at_line && engine->best_lap.final > 0.0)
+					UpdateCornerTimes(engine);
+				if (ended_at_line && engine->best_lap.final > 0.0 && engine->best_inputs.bins > 0
+						&& engine->last_inputs.bins > 0 && engine->lap_completed != NULL)
+					engine->lap_completed(engine->callback_context, engine->best_lap.corners,
+						engine->last_inputs, engine->best_inputs, engine->last_lap.final, engine->best_lap.final);
+
+#ifdef ENABLE_LOG
+				fprintf(engine->log, "New LAP: Last = %.3f, started = %.3f, ended = %.3f interval_offset = %.3f\n",
+					engine->last_lap.final, engine->last_lap.started, engine->last_lap.ended, engine->last_lap.interval_offset);
+#endif /* ENABLE_LOG */
+
+				/* Was it the best lap so far? */
+				/* .final == -1.0 is the first lap of the session, can't be timed */
+				bool valid_timed_lap = engine->last_lap.final > 0.0;
+				bool best_so_far = valid_timed_lap && (
+						(engine->best_lap.final == 0)
+					 || (engine->best_lap.final != 0 && engine->last_lap.final < engine->best_lap.final));
+
+				if (valid_timed_lap) {
+					/**
+					 * Complete the mileage of the last lap.
+                     * This avoids nasty jumps into empty space (+50.xx) when later comparing with best lap.
+					 */
+					for (unsigned int i = engine->last_pos + 1 ; i <= (unsigned int) info.mLapDist; i++) {
+						/* FIXME: Inaccurate. Should extrapolate last interval */
+						engine->last_lap.elapsed[i] = engine->last_lap.elapsed[i - 1];
+						engine->last_lap.pos_x[i] = engine->last_lap.pos_x[i - 1];
+						engine->last_lap.pos_z[i] = engine->last_lap.pos_z[i - 1];
+					}
+
+					memcpy(engine->last_lap.odometry, engine->odometry, sizeof(engine->last_lap.odometry));
+					engine->last_lap.archive_entry = -1;
+					if (engine->archive_lap != NULL)
+						engine->last_lap.archive_entry = engine->archive_lap(engine->callback_context, &engine->last_lap,
+							ended_at_line, info, vinfo);
+				}
+
+				if (best_so_far) {
+#ifdef ENABLE_LOG
+					fprintf(engine->log, "Last lap was the best so far (final time = %.3f, previous best = %.3f)\n",
+						engine->last_lap.final, engine->best_lap.final);
+#endif /* ENABLE_LOG */
+
+					engine->best_lap = engine->last_lap;
+					LapTimeIndexBuild(&engine->best_index, engine->best_lap);
+					InputTraceCopy(&engine->best_inputs, engine->last_inputs);
+					engine->reference++;
+					engine->corners_unsaved = false;
+					if (engine->save_best_lap != NULL)
+						engine->save_best_lap(engine->callback_context, &engine->best_lap, info, vinfo);
+					if (engine->new_reference != NULL)
+						engine->new_reference(engine->callback_context, engine->best_lap, engine->best_inputs, engine->reference);
+
+					/* New reference lap, new map */
+					if (config.map_enabled)
+						TrackMapBuild(&engine->track_map, engine->best_lap.pos_x, engine->best_lap.pos_z, (unsigned int) info.mLapDist);
+				}
+
+#ifdef ENABLE_LOG
+				fprintf(engine->log, "Best LAP yet  = %.3f, started = %.3f, ended = %.3f\n",
+					engine->best_lap.final, engine->best_lap.started, engine->best_lap.ended);
+#endif /* ENABLE_LOG */
+			}
+
+			DeltaGraphNewLap(&engine->delta_graph);
+			TrackMapNewLap(&engine->track_map);
+
+			/* Prepare to archive the new lap. Times left over from the
+			   previous laps would be taken as already filled in below,
+			   and end up in the next best lap. */
+			memset(engine->last_lap.elapsed, 0, sizeof(engine->last_lap.elapsed));
+			engine->last_lap.started = vinfo.mLapStartET;
+			engine->last_lap.final = 0;
+			engine->last_lap.ended = 0;
+			engine->last_lap.interval_offset = info.mCurrentET - vinfo.mLapStartET;
+			engine->last_lap.elapsed[0] = 0;
+			engine->last_lap.has_positions = true;
+			engine->last_lap.sector[0] = engine->last_lap.sector[1] = 0;
+			ClearLapOdometry(engine);
+			InputTraceClear(&engine->last_inputs);
+			engine->last_pos = engine->prev_pos = 0;
+			engine->prev_lap_dist = 0;
+			/* Leave prev_current_et alone, or you have hyper-jumps */
+		}
+
+		/* If there's a lap in progress, save the delta updates */
+		if (engine->last_lap.started > 0.0) {
+			unsigned int meters = RoundMeters(vinfo.mLapDist >= 0 ? vinfo.mLapDist : 0);
+
+			/* It could be that we have stopped our vehicle.
+			In that case (same array position), we want to
+			overwrite the previous value anyway */
+			if (meters >= engine->last_pos) {
+				double distance_traveled = (vinfo.mLapDist - engine->prev_lap_dist);
+				if (distance_traveled < 0)
+					distance_traveled = 0;
+				double time_interval = (info.mCurrentET - engine->prev_current_et);
+
+				/* Telemetry distance against mLapDist progress, for the calibration.
+				   Intervals are a few meters, they go to the segment of their middle. */
+				if (engine->odometry_traveled > 0 && distance_traveled > 0 && ! engine->player_in_pits) {
+					unsigned int segment = (unsigned int) ((engine->prev_lap_dist + vinfo.mLapDist) / 2) / ODOMETRY_SEGMENT_LENGTH;
+					if (segment < ODOMETRY_SEGMENTS) {
+						engine->lap_track[segment] += (float) distance_traveled;
+						engine->lap_odometer[segment] += (float) engine->odometry_traveled;
+					}
+				}
+
+				if (meters == engine->last_pos) {
+					engine->last_lap.elapsed[meters] = info.mCurrentET - vinfo.mLapStartET;
+#ifdef ENABLE_LOG
+					fprintf(engine->log, "[DELTA]     elapsed[%d] = %.3f [same position]\n", meters, engine->last_lap.elapsed[meters]);
+#endif /* ENABLE_LOG */
+				}
+				else {
+					for (unsigned int i = engine->last_pos; i < meters; i++) {
+						/* Elapsed time at this position already filled in by UpdateTelemetry()? */
+						if (engine->last_lap.elapsed[i] > 0.0)
+							continue;
+						/* Linear interpolation of elapsed time in relation to physical position */
+						double interval_fraction = meters == engine->last_pos ? 1.0 : (1.0 * i - engine->last_pos) / (1.0 * meters - engine->last_pos);
+						engine->last_lap.elapsed[i] = engine->prev_current_et + (interval_fraction * time_interval) - vinfo.mLapStartET;
+#ifdef ENABLE_LOG
+						fprintf(engine->log, "[DELTA]     elapsed[%d] = %.3f (interval_fraction=%.3f)\n", i, engine->last_lap.elapsed[i], interval_fraction);
+#endif /* ENABLE_LOG */
+					}
+					engine->last_lap.elapsed[meters] = info.mCurrentET - vinfo.mLapStartET;
+
+					if (anchor_sector >= 0)
+						AnchorSplit(engine, config, anchor_sector, engine->last_pos, meters,
+							engine->prev_current_et - vinfo.mLapStartET, info.mCurrentET - vinfo.mLapStartET, anchor_time);
+				}
+
+#ifdef ENABLE_LOG
+				fprintf(engine->log, "[DELTA] distance_traveled=%.3f time_interval=%.3f [%d .. %d]\n",
+					distance_traveled, time_interval, engine->last_pos, meters);
+#endif /* ENABLE_LOG */
+
+				/* World positions, interpolated the same way as elapsed times */
+				for (unsigned int i = engine->last_pos; i <= meters; i++) {
+					double fraction = meters == engine->last_pos ? 1.0 : (1.0 * i - engine->last_pos) / (1.0 * meters - engine->last_pos);
+					engine->last_lap.pos_x[i] = (float) (engine->prev_world_x + fraction * (vinfo.mPos.x - engine->prev_world_x));
+					engine->last_lap.pos_z[i] = (float) (engine->prev_world_z + fraction * (vinfo.mPos.z - engine->prev_world_z));
+				}
+
+				/* Feed the graph with the delta at every meter filled in above */
+				if (config.graph_enabled && engine->best_lap.final > 0.0) {
+					for (unsigned int i = engine->last_pos; i <= meters; i++)
+						DeltaGraphAdd(&engine->delta_graph, i, engine->last_lap.elapsed[i] - engine->best_lap.elapsed[i]);
+				}
+
+				if (config.map_enabled && engine->best_lap.final > 0.0)
+					TrackMapUpdate(&engine->track_map, engine->last_lap.elapsed, engine->best_lap.elapsed, meters);
+			}
+
+			engine->prev_pos = engine->last_pos;
+			engine->last_pos = meters;
+		}
+
+		if (curr_lap_dist > engine->prev_lap_dist)
+			engine->prev_lap_dist = curr_lap_dist;
+
+		engine->prev_current_et = info.mCurrentET;
+		engine->prev_world_x = vinfo.mPos.x;
+		engine->prev_world_z = vinfo.mPos.z;
+
+		engine->inbtw_scoring_traveled = 0;
+		engine->inbtw_scoring_elapsed = 0;
+		engine->odometry_traveled = 0;
+
+		engine->track_length = info.mLapDist;
+		engine->current_et = info.mCurrentET;
+		engine->drift_correction = config.drift_correction ? engine->drift_rate : 0;
+		engine->delta_slope.window = config.slope_window < SLOPE_MIN_WINDOW ? SLOPE_MIN_WINDOW
+			: config.slope_window < SLOPE_MAX_SAMPLES ? config.slope_window : SLOPE_MAX_SAMPLES - 1;
+		engine->rolling_meters = config.rolling_meters;
+		engine->rolling_seconds = config.rolling_seconds;
+		UpdateEstimate(engine);
+	}
+
+}
+
+/* We use UpdateTelemetry() to gain notable precision in position updates.
+We assume that (-1.0 * LocalVelocity.z) is the forward speed of the
+vehicle, which seems to be confirmed by observed data.
+
+Having forward speed means that with a delta-t we can directly measure
+the distance traveled at 20hz instead of 5hz of UpdateScoring().
+
+We use this data to complete information on vehicle lap progress
+between successive UpdateScoring() calls.
+
+This behaviour can be disabled by the "HiresUpdates=0" option
+in the ini file.
+
+*/
+
+void DeltaEngineUpdateTelemetry(DeltaEngine *engine, const PluginConfig &config, const TelemInfoV01 &info)
+{
+	if (! engine->in_realtime)
+		return;
+
+	engine->current_et = info.mElapsedTime;
+	int sector_ended = TelemetrySector(engine, info);
+
+	if (! config.hires_updates)
+		return;
+
+	double dt = info.mDeltaTime;
+	double forward_speed = - info.mLocalVel.z;
+
+	/* Ignore movement in reverse gear
+	   Causes crashes down the line but don't know why :-| */
+	if (forward_speed <= 0)
+		return;
+
+	double distance = forward_speed * dt;
+	engine->odometry_traveled += distance;
+
+	/* Along the centre of the track, as mLapDist */
+	unsigned int segment = (unsigned int) CurrentPosition(engine) / ODOMETRY_SEGMENT_LENGTH;
+	if (config.odometry_calibration && segment < ODOMETRY_SEGMENTS && engine->odometry[segment] > 0)
+		distance *= engine->odometry[segment];
+
+	/* Not past the line, until the scoring update that starts the next
+	   lap: there's no best lap time to compare with out there. Once at
+	   the line, the time we got there is kept. */
+	double traveled = engine->inbtw_scoring_traveled + distance;
+	double max_traveled = floor(engine->track_length) - engine->last_pos;
+	bool at_line = false;
+	if (engine->track_length > 0 && traveled > max_traveled) {
+		at_line = engine->inbtw_scoring_traveled >= max_traveled;
+		traveled = max_traveled > 0 ? max_traveled : 0;
+	}
+
+	/* Right at the end of a sector: we know where that is */
+	if (sector_ended >= 0 && config.sector_resync) {
+		double boundary = engine->sector_position[sector_ended] - engine->last_pos;
+		if (boundary > 0 && boundary <= max_traveled && fabs(boundary - traveled) < SECTOR_RESYNC_MAX)
+			traveled = boundary;
+	}
+
+	engine->inbtw_scoring_traveled = traveled;
+	engine->inbtw_scoring_elapsed  += dt;
+
+	unsigned int inbtw_pos = RoundMeters(engine->last_pos + engine->inbtw_scoring_traveled);
+	if (inbtw_pos > engine->last_pos && ! at_line) {
+		engine->last_lap.elapsed[inbtw_pos] = engine->last_lap.elapsed[engine->last_pos] + engine->inbtw_scoring_elapsed;
+#ifdef ENABLE_LOG
+		fprintf(engine->log, "\tNEW inbtw pos=%d elapsed=%.3f (last_pos=%d, t=%.3f, acc_t=%.3f)\n",
+			inbtw_pos, engine->inbtw_scoring_elapsed, engine->last_pos, engine->last_lap.elapsed[engine->last_pos], engine->last_lap.elapsed[inbtw_pos]);
+#endif /* ENABLE_LOG */
+	}
+
+	if (! at_line)
+		InputTraceAdd(&engine->last_inputs, CurrentPosition(engine),
+			engine->last_lap.elapsed[engine->last_pos] + engine->inbtw_scoring_elapsed, info);
+
+#ifdef ENABLE_LOG
+	fprintf(engine->log, "\tdt=%.3f fwd_speed=%.3f dist=%.3f inbtw_scoring_traveled=%.3f last_pos(m)=%d\n",
+		dt, forward_speed, distance, engine->inbtw_scoring_traveled, engine->last_pos);
+#endif /* ENABLE_LOG */
+
+	UpdateEstimate(engine);
+}
+
+double DeltaEngineLapDistance(const DeltaEngine *engine)
+{
+	return CurrentPosition(engine);
+}
+
+double DeltaEngineCalculateDelta(const DeltaEngine *engine)
+{
+	/* Shouldn't really happen */
+	if (! engine->best_lap.final)
+		return 0;
+
+	double delta_best = RawDelta(engine);
+
+	/* Take off the drift expected this far into the lap */
+	if (engine->drift_correction != 0 && engine->track_length > 0)
+		delta_best -= engine->drift_correction * CurrentPosition(engine) / engine->track_length;
+
+	if (delta_best > 99.0)
+		delta_best = 99.0;
+	else if (delta_best < -99)
+		delta_best = -99.0;
+
+	return delta_best;
+}
+
+double DeltaEngineDisplayDelta(DeltaEngine *engine, const PluginConfig &config, double *diff_out)
+{
+	double delta = engine->current_delta_best;
+	double diff = engine->current_delta_best - engine->prev_delta_best;
+
+	/* Calculate the new delta best every n ticks
+	and display a suitable value to get there in n ticks */
+	if (engine->render_ticks % engine->render_ticks_int == 0) {
+		engine->prev_delta_best = engine->current_delta_best;
+		engine->current_delta_best = DeltaEngineCalculateDelta(engine);
+		diff = engine->current_delta_best - delta;
+		double abs_diff = fabs(diff);
+
+		if (abs_diff > 1.0) {
+			delta = engine->current_delta_best;
+		}
+		else {
+			if (config.hires_updates) {
+				engine->render_ticks_int = 16;
+				if (abs_diff > 0.25)
+					engine->render_ticks_int = 1;
+				else if (abs_diff > 0.1)
+					engine->render_ticks_int = 8;
+			}
+			if (abs_diff > 0.01) {
+				delta += diff < 0 ? -0.01 : 0.01;
+			}
+			engine->current_delta_best = delta;
+		}
+	}
+
+	engine->render_ticks++;
+
+	*diff_out = diff;
+	return delta;
+}
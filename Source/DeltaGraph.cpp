@@ -0,0 +1,123 @@
+/*
+rF2 Delta Best Plugin
+
+Delta over lap distance graph ("sparkline").
+
+*/
+
+#include "DeltaGraph.hpp"
+
+static void ResetTrace(DeltaGraphTrace *trace)
+{
+	trace->filled = 0;
+}
+
+void DeltaGraphInit(DeltaGraph *graph, unsigned int columns, double track_length)
+{
+	if (columns > DELTA_GRAPH_MAX_COLUMNS)
+		columns = DELTA_GRAPH_MAX_COLUMNS;
+
+	graph->columns = columns;
+	graph->track_length = track_length;
+	graph->current = 0;
+	ResetTrace(&graph->traces[0]);
+	ResetTrace(&graph->traces[1]);
+	graph->version++;
+}
+
+void DeltaGraphNewLap(DeltaGraph *graph)
+{
+	graph->current ^= 1;
+	ResetTrace(&graph->traces[graph->current]);
+	graph->version++;
+}
+
+void DeltaGraphAdd(DeltaGraph *graph, double lap_dist, double delta)
+{
+	if (graph->columns == 0 || graph->track_length <= 0 || lap_dist < 0)
+		return;
+
+	unsigned int column = (unsigned int) (lap_dist * graph->columns / graph->track_length);
+	if (column >= graph->columns)
+		column = graph->columns - 1;
+
+	DeltaGraphTrace *trace = &graph->traces[graph->current];
+	float value = (float) delta;
+
+	/* Car moved into new columns: any skipped column gets this same value */
+	if (column >= trace->filled) {
+		for (unsigned int i = trace->filled; i <= column; i++) {
+			trace->min[i] = value;
+			trace->max[i] = value;
+		}
+		trace->filled = column + 1;
+		graph->version++;
+		return;
+	}
+
+	if (value < trace->min[column]) {
+		trace->min[column] = value;
+		graph->version++;
+	}
+	else if (value > trace->max[column]) {
+		trace->max[column] = value;
+		graph->version++;
+	}
+}
+
+/* Delta value to screen row, clamped to the graph range */
+static float ValueToY(const OverlayLayout &layout, float value)
+{
+	const float half_height = layout.graph_height / 2.0f;
+
+	if (value > layout.graph_range)
+		value = layout.graph_range;
+	else if (value < -layout.graph_range)
+		value = -layout.graph_range;
+
+	/* Positive delta (losing time) goes up */
+	return layout.graph_top + half_height - (value / layout.graph_range) * half_height;
+}
+
+static void AddTrace(OverlayBatch *batch, const OverlayLayout &layout, const DeltaGraphTrace &trace,
+	unsigned int columns, bool colored, const DeltaGraphColors &colors)
+{
+	const float zero_y = ValueToY(layout, 0);
+
+	for (unsigned int i = 0; i < trace.filled && i < columns; i++) {
+		float top = ValueToY(layout, trace.max[i]);
+		float bottom = ValueToY(layout, trace.min[i]);
+
+		/* Fill from the zero line, so the column is visible even when min == max */
+		if (zero_y < top)
+			top = zero_y;
+		if (zero_y > bottom)
+			bottom = zero_y;
+		if (bottom - top < 1)
+			bottom = top + 1;
+
+		unsigned int color = colors.previous_lap;
+		if (colored)
+			color = (trace.max[i] + trace.min[i]) > 0 ? colors.losing : colors.gaining;
+
+		OverlayBatchAddQuad(batch, layout, layout.graph_left + i, top, 1, bottom - top, color);
+	}
+}
+
+void BuildDeltaGraph(OverlayBatch *batch, const OverlayLayout &layout,
+	const DeltaGraph &graph, const DeltaGraphColors &colors)
+{
+	if (! layout.graph_enabled || graph.columns == 0 || layout.graph_range <= 0)
+		return;
+
+	OverlayBatchAddQuad(batch, layout, layout.graph_left, layout.graph_top,
+		(float) graph.columns, layout.graph_height, colors.background);
+
+	if (layout.graph_previous_lap)
+		AddTrace(batch, layout, graph.traces[graph.current ^ 1], graph.columns, false, colors);
+
+	AddTrace(batch, layout, graph.traces[graph.current], graph.columns, true, colors);
+
+	OverlayBatchAddQuad(batch, layout, layout.graph_left, ValueToY(layout, 0),
+		(float) graph.columns, 1, colors.zero_line);
+}
@@ -0,0 +1,77 @@
+/*
+rF2 Delta Best Plugin
+
+Background watcher for changes to a file.
+
+*/
+
+#include "FileWatcher.hpp"
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+
+/* How often the thread looks at the running flag, to stop quickly */
+#define FILE_WATCHER_SLEEP_MS       50
+
+struct FileState {
+	bool exists;
+	time_t mtime;
+	long long size;
+};
+
+static FileState GetFileState(const char *path)
+{
+	FileState state;
+	struct stat st;
+
+	state.exists = stat(path, &st) == 0;
+	state.mtime = state.exists ? st.st_mtime : 0;
+	state.size = state.exists ? (long long) st.st_size : 0;
+	return state;
+}
+
+static bool SameState(const FileState &a, const FileState &b)
+{
+	return a.exists == b.exists && a.mtime == b.mtime && a.size == b.size;
+}
+
+static void WatchFile(FileWatcher *watcher)
+{
+	FileState last = GetFileState(watcher->path);      /* When last called back */
+	FileState previous = last;                          /* At the previous check */
+	unsigned int slept = 0;
+
+	while (watcher->running.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(FILE_WATCHER_SLEEP_MS));
+		slept += FILE_WATCHER_SLEEP_MS;
+		if (slept < FILE_WATCHER_INTERVAL_MS)
+			continue;
+		slept = 0;
+
+		FileState now = GetFileState(watcher->path);
+		if (SameState(now, previous) && ! SameState(now, last)) {
+			last = now;
+			watcher->callback(watcher->context);
+		}
+		previous = now;
+	}
+}
+
+void FileWatcherStart(FileWatcher *watcher, const char *path, FileChangedCallback callback, void *context)
+{
+	FileWatcherStop(watcher);
+
+	strncpy(watcher->path, path, sizeof(watcher->path) - 1);
+	watcher->path[sizeof(watcher->path) - 1] = '\0';
+	watcher->callback = callback;
+	watcher->context = context;
+	watcher->running.store(true);
+	watcher->thread = std::thread(WatchFile, watcher);
+}
+
+void FileWatcherStop(FileWatcher *watcher)
+{
+	watcher->running.store(false);
+	if (watcher->thread.joinable())
+		watcher->thread.join();
+}
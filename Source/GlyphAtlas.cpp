@@ -0,0 +1,194 @@
+/*
+rF2 Delta Best Plugin
+
+Glyph atlas for the delta time readout.
+
+*/
+
+#include "GlyphAtlas.hpp"
+#include <math.h>
+
+int GlyphAtlasIndex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return 3 + (c - '0');
+	if (c == '+')
+		return 0;
+	if (c == '-')
+		return 1;
+	if (c == '.')
+		return 2;
+	if (c == ':')
+		return 13;
+	if (c == 'm')
+		return 14;
+	return -1;
+}
+
+unsigned int GlyphAtlasPack(GlyphAtlas *atlas, const unsigned int widths[GLYPH_ATLAS_NUM_CHARS],
+	unsigned int line_height, unsigned int texture_width, unsigned int top)
+{
+	const unsigned int cell_height = line_height + 2 * GLYPH_ATLAS_PADDING;
+	unsigned int x = 0, y = 0;
+
+	for (unsigned int i = 0; i < GLYPH_ATLAS_NUM_CHARS; i++) {
+		unsigned int cell_width = widths[i] + 2 * GLYPH_ATLAS_PADDING;
+
+		/* Start a new row when this glyph doesn't fit anymore */
+		if (x > 0 && x + cell_width > texture_width) {
+			x = 0;
+			y += cell_height;
+		}
+
+		atlas->glyphs[i].x = (float) (x + GLYPH_ATLAS_PADDING);
+		atlas->glyphs[i].y = (float) (top + y + GLYPH_ATLAS_PADDING);
+		atlas->glyphs[i].width = (float) widths[i];
+		atlas->glyphs[i].height = (float) line_height;
+
+		x += cell_width;
+	}
+
+	return y + cell_height;
+}
+
+unsigned int DeltaToGlyphs(double delta, int glyphs[DELTA_TEXT_MAXLEN])
+{
+	unsigned int n = 0;
+
+	/* Delta is always clamped to +/-99.0 by the caller, the check
+	   is here to never overflow the glyphs array */
+	double abs_delta = fabs(delta);
+	if (abs_delta > 99.99)
+		abs_delta = 99.99;
+
+	/* Like printf(), a negative value rounding to zero keeps its sign */
+	unsigned int hundredths = ReadoutUnits(abs_delta, 100);
+	unsigned int units = hundredths / 100;
+
+	glyphs[n++] = GlyphAtlasIndex(ReadoutNegative(delta) ? '-' : '+');
+	if (units >= 10)
+		glyphs[n++] = GlyphAtlasIndex('0' + units / 10);
+	glyphs[n++] = GlyphAtlasIndex('0' + units % 10);
+	glyphs[n++] = GlyphAtlasIndex('.');
+	glyphs[n++] = GlyphAtlasIndex('0' + (hundredths / 10) % 10);
+	glyphs[n++] = GlyphAtlasIndex('0' + hundredths % 10);
+
+	return n;
+}
+
+unsigned int LapTimeToGlyphs(double seconds, int glyphs[LAP_TIME_TEXT_MAXLEN])
+{
+	unsigned int n = 0;
+
+	if (seconds < 0)
+		seconds = 0;
+	if (seconds > 99 * 60 + 59.99)
+		seconds = 99 * 60 + 59.99;
+
+	unsigned int hundredths = ReadoutUnits(seconds, 100);
+	unsigned int minutes = hundredths / 6000;
+	hundredths %= 6000;
+
+	if (minutes >= 10)
+		glyphs[n++] = GlyphAtlasIndex('0' + minutes / 10);
+	glyphs[n++] = GlyphAtlasIndex('0' + minutes % 10);
+	glyphs[n++] = GlyphAtlasIndex(':');
+	glyphs[n++] = GlyphAtlasIndex('0' + hundredths / 1000);
+	glyphs[n++] = GlyphAtlasIndex('0' + (hundredths / 100) % 10);
+	glyphs[n++] = GlyphAtlasIndex('.');
+	glyphs[n++] = GlyphAtlasIndex('0' + (hundredths / 10) % 10);
+	glyphs[n++] = GlyphAtlasIndex('0' + hundredths % 10);
+
+	return n;
+}
+
+unsigned int GapToGlyphs(double meters, int glyphs[GAP_TEXT_MAXLEN])
+{
+	unsigned int n = 0;
+
+	double abs_meters = fabs(meters);
+	if (abs_meters > 9999)
+		abs_meters = 9999;
+
+	glyphs[n++] = GlyphAtlasIndex(ReadoutNegative(meters) ? '-' : '+');
+
+	unsigned int tenths = ReadoutUnits(abs_meters, 10);
+	if (tenths < 1000) {
+		if (tenths >= 100)
+			glyphs[n++] = GlyphAtlasIndex('0' + tenths / 100);
+		glyphs[n++] = GlyphAtlasIndex('0' + (tenths / 10) % 10);
+		glyphs[n++] = GlyphAtlasIndex('.');
+		glyphs[n++] = GlyphAtlasIndex('0' + tenths % 10);
+	}
+	else {
+		unsigned int units = ReadoutUnits(abs_meters, 1);
+		unsigned int divisor = 1;
+		while (divisor * 10 <= units)
+			divisor *= 10;
+		for (; divisor > 0; divisor /= 10)
+			glyphs[n++] = GlyphAtlasIndex('0' + (units / divisor) % 10);
+	}
+	glyphs[n++] = GlyphAtlasIndex('m');
+
+	return n;
+}
+
+static void AddGlyphs(OverlayBatch *batch, const GlyphAtlas &atlas, const int glyphs[], unsigned int count,
+	float x, float y, unsigned int color)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		const GlyphInfo &g = atlas.glyphs[glyphs[i]];
+		OverlayBatchAddTexturedQuad(batch, x, y, g.width, g.height, color,
+			g.x / atlas.texture_width, g.y / atlas.texture_height,
+			(g.x + g.width) / atlas.texture_width, (g.y + g.height) / atlas.texture_height);
+		x += g.width;
+	}
+}
+
+static void LayoutGlyphs(OverlayBatch *batch, const GlyphAtlas &atlas, const int glyphs[], unsigned int count,
+	const OverlayRect &box, unsigned int color, unsigned int shadow_color, float shadow_offset)
+{
+	float text_width = 0;
+	for (unsigned int i = 0; i < count; i++)
+		text_width += atlas.glyphs[glyphs[i]].width;
+
+	/* Whole pixels, or glyphs get blurred by the texture filtering */
+	float x = floor(box.left + (box.width - text_width) / 2.0f);
+	float y = floor(box.top);
+
+	AddGlyphs(batch, atlas, glyphs, count, x + shadow_offset, y + shadow_offset, shadow_color);
+	AddGlyphs(batch, atlas, glyphs, count, x, y, color);
+}
+
+void LayoutDeltaText(OverlayBatch *batch, const GlyphAtlas &atlas, double delta,
+	const OverlayRect &box, unsigned int color, unsigned int shadow_color, float shadow_offset)
+{
+	if (! atlas.ready)
+		return;
+
+	int glyphs[DELTA_TEXT_MAXLEN];
+	unsigned int count = DeltaToGlyphs(delta, glyphs);
+	LayoutGlyphs(batch, atlas, glyphs, count, box, color, shadow_color, shadow_offset);
+}
+
+void LayoutLapTimeText(OverlayBatch *batch, const GlyphAtlas &atlas, double seconds,
+	const OverlayRect &box, unsigned int color, unsigned int shadow_color, float shadow_offset)
+{
+	if (! atlas.ready)
+		return;
+
+	int glyphs[LAP_TIME_TEXT_MAXLEN];
+	unsigned int count = LapTimeToGlyphs(seconds, glyphs);
+	LayoutGlyphs(batch, atlas, glyphs, count, box, color, shadow_color, shadow_offset);
+}
+
+void LayoutGapText(OverlayBatch *batch, const GlyphAtlas &atlas, double meters,
+	const OverlayRect &box, unsigned int color, unsigned int shadow_color, float shadow_offset)
+{
+	if (! atlas.ready)
+		return;
+
+	int glyphs[GAP_TEXT_MAXLEN];
+	unsigned int count = GapToGlyphs(meters, glyphs);
+	LayoutGlyphs(batch, atlas, glyphs, count, box, color, shadow_color, shadow_offset);
+}
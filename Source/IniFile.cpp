@@ -0,0 +1,136 @@
+/*
+rF2 Delta Best Plugin
+
+Minimal INI file parser.
+
+*/
+
+#include "IniFile.hpp"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* Copies [begin, end) without surrounding blanks, truncating to size */
+static void CopyTrimmed(char *dst, size_t size, const char *begin, const char *end)
+{
+	while (begin < end && IsBlank(*begin))
+		begin++;
+	while (end > begin && IsBlank(end[-1]))
+		end--;
+
+	size_t length = end - begin;
+	if (length >= size)
+		length = size - 1;
+	memcpy(dst, begin, length);
+	dst[length] = '\0';
+}
+
+static bool SameName(const char *a, const char *b)
+{
+	while (*a && tolower((unsigned char) *a) == tolower((unsigned char) *b)) {
+		a++;
+		b++;
+	}
+	return tolower((unsigned char) *a) == tolower((unsigned char) *b);
+}
+
+void IniParse(IniFile *ini, const char *text, size_t length)
+{
+	const char *p = text, *end = text + length;
+	char section[INI_NAME_MAXLEN] = "";
+
+	ini->entries.clear();
+
+	/* UTF-8 byte order mark, as saved by some editors */
+	if (length >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+		p += 3;
+
+	while (p < end) {
+		const char *line_end = (const char *) memchr(p, '\n', end - p);
+		if (line_end == NULL)
+			line_end = end;
+
+		const char *s = p;
+		while (s < line_end && IsBlank(*s))
+			s++;
+
+		if (s < line_end && *s == '[') {
+			const char *close = (const char *) memchr(s, ']', line_end - s);
+			if (close != NULL)
+				CopyTrimmed(section, sizeof(section), s + 1, close);
+		}
+		else if (s < line_end && *s != ';' && section[0] != '\0') {
+			const char *equals = (const char *) memchr(s, '=', line_end - s);
+			if (equals != NULL) {
+				IniEntry entry;
+				strcpy(entry.section, section);
+				CopyTrimmed(entry.key, sizeof(entry.key), s, equals);
+				CopyTrimmed(entry.value, sizeof(entry.value), equals + 1, line_end);
+
+				/* Remove matching quotes around the value */
+				size_t n = strlen(entry.value);
+				if (n >= 2 && (entry.value[0] == '"' || entry.value[0] == '\'')
+					&& entry.value[n - 1] == entry.value[0]) {
+					memmove(entry.value, entry.value + 1, n - 2);
+					entry.value[n - 2] = '\0';
+				}
+
+				if (entry.key[0] != '\0')
+					ini->entries.push_back(entry);
+			}
+		}
+
+		p = line_end + 1;
+	}
+}
+
+bool IniLoad(IniFile *ini, const char *path)
+{
+	ini->entries.clear();
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return false;
+
+	std::vector<char> text(INI_FILE_MAXSIZE);
+	size_t length = fread(&text[0], 1, text.size(), f);
+	fclose(f);
+
+	IniParse(ini, &text[0], length);
+	return true;
+}
+
+static const IniEntry *FindEntry(const IniFile &ini, const char *section, const char *key)
+{
+	for (size_t i = 0; i < ini.entries.size(); i++) {
+		const IniEntry &entry = ini.entries[i];
+		if (SameName(entry.key, key) && SameName(entry.section, section))
+			return &entry;
+	}
+	return NULL;
+}
+
+unsigned int IniGetInt(const IniFile &ini, const char *section, const char *key, unsigned int default_value)
+{
+	const IniEntry *entry = FindEntry(ini, section, key);
+	if (entry == NULL)
+		return default_value;
+
+	long value = strtol(entry->value, NULL, 10);
+	return value > 0 ? (unsigned int) value : 0;
+}
+
+void IniGetString(const IniFile &ini, const char *section, const char *key, const char *default_value,
+	char *value, size_t size)
+{
+	const IniEntry *entry = FindEntry(ini, section, key);
+	const char *s = entry != NULL ? entry->value : default_value;
+
+	CopyTrimmed(value, size, s, s + strlen(s));
+}
@@ -0,0 +1,327 @@
+/*
+rF2 Delta Best Plugin
+
+Driver inputs along the lap, and their comparison per corner.
+
+*/
+
+#include "InputTrace.hpp"
+#include <math.h>
+#include <string.h>
+
+void InputTraceClear(InputTrace *trace)
+{
+	trace->bins = 0;
+}
+
+static void SetBin(InputTrace *trace, unsigned int b, float elapsed, float speed,
+	float throttle, float brake, float steering, float lateral, signed char gear)
+{
+	trace->elapsed[b] = elapsed;
+	trace->speed[b] = speed;
+	trace->throttle[b] = throttle;
+	trace->brake[b] = brake;
+	trace->steering[b] = steering;
+	trace->lateral[b] = lateral;
+	trace->gear[b] = gear;
+}
+
+void InputTraceAdd(InputTrace *trace, double meters, double elapsed, const TelemInfoV01 &info)
+{
+	if (meters < 0)
+		return;
+
+	unsigned int bin = (unsigned int) (meters / INPUT_BIN_LENGTH);
+	if (bin >= INPUT_MAX_BINS || bin + 1 < trace->bins)
+		return;
+
+	const TelemVect3 &v = info.mLocalVel;
+	float speed = (float) sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	float throttle = (float) info.mUnfilteredThrottle;
+	float brake = (float) info.mUnfilteredBrake;
+	float steering = (float) info.mUnfilteredSteering;
+	float lateral = (float) info.mLocalAccel.x;
+	signed char gear = (signed char) info.mGear;
+
+	/* Bins driven through between two samples, with no sample of their own */
+	if (bin >= trace->bins) {
+		for (unsigned int b = trace->bins; b < bin; b++) {
+			SetBin(trace, b, (float) elapsed, speed, throttle, brake, steering, lateral, gear);
+			trace->samples[b] = 0;
+		}
+		trace->samples[bin] = 0;
+		trace->bins = bin + 1;
+	}
+
+	/* Running mean of the samples in the bin */
+	unsigned short n = trace->samples[bin];
+	if (n < 0xFFFF)
+		n++;
+	trace->samples[bin] = n;
+	if (n == 1) {
+		SetBin(trace, bin, (float) elapsed, speed, throttle, brake, steering, lateral, gear);
+		return;
+	}
+
+	float weight = 1.0f / n;
+	trace->elapsed[bin] = (float) elapsed;
+	trace->speed[bin] += (speed - trace->speed[bin]) * weight;
+	trace->throttle[bin] += (throttle - trace->throttle[bin]) * weight;
+	trace->brake[bin] += (brake - trace->brake[bin]) * weight;
+	trace->steering[bin] += (steering - trace->steering[bin]) * weight;
+	trace->lateral[bin] += (lateral - trace->lateral[bin]) * weight;
+	trace->gear[bin] = gear;
+}
+
+void InputTraceCopy(InputTrace *to, const InputTrace &from)
+{
+	unsigned int n = from.bins;
+	memcpy(to->elapsed, from.elapsed, n * sizeof(from.elapsed[0]));
+	memcpy(to->speed, from.speed, n * sizeof(from.speed[0]));
+	memcpy(to->throttle, from.throttle, n * sizeof(from.throttle[0]));
+	memcpy(to->brake, from.brake, n * sizeof(from.brake[0]));
+	memcpy(to->steering, from.steering, n * sizeof(from.steering[0]));
+	memcpy(to->lateral, from.lateral, n * sizeof(from.lateral[0]));
+	memcpy(to->gear, from.gear, n * sizeof(from.gear[0]));
+	memcpy(to->samples, from.samples, n * sizeof(from.samples[0]));
+	to->bins = n;
+}
+
+void InputTraceFromTimes(InputTrace *trace, const double *elapsed, unsigned int meters)
+{
+	trace->bins = 0;
+
+	/* Up to the line, where the times stop */
+	while (meters > 1 && elapsed[meters - 1] <= 0)
+		meters--;
+	unsigned int n = meters / INPUT_BIN_LENGTH;
+	if (n > INPUT_MAX_BINS)
+		n = INPUT_MAX_BINS;
+	if (n < 2)
+		return;
+
+	/* Times only change at every scoring update: speeds over a few
+	   of them, around the middle of the bin */
+	float speed = 0;
+	for (unsigned int b = 0; b < n; b++) {
+		unsigned int m = b * INPUT_BIN_LENGTH + INPUT_BIN_LENGTH / 2;
+		unsigned int from = m > TIMES_SPEED_METERS / 2 ? m - TIMES_SPEED_METERS / 2 : 0;
+		unsigned int to = m + TIMES_SPEED_METERS / 2 < meters ? m + TIMES_SPEED_METERS / 2 : meters - 1;
+		double dt = elapsed[to] - elapsed[from];
+		if (dt > 0)
+			speed = (float) ((to - from) / dt);
+		SetBin(trace, b, (float) elapsed[(b + 1) * INPUT_BIN_LENGTH - 1], speed, 0, 0, 0, 0, 0);
+		trace->samples[b] = 1;
+	}
+	trace->bins = n;
+}
+
+/* The loops below only read one contiguous array each, with no
+   dependency between iterations but the running minimum or maximum */
+
+static float MinValue(const float *x, unsigned int from, unsigned int to)
+{
+	float m = x[from];
+	for (unsigned int i = from + 1; i < to; i++)
+		m = x[i] < m ? x[i] : m;
+	return m;
+}
+
+static float MaxValue(const float *x, unsigned int from, unsigned int to)
+{
+	float m = x[from];
+	for (unsigned int i = from + 1; i < to; i++)
+		m = x[i] > m ? x[i] : m;
+	return m;
+}
+
+/* First index in [from, to) with x[i] >= value, or to if none */
+static unsigned int FirstAtLeast(const float *x, unsigned int from, unsigned int to, float value)
+{
+	for (unsigned int i = from; i < to; i++) {
+		if (x[i] >= value)
+			return i;
+	}
+	return to;
+}
+
+/* First index in [from, to) with x[i] <= value, or to if none */
+static unsigned int FirstAtMost(const float *x, unsigned int from, unsigned int to, float value)
+{
+	for (unsigned int i = from; i < to; i++) {
+		if (x[i] <= value)
+			return i;
+	}
+	return to;
+}
+
+static unsigned int MinIndex(const float *x, unsigned int from, unsigned int to)
+{
+	return FirstAtMost(x, from, to, MinValue(x, from, to));
+}
+
+static unsigned int MaxIndex(const float *x, unsigned int from, unsigned int to)
+{
+	return FirstAtLeast(x, from, to, MaxValue(x, from, to));
+}
+
+/* Whether the car turned anywhere in the trace */
+static bool HasTurning(const InputTrace &trace, unsigned int n)
+{
+	return MaxValue(trace.lateral, 0, n) > 0 || MinValue(trace.lateral, 0, n) < 0
+		|| MaxValue(trace.steering, 0, n) > 0 || MinValue(trace.steering, 0, n) < 0;
+}
+
+static bool Turning(const InputTrace &trace, unsigned int i)
+{
+	return fabs(trace.lateral[i]) >= CORNER_LATERAL_ON || fabs(trace.steering[i]) >= CORNER_STEERING_ON;
+}
+
+/* Slowest point of every stretch of the trace where the car turns */
+static unsigned int FindTurns(const InputTrace &trace, unsigned int n, unsigned int apexes[])
+{
+	unsigned int count = 0, i = 0;
+
+	while (i < n && count < INPUT_MAX_CORNERS) {
+		if (! Turning(trace, i)) {
+			i++;
+			continue;
+		}
+
+		/* Until it stops turning for CORNER_MERGE_BINS */
+		unsigned int last = i, j;
+		for (j = i + 1; j < n && j - last < CORNER_MERGE_BINS; j++) {
+			if (Turning(trace, j))
+				last = j;
+		}
+
+		if (last + 1 - i >= CORNER_MIN_BINS)
+			apexes[count++] = MinIndex(trace.speed, i, last + 1);
+		i = j;
+	}
+
+	return count;
+}
+
+/* Slowest points over CORNER_APEX_BINS on either side, well below the
+   fastest point since the previous one, for traces with speeds only */
+static unsigned int FindSpeedMinima(const InputTrace &trace, unsigned int n, unsigned int apexes[])
+{
+	const float *speed = trace.speed;
+	unsigned int count = 0, last_apex = 0;
+
+	for (unsigned int i = CORNER_APEX_BINS; i + CORNER_APEX_BINS < n && count < INPUT_MAX_CORNERS; i++) {
+		if (MinIndex(speed, i - CORNER_APEX_BINS, i + CORNER_APEX_BINS + 1) != i)
+			continue;
+		if (speed[i] > (1.0f - CORNER_MIN_DROP) * MaxValue(speed, last_apex, i))
+			continue;
+
+		apexes[count++] = i;
+		last_apex = i;
+		i += CORNER_APEX_BINS;
+	}
+
+	return count;
+}
+
+unsigned int FindCorners(const InputTrace &reference, CornerMap *map)
+{
+	map->count = 0;
+
+	unsigned int n = reference.bins;
+	if (n < 2 * CORNER_APEX_BINS + 1)
+		return 0;
+
+	unsigned int apexes[INPUT_MAX_CORNERS];
+	unsigned int count = HasTurning(reference, n) ? FindTurns(reference, n, apexes) : FindSpeedMinima(reference, n, apexes);
+
+	/* From the fastest point since the previous corner */
+	unsigned int previous = 0;
+	for (unsigned int c = 0; c < count; c++) {
+		map->start[c] = (float) (MaxIndex(reference.speed, previous, apexes[c] + 1) * INPUT_BIN_LENGTH);
+		map->apex[c] = (float) (apexes[c] * INPUT_BIN_LENGTH);
+		previous = apexes[c];
+	}
+	for (unsigned int c = 0; c < count; c++)
+		map->end[c] = c + 1 < count ? map->start[c + 1] : (float) ((n - 1) * INPUT_BIN_LENGTH);
+
+	map->count = count;
+	return count;
+}
+
+/* Where the trace braked, was slowest and got back on the throttle, in
+   [start, end), and how much it steered at most into the corner */
+struct CornerInputs {
+	unsigned int brake;
+	unsigned int slowest;
+	unsigned int throttle;
+	float steering;
+};
+
+static void GetCornerInputs(const InputTrace &trace, unsigned int start, unsigned int apex,
+	unsigned int end, CornerInputs *inputs)
+{
+	inputs->brake = FirstAtLeast(trace.brake, start, apex + 1, INPUT_BRAKE_ON);
+	inputs->slowest = MinIndex(trace.speed, start, end);
+	inputs->throttle = FirstAtLeast(trace.throttle, inputs->slowest, end, INPUT_THROTTLE_ON);
+
+	/* Steering to the left is negative */
+	float left = -MinValue(trace.steering, start, apex + 1);
+	float right = MaxValue(trace.steering, start, apex + 1);
+	inputs->steering = left > right ? left : right;
+}
+
+unsigned int CompareInputTraces(const CornerMap &map, const InputTrace &reference, const InputTrace &lap,
+	InputComparison *comparison)
+{
+	comparison->count = 0;
+
+	CornerMap found;
+	const CornerMap *corners = &map;
+	if (map.count == 0) {
+		FindCorners(reference, &found);
+		corners = &found;
+	}
+
+	/* A lap with no inputs at all, f.ex. with HiresUpdates turned off during the lap */
+	unsigned int n = reference.bins < lap.bins ? reference.bins : lap.bins;
+	unsigned int count = 0;
+	if (n < 2)
+		return 0;
+
+	for (unsigned int c = 0; c < corners->count; c++) {
+		unsigned int start = (unsigned int) corners->start[c] / INPUT_BIN_LENGTH;
+		unsigned int apex = (unsigned int) corners->apex[c] / INPUT_BIN_LENGTH;
+		unsigned int end = (unsigned int) corners->end[c] / INPUT_BIN_LENGTH;
+
+		/* Past where one of the laps stops */
+		if (end >= n)
+			end = n - 1;
+		if (apex >= end)
+			break;
+
+		CornerInputs ref, cur;
+		GetCornerInputs(reference, start, apex, end, &ref);
+		GetCornerInputs(lap, start, apex, end, &cur);
+
+		InputCorner &corner = comparison->corners[c];
+		corner.start = corners->start[c];
+		corner.apex = corners->apex[c];
+		corner.end = corners->end[c];
+		corner.time_delta = (lap.elapsed[end] - lap.elapsed[start]) - (reference.elapsed[end] - reference.elapsed[start]);
+		corner.min_speed = lap.speed[cur.slowest] - reference.speed[ref.slowest];
+		corner.gear = lap.gear[cur.slowest];
+		corner.reference_gear = reference.gear[ref.slowest];
+
+		corner.braked = cur.brake <= apex && ref.brake <= apex;
+		corner.brake_point = corner.braked ? ((float) cur.brake - (float) ref.brake) * INPUT_BIN_LENGTH : 0;
+		corner.throttled = cur.throttle < end && ref.throttle < end;
+		corner.throttle_point = corner.throttled ? ((float) cur.throttle - (float) ref.throttle) * INPUT_BIN_LENGTH : 0;
+		corner.steered = cur.steering > 0 && ref.steering > 0;
+		corner.steering = corner.steered ? cur.steering - ref.steering : 0;
+		count++;
+	}
+
+	comparison->count = count;
+	return count;
+}
@@ -0,0 +1,180 @@
+/*
+rF2 Delta Best Plugin
+
+Background comparison of the driver inputs of each lap.
+
+*/
+
+#include "LapAnalysis.hpp"
+#include <string.h>
+#include <chrono>
+
+static void AnalyzeLaps(LapAnalysis *analysis)
+{
+	for (;;) {
+		/* Before looking at the jobs, so that those submitted before LapAnalysisStop() are done */
+		bool running = analysis->running.load();
+
+		/* Best laps first, the next comparison may need their corners */
+		bool have_segment = false;
+		unsigned long reference = 0;
+		{
+			std::lock_guard<std::mutex> guard(analysis->lock);
+			if (analysis->segment_pending) {
+				InputTrace *trace = analysis->segment_working;
+				analysis->segment_working = analysis->segment_submitted;
+				analysis->segment_submitted = trace;
+				reference = analysis->segment_reference;
+				analysis->segment_pending = false;
+				have_segment = true;
+			}
+		}
+
+		if (have_segment) {
+			CornerMap corners;
+			FindCorners(*analysis->segment_working, &corners);
+
+			std::lock_guard<std::mutex> guard(analysis->lock);
+			analysis->corners = corners;
+			analysis->corners_reference = reference;
+			analysis->corners_version++;
+			continue;
+		}
+
+		bool have_job = false;
+		{
+			std::lock_guard<std::mutex> guard(analysis->lock);
+			if (analysis->pending) {
+				LapAnalysisJob job = analysis->working;
+				analysis->working = analysis->submitted;
+				analysis->submitted = job;
+				analysis->pending = false;
+				have_job = true;
+			}
+		}
+
+		if (have_job) {
+			InputComparison result;
+			CompareInputTraces(analysis->working.corners, *analysis->working.reference, *analysis->working.lap, &result);
+			result.lap_time = analysis->working.lap_time;
+			result.reference_time = analysis->working.reference_time;
+
+			std::lock_guard<std::mutex> guard(analysis->lock);
+			analysis->result = result;
+			analysis->version++;
+			continue;
+		}
+
+		if (! running)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(LAP_ANALYSIS_POLL_MS));
+	}
+}
+
+static void AllocateJob(LapAnalysisJob *job)
+{
+	job->lap = new InputTrace;
+	job->reference = new InputTrace;
+	job->lap->bins = job->reference->bins = 0;
+}
+
+static void FreeJob(LapAnalysisJob *job)
+{
+	delete job->lap;
+	delete job->reference;
+	job->lap = job->reference = NULL;
+}
+
+void LapAnalysisStart(LapAnalysis *analysis)
+{
+	if (analysis->running.load())
+		return;
+
+	AllocateJob(&analysis->submitted);
+	AllocateJob(&analysis->working);
+	analysis->pending = false;
+	memset(&analysis->result, 0, sizeof(analysis->result));
+	analysis->version = 0;
+	analysis->segment_submitted = new InputTrace;
+	analysis->segment_working = new InputTrace;
+	analysis->segment_submitted->bins = analysis->segment_working->bins = 0;
+	analysis->segment_pending = false;
+	analysis->corners.count = 0;
+	analysis->corners_reference = 0;
+	analysis->corners_version = 0;
+	analysis->submitted_count = 0;
+	analysis->dropped = 0;
+
+	analysis->running.store(true);
+	analysis->thread = std::thread(AnalyzeLaps, analysis);
+}
+
+void LapAnalysisStop(LapAnalysis *analysis)
+{
+	analysis->running.store(false);
+	if (! analysis->thread.joinable())
+		return;
+
+	analysis->thread.join();
+	FreeJob(&analysis->submitted);
+	FreeJob(&analysis->working);
+	delete analysis->segment_submitted;
+	delete analysis->segment_working;
+	analysis->segment_submitted = analysis->segment_working = NULL;
+}
+
+void LapAnalysisSubmit(LapAnalysis *analysis, const CornerMap &corners, const InputTrace &lap,
+	const InputTrace &reference, double lap_time, double reference_time)
+{
+	if (! analysis->running.load(std::memory_order_relaxed))
+		return;
+
+	std::lock_guard<std::mutex> guard(analysis->lock);
+	if (analysis->pending)
+		analysis->dropped++;
+
+	analysis->submitted.corners = corners;
+	InputTraceCopy(analysis->submitted.lap, lap);
+	InputTraceCopy(analysis->submitted.reference, reference);
+	analysis->submitted.lap_time = lap_time;
+	analysis->submitted.reference_time = reference_time;
+	analysis->pending = true;
+	analysis->submitted_count++;
+}
+
+bool LapAnalysisLatest(LapAnalysis *analysis, InputComparison *result, unsigned long *version)
+{
+	std::lock_guard<std::mutex> guard(analysis->lock);
+	if (analysis->version == *version)
+		return false;
+
+	*result = analysis->result;
+	*version = analysis->version;
+	return true;
+}
+
+void LapAnalysisSegment(LapAnalysis *analysis, const InputTrace &reference, unsigned long id)
+{
+	if (! analysis->running.load(std::memory_order_relaxed))
+		return;
+
+	std::lock_guard<std::mutex> guard(analysis->lock);
+	if (analysis->segment_pending)
+		analysis->dropped++;
+
+	InputTraceCopy(analysis->segment_submitted, reference);
+	analysis->segment_reference = id;
+	analysis->segment_pending = true;
+}
+
+bool LapAnalysisCorners(LapAnalysis *analysis, CornerMap *corners, unsigned long *reference, unsigned long *version)
+{
+	std::lock_guard<std::mutex> guard(analysis->lock);
+	if (analysis->corners_version == *version)
+		return false;
+
+	*corners = analysis->corners;
+	*reference = analysis->corners_reference;
+	*version = analysis->corners_version;
+	return true;
+}
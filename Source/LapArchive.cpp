@@ -0,0 +1,444 @@
+/*
+rF2 Delta Best Plugin
+
+Archive of all the laps driven, per track and vehicle class.
+
+*/
+
+#include "LapArchive.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Part of a file, mapped read-only */
+struct MappedFile {
+	const char *data;           /* At the offset asked for */
+	const void *view;           /* Start of the mapping, aligned */
+	size_t view_size;
+	uint64_t file_size;
+	void *file;
+	void *mapping;
+};
+
+/* Maps length bytes at offset, the whole file if length is 0. Fails
+   if the file is shorter than that. */
+static bool MapFile(MappedFile *mapped, const char *path, uint64_t offset, size_t length)
+{
+	memset(mapped, 0, sizeof(*mapped));
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (! GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		return false;
+	}
+	uint64_t size = (uint64_t) file_size.QuadPart;
+	if (length == 0)
+		length = (size_t) (size > offset ? size - offset : 0);
+	if (length == 0 || offset + length > size) {
+		CloseHandle(file);
+		return false;
+	}
+
+	/* Views start at a multiple of the allocation granularity */
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	uint64_t start = offset - offset % system_info.dwAllocationGranularity;
+	size_t view_size = (size_t) (offset - start) + length;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD) (start >> 32), (DWORD) start, view_size);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	mapped->file = file;
+	mapped->mapping = mapping;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	uint64_t size = (uint64_t) st.st_size;
+	if (length == 0)
+		length = (size_t) (size > offset ? size - offset : 0);
+
+	/* Past the end of the file would be a bus error, not a short read */
+	if (length == 0 || offset + length > size) {
+		close(fd);
+		return false;
+	}
+
+	uint64_t page = (uint64_t) sysconf(_SC_PAGESIZE);
+	uint64_t start = offset - offset % page;
+	size_t view_size = (size_t) (offset - start) + length;
+
+	/* The mapping stays valid once the descriptor is closed */
+	void *view = mmap(NULL, view_size, PROT_READ, MAP_SHARED, fd, (off_t) start);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+#endif
+
+	mapped->view = view;
+	mapped->view_size = view_size;
+	mapped->file_size = size;
+	mapped->data = (const char *) view + (offset - start);
+	return true;
+}
+
+static void UnmapFile(MappedFile *mapped)
+{
+	if (mapped->view == NULL)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapped->view);
+	CloseHandle((HANDLE) mapped->mapping);
+	CloseHandle((HANDLE) mapped->file);
+#else
+	munmap((void *) mapped->view, mapped->view_size);
+#endif
+	memset(mapped, 0, sizeof(*mapped));
+}
+
+static bool SeekTo(FILE *file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t SeekEnd(FILE *file)
+{
+#ifdef _WIN32
+	_fseeki64(file, 0, SEEK_END);
+	return (uint64_t) _ftelli64(file);
+#else
+	fseeko(file, 0, SEEK_END);
+	return (uint64_t) ftello(file);
+#endif
+}
+
+static bool ArchivePath(char *path, const char *base, const char *extension)
+{
+	if (strlen(base) + strlen(extension) >= FILENAME_MAX)
+		return false;
+	sprintf(path, "%s%s", base, extension);
+	return true;
+}
+
+static bool HeaderMatches(const LapArchiveHeader &header, const char *magic)
+{
+	return memcmp(header.magic, magic, sizeof(header.magic)) == 0
+		&& header.version == LAP_ARCHIVE_VERSION
+		&& header.entry_size == sizeof(LapArchiveEntry);
+}
+
+/* Opens the file to append to, writing the header if it's new. Leaves
+   it positioned at the end, and tells where that is. */
+static FILE *OpenForAppend(const char *path, const char *magic, uint64_t *end)
+{
+	FILE *file = fopen(path, "a+b");
+	if (file == NULL)
+		return NULL;
+
+	LapArchiveHeader header;
+	uint64_t size = SeekEnd(file);
+	if (size == 0) {
+		memcpy(header.magic, magic, sizeof(header.magic));
+		header.version = LAP_ARCHIVE_VERSION;
+		header.entry_size = sizeof(LapArchiveEntry);
+		if (fwrite(&header, sizeof(header), 1, file) != 1) {
+			fclose(file);
+			return NULL;
+		}
+		size = sizeof(header);
+	}
+	else if (! SeekTo(file, 0) || fread(&header, sizeof(header), 1, file) != 1 || ! HeaderMatches(header, magic)) {
+		fclose(file);
+		return NULL;
+	}
+
+	*end = SeekEnd(file);
+	if (*end != size) {
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+static uint32_t LapSize(uint32_t meters, uint32_t flags)
+{
+	uint32_t size = meters * sizeof(double);
+	if (flags & LAP_ARCHIVE_POSITIONS)
+		size += 2 * meters * sizeof(float);
+	if (flags & LAP_ARCHIVE_ODOMETRY)
+		size += ODOMETRY_SEGMENTS * sizeof(float);
+	return size;
+}
+
+static bool WriteCorners(FILE *file, const CornerMap &corners)
+{
+	unsigned int n = corners.count;
+	return fwrite(corners.start, sizeof(corners.start[0]), n, file) == n
+		&& fwrite(corners.apex, sizeof(corners.apex[0]), n, file) == n
+		&& fwrite(corners.end, sizeof(corners.end[0]), n, file) == n;
+}
+
+void LapArchiveEntryInit(LapArchiveEntry *entry, bool ended_at_line, const ScoringInfoV01 &scoring,
+	const VehicleScoringInfoV01 &veh)
+{
+	memset(entry, 0, sizeof(*entry));
+	entry->flags = ended_at_line ? LAP_ARCHIVE_VALID : 0;
+	entry->date = (int64_t) time(NULL);
+	entry->session = scoring.mSession;
+	entry->raining = (float) scoring.mRaining;
+	entry->wetness = (float) scoring.mOnPathWetness;
+	entry->ambient_temp = (float) scoring.mAmbientTemp;
+	entry->track_temp = (float) scoring.mTrackTemp;
+	memcpy(entry->driver, veh.mDriverName, sizeof(entry->driver) - 1);
+}
+
+long LapArchiveAppend(const char *base, const LapTime &lap, const LapArchiveEntry &info)
+{
+	char path[FILENAME_MAX];
+	LapArchiveEntry entry = info;
+
+	/* Only up to the last meter driven, as in a capture */
+	unsigned int meters = MAX_TRACK_LENGTH;
+	while (meters > 0 && lap.elapsed[meters - 1] == 0 && lap.pos_x[meters - 1] == 0 && lap.pos_z[meters - 1] == 0)
+		meters--;
+
+	entry.lap_time = lap.final;
+	entry.sector[0] = lap.sector[0];
+	entry.sector[1] = lap.sector[1];
+	entry.meters = meters;
+	entry.flags = info.flags & (LAP_ARCHIVE_VALID | LAP_ARCHIVE_IMPORTED);
+	if (lap.has_positions)
+		entry.flags |= LAP_ARCHIVE_POSITIONS;
+	for (unsigned int i = 0; i < ODOMETRY_SEGMENTS && ! (entry.flags & LAP_ARCHIVE_ODOMETRY); i++) {
+		if (lap.odometry[i] > 0)
+			entry.flags |= LAP_ARCHIVE_ODOMETRY;
+	}
+	entry.size = LapSize(meters, entry.flags);
+	entry.corners_offset = 0;
+	entry.corners = 0;
+	entry.reserved = 0;
+
+	/* The lap first: if anything fails after that, it's only unused bytes */
+	uint64_t end;
+	FILE *data = ArchivePath(path, base, LAP_ARCHIVE_DATA_EXT) ? OpenForAppend(path, LAP_ARCHIVE_DATA_MAGIC, &end) : NULL;
+	if (data == NULL)
+		return -1;
+
+	entry.offset = end;
+	bool ok = fwrite(lap.elapsed, sizeof(lap.elapsed[0]), meters, data) == meters;
+	if (ok && (entry.flags & LAP_ARCHIVE_POSITIONS))
+		ok = fwrite(lap.pos_x, sizeof(lap.pos_x[0]), meters, data) == meters
+			&& fwrite(lap.pos_z, sizeof(lap.pos_z[0]), meters, data) == meters;
+	if (ok && (entry.flags & LAP_ARCHIVE_ODOMETRY))
+		ok = fwrite(lap.odometry, sizeof(lap.odometry), 1, data) == 1;
+	if (ok && lap.corners.count > 0) {
+		entry.corners_offset = entry.offset + entry.size;
+		entry.corners = lap.corners.count;
+		ok = WriteCorners(data, lap.corners);
+	}
+	if (fclose(data) != 0 || ! ok)
+		return -1;
+
+	FILE *index = ArchivePath(path, base, LAP_ARCHIVE_INDEX_EXT) ? OpenForAppend(path, LAP_ARCHIVE_INDEX_MAGIC, &end) : NULL;
+	if (index == NULL)
+		return -1;
+
+	/* A torn entry at the end would shift all the ones after it */
+	uint64_t entries = end - sizeof(LapArchiveHeader);
+	ok = entries % sizeof(entry) == 0 && fwrite(&entry, sizeof(entry), 1, index) == 1;
+	if (fclose(index) != 0 || ! ok)
+		return -1;
+
+	return (long) (entries / sizeof(entry));
+}
+
+bool LapArchiveSetCorners(const char *base, long n, const CornerMap &corners)
+{
+	char path[FILENAME_MAX];
+	if (n < 0 || corners.count == 0)
+		return false;
+
+	uint64_t end;
+	FILE *data = ArchivePath(path, base, LAP_ARCHIVE_DATA_EXT) ? OpenForAppend(path, LAP_ARCHIVE_DATA_MAGIC, &end) : NULL;
+	if (data == NULL)
+		return false;
+	bool ok = WriteCorners(data, corners);
+	if (fclose(data) != 0 || ! ok)
+		return false;
+
+	FILE *index = ArchivePath(path, base, LAP_ARCHIVE_INDEX_EXT) ? fopen(path, "r+b") : NULL;
+	if (index == NULL)
+		return false;
+
+	LapArchiveHeader header;
+	LapArchiveEntry entry;
+	uint64_t at = sizeof(header) + (uint64_t) n * sizeof(entry);
+	ok = fread(&header, sizeof(header), 1, index) == 1 && HeaderMatches(header, LAP_ARCHIVE_INDEX_MAGIC)
+		&& SeekTo(index, at) && fread(&entry, sizeof(entry), 1, index) == 1;
+	if (ok) {
+		entry.corners_offset = end;
+		entry.corners = corners.count;
+		ok = SeekTo(index, at) && fwrite(&entry, sizeof(entry), 1, index) == 1;
+	}
+	if (fclose(index) != 0)
+		ok = false;
+	return ok;
+}
+
+bool LapArchiveOpenIndex(LapArchiveIndex *index, const char *base)
+{
+	char path[FILENAME_MAX];
+	MappedFile mapped;
+
+	memset(index, 0, sizeof(*index));
+	if (! ArchivePath(path, base, LAP_ARCHIVE_INDEX_EXT) || ! MapFile(&mapped, path, 0, 0))
+		return false;
+
+	LapArchiveHeader header;
+	if (mapped.file_size < sizeof(header)) {
+		UnmapFile(&mapped);
+		return false;
+	}
+	memcpy(&header, mapped.data, sizeof(header));
+	if (! HeaderMatches(header, LAP_ARCHIVE_INDEX_MAGIC)) {
+		UnmapFile(&mapped);
+		return false;
+	}
+
+	index->entries = (const LapArchiveEntry *) (mapped.data + sizeof(header));
+	index->count = (unsigned int) ((mapped.file_size - sizeof(header)) / sizeof(LapArchiveEntry));
+	index->view = mapped.view;
+	index->size = mapped.view_size;
+	index->file = mapped.file;
+	index->mapping = mapped.mapping;
+	return true;
+}
+
+void LapArchiveCloseIndex(LapArchiveIndex *index)
+{
+	MappedFile mapped;
+	memset(&mapped, 0, sizeof(mapped));
+	mapped.view = index->view;
+	mapped.view_size = index->size;
+	mapped.file = index->file;
+	mapped.mapping = index->mapping;
+	UnmapFile(&mapped);
+	memset(index, 0, sizeof(*index));
+}
+
+static bool SameConditions(const LapArchiveEntry &entry, const LapArchiveQuery &query)
+{
+	if (entry.flags & LAP_ARCHIVE_IMPORTED)
+		return false;
+	return fabs(entry.raining - query.raining) <= LAP_ARCHIVE_RAIN_TOLERANCE
+		&& fabs(entry.wetness - query.wetness) <= LAP_ARCHIVE_RAIN_TOLERANCE
+		&& fabs(entry.track_temp - query.track_temp) <= LAP_ARCHIVE_TEMP_TOLERANCE;
+}
+
+long LapArchiveFind(const LapArchiveIndex &index, const LapArchiveQuery &query)
+{
+	long best = -1;
+
+	for (unsigned int i = 0; i < index.count; i++) {
+		const LapArchiveEntry &entry = index.entries[i];
+		if (! (entry.flags & LAP_ARCHIVE_VALID) || entry.lap_time <= 0)
+			continue;
+		if (query.driver != NULL && strncmp(entry.driver, query.driver, sizeof(entry.driver)) != 0)
+			continue;
+		if (query.same_conditions && ! SameConditions(entry, query))
+			continue;
+		if (best < 0 || entry.lap_time < index.entries[best].lap_time)
+			best = (long) i;
+	}
+
+	return best;
+}
+
+bool LapArchiveLoad(const char *base, const LapArchiveIndex &index, long n, LapTime *lap)
+{
+	char path[FILENAME_MAX];
+	if (n < 0 || (unsigned long) n >= index.count || ! ArchivePath(path, base, LAP_ARCHIVE_DATA_EXT))
+		return false;
+
+	const LapArchiveEntry &entry = index.entries[n];
+	if (entry.meters > MAX_TRACK_LENGTH || entry.size != LapSize(entry.meters, entry.flags)
+			|| entry.corners > INPUT_MAX_CORNERS)
+		return false;
+
+	MappedFile mapped;
+	if (! MapFile(&mapped, path, entry.offset, entry.size))
+		return false;
+
+	ResetLap(lap);
+	lap->final = entry.lap_time;
+	lap->sector[0] = entry.sector[0];
+	lap->sector[1] = entry.sector[1];
+	lap->has_positions = (entry.flags & LAP_ARCHIVE_POSITIONS) != 0;
+
+	const char *p = mapped.data;
+	unsigned int meters = entry.meters;
+	memcpy(lap->elapsed, p, meters * sizeof(lap->elapsed[0]));
+	p += meters * sizeof(lap->elapsed[0]);
+	for (unsigned int i = 0; i < meters; i++) {
+		if (lap->elapsed[i] > lap->final)
+			lap->elapsed[i] = lap->final;
+	}
+	if (lap->has_positions) {
+		memcpy(lap->pos_x, p, meters * sizeof(lap->pos_x[0]));
+		p += meters * sizeof(lap->pos_x[0]);
+		memcpy(lap->pos_z, p, meters * sizeof(lap->pos_z[0]));
+		p += meters * sizeof(lap->pos_z[0]);
+	}
+	if (entry.flags & LAP_ARCHIVE_ODOMETRY)
+		memcpy(lap->odometry, p, sizeof(lap->odometry));
+	UnmapFile(&mapped);
+
+	/* Corners, if they were found by now */
+	unsigned int count = entry.corners;
+	if (count > 0 && MapFile(&mapped, path, entry.corners_offset, 3 * count * sizeof(float))) {
+		const float *corners = (const float *) mapped.data;
+		memcpy(lap->corners.start, corners, count * sizeof(float));
+		memcpy(lap->corners.apex, corners + count, count * sizeof(float));
+		memcpy(lap->corners.end, corners + 2 * count, count * sizeof(float));
+		lap->corners.count = count;
+		UnmapFile(&mapped);
+	}
+
+	lap->archive_entry = n;
+	return true;
+}
@@ -0,0 +1,256 @@
+/*
+rF2 Delta Best Plugin
+
+Overlay geometry generation.
+
+*/
+
+#include "OverlayGeometry.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+void OverlayBatchReset(OverlayBatch *batch)
+{
+	batch->num_vertices = 0;
+}
+
+unsigned int OverlayBatchPrimitives(const OverlayBatch *batch)
+{
+	return batch->num_vertices / 3;
+}
+
+static inline void SetVertex(OverlayVertex *v, float x, float y, unsigned int color, float u, float tv)
+{
+	v->x = x;
+	v->y = y;
+	v->z = 0.0f;
+	v->rhw = 1.0f;
+	v->color = color;
+	v->u = u;
+	v->v = tv;
+}
+
+bool OverlayBatchAddTexturedQuad(OverlayBatch *batch,
+	float left, float top, float width, float height, unsigned int color,
+	float u0, float v0, float u1, float v1)
+{
+	if (batch->num_vertices + OVERLAY_VERTS_PER_QUAD > OVERLAY_MAX_VERTICES)
+		return false;
+
+	/* Texel centers are offset by half a pixel with pre-transformed vertices */
+	float x0 = left - 0.5f;
+	float y0 = top - 0.5f;
+	float x1 = x0 + width;
+	float y1 = y0 + height;
+
+	OverlayVertex *v = &batch->vertices[batch->num_vertices];
+	SetVertex(&v[0], x0, y0, color, u0, v0);
+	SetVertex(&v[1], x1, y0, color, u1, v0);
+	SetVertex(&v[2], x0, y1, color, u0, v1);
+	SetVertex(&v[3], x0, y1, color, u0, v1);
+	SetVertex(&v[4], x1, y0, color, u1, v0);
+	SetVertex(&v[5], x1, y1, color, u1, v1);
+	batch->num_vertices += OVERLAY_VERTS_PER_QUAD;
+
+	return true;
+}
+
+bool OverlayBatchAddQuad(OverlayBatch *batch, const OverlayLayout &layout,
+	float left, float top, float width, float height, unsigned int color)
+{
+	/* The sprite version drew the top-left (width x height) texels
+	   of the background, clamped to the background size */
+	float u1 = (width < layout.background_width ? width : layout.background_width) / layout.texture_width;
+	float v1 = (height < layout.background_height ? height : layout.background_height) / layout.texture_height;
+
+	return OverlayBatchAddTexturedQuad(batch, left, top, width, height, color, 0.0f, 0.0f, u1, v1);
+}
+
+bool OverlayBatchAddVertices(OverlayBatch *batch, const OverlayVertex *vertices, unsigned int count)
+{
+	if (batch->num_vertices + count > OVERLAY_MAX_VERTICES)
+		return false;
+
+	memcpy(&batch->vertices[batch->num_vertices], vertices, count * sizeof(OverlayVertex));
+	batch->num_vertices += count;
+
+	return true;
+}
+
+void MakeLineQuad(OverlayVertex v[OVERLAY_VERTS_PER_QUAD],
+	float x0, float y0, float x1, float y1, float thickness, unsigned int color)
+{
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	float length = sqrt(dx * dx + dy * dy);
+
+	/* Half thickness, perpendicular to the segment */
+	float nx = 0, ny = thickness / 2.0f;
+	if (length > 0) {
+		nx = -dy / length * thickness / 2.0f;
+		ny = dx / length * thickness / 2.0f;
+	}
+
+	x0 -= 0.5f; y0 -= 0.5f;
+	x1 -= 0.5f; y1 -= 0.5f;
+
+	SetVertex(&v[0], x0 + nx, y0 + ny, color, 0, 0);
+	SetVertex(&v[1], x1 + nx, y1 + ny, color, 0, 0);
+	SetVertex(&v[2], x0 - nx, y0 - ny, color, 0, 0);
+	SetVertex(&v[3], x0 - nx, y0 - ny, color, 0, 0);
+	SetVertex(&v[4], x1 + nx, y1 + ny, color, 0, 0);
+	SetVertex(&v[5], x1 - nx, y1 - ny, color, 0, 0);
+}
+
+void DeltaBarExtent(const OverlayLayout &layout, double delta, float *left, float *width)
+{
+	const float SCREEN_CENTER = layout.screen_width / 2.0f;
+	const float BAR_WIDTH     = layout.bar_width;
+
+	// Provide a default centered position in case user
+	// disabled drawing of the bar
+	float delta_left = SCREEN_CENTER;
+	float delta_width = 1;
+
+	if (layout.bar_enabled) {
+
+		// Delta is negative: colored bar is in the right-hand half.
+		if (delta < 0) {
+			delta_width = (float) (long) ((BAR_WIDTH / 2.0) * (-delta / 2.0));
+		}
+
+		// Delta non-negative, colored bar is in the left-hand half
+		else if (delta > 0) {
+			delta_left -= (float) ((BAR_WIDTH / 2.0) * (delta / 2.0));
+			delta_width = (float) (long) (SCREEN_CENTER - delta_left);
+		}
+
+		// Don't allow positive (green) bar to start before the -2.0s position
+		if (delta_left < SCREEN_CENTER - (BAR_WIDTH / 2.0f))
+			delta_left = SCREEN_CENTER - (BAR_WIDTH / 2.0f);
+
+		// Max width is always half of bar width (left or right half)
+		if (delta_width > (float) (long) (BAR_WIDTH / 2.0f))
+			delta_width = (float) (long) (BAR_WIDTH / 2.0f);
+
+		// Min width is 1, as zero doesn't make sense to draw
+		if (delta_width < 1)
+			delta_width = 1;
+	}
+
+	*left = delta_left;
+	*width = delta_width;
+}
+
+void BuildDeltaBar(OverlayBatch *batch, const OverlayLayout &layout,
+	double delta, unsigned int bar_color, unsigned int box_color, OverlayRect *text_box)
+{
+	const float BAR_WIDTH     = layout.bar_width;
+	const float BAR_LEFT      = (layout.screen_width - BAR_WIDTH) / 2.0f;
+	const float TIME_TOP      = layout.bar_top + layout.bar_height + layout.bar_gutter;
+
+	float delta_left, delta_width;
+	DeltaBarExtent(layout, delta, &delta_left, &delta_width);
+
+	if (layout.bar_enabled) {
+		OverlayBatchAddQuad(batch, layout, BAR_LEFT, layout.bar_top,
+			BAR_WIDTH, layout.bar_height, box_color);
+		OverlayBatchAddQuad(batch, layout, delta_left, layout.bar_top + 1,
+			delta_width, layout.bar_height - 2, bar_color);
+	}
+
+	if (layout.time_enabled) {
+
+		float time_rect_center = delta < 0
+			? (delta_left + delta_width)
+			: delta_left;
+		float left_edge = BAR_LEFT;
+		float right_edge = (layout.screen_width + BAR_WIDTH) / 2.0f;
+		if (time_rect_center <= left_edge)
+			time_rect_center = left_edge + 1;
+		else if (time_rect_center >= right_edge)
+			time_rect_center = right_edge - 1;
+
+		text_box->left = time_rect_center - layout.time_width / 2.0f;
+		text_box->top = TIME_TOP;
+		text_box->width = layout.time_width;
+		text_box->height = layout.time_height;
+
+		OverlayBatchAddQuad(batch, layout, text_box->left, text_box->top,
+			text_box->width, text_box->height, box_color);
+	}
+}
+
+unsigned int ReadoutUnits(double value, unsigned int scale)
+{
+	/* Rounds to 0 for sure, and keeps the shifts below in range */
+	if (! (value >= 0.25 / scale))
+		return 0;
+	if (value >= 4294967295.0 / scale)
+		return 4294967295u;
+
+	/* value is exactly mantissa / 2^shift, then scaled without rounding */
+	int exponent;
+	uint64_t mantissa = (uint64_t) ldexp(frexp(value, &exponent), 53);
+	int shift = 53 - exponent;
+	uint64_t scaled = mantissa * scale;
+	uint64_t units = scaled >> shift;
+	uint64_t rest = scaled & ((1ULL << shift) - 1);
+	uint64_t half = 1ULL << (shift - 1);
+
+	if (rest > half || (rest == half && (units & 1)))
+		units++;
+	return (unsigned int) units;
+}
+
+bool ReadoutNegative(double value)
+{
+	return value < 0 || (value == 0 && 1.0 / value < 0);
+}
+
+void MakeOverlayKey(OverlayKey *key, const OverlayLayout &layout, double delta, int readout, double readout_value,
+	unsigned int bar_color, unsigned int text_color, unsigned long graph_version, unsigned long map_version)
+{
+	/* Displayed value, rounded exactly as the readout shows it, so
+	   that the key changes whenever the text does */
+	key->delta_hundredths = ReadoutUnits(fabs(delta), 100);
+	key->delta_negative = ReadoutNegative(delta);
+	key->readout = readout;
+	key->readout_units = 0;
+	key->readout_negative = false;
+	if (readout == READOUT_PREDICTED_LAP || readout == READOUT_ROLLING_DELTA)
+		key->readout_units = ReadoutUnits(fabs(readout_value), 100);
+	else if (readout == READOUT_DISTANCE_GAP) {
+		/* Whole meters from 100m, see GapToGlyphs() */
+		key->readout_units = ReadoutUnits(fabs(readout_value), 10);
+		if (key->readout_units >= 1000)
+			key->readout_units = 10 * ReadoutUnits(fabs(readout_value), 1);
+	}
+	if (readout != READOUT_DELTA)
+		key->readout_negative = ReadoutNegative(readout_value);
+	DeltaBarExtent(layout, delta, &key->delta_left, &key->delta_width);
+	key->bar_color = bar_color;
+	key->text_color = text_color;
+	key->screen_width = layout.screen_width;
+	key->screen_height = layout.screen_height;
+	key->graph_version = layout.graph_enabled ? graph_version : 0;
+	key->map_version = layout.map_enabled ? map_version : 0;
+}
+
+bool OverlayKeyEquals(const OverlayKey &a, const OverlayKey &b)
+{
+	return a.delta_hundredths == b.delta_hundredths
+		&& a.delta_negative == b.delta_negative
+		&& a.readout == b.readout
+		&& a.readout_units == b.readout_units
+		&& a.readout_negative == b.readout_negative
+		&& a.delta_left == b.delta_left
+		&& a.delta_width == b.delta_width
+		&& a.bar_color == b.bar_color
+		&& a.text_color == b.text_color
+		&& a.screen_width == b.screen_width
+		&& a.screen_height == b.screen_height
+		&& a.graph_version == b.graph_version
+		&& a.map_version == b.map_version;
+}
@@ -0,0 +1,80 @@
+/*
+rF2 Delta Best Plugin
+
+Plugin configuration, as read from DeltaBest.ini.
+
+*/
+
+#include "PluginConfig.hpp"
+
+void LoadPluginConfig(PluginConfig &config, const IniFile &ini)
+{
+
+	// [Bar] section
+	config.bar_left = IniGetInt(ini, "Bar", "Left", 0);
+	config.bar_top = IniGetInt(ini, "Bar", "Top", DEFAULT_BAR_TOP);
+	config.bar_width = IniGetInt(ini, "Bar", "Width", DEFAULT_BAR_WIDTH);
+	config.bar_height = IniGetInt(ini, "Bar", "Height", DEFAULT_BAR_HEIGHT);
+	config.bar_gutter = IniGetInt(ini, "Bar", "Gutter", DEFAULT_BAR_TIME_GUTTER);
+	config.bar_enabled = IniGetInt(ini, "Bar", "Enabled", 1) == 1 ? true : false;
+	config.slope_window = IniGetInt(ini, "Bar", "SlopeWindow", DEFAULT_SLOPE_WINDOW);
+
+	// [Time] section
+	config.time_top = IniGetInt(ini, "Time", "Top", 0);
+	config.time_width = IniGetInt(ini, "Time", "Width", DEFAULT_TIME_WIDTH);
+	config.time_height = IniGetInt(ini, "Time", "Height", DEFAULT_TIME_HEIGHT);
+	config.time_font_size = IniGetInt(ini, "Time", "FontSize", DEFAULT_FONT_SIZE);
+	config.time_enabled = IniGetInt(ini, "Time", "Enabled", 1) == 1 ? true : false;
+	config.hires_updates = IniGetInt(ini, "Time", "HiresUpdates", DEFAULT_HIRES_UPDATES) == 1 ? true : false;
+	config.drift_correction = IniGetInt(ini, "Time", "DriftCorrection", 0) == 1 ? true : false;
+	config.odometry_calibration = IniGetInt(ini, "Time", "OdometryCalibration", 1) == 1 ? true : false;
+	config.sector_resync = IniGetInt(ini, "Time", "SectorResync", 1) == 1 ? true : false;
+	config.split_seconds = IniGetInt(ini, "Time", "SplitSeconds", DEFAULT_SPLIT_SECONDS);
+	config.time_readout = IniGetInt(ini, "Time", "Readout", READOUT_DELTA);
+	config.rolling_meters = IniGetInt(ini, "Time", "RollingMeters", DEFAULT_ROLLING_METERS);
+	config.rolling_seconds = IniGetInt(ini, "Time", "RollingSeconds", 0);
+	IniGetString(ini, "Time", "FontName", DEFAULT_FONT_NAME, config.time_font_name, FONT_NAME_MAXLEN);
+
+	// [Graph] section
+	config.graph_enabled = IniGetInt(ini, "Graph", "Enabled", 0) == 1 ? true : false;
+	config.graph_previous_lap = IniGetInt(ini, "Graph", "PreviousLap", 1) == 1 ? true : false;
+	config.graph_left = IniGetInt(ini, "Graph", "Left", 0);
+	config.graph_top = IniGetInt(ini, "Graph", "Top", 0);
+	config.graph_width = IniGetInt(ini, "Graph", "Width", DEFAULT_GRAPH_WIDTH);
+	config.graph_height = IniGetInt(ini, "Graph", "Height", DEFAULT_GRAPH_HEIGHT);
+	config.graph_range = IniGetInt(ini, "Graph", "Range", DEFAULT_GRAPH_RANGE);
+	if (config.graph_range == 0)
+		config.graph_range = DEFAULT_GRAPH_RANGE;
+
+	// [TrackMap] section
+	config.map_enabled = IniGetInt(ini, "TrackMap", "Enabled", 0) == 1 ? true : false;
+	config.map_left = IniGetInt(ini, "TrackMap", "Left", 0);
+	config.map_top = IniGetInt(ini, "TrackMap", "Top", 0);
+	config.map_size = IniGetInt(ini, "TrackMap", "Size", DEFAULT_MAP_SIZE);
+	config.map_thickness = IniGetInt(ini, "TrackMap", "Thickness", DEFAULT_MAP_THICKNESS);
+
+	// [Corners] section
+	config.corner_summary = IniGetInt(ini, "Corners", "Summary", 0) == 1 ? true : false;
+
+	// [Reference] section
+	config.reference_lap = IniGetInt(ini, "Reference", "Lap", REFERENCE_FASTEST);
+	IniGetString(ini, "Reference", "Driver", "", config.reference_driver, DRIVER_NAME_MAXLEN);
+
+	// [Stats] section
+	config.stats_enabled = IniGetInt(ini, "Stats", "Enabled", 0) == 1 ? true : false;
+
+	// [Capture] section
+	config.capture_enabled = IniGetInt(ini, "Capture", "Enabled", 0) == 1 ? true : false;
+
+	// [Shared] section
+	config.shared_enabled = IniGetInt(ini, "Shared", "Enabled", 0) == 1 ? true : false;
+
+	// [Broadcast] section
+	config.broadcast_enabled = IniGetInt(ini, "Broadcast", "Enabled", 0) == 1 ? true : false;
+	IniGetString(ini, "Broadcast", "Address", DEFAULT_BROADCAST_ADDRESS, config.broadcast_address, ADDRESS_MAXLEN);
+	config.broadcast_port = IniGetInt(ini, "Broadcast", "Port", DEFAULT_BROADCAST_PORT);
+	config.broadcast_rate = IniGetInt(ini, "Broadcast", "Rate", DEFAULT_BROADCAST_RATE);
+	if (config.broadcast_rate == 0)
+		config.broadcast_rate = DEFAULT_BROADCAST_RATE;
+
+}
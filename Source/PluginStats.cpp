@@ -0,0 +1,102 @@
+/*
+rF2 Delta Best Plugin
+
+Runtime statistics.
+
+*/
+
+#include "PluginStats.hpp"
+#include <string.h>
+
+static double Percent(unsigned long part, unsigned long total)
+{
+	return total > 0 ? (100.0 * part) / total : 0.0;
+}
+
+void ResetPluginStats(PluginStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+static void WriteAccuracy(FILE *f, const char *name, const DeltaAccuracy &accuracy)
+{
+	fprintf(f, "%sCount=%lu\n", name, accuracy.count);
+	fprintf(f, "%sMeanError=%+.3f\n", name, accuracy.mean);
+	fprintf(f, "%sStdDev=%.3f\n", name, DeltaAccuracyStdDev(accuracy));
+	fprintf(f, "%sMaxError=%.3f\n", name, accuracy.max_error);
+}
+
+/* Blank where one of the laps didn't brake, get back on the throttle
+   or steer, or where the inputs weren't compared */
+static void WriteCorner(FILE *f, unsigned int n, const CornerTimes &times, const InputCorner *corner)
+{
+	const CornerMap &map = times.corners;
+	fprintf(f, "Corner%u=%.0f,%.0f,%.0f,%+.3f,", n + 1, map.start[n], map.apex[n], map.end[n], times.delta[n]);
+	if (corner == NULL) {
+		fprintf(f, ",,,,,\n");
+		return;
+	}
+
+	if (corner->braked)
+		fprintf(f, "%+.0f", corner->brake_point);
+	fprintf(f, ",%+.1f,", corner->min_speed);
+	if (corner->throttled)
+		fprintf(f, "%+.0f", corner->throttle_point);
+	fprintf(f, ",%d,%d,", corner->gear, corner->reference_gear);
+	if (corner->steered)
+		fprintf(f, "%+.0f", corner->steering * 100.0f);
+	fprintf(f, "\n");
+}
+
+void WritePluginStats(FILE *f, const PluginStats &stats)
+{
+	fprintf(f, "[Overlay]\n");
+	fprintf(f, "Frames=%lu\n", stats.overlay_frames);
+	fprintf(f, "CacheHits=%lu\n", stats.overlay_cache_hits);
+	fprintf(f, "Rebuilds=%lu\n", stats.overlay_rebuilds);
+	fprintf(f, "CacheHitRate=%.1f%%\n", Percent(stats.overlay_cache_hits, stats.overlay_frames));
+	fprintf(f, "\n");
+
+	if (stats.capture_records > 0 || stats.capture_dropped > 0) {
+		fprintf(f, "[Capture]\n");
+		fprintf(f, "Records=%lu\n", stats.capture_records);
+		fprintf(f, "Dropped=%lu\n", stats.capture_dropped);
+		fprintf(f, "\n");
+	}
+
+	if (stats.broadcast_sent > 0 || stats.broadcast_dropped > 0 || stats.broadcast_errors > 0) {
+		fprintf(f, "[Broadcast]\n");
+		fprintf(f, "Sent=%lu\n", stats.broadcast_sent);
+		fprintf(f, "Dropped=%lu\n", stats.broadcast_dropped);
+		fprintf(f, "Errors=%lu\n", stats.broadcast_errors);
+		fprintf(f, "\n");
+	}
+
+	/* Displayed delta minus the delta from the official times, in seconds */
+	if (stats.line_accuracy.count > 0 || stats.sector_accuracy[0].count > 0 || stats.sector_accuracy[1].count > 0) {
+		fprintf(f, "[Accuracy]\n");
+		WriteAccuracy(f, "Line", stats.line_accuracy);
+		WriteAccuracy(f, "Sector1", stats.sector_accuracy[0]);
+		WriteAccuracy(f, "Sector2", stats.sector_accuracy[1]);
+		fprintf(f, "DriftPerLap=%+.3f\n", stats.drift_rate);
+		fprintf(f, "\n");
+	}
+
+	/* Lap minus best lap, in meters, seconds and meters per second */
+	const CornerTimes &times = stats.corner_times;
+	if (times.corners.count > 0) {
+		fprintf(f, "[Corners]\n");
+		fprintf(f, "Analysed=%lu\n", stats.analysis_submitted);
+		fprintf(f, "Dropped=%lu\n", stats.analysis_dropped);
+		fprintf(f, "LapTime=%.3f\n", times.lap_time);
+		fprintf(f, "BestLapTime=%.3f\n", times.reference_time);
+		fprintf(f, "; Start,Apex,End,Time,BrakePoint,MinSpeed,ThrottlePoint,Gear,BestGear,Steering\n");
+
+		/* Inputs of the same lap, against the same corners */
+		const InputComparison &inputs = stats.corners;
+		bool compared = inputs.lap_time == times.lap_time && inputs.reference_time == times.reference_time;
+		for (unsigned int i = 0; i < times.corners.count; i++)
+			WriteCorner(f, i, times, compared && i < inputs.count ? &inputs.corners[i] : NULL);
+		fprintf(f, "\n");
+	}
+}
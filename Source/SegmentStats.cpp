@@ -0,0 +1,152 @@
+/*
+rF2 Delta Best Plugin
+
+Lap to lap statistics per segment of the track.
+
+*/
+
+#include "SegmentStats.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void SegmentStatsClear(SegmentStats *stats)
+{
+	stats->segments = 0;
+	stats->track_length = 0;
+	stats->laps = 0;
+}
+
+/* Time at that meter, or at the last meter before with a time */
+static double TimeAt(const double *elapsed, unsigned int meters)
+{
+	while (meters > 0 && elapsed[meters] <= 0)
+		meters--;
+	return elapsed[meters];
+}
+
+static void StartOver(SegmentStats *stats, unsigned int track_length)
+{
+	unsigned int n = (track_length + SEGMENT_STATS_LENGTH - 1) / SEGMENT_STATS_LENGTH;
+	if (n > SEGMENT_STATS_MAX)
+		n = SEGMENT_STATS_MAX;
+
+	stats->segments = n;
+	stats->track_length = track_length;
+	stats->laps = 0;
+	memset(stats->count, 0, n * sizeof(stats->count[0]));
+	memset(stats->mean, 0, n * sizeof(stats->mean[0]));
+	memset(stats->m2, 0, n * sizeof(stats->m2[0]));
+	memset(stats->min, 0, n * sizeof(stats->min[0]));
+}
+
+void SegmentStatsAddLap(SegmentStats *stats, const double *elapsed, unsigned int track_length, double final)
+{
+	if (track_length < SEGMENT_STATS_LENGTH || final <= 0)
+		return;
+	if (stats->segments == 0 || stats->track_length != track_length)
+		StartOver(stats, track_length);
+
+	float *last = stats->last[stats->laps % SEGMENT_STATS_LAST];
+	double start = 0;
+	for (unsigned int s = 0; s < stats->segments; s++) {
+		double end = s + 1 < stats->segments ? TimeAt(elapsed, (s + 1) * SEGMENT_STATS_LENGTH) : final;
+		double x = end - start;
+		start = end;
+
+		unsigned long n = ++stats->count[s];
+		double d = x - stats->mean[s];
+		stats->mean[s] += d / n;
+		stats->m2[s] += d * (x - stats->mean[s]);
+		if (n == 1 || x < stats->min[s])
+			stats->min[s] = (float) x;
+		last[s] = (float) x;
+	}
+	stats->laps++;
+}
+
+double SegmentStatsStdDev(const SegmentStats &stats, unsigned int segment)
+{
+	unsigned long n = stats.count[segment];
+	return n > 1 ? sqrt(stats.m2[segment] / (n - 1)) : 0;
+}
+
+bool SegmentStatsWrite(const SegmentStats &stats, const char *path, const char *track, const char *vehicle_class)
+{
+	FILE *f = fopen(path, "w");
+	if (f == NULL)
+		return false;
+
+	fprintf(f, "track=%s\n", track);
+	fprintf(f, "class=%s\n", vehicle_class);
+	fprintf(f, "length=%u\n", stats.track_length);
+	fprintf(f, "laps=%lu\n", stats.laps);
+
+	/* "segment <n>=<count> <mean> <variance> <min>", then the last times, latest first */
+	unsigned int kept = stats.laps < SEGMENT_STATS_LAST ? (unsigned int) stats.laps : SEGMENT_STATS_LAST;
+	for (unsigned int s = 0; s < stats.segments; s++) {
+		unsigned long n = stats.count[s];
+		fprintf(f, "segment %u=%lu %.4f %.6f %.4f", s, n, stats.mean[s], n > 1 ? stats.m2[s] / (n - 1) : 0, stats.min[s]);
+		for (unsigned int k = 1; k <= kept; k++)
+			fprintf(f, " %.4f", stats.last[(stats.laps - k) % SEGMENT_STATS_LAST][s]);
+		fprintf(f, "\n");
+	}
+
+	fclose(f);
+	return true;
+}
+
+bool SegmentStatsRead(SegmentStats *stats, const char *path, char *track, char *vehicle_class, unsigned int name_size)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return false;
+
+	SegmentStatsClear(stats);
+	track[0] = vehicle_class[0] = '\0';
+
+	char line[512];
+	unsigned long laps = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		unsigned int length = 0, s = 0;
+		unsigned long n = 0;
+		double mean = 0, variance = 0;
+		float min = 0;
+		int used = 0;
+
+		if (strncmp(line, "track=", 6) == 0) {
+			strncpy(track, line + 6, name_size - 1);
+			track[name_size - 1] = '\0';
+		}
+		else if (strncmp(line, "class=", 6) == 0) {
+			strncpy(vehicle_class, line + 6, name_size - 1);
+			vehicle_class[name_size - 1] = '\0';
+		}
+		else if (sscanf(line, "length=%u", &length) == 1) {
+			StartOver(stats, length);
+		}
+		else if (sscanf(line, "laps=%lu", &laps) == 1) {
+			stats->laps = laps;
+		}
+		else if (sscanf(line, "segment %u=%lu %lf %lf %f%n", &s, &n, &mean, &variance, &min, &used) == 5 && s < stats->segments) {
+			stats->count[s] = n;
+			stats->mean[s] = mean;
+			stats->m2[s] = n > 1 ? variance * (n - 1) : 0;
+			stats->min[s] = min;
+
+			/* Latest first */
+			const char *at = line + used;
+			float x = 0;
+			int advance = 0;
+			for (unsigned int k = 1; k <= SEGMENT_STATS_LAST && k <= laps && sscanf(at, " %f%n", &x, &advance) == 1; k++) {
+				stats->last[(laps - k) % SEGMENT_STATS_LAST][s] = x;
+				at += advance;
+			}
+		}
+	}
+
+	fclose(f);
+	return stats->segments > 0;
+}
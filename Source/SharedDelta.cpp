@@ -0,0 +1,233 @@
+/*
+rF2 Delta Best Plugin
+
+Live delta state in shared memory.
+
+*/
+
+#include "SharedDelta.hpp"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static SharedDeltaRegion *MapRegion(SharedDelta *shared, const char *name, bool writer)
+{
+#ifdef _WIN32
+	HANDLE mapping = writer
+		? CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(SharedDeltaRegion), name)
+		: OpenFileMapping(FILE_MAP_READ, FALSE, name);
+	if (mapping == NULL)
+		return NULL;
+
+	void *view = MapViewOfFile(mapping, writer ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, sizeof(SharedDeltaRegion));
+	if (view == NULL) {
+		CloseHandle(mapping);
+		return NULL;
+	}
+	shared->mapping = mapping;
+	return (SharedDeltaRegion *) view;
+#else
+	int fd = writer ? shm_open(name, O_CREAT | O_RDWR, 0644) : shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (writer && ftruncate(fd, sizeof(SharedDeltaRegion)) != 0) {
+		close(fd);
+		return NULL;
+	}
+	if (! writer && lseek(fd, 0, SEEK_END) < (off_t) sizeof(SharedDeltaRegion)) {
+		close(fd);
+		return NULL;
+	}
+
+	/* The mapping stays valid once the descriptor is closed */
+	void *view = mmap(NULL, sizeof(SharedDeltaRegion), writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return NULL;
+	shared->mapping = NULL;
+	return (SharedDeltaRegion *) view;
+#endif
+}
+
+static void UnmapRegion(SharedDelta *shared)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(shared->region);
+	CloseHandle((HANDLE) shared->mapping);
+#else
+	munmap(shared->region, sizeof(SharedDeltaRegion));
+#endif
+	shared->region = NULL;
+	shared->mapping = NULL;
+}
+
+bool SharedDeltaCreate(SharedDelta *shared, const char *name)
+{
+	if (shared->region != NULL)
+		return true;
+
+	SharedDeltaRegion *region = MapRegion(shared, name, true);
+	if (region == NULL)
+		return false;
+
+	/* Readers may still hold a region from an earlier writer: carry on
+	   with its sequence, so they see a new snapshot, but never odd */
+	uint32_t sequence = region->header.sequence.load(std::memory_order_relaxed);
+	region->header.sequence.store(sequence + (sequence & 1), std::memory_order_relaxed);
+	memset(&region->data, 0, sizeof(region->data));
+	region->header.magic = SHARED_DELTA_MAGIC;
+	region->header.version = SHARED_DELTA_VERSION;
+	region->header.size = sizeof(SharedDeltaRegion);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	shared->region = region;
+	shared->writer = true;
+	return true;
+}
+
+bool SharedDeltaOpen(SharedDelta *shared, const char *name)
+{
+	if (shared->region != NULL)
+		return true;
+
+	SharedDeltaRegion *region = MapRegion(shared, name, false);
+	if (region == NULL)
+		return false;
+
+	shared->region = region;
+	shared->writer = false;
+	if (region->header.magic != SHARED_DELTA_MAGIC || region->header.version != SHARED_DELTA_VERSION
+		|| region->header.size != sizeof(SharedDeltaRegion)) {
+		UnmapRegion(shared);
+		return false;
+	}
+
+	return true;
+}
+
+void SharedDeltaClose(SharedDelta *shared)
+{
+	if (shared->region == NULL)
+		return;
+
+	/* Tell the readers there's nothing live any more */
+	if (shared->writer) {
+		uint32_t sequence = shared->region->header.sequence.load(std::memory_order_relaxed);
+		shared->region->header.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		shared->region->data.flags = 0;
+		shared->region->header.sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	UnmapRegion(shared);
+}
+
+/* Change of the delta over the last SHARED_DELTA_RATE_INTERVAL or more */
+static double DeltaRate(SharedDeltaRate *rate, bool valid, double et, double delta)
+{
+	if (! valid || et < rate->et) {
+		rate->et = et;
+		rate->delta = delta;
+		rate->rate = 0;
+	}
+	else if (et - rate->et >= SHARED_DELTA_RATE_INTERVAL) {
+		rate->rate = (delta - rate->delta) / (et - rate->et);
+		rate->et = et;
+		rate->delta = delta;
+	}
+
+	return rate->rate;
+}
+
+void SharedDeltaSnapshot(SharedDeltaRate *rate, const DeltaEngine *engine, SharedDeltaData *data)
+{
+	bool valid = DeltaEngineHasDelta(engine);
+	double delta = valid ? DeltaEngineCalculateDelta(engine) : 0;
+
+	data->publish_time = SharedDeltaClock();
+	data->session_et = engine->current_et;
+	data->flags = (engine->in_realtime ? SHARED_DELTA_REALTIME : 0)
+		| (valid ? SHARED_DELTA_VALID : 0)
+		| (engine->player_in_pits ? SHARED_DELTA_IN_PITS : 0);
+	data->delta = delta;
+	data->delta_rate = DeltaRate(rate, valid, engine->current_et, delta);
+	data->lap_distance = DeltaEngineLapDistance(engine);
+	data->track_length = engine->track_length;
+	data->lap_elapsed = engine->last_lap.started > 0 ? engine->current_et - engine->last_lap.started : 0;
+	data->best_lap = engine->best_lap.final;
+	data->predicted_lap = DeltaEnginePredictedLap(engine);
+	for (int i = 0; i < 2; i++) {
+		data->best_sector[i] = engine->best_lap.sector[i];
+		data->lap_sector[i] = engine->last_lap.sector[i];
+	}
+	data->split_sector = engine->split.sector;
+	data->split_delta = engine->split.delta;
+	data->split_et = engine->split.et;
+	data->split_official = engine->split.official ? 1 : 0;
+	data->reserved = 0;
+	data->distance_gap = DeltaEngineDistanceGap(engine);
+	data->delta_slope = DeltaEngineDeltaSlope(engine);
+}
+
+void SharedDeltaPublish(SharedDelta *shared, const SharedDeltaData &data)
+{
+	if (shared->region == NULL || ! shared->writer)
+		return;
+
+	SharedDeltaRegion *region = shared->region;
+	uint32_t sequence = region->header.sequence.load(std::memory_order_relaxed);
+	region->header.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	memcpy(&region->data, &data, sizeof(data));
+
+	region->header.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedDeltaRead(const SharedDelta *shared, SharedDeltaData *data, uint32_t *sequence)
+{
+	if (shared->region == NULL)
+		return false;
+
+	const SharedDeltaRegion *region = shared->region;
+	for (int tries = 0; tries < SHARED_DELTA_READ_TRIES; tries++) {
+		uint32_t before = region->header.sequence.load(std::memory_order_acquire);
+		if (before & 1)
+			continue;
+
+		memcpy(data, &region->data, sizeof(*data));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (region->header.sequence.load(std::memory_order_relaxed) == before) {
+			*sequence = before;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint64_t SharedDeltaClock()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	uint64_t ticks = counter.QuadPart, hz = frequency.QuadPart;
+	return (ticks / hz) * 1000000000ULL + (ticks % hz) * 1000000000ULL / hz;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
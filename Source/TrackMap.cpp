@@ -0,0 +1,210 @@
+/*
+rF2 Delta Best Plugin
+
+Track map with a delta "heat map".
+
+*/
+
+#include "TrackMap.hpp"
+#include <math.h>
+#include <vector>
+
+static double SegmentDistance(double px, double pz, double ax, double az, double bx, double bz)
+{
+	double dx = bx - ax, dz = bz - az;
+	double length2 = dx * dx + dz * dz;
+	double t = 0;
+
+	if (length2 > 0) {
+		t = ((px - ax) * dx + (pz - az) * dz) / length2;
+		if (t < 0)
+			t = 0;
+		else if (t > 1)
+			t = 1;
+	}
+
+	double cx = ax + t * dx - px, cz = az + t * dz - pz;
+	return sqrt(cx * cx + cz * cz);
+}
+
+unsigned int SimplifyPolyline(const float *x, const float *z, unsigned int count,
+	double epsilon, unsigned char *keep)
+{
+	if (count == 0)
+		return 0;
+
+	for (unsigned int i = 0; i < count; i++)
+		keep[i] = 0;
+	keep[0] = keep[count - 1] = 1;
+	unsigned int kept = count > 1 ? 2 : 1;
+
+	/* Explicit stack instead of recursion, a lap can be many thousand points */
+	std::vector<unsigned int> stack;
+	stack.push_back(0);
+	stack.push_back(count - 1);
+
+	while (! stack.empty()) {
+		unsigned int last = stack.back(); stack.pop_back();
+		unsigned int first = stack.back(); stack.pop_back();
+
+		double max_distance = 0;
+		unsigned int farthest = first;
+		for (unsigned int i = first + 1; i < last; i++) {
+			double d = SegmentDistance(x[i], z[i], x[first], z[first], x[last], z[last]);
+			if (d > max_distance) {
+				max_distance = d;
+				farthest = i;
+			}
+		}
+
+		if (max_distance > epsilon) {
+			keep[farthest] = 1;
+			kept++;
+			stack.push_back(first);
+			stack.push_back(farthest);
+			stack.push_back(farthest);
+			stack.push_back(last);
+		}
+	}
+
+	return kept;
+}
+
+void TrackMapClear(TrackMap *map)
+{
+	map->num_points = 0;
+	map->next_segment = 0;
+	map->points_version++;
+	map->version++;
+}
+
+void TrackMapBuild(TrackMap *map, const float *x, const float *z, unsigned int meters)
+{
+	if (meters < 2) {
+		TrackMapClear(map);
+		return;
+	}
+
+	std::vector<unsigned char> keep(meters);
+	double epsilon = TRACK_MAP_EPSILON;
+	while (SimplifyPolyline(x, z, meters, epsilon, &keep[0]) > TRACK_MAP_MAX_POINTS)
+		epsilon *= 2;
+
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < meters; i++) {
+		if (! keep[i])
+			continue;
+
+		map->points[n].x = x[i];
+		map->points[n].z = z[i];
+		map->points[n].meter = i;
+
+		if (n == 0 || x[i] < map->min_x) map->min_x = x[i];
+		if (n == 0 || x[i] > map->max_x) map->max_x = x[i];
+		if (n == 0 || z[i] < map->min_z) map->min_z = z[i];
+		if (n == 0 || z[i] > map->max_z) map->max_z = z[i];
+		n++;
+	}
+
+	map->num_points = n;
+	map->points_version++;
+	TrackMapNewLap(map);
+}
+
+void TrackMapNewLap(TrackMap *map)
+{
+	for (unsigned int i = 0; i < TRACK_MAP_MAX_SEGMENTS; i++)
+		map->colors[i] = TRACK_MAP_COLOR_NOT_DRIVEN;
+	map->next_segment = 0;
+	map->version++;
+}
+
+/* Grey when even, blending into green (gained) or red (lost) */
+static unsigned int HeatColor(double loss, unsigned int length)
+{
+	const unsigned int GREY = 0xA0, FULL = 0xF0;
+
+	double rate = length > 0 ? loss * 100.0 / length : 0;
+	double t = fabs(rate) / TRACK_MAP_FULL_COLOR_LOSS;
+	if (t > 1)
+		t = 1;
+
+	unsigned int main_channel = (unsigned int) (GREY + (FULL - GREY) * t);
+	unsigned int other_channels = (unsigned int) (GREY * (1 - t));
+	unsigned int color = 0xE0000000 | (other_channels << 16) | (other_channels << 8) | other_channels;
+
+	if (loss > 0)
+		color = (color & 0xFF00FFFF) | (main_channel << 16);
+	else
+		color = (color & 0xFFFF00FF) | (main_channel << 8);
+
+	return color;
+}
+
+void TrackMapUpdate(TrackMap *map, const double *current_elapsed,
+	const double *reference_elapsed, unsigned int meters)
+{
+	while (map->next_segment + 1 < map->num_points
+		&& map->points[map->next_segment + 1].meter <= meters) {
+
+		unsigned int a = map->points[map->next_segment].meter;
+		unsigned int b = map->points[map->next_segment + 1].meter;
+		double current = current_elapsed[b] - current_elapsed[a];
+		double reference = reference_elapsed[b] - reference_elapsed[a];
+
+		map->colors[map->next_segment] = HeatColor(current - reference, b - a);
+		map->next_segment++;
+		map->version++;
+	}
+}
+
+static void BuildSegments(TrackMap *map, const OverlayLayout &layout)
+{
+	float range_x = map->max_x - map->min_x;
+	float range_z = map->max_z - map->min_z;
+	float range = range_x > range_z ? range_x : range_z;
+	float usable = layout.map_size - layout.map_thickness;
+	float scale = range > 0 ? usable / range : 0;
+
+	/* Centered in the map square, world z going up the screen */
+	float left = layout.map_left + (layout.map_size - range_x * scale) / 2.0f;
+	float top = layout.map_top + (layout.map_size - range_z * scale) / 2.0f;
+
+	for (unsigned int i = 0; i + 1 < map->num_points; i++) {
+		const TrackMapPoint &a = map->points[i];
+		const TrackMapPoint &b = map->points[i + 1];
+		MakeLineQuad(&map->vertices[i * OVERLAY_VERTS_PER_QUAD],
+			left + (a.x - map->min_x) * scale, top + (map->max_z - a.z) * scale,
+			left + (b.x - map->min_x) * scale, top + (map->max_z - b.z) * scale,
+			layout.map_thickness, TRACK_MAP_COLOR_NOT_DRIVEN);
+	}
+
+	map->vertices_version = map->points_version;
+	map->vertices_left = layout.map_left;
+	map->vertices_top = layout.map_top;
+	map->vertices_size = layout.map_size;
+	map->vertices_thickness = layout.map_thickness;
+}
+
+void BuildTrackMap(OverlayBatch *batch, const OverlayLayout &layout, TrackMap *map)
+{
+	if (! layout.map_enabled || map->num_points < 2)
+		return;
+
+	if (map->vertices_version != map->points_version
+		|| map->vertices_left != layout.map_left
+		|| map->vertices_top != layout.map_top
+		|| map->vertices_size != layout.map_size
+		|| map->vertices_thickness != layout.map_thickness)
+		BuildSegments(map, layout);
+
+	/* Positions are cached, only the color attribute changes */
+	unsigned int segments = map->num_points - 1;
+	for (unsigned int i = 0; i < segments; i++) {
+		OverlayVertex *v = &map->vertices[i * OVERLAY_VERTS_PER_QUAD];
+		for (unsigned int k = 0; k < OVERLAY_VERTS_PER_QUAD; k++)
+			v[k].color = map->colors[i];
+	}
+
+	OverlayBatchAddVertices(batch, map->vertices, segments * OVERLAY_VERTS_PER_QUAD);
+}
@@ -0,0 +1,212 @@
+/*
+rF2 Delta Best Plugin
+
+Broadcast receiver.
+
+Sample receiver of the UDP packets the plugin sends with
+"[Broadcast] Enabled=1" (see Broadcast.hpp). Once a second prints
+the latest packet, how many packets arrived, how many were lost or
+came out of order, from their sequence numbers, and their latency:
+from the snapshot being taken in the simulation thread to the packet
+being received, and from the packet being sent. Latencies only make
+sense with the sender on the same machine.
+
+On Linux, the CapturePlayer can stand in for the game:
+
+  CapturePlayer -s 1 -b 127.0.0.1:27184 DeltaBest.capture &
+  BroadcastReceiver -t 60
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -pthread -IInclude -ITools -ITools/Posix -D__cdecl= -o BroadcastReceiver \
+      Tools/BroadcastReceiver.cpp Source/Broadcast.cpp Source/SharedDelta.cpp \
+      Source/InputTrace.cpp Source/SegmentStats.cpp \
+      Source/DeltaEngine.cpp \
+      Source/DeltaGraph.cpp Source/TrackMap.cpp Source/OverlayGeometry.cpp -lrt
+
+Usage:
+
+  BroadcastReceiver [-p port] [-t seconds]
+
+  -p  Port to listen to, the plugin's default if not given
+  -t  Stop after that many seconds, runs until interrupted by default
+
+*/
+
+#include "Broadcast.hpp"
+#include "PluginConfig.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+/* How long recv() waits, so that reports come out on time */
+#define RECEIVE_TIMEOUT_MS      200
+
+struct Reception {
+	unsigned long received;
+	unsigned long lost;
+	unsigned long reordered;
+	std::vector<double> latency;       /* Microseconds, sample to reception */
+	std::vector<double> network;       /* Microseconds, send to reception */
+};
+
+static void ResetReception(Reception *r)
+{
+	r->received = r->lost = r->reordered = 0;
+	r->latency.clear();
+	r->network.clear();
+}
+
+static double Percentile(std::vector<double> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+static void PrintReception(const char *label, Reception *r, double seconds)
+{
+	std::sort(r->latency.begin(), r->latency.end());
+	std::sort(r->network.begin(), r->network.end());
+	unsigned long expected = r->received + r->lost;
+	printf("%s%6lu packets %6.1f/s  lost %lu (%.2f%%) reordered %lu  latency us p50 %7.1f p99 %7.1f max %8.1f  send to receive p50 %6.1f\n",
+		label, r->received, seconds > 0 ? r->received / seconds : 0, r->lost,
+		expected > 0 ? 100.0 * r->lost / expected : 0, r->reordered,
+		Percentile(r->latency, 0.5), Percentile(r->latency, 0.99), r->latency.empty() ? 0 : r->latency.back(),
+		Percentile(r->network, 0.5));
+}
+
+static void PrintPacket(const BroadcastPacket &packet)
+{
+	if (! (packet.flags & SHARED_DELTA_REALTIME)) {
+		printf("  #%u not driving\n", packet.sequence);
+		return;
+	}
+
+	printf("  #%u et %9.3f  lap %7.1f/%.0fm %8.3fs", packet.sequence, packet.session_et,
+		packet.lap_distance, packet.track_length, packet.lap_elapsed);
+	if (packet.flags & SHARED_DELTA_VALID)
+		printf("  delta %+7.3f (%+.3f/s, %+.3f/100m)  gap %+6.1fm  predicted %.3f of %.3f",
+			packet.delta, packet.delta_rate, packet.delta_slope, packet.distance_gap, packet.predicted_lap, packet.best_lap);
+	if (packet.split_sector == 3)
+		printf("  line %+7.3f", packet.split_delta);
+	else if (packet.split_sector != 0)
+		printf("  S%d %+7.3f", packet.split_sector, packet.split_delta);
+	printf("\n");
+}
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: BroadcastReceiver [-p port] [-t seconds]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int port = DEFAULT_BROADCAST_PORT;
+	double run_seconds = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+			port = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			run_seconds = atof(argv[++i]);
+		else
+			Usage();
+	}
+
+	int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons((unsigned short) port);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (s < 0 || bind(s, (const sockaddr *) &local, sizeof(local)) != 0) {
+		fprintf(stderr, "Can't listen to port %u\n", port);
+		return 2;
+	}
+
+	struct timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = RECEIVE_TIMEOUT_MS * 1000;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	Reception second, total;
+	ResetReception(&second);
+	ResetReception(&total);
+	BroadcastPacket last;
+	memset(&last, 0, sizeof(last));
+	bool have_packet = false;
+	uint32_t expected = 0;
+	unsigned long invalid = 0;
+
+	uint64_t start = SharedDeltaClock(), report = start;
+	for (;;) {
+		uint64_t now = SharedDeltaClock();
+		if (run_seconds > 0 && now - start >= (uint64_t) (run_seconds * 1e9))
+			break;
+
+		if (now - report >= 1000000000ULL) {
+			PrintReception("", &second, (now - report) / 1e9);
+			if (have_packet)
+				PrintPacket(last);
+			ResetReception(&second);
+			report = now;
+		}
+
+		char datagram[512];
+		ssize_t size = recv(s, datagram, sizeof(datagram), 0);
+		if (size < 0)
+			continue;
+
+		uint64_t received = SharedDeltaClock();
+		BroadcastPacket packet;
+		if (! BroadcastDecode(datagram, (size_t) size, &packet)) {
+			invalid++;
+			continue;
+		}
+
+		/* The sender starts over from 0 when restarted */
+		if (have_packet && packet.sequence == 0 && expected > 1)
+			expected = 0;
+		if (packet.sequence >= expected) {
+			unsigned long gap = have_packet ? packet.sequence - expected : 0;
+			second.lost += gap;
+			total.lost += gap;
+			expected = packet.sequence + 1;
+		}
+		else {
+			second.reordered++;
+			total.reordered++;
+		}
+
+		second.received++;
+		total.received++;
+		if (received >= packet.sample_time) {
+			double us = (received - packet.sample_time) / 1000.0;
+			second.latency.push_back(us);
+			total.latency.push_back(us);
+		}
+		if (received >= packet.send_time) {
+			double us = (received - packet.send_time) / 1000.0;
+			second.network.push_back(us);
+			total.network.push_back(us);
+		}
+
+		last = packet;
+		have_packet = true;
+	}
+
+	PrintReception("Total ", &total, (SharedDeltaClock() - start) / 1e9);
+	if (invalid > 0)
+		printf("%lu datagrams that aren't packets of version %d\n", invalid, BROADCAST_VERSION);
+	close(s);
+	return 0;
+}
@@ -0,0 +1,501 @@
+/*
+rF2 Delta Best Plugin
+
+Capture player.
+
+Plays a DeltaBest.capture file, written by the plugin with
+"[Capture] Enabled=1", back into a DeltaEngine: the same scoring
+and telemetry structures, lifecycle callbacks, commands, config
+and best lap the plugin had, in the same order. Prints the laps,
+and optionally writes or checks the delta at every scoring update
+in the same "golden" format as the ReplayRunner.
+
+The captured structures are used as they are, so the player must be
+built for the same pointer size as the plugin (64-bit for Bin64).
+InternalsPlugin.hpp takes care of the rest of the layout.
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -pthread -IInclude -ITools -ITools/Posix -D__cdecl= -o CapturePlayer \
+      Tools/CapturePlayer.cpp Tools/Replay.cpp Source/Capture.cpp Source/SharedDelta.cpp \
+      Source/Broadcast.cpp Source/InputTrace.cpp Source/SegmentStats.cpp Source/LapArchive.cpp \
+      Source/DeltaEngine.cpp Source/PluginConfig.cpp Source/IniFile.cpp \
+      Source/DeltaGraph.cpp Source/TrackMap.cpp Source/OverlayGeometry.cpp
+
+Usage:
+
+  CapturePlayer [-s speed] [-p] [-b address:port] [-i] [-x out.segments] [-a archive] [-c DeltaBest.ini] [-o out.golden] [-g in.golden] DeltaBest.capture
+
+  -s  Playback speed, 1 for real time, 0 (the default) as fast as possible
+  -p  Publish the live state to shared memory as the plugin does, for
+      testing readers such as SharedDeltaReader (best with -s 1)
+  -b  Broadcast the delta over UDP as the plugin does, at the configured
+      rate, for testing receivers such as BroadcastReceiver
+  -i  Cut each best lap into corners, and print the time of each lap
+      in every corner against the best lap, and how its inputs compare,
+      as in the [Corners] section of the stats file
+  -x  Write the statistics per segment of the last session played, as
+      the plugin does at the end of a session, for the SegmentReport
+  -a  Append every lap to the lap archive "archive.laps" and ".index",
+      as the plugin does, with the corners of the best laps if -i
+  -c  Config to play with, instead of the one captured
+  -o  Write the delta at every scoring update to a golden file
+  -g  Compare with a golden file, exits with 1 if different
+
+*/
+
+#include "Capture.hpp"
+#include "CommandQueue.hpp"
+#include "Replay.hpp"
+#include "Broadcast.hpp"
+#include "LapArchive.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+struct Player {
+	DeltaEngine *engine;
+	PluginConfig config;
+	bool config_override;
+	bool print_corners;
+	const char *archive;
+	unsigned long corner_laps;
+	InputTrace *loaded_speeds;
+
+	/* Of the player, from the last scoring update */
+	char track[64];
+	char vehicle_class[32];
+
+	/* Best lap loaded by the plugin, for the next load callback */
+	LapTime *loaded_lap;
+	bool has_loaded_lap;
+
+	/* Player lap in progress */
+	bool lap_open;
+	double lap_start;
+	ReplayLap lap;
+
+	ReplayResult result;
+	unsigned long records[CAPTURE_RECORD_TYPES];
+};
+
+static void LoadBestLap(void *context, LapTime *lap, const ScoringInfoV01 &, const VehicleScoringInfoV01 &)
+{
+	Player *player = (Player *) context;
+
+	if (player->has_loaded_lap) {
+		memcpy(lap, player->loaded_lap, sizeof(*lap));
+		player->has_loaded_lap = false;
+	}
+}
+
+/* Right away, where the plugin does it in the background */
+static void FindReferenceCorners(void *context, const LapTime &lap, const InputTrace &inputs, unsigned long reference)
+{
+	Player *player = (Player *) context;
+	const InputTrace *trace = &inputs;
+	if (inputs.bins == 0) {
+		InputTraceFromTimes(player->loaded_speeds, lap.elapsed, MAX_TRACK_LENGTH);
+		trace = player->loaded_speeds;
+	}
+
+	CornerMap corners;
+	FindCorners(*trace, &corners);
+	DeltaEngineSetCorners(player->engine, corners, reference);
+
+	printf("Best lap %.3f, %u corners:", lap.final, corners.count);
+	for (unsigned int i = 0; i < corners.count; i++)
+		printf(" %.0f", corners.apex[i]);
+	printf("\n");
+}
+
+static void PrintCornerTimes(const CornerTimes &times)
+{
+	printf("Lap %.3f against %.3f, per corner:", times.lap_time, times.reference_time);
+	for (unsigned int i = 0; i < times.corners.count; i++)
+		printf(" %+.3f", times.delta[i]);
+	printf("\n");
+}
+
+static void PrintCorners(void *, const CornerMap &corners, const InputTrace &lap, const InputTrace &reference,
+	double lap_time, double reference_time)
+{
+	InputComparison comparison;
+	CompareInputTraces(corners, reference, lap, &comparison);
+
+	printf("Inputs %.3f against %.3f, %u corners (start apex end, time brake min speed throttle steering, gear)\n",
+		lap_time, reference_time, comparison.count);
+	for (unsigned int i = 0; i < comparison.count; i++) {
+		const InputCorner &corner = comparison.corners[i];
+		printf("  %2u %5.0f %5.0f %5.0fm  %+6.3fs", i + 1, corner.start, corner.apex, corner.end, corner.time_delta);
+		if (corner.braked)
+			printf(" %+4.0fm", corner.brake_point);
+		else
+			printf("      ");
+		printf(" %+5.1fm/s", corner.min_speed);
+		if (corner.throttled)
+			printf(" %+4.0fm", corner.throttle_point);
+		else
+			printf("      ");
+		if (corner.steered)
+			printf(" %+4.0f%%", corner.steering * 100.0f);
+		else
+			printf("      ");
+		printf("  %d/%d\n", corner.gear, corner.reference_gear);
+	}
+}
+
+static long ArchiveLap(void *context, const LapTime *lap, bool ended_at_line,
+	const ScoringInfoV01 &scoring, const VehicleScoringInfoV01 &veh)
+{
+	Player *player = (Player *) context;
+	LapArchiveEntry entry;
+	LapArchiveEntryInit(&entry, ended_at_line, scoring, veh);
+
+	long archived = LapArchiveAppend(player->archive, *lap, entry);
+	if (archived < 0)
+		fprintf(stderr, "Can't archive the lap of %.3f to '%s'\n", lap->final, player->archive);
+	return archived;
+}
+
+/* Corners of the best lap, once found */
+static void SaveCorners(void *context, const LapTime *lap, const ScoringInfoV01 &, const VehicleScoringInfoV01 &)
+{
+	Player *player = (Player *) context;
+	if (lap->corners.count > 0 && lap->archive_entry >= 0 && ! LapArchiveSetCorners(player->archive, lap->archive_entry, lap->corners))
+		fprintf(stderr, "Can't save the corners of lap %ld to '%s'\n", lap->archive_entry, player->archive);
+}
+
+static void NewEngine(Player *player)
+{
+	if (player->engine != NULL)
+		DeltaEngineDestroy(player->engine);
+
+	player->engine = DeltaEngineCreate();
+	player->engine->load_best_lap = LoadBestLap;
+	if (player->print_corners) {
+		player->engine->lap_completed = PrintCorners;
+		player->engine->new_reference = FindReferenceCorners;
+	}
+	if (player->archive != NULL) {
+		player->engine->archive_lap = ArchiveLap;
+		player->engine->save_best_lap = SaveCorners;
+	}
+	player->corner_laps = 0;
+	player->engine->callback_context = player;
+	player->has_loaded_lap = false;
+}
+
+static const VehicleScoringInfoV01 *FindPlayer(const ScoringInfoV01 &info)
+{
+	for (long i = 0; i < info.mNumVehicles; i++) {
+		if (info.mVehicle[i].mIsPlayer)
+			return &info.mVehicle[i];
+	}
+	return NULL;
+}
+
+/* Same laps and samples as the ReplayRunner */
+static void TrackLap(Player *player, const ScoringInfoV01 &info)
+{
+	const VehicleScoringInfoV01 *veh = FindPlayer(info);
+	if (veh == NULL)
+		return;
+
+	if (player->lap_open && veh->mLapStartET != player->lap_start) {
+		player->lap.final = veh->mLastLapTime;
+		player->lap.best = player->engine->best_lap.final;
+		player->result.laps.push_back(player->lap);
+		player->lap_open = false;
+	}
+
+	if (! player->lap_open) {
+		player->lap.number = (unsigned int) player->result.laps.size() + 1;
+		player->lap.final = 0;
+		player->lap.best = 0;
+		player->lap.samples.clear();
+		player->lap_start = veh->mLapStartET;
+		player->lap_open = true;
+	}
+
+	if (DeltaEngineHasDelta(player->engine)) {
+		ReplaySample sample;
+		sample.meters = (float) player->engine->last_pos;
+		sample.delta = (float) DeltaEngineCalculateDelta(player->engine);
+		player->lap.samples.push_back(sample);
+	}
+}
+
+static bool PlayRecord(Player *player, const CaptureReader &reader, const CaptureRecordHeader &header,
+	const std::vector<char> &payload)
+{
+	ScoringInfoV01 scoring;
+	std::vector<VehicleScoringInfoV01> vehicles;
+	TelemInfoV01 telemetry;
+	unsigned int command;
+
+	switch (header.type) {
+
+	case CAPTURE_OPEN:
+		if (! CaptureReaderCompatible(&reader)) {
+			fprintf(stderr, "Captured with different structures (version %u, pointers %u, scoring %u+%u, telemetry %u, best lap %u bytes)\n",
+				reader.info.version, reader.info.pointer_size, reader.info.scoring_size, reader.info.vehicle_size,
+				reader.info.telemetry_size, reader.info.best_lap_size);
+			return false;
+		}
+		/* The game was restarted, so was the plugin */
+		NewEngine(player);
+		break;
+
+	case CAPTURE_START_SESSION:
+		DeltaEngineStartSession(player->engine);
+		break;
+
+	case CAPTURE_END_SESSION:
+		DeltaEngineEndSession(player->engine);
+		break;
+
+	case CAPTURE_ENTER_REALTIME:
+		DeltaEngineEnterRealtime(player->engine);
+		break;
+
+	case CAPTURE_EXIT_REALTIME:
+		DeltaEngineExitRealtime(player->engine);
+		break;
+
+	case CAPTURE_SCORING:
+		if (! CaptureGetScoring(payload, &scoring, &vehicles))
+			return false;
+		DeltaEngineUpdateScoring(player->engine, player->config, scoring);
+		TrackLap(player, scoring);
+		if (FindPlayer(scoring) != NULL) {
+			memcpy(player->track, scoring.mTrackName, sizeof(player->track));
+			memcpy(player->vehicle_class, FindPlayer(scoring)->mVehicleClass, sizeof(player->vehicle_class));
+		}
+		break;
+
+	case CAPTURE_TELEMETRY:
+		if (! CaptureGetTelemetry(payload, &telemetry))
+			return false;
+		DeltaEngineUpdateTelemetry(player->engine, player->config, telemetry);
+		break;
+
+	case CAPTURE_COMMAND:
+		if (payload.size() != sizeof(command))
+			return false;
+		memcpy(&command, &payload[0], sizeof(command));
+		if (command == CMD_RESET_BEST_LAP)
+			DeltaEngineResetBestLap(player->engine);
+		break;
+
+	case CAPTURE_CONFIG:
+		/* Only if the config hasn't changed since the capture */
+		if (! player->config_override && reader.info.config_size == sizeof(PluginConfig) && payload.size() == sizeof(PluginConfig))
+			memcpy(&player->config, &payload[0], sizeof(PluginConfig));
+		break;
+
+	case CAPTURE_BEST_LAP:
+		if (! CaptureGetLap(payload, player->loaded_lap))
+			return false;
+		player->has_loaded_lap = true;
+		break;
+	}
+
+	player->records[header.type]++;
+	return true;
+}
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: CapturePlayer [-s speed] [-p] [-b address:port] [-i] [-x out.segments] [-a archive] [-c DeltaBest.ini] [-o out.golden] [-g in.golden] DeltaBest.capture\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	double speed = 0;
+	bool publish = false, print_corners = false;
+	char broadcast_address[BROADCAST_ADDRESS_MAXLEN] = "";
+	unsigned int broadcast_port = 0;
+	const char *ini_file = NULL, *out_file = NULL, *golden_file = NULL, *capture_file = NULL, *segments_file = NULL;
+	const char *archive = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			speed = atof(argv[++i]);
+		else if (strcmp(argv[i], "-p") == 0)
+			publish = true;
+		else if (strcmp(argv[i], "-i") == 0)
+			print_corners = true;
+		else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc)
+			segments_file = argv[++i];
+		else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+			archive = argv[++i];
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			const char *colon = strchr(argv[++i], ':');
+			if (colon == NULL || colon - argv[i] >= BROADCAST_ADDRESS_MAXLEN)
+				Usage();
+			memcpy(broadcast_address, argv[i], colon - argv[i]);
+			broadcast_address[colon - argv[i]] = '\0';
+			broadcast_port = atoi(colon + 1);
+		}
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			ini_file = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			out_file = argv[++i];
+		else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+			golden_file = argv[++i];
+		else if (argv[i][0] == '-' || capture_file != NULL)
+			Usage();
+		else
+			capture_file = argv[i];
+	}
+
+	if (capture_file == NULL)
+		Usage();
+
+	Player *player = new Player;
+	player->engine = NULL;
+	player->config_override = ini_file != NULL;
+	player->print_corners = print_corners;
+	player->archive = archive;
+	player->loaded_speeds = new InputTrace;
+	player->track[0] = player->vehicle_class[0] = '\0';
+	player->loaded_lap = new LapTime;
+	player->has_loaded_lap = false;
+	player->lap_open = false;
+	player->lap_start = 0;
+	player->result.callbacks = 0;
+	memset(player->records, 0, sizeof(player->records));
+
+	IniFile ini;
+	if (ini_file != NULL && ! IniLoad(&ini, ini_file)) {
+		fprintf(stderr, "Can't read config '%s'\n", ini_file);
+		return 2;
+	}
+	LoadPluginConfig(player->config, ini);
+
+	SharedDelta shared;
+	memset(&shared, 0, sizeof(shared));
+	if (publish && ! SharedDeltaCreate(&shared, SHARED_DELTA_NAME)) {
+		fprintf(stderr, "Can't create shared memory '%s'\n", SHARED_DELTA_NAME);
+		return 2;
+	}
+
+	CaptureReader reader;
+	if (! CaptureReaderOpen(&reader, capture_file)) {
+		fprintf(stderr, "Can't open capture '%s'\n", capture_file);
+		return 2;
+	}
+
+	/* Rate as configured: the captured config, if any, only comes later */
+	static Broadcast broadcast;
+	if (broadcast_port != 0)
+		BroadcastStart(&broadcast, broadcast_address, broadcast_port, player->config.broadcast_rate);
+	SharedDeltaRate rate;
+	memset(&rate, 0, sizeof(rate));
+
+	CaptureRecordHeader header;
+	std::vector<char> payload;
+	bool ok = true;
+	double play_seconds = 0;
+	std::chrono::high_resolution_clock::time_point wall_start = std::chrono::high_resolution_clock::now();
+
+	while (CaptureReadRecord(&reader, &header, &payload)) {
+
+		if (player->engine == NULL && header.type != CAPTURE_OPEN) {
+			fprintf(stderr, "Not a capture file '%s'\n", capture_file);
+			ok = false;
+			break;
+		}
+
+		/* Timestamps start over with each capture in the file */
+		if (header.type == CAPTURE_OPEN) {
+			wall_start = std::chrono::high_resolution_clock::now();
+		}
+		else if (speed > 0) {
+			std::chrono::duration<double> due(header.timestamp / speed);
+			std::this_thread::sleep_until(wall_start + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(due));
+		}
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		if (! PlayRecord(player, reader, header, payload)) {
+			fprintf(stderr, "Bad record at %.3fs\n", header.timestamp);
+			ok = false;
+			break;
+		}
+		std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		play_seconds += elapsed.count();
+		player->result.callbacks++;
+
+		if (player->print_corners && player->engine->corner_times.laps != player->corner_laps) {
+			PrintCornerTimes(player->engine->corner_times);
+			player->corner_laps = player->engine->corner_times.laps;
+		}
+
+		if (shared.region != NULL || BroadcastDue(&broadcast)) {
+			SharedDeltaData data;
+			SharedDeltaSnapshot(&rate, player->engine, &data);
+			SharedDeltaPublish(&shared, data);
+			BroadcastPush(&broadcast, data);
+		}
+	}
+
+	CaptureReaderClose(&reader);
+	SharedDeltaClose(&shared);
+	BroadcastStop(&broadcast);
+	if (broadcast_port != 0)
+		printf("Broadcast %lu packets, %lu dropped, %lu errors\n", broadcast.sent.load(), broadcast.dropped, broadcast.errors.load());
+
+	/* Lap in progress when the capture ends */
+	if (player->lap_open) {
+		player->lap.best = player->engine->best_lap.final;
+		player->result.laps.push_back(player->lap);
+	}
+
+	printf("%lu records: %lu scoring, %lu telemetry, %lu sessions, %lu commands, %lu best laps loaded\n",
+		player->result.callbacks, player->records[CAPTURE_SCORING], player->records[CAPTURE_TELEMETRY],
+		player->records[CAPTURE_START_SESSION], player->records[CAPTURE_COMMAND], player->records[CAPTURE_BEST_LAP]);
+	for (size_t i = 0; i < player->result.laps.size(); i++) {
+		const ReplayLap &lap = player->result.laps[i];
+		printf("Lap %u: %.3f, best %.3f\n", lap.number, lap.final, lap.best);
+	}
+	printf("Engine time %.2f ms, %.0f callbacks/s\n", play_seconds * 1000.0,
+		play_seconds > 0 ? player->result.callbacks / play_seconds : 0);
+
+	if (ok && segments_file != NULL) {
+		printf("%lu laps per segment\n", player->engine->segment_stats.laps);
+		if (! SegmentStatsWrite(player->engine->segment_stats, segments_file, player->track, player->vehicle_class)) {
+			fprintf(stderr, "Can't write '%s'\n", segments_file);
+			ok = false;
+		}
+	}
+
+	if (ok && out_file != NULL && ! ReplayWriteGolden(out_file, player->result)) {
+		fprintf(stderr, "Can't write '%s'\n", out_file);
+		ok = false;
+	}
+
+	if (ok && golden_file != NULL) {
+		ReplayResult golden;
+		char message[256] = "";
+		if (! ReplayLoadGolden(golden_file, &golden)) {
+			fprintf(stderr, "Can't read '%s'\n", golden_file);
+			ok = false;
+		}
+		else if (! ReplayCompare(golden, player->result, REPLAY_DELTA_TOLERANCE, REPLAY_LAP_TIME_TOLERANCE, message, sizeof(message))) {
+			printf("FAIL %s\n", message);
+			ok = false;
+		}
+		else {
+			printf("OK\n");
+		}
+	}
+
+	if (player->engine != NULL)
+		DeltaEngineDestroy(player->engine);
+	delete player->loaded_lap;
+	delete player->loaded_speeds;
+	delete player;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,576 @@
+/*
+rF2 Delta Best Plugin
+
+Delta accuracy vs. cost benchmark.
+
+Plays sessions through a DeltaEngine once for each way the engine can
+estimate the distance and time between scoring updates, and measures
+how right the delta was at the timing lines: the last delta calculated
+before the line is compared with what it should have been, the lap
+time (or the sector 1 or 2 split) minus the same of the best lap.
+Also measures the CPU time the engine takes per scoring and telemetry
+callback.
+
+Sessions are capture files (see Capture.hpp and GenerateSession), or
+a built-in set of synthetic sessions when none is given.
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -pthread -IInclude -ITools -ITools/Posix -D__cdecl= -o DeltaBenchmark \
+      Tools/DeltaBenchmark.cpp Tools/SessionGenerator.cpp Source/Capture.cpp \
+      Source/InputTrace.cpp Source/SegmentStats.cpp \
+      Source/DeltaEngine.cpp Source/PluginConfig.cpp Source/IniFile.cpp \
+      Source/DeltaGraph.cpp Source/TrackMap.cpp Source/OverlayGeometry.cpp
+
+Usage:
+
+  DeltaBenchmark [-j threads] [-c DeltaBest.ini] [-o results.csv] [capture...]
+
+  -j  Number of threads, 1 by default so that CPU times are comparable
+  -c  Base config, the estimator modes only change what they need
+  -o  Also write one line per session and mode, for charts
+
+*/
+
+#include "SessionGenerator.hpp"
+#include "CommandQueue.hpp"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+/* Ways of estimating the position and time between scoring updates */
+struct EstimatorMode {
+	const char *name;
+	void (*setup)(PluginConfig *config);
+};
+
+static void ScoringOnly(PluginConfig *config)
+{
+	config->hires_updates = false;
+	config->odometry_calibration = false;
+	config->drift_correction = false;
+	config->sector_resync = false;
+}
+
+static void DeadReckoning(PluginConfig *config)
+{
+	config->hires_updates = true;
+	config->odometry_calibration = false;
+	config->drift_correction = false;
+	config->sector_resync = false;
+}
+
+static void Calibrated(PluginConfig *config)
+{
+	config->hires_updates = true;
+	config->odometry_calibration = true;
+	config->drift_correction = false;
+	config->sector_resync = false;
+}
+
+static void CalibratedResync(PluginConfig *config)
+{
+	Calibrated(config);
+	config->sector_resync = true;
+}
+
+static void ScoringOnlyDrift(PluginConfig *config)
+{
+	ScoringOnly(config);
+	config->drift_correction = true;
+}
+
+static void CalibratedDrift(PluginConfig *config)
+{
+	Calibrated(config);
+	config->drift_correction = true;
+}
+
+static const EstimatorMode modes[] = {
+	{ "scoring-only", ScoringOnly },
+	{ "dead-reckoning", DeadReckoning },
+	{ "calibrated", Calibrated },
+	{ "calibrated+resync", CalibratedResync },
+	{ "scoring+drift", ScoringOnlyDrift },
+	{ "calibrated+drift", CalibratedDrift },
+};
+
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+/* Built-in sessions, when no capture is given */
+struct SyntheticSession {
+	const char *name;
+	double track_length;
+	unsigned int laps;
+	unsigned int vehicles;
+	double telemetry_hz;
+	double position_noise;
+	double speed_noise;
+	double time_jitter;
+	unsigned int pit_every;
+	double reset_chance;
+	double reverse_chance;
+	double line_deviation;
+};
+
+static const SyntheticSession synthetic_sessions[] = {
+	/* name           length  laps cars  Hz  pos  speed  jitter pits reset reverse line */
+	{ "kart",           585,   30,   1,  90, 0.0, 0.000, 0.00,   0,  0.0,  0.0, 0.00 },
+	{ "circuit",       5000,   12,  20,  90, 0.2, 0.005, 0.02,   5,  0.1,  0.1, 0.03 },
+	{ "circuit-400hz", 5000,   12,  20, 400, 0.2, 0.005, 0.02,   5,  0.1,  0.1, 0.03 },
+	{ "noisy",         3000,   15,  10,  90, 1.0, 0.020, 0.10,   0,  0.0,  0.0, 0.05 },
+	{ "nordschleife", 25000,    4, 100, 400, 0.5, 0.010, 0.05,   0,  0.0,  0.0, 0.03 },
+};
+
+#define NUM_SYNTHETIC (sizeof(synthetic_sessions) / sizeof(synthetic_sessions[0]))
+
+/* Callbacks of a session, from a capture or made up */
+struct SessionSource {
+	SessionGenerator *gen;
+	CaptureReader reader;
+	bool compatible;
+	std::vector<char> payload;
+	ScoringInfoV01 scoring;
+	std::vector<VehicleScoringInfoV01> vehicles;
+	TelemInfoV01 telemetry;
+	unsigned int command;
+};
+
+static bool SourceOpen(SessionSource *source, const std::string &session)
+{
+	source->gen = NULL;
+	source->compatible = true;
+
+	for (unsigned int i = 0; i < NUM_SYNTHETIC; i++) {
+		const SyntheticSession &s = synthetic_sessions[i];
+		if (session != s.name)
+			continue;
+
+		GeneratorConfig config;
+		GeneratorDefaults(&config);
+		config.track_length = s.track_length;
+		config.laps = s.laps;
+		config.vehicles = s.vehicles;
+		config.telemetry_hz = s.telemetry_hz;
+		config.position_noise = s.position_noise;
+		config.speed_noise = s.speed_noise;
+		config.time_jitter = s.time_jitter;
+		config.pit_every = s.pit_every;
+		config.reset_chance = s.reset_chance;
+		config.reverse_chance = s.reverse_chance;
+		config.line_deviation = s.line_deviation;
+		config.lap_variation = 0.01;
+		config.seed = i + 1;
+		source->gen = GeneratorCreate(config);
+		return true;
+	}
+
+	return CaptureReaderOpen(&source->reader, session.c_str());
+}
+
+static void SourceClose(SessionSource *source)
+{
+	if (source->gen != NULL)
+		GeneratorDestroy(source->gen);
+	else
+		CaptureReaderClose(&source->reader);
+}
+
+/* Only what the engine needs: lifecycle, scoring, telemetry and commands.
+   The captured config and best lap are left out, sessions start from
+   scratch with the config of the mode. */
+static bool SourceNext(SessionSource *source, GeneratorEvent *event)
+{
+	if (source->gen != NULL)
+		return GeneratorNext(source->gen, event);
+
+	CaptureRecordHeader header;
+	while (CaptureReadRecord(&source->reader, &header, &source->payload)) {
+		event->type = (CaptureRecordType) header.type;
+		event->et = header.timestamp;
+		event->scoring = NULL;
+		event->telemetry = NULL;
+
+		switch (header.type) {
+
+		case CAPTURE_OPEN:
+			source->compatible = CaptureReaderCompatible(&source->reader);
+			if (! source->compatible)
+				return false;
+			break;
+
+		case CAPTURE_START_SESSION:
+		case CAPTURE_END_SESSION:
+		case CAPTURE_ENTER_REALTIME:
+		case CAPTURE_EXIT_REALTIME:
+			return true;
+
+		case CAPTURE_SCORING:
+			if (! CaptureGetScoring(source->payload, &source->scoring, &source->vehicles))
+				return false;
+			event->scoring = &source->scoring;
+			return true;
+
+		case CAPTURE_TELEMETRY:
+			if (! CaptureGetTelemetry(source->payload, &source->telemetry))
+				return false;
+			event->telemetry = &source->telemetry;
+			return true;
+
+		case CAPTURE_COMMAND:
+			if (source->payload.size() != sizeof(source->command))
+				return false;
+			memcpy(&source->command, &source->payload[0], sizeof(source->command));
+			return true;
+
+		default:
+			break;
+		}
+	}
+
+	return false;
+}
+
+struct BenchmarkJob {
+	std::string session;
+	unsigned int mode;
+
+	/* Filled in by the worker threads */
+	bool ok;
+	std::vector<double> errors;        /* Predicted minus true delta at the line, one per lap */
+	std::vector<double> split_errors;  /* Same at the end of sectors 1 and 2 */
+	std::vector<double> lap_errors;    /* Predicted lap time halfway round, minus the lap time */
+	unsigned long scoring_calls;
+	unsigned long telemetry_calls;
+	double scoring_seconds;
+	double telemetry_seconds;
+};
+
+static const VehicleScoringInfoV01 *FindPlayer(const ScoringInfoV01 &info)
+{
+	for (long i = 0; i < info.mNumVehicles; i++) {
+		if (info.mVehicle[i].mIsPlayer && info.mVehicle[i].mControl == 0)
+			return &info.mVehicle[i];
+	}
+	return NULL;
+}
+
+static void RunJob(BenchmarkJob *job, const PluginConfig &base_config)
+{
+	PluginConfig config = base_config;
+	modes[job->mode].setup(&config);
+
+	SessionSource *source = new SessionSource;
+	if (! SourceOpen(source, job->session)) {
+		delete source;
+		job->ok = false;
+		return;
+	}
+
+	DeltaEngine *engine = DeltaEngineCreate();
+	GeneratorEvent event;
+
+	/* Latest delta calculated, the lap it was calculated in, and after
+	   which scoring update. Laps ending in the pits, where there's no
+	   delta to compare, are left out. */
+	bool has_prediction = false;
+	double prediction = 0, prediction_lap = 0;
+	unsigned long prediction_scoring = 0;
+	signed char player_sector = 0;
+
+	/* Predicted lap time, as soon as past half the lap */
+	double halfway_prediction = 0, halfway_lap = 0;
+
+	while (SourceNext(source, &event)) {
+		typedef std::chrono::high_resolution_clock Clock;
+
+		switch (event.type) {
+
+		case CAPTURE_START_SESSION:
+			DeltaEngineStartSession(engine);
+			has_prediction = false;
+			break;
+
+		case CAPTURE_END_SESSION:
+			DeltaEngineEndSession(engine);
+			break;
+
+		case CAPTURE_ENTER_REALTIME:
+			DeltaEngineEnterRealtime(engine);
+			break;
+
+		case CAPTURE_EXIT_REALTIME:
+			DeltaEngineExitRealtime(engine);
+			has_prediction = false;
+			break;
+
+		case CAPTURE_COMMAND:
+			if (source->command == CMD_RESET_BEST_LAP)
+				DeltaEngineResetBestLap(engine);
+			break;
+
+		case CAPTURE_SCORING: {
+			double lap_before = engine->last_lap.started;
+			double best_before = engine->best_lap.final;
+			double best_sectors[2] = { engine->best_lap.sector[0], engine->best_lap.sector[1] };
+			bool fresh = has_prediction && prediction_scoring == job->scoring_calls;
+
+			Clock::time_point start = Clock::now();
+			DeltaEngineUpdateScoring(engine, config, *event.scoring);
+			std::chrono::duration<double> elapsed = Clock::now() - start;
+			job->scoring_seconds += elapsed.count();
+			job->scoring_calls++;
+
+			/* A lap just ended at the line (not with a reset to the garage,
+			   where mLastLapTime is the one before): how far off was the
+			   delta there? */
+			const VehicleScoringInfoV01 *veh = FindPlayer(*event.scoring);
+			if (veh != NULL && engine->last_lap.started != lap_before && lap_before > 0
+				&& fresh && prediction_lap == lap_before
+				&& veh->mLastLapTime > 0 && best_before > 0
+				&& fabs(veh->mLapStartET - lap_before - veh->mLastLapTime) < LAP_END_TOLERANCE)
+				job->errors.push_back(prediction - (veh->mLastLapTime - best_before));
+
+			/* Pit lane at the end of the lap: nothing to predict that from */
+			if (veh != NULL && engine->last_lap.started != lap_before && lap_before > 0 && ! veh->mInPits
+				&& halfway_lap == lap_before && halfway_prediction > 0 && veh->mLastLapTime > 0
+				&& fabs(veh->mLapStartET - lap_before - veh->mLastLapTime) < LAP_END_TOLERANCE)
+				job->lap_errors.push_back(halfway_prediction - veh->mLastLapTime);
+
+			/* Same at the end of sectors 1 and 2, against the best lap's splits */
+			if (veh != NULL && engine->last_lap.started == lap_before && fresh && prediction_lap == lap_before) {
+				if (player_sector == 1 && veh->mSector == 2 && veh->mCurSector1 > 0 && best_sectors[0] > 0)
+					job->split_errors.push_back(prediction - (veh->mCurSector1 - best_sectors[0]));
+				else if (player_sector == 2 && veh->mSector == 0 && veh->mCurSector2 > 0 && best_sectors[1] > 0)
+					job->split_errors.push_back(prediction - (veh->mCurSector2 - best_sectors[1]));
+			}
+			if (veh != NULL)
+				player_sector = veh->mSector;
+			break;
+		}
+
+		case CAPTURE_TELEMETRY: {
+			Clock::time_point start = Clock::now();
+			DeltaEngineUpdateTelemetry(engine, config, *event.telemetry);
+			std::chrono::duration<double> elapsed = Clock::now() - start;
+			job->telemetry_seconds += elapsed.count();
+			job->telemetry_calls++;
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		if (DeltaEngineHasDelta(engine)) {
+			has_prediction = true;
+			prediction = DeltaEngineCalculateDelta(engine);
+			prediction_lap = engine->last_lap.started;
+			prediction_scoring = job->scoring_calls;
+
+			if (halfway_lap != prediction_lap && DeltaEngineLapDistance(engine) >= engine->track_length / 2) {
+				halfway_prediction = DeltaEnginePredictedLap(engine);
+				halfway_lap = prediction_lap;
+			}
+		}
+	}
+
+	job->ok = source->compatible;
+	DeltaEngineDestroy(engine);
+	SourceClose(source);
+	delete source;
+}
+
+static void Worker(std::vector<BenchmarkJob> *jobs, std::atomic<size_t> *next, const PluginConfig *config)
+{
+	for (;;) {
+		size_t i = next->fetch_add(1);
+		if (i >= jobs->size())
+			break;
+		RunJob(&(*jobs)[i], *config);
+	}
+}
+
+struct ErrorStats {
+	unsigned int count;
+	double mean;
+	double stddev;
+	double p50;        /* Of the absolute error */
+	double p95;
+	double max;
+};
+
+static ErrorStats GetErrorStats(std::vector<double> errors)
+{
+	ErrorStats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	stats.count = (unsigned int) errors.size();
+	if (errors.empty())
+		return stats;
+
+	double sum = 0, sum2 = 0;
+	for (size_t i = 0; i < errors.size(); i++) {
+		sum += errors[i];
+		sum2 += errors[i] * errors[i];
+		errors[i] = fabs(errors[i]);
+	}
+	stats.mean = sum / errors.size();
+	double variance = sum2 / errors.size() - stats.mean * stats.mean;
+	stats.stddev = variance > 0 ? sqrt(variance) : 0;
+
+	std::sort(errors.begin(), errors.end());
+	stats.p50 = errors[(errors.size() - 1) / 2];
+	stats.p95 = errors[(size_t) ((errors.size() - 1) * 0.95)];
+	stats.max = errors.back();
+	return stats;
+}
+
+static double Nanoseconds(double seconds, unsigned long calls)
+{
+	return calls > 0 ? seconds * 1e9 / calls : 0;
+}
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: DeltaBenchmark [-j threads] [-c DeltaBest.ini] [-o results.csv] [capture...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int threads = 1;
+	const char *ini_file = NULL, *csv_file = NULL;
+	std::vector<std::string> sessions;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			ini_file = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			csv_file = argv[++i];
+		else if (argv[i][0] == '-')
+			Usage();
+		else
+			sessions.push_back(argv[i]);
+	}
+
+	if (sessions.empty()) {
+		for (unsigned int i = 0; i < NUM_SYNTHETIC; i++)
+			sessions.push_back(synthetic_sessions[i].name);
+	}
+	if (threads == 0)
+		threads = 1;
+
+	IniFile ini;
+	if (ini_file != NULL && ! IniLoad(&ini, ini_file)) {
+		fprintf(stderr, "Can't read config '%s'\n", ini_file);
+		return 2;
+	}
+	PluginConfig config;
+	LoadPluginConfig(config, ini);
+
+	std::vector<BenchmarkJob> jobs;
+	for (size_t s = 0; s < sessions.size(); s++) {
+		for (unsigned int m = 0; m < NUM_MODES; m++) {
+			BenchmarkJob job;
+			job.session = sessions[s];
+			job.mode = m;
+			job.ok = false;
+			job.scoring_calls = job.telemetry_calls = 0;
+			job.scoring_seconds = job.telemetry_seconds = 0;
+			jobs.push_back(job);
+		}
+	}
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> pool;
+	for (unsigned int t = 0; t < threads && t < jobs.size(); t++)
+		pool.push_back(std::thread(Worker, &jobs, &next, &config));
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+
+	FILE *csv = NULL;
+	if (csv_file != NULL) {
+		csv = fopen(csv_file, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Can't write '%s'\n", csv_file);
+			return 2;
+		}
+		fprintf(csv, "session,mode,laps,mean,stddev,p50,p95,max,splits,split_mean,split_stddev,split_p50,split_p95,split_max,"
+			"predicted,predicted_mean,predicted_stddev,predicted_p50,predicted_p95,predicted_max,"
+			"scoring_ns,telemetry_ns,tick_ns\n");
+	}
+
+	printf("Delta error (s), predicted minus true, at the line and at the end of sectors 1 and 2,\n"
+		"predicted lap time error (s) from halfway round the lap, and engine time per callback (ns)\n\n");
+	printf("%-20s %-17s %4s %7s %7s %7s %5s %7s %7s %7s %7s %7s %8s %8s\n",
+		"", "", "laps", "mean", "p95|e|", "max|e|", "split", "mean", "p95|e|", "max|e|", "lap p50", "p95", "scoring", "telem");
+
+	int failed = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const BenchmarkJob &job = jobs[i];
+		std::string name = job.session.size() > 20 ? "..." + job.session.substr(job.session.size() - 17) : job.session;
+
+		if (! job.ok) {
+			printf("%-20s %-17s can't be played\n", name.c_str(), modes[job.mode].name);
+			failed++;
+			continue;
+		}
+
+		ErrorStats line = GetErrorStats(job.errors);
+		ErrorStats split = GetErrorStats(job.split_errors);
+		ErrorStats lap = GetErrorStats(job.lap_errors);
+		double scoring_ns = Nanoseconds(job.scoring_seconds, job.scoring_calls);
+		double telemetry_ns = Nanoseconds(job.telemetry_seconds, job.telemetry_calls);
+		double tick_ns = Nanoseconds(job.scoring_seconds + job.telemetry_seconds, job.scoring_calls + job.telemetry_calls);
+
+		printf("%-20s %-17s %4u %+7.3f %7.3f %7.3f %5u %+7.3f %7.3f %7.3f %7.3f %7.3f %8.0f %8.0f\n",
+			name.c_str(), modes[job.mode].name, line.count, line.mean, line.p95, line.max,
+			split.count, split.mean, split.p95, split.max, lap.p50, lap.p95, scoring_ns, telemetry_ns);
+
+		if (csv != NULL)
+			fprintf(csv, "%s,%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f,%.1f,%.1f\n",
+				job.session.c_str(), modes[job.mode].name,
+				line.count, line.mean, line.stddev, line.p50, line.p95, line.max,
+				split.count, split.mean, split.stddev, split.p50, split.p95, split.max,
+				lap.count, lap.mean, lap.stddev, lap.p50, lap.p95, lap.max,
+				scoring_ns, telemetry_ns, tick_ns);
+	}
+
+	/* All sessions together, one line per mode */
+	printf("\n");
+	for (unsigned int m = 0; m < NUM_MODES; m++) {
+		std::vector<double> errors, split_errors, lap_errors;
+		double seconds = 0;
+		unsigned long calls = 0;
+
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (jobs[i].mode != m || ! jobs[i].ok)
+				continue;
+			errors.insert(errors.end(), jobs[i].errors.begin(), jobs[i].errors.end());
+			split_errors.insert(split_errors.end(), jobs[i].split_errors.begin(), jobs[i].split_errors.end());
+			lap_errors.insert(lap_errors.end(), jobs[i].lap_errors.begin(), jobs[i].lap_errors.end());
+			seconds += jobs[i].scoring_seconds + jobs[i].telemetry_seconds;
+			calls += jobs[i].scoring_calls + jobs[i].telemetry_calls;
+		}
+
+		ErrorStats line = GetErrorStats(errors);
+		ErrorStats split = GetErrorStats(split_errors);
+		ErrorStats lap = GetErrorStats(lap_errors);
+		printf("%-20s %-17s %4u %+7.3f %7.3f %7.3f %5u %+7.3f %7.3f %7.3f %7.3f %7.3f %8.0f ns/callback\n",
+			"all", modes[m].name, line.count, line.mean, line.p95, line.max,
+			split.count, split.mean, split.p95, split.max, lap.p50, lap.p95, Nanoseconds(seconds, calls));
+	}
+
+	if (csv != NULL)
+		fclose(csv);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/*
+rF2 Delta Best Plugin
+
+Synthetic session generator, command line.
+
+Writes a made up session (see SessionGenerator.hpp) as a capture
+file, to be played with the CapturePlayer, like one recorded by the
+plugin with "[Capture] Enabled=1".
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -pthread -IInclude -ITools -ITools/Posix -D__cdecl= -o GenerateSession \
+      Tools/GenerateSession.cpp Tools/SessionGenerator.cpp Source/Capture.cpp \
+      Source/DeltaEngine.cpp Source/DeltaGraph.cpp Source/TrackMap.cpp \
+      Source/OverlayGeometry.cpp Source/InputTrace.cpp Source/SegmentStats.cpp
+
+Usage:
+
+  GenerateSession [options] out.capture
+
+  -l meters   Track length (5000)
+  -n laps     Player laps (10)
+  -v cars     Number of cars, including the player (20)
+  -s hz       Scoring rate (5)
+  -t hz       Telemetry rate, 0 for none (90)
+  -T seconds  Player lap time, defaults to an average of 45 m/s
+  -V ratio    Lap to lap pace variation (0.005)
+  -P meters   Noise on the scoring lap distance (0)
+  -S ratio    Noise on the telemetry speed (0)
+  -J ratio    Jitter on the telemetry time step (0)
+  -L ratio    Racing line shorter than the lap distance in corners (0)
+  -p laps     Pit stop every that many laps (never)
+  -r chance   Chance of a reset to the garage, every lap (0)
+  -b chance   Chance of driving backwards for a while, every lap (0)
+  -x seed     Random seed (1)
+
+  ./GenerateSession -l 25000 -v 120 -t 400 -P 0.5 -p 4 -r 0.1 -b 0.1 nords.capture
+  ./CapturePlayer nords.capture
+
+*/
+
+#include "SessionGenerator.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: GenerateSession [-l meters] [-n laps] [-v cars] [-s hz] [-t hz] [-T seconds] [-V ratio]\n"
+		"       [-P meters] [-S ratio] [-J ratio] [-L ratio] [-p laps] [-r chance] [-b chance] [-x seed] out.capture\n");
+	exit(2);
+}
+
+static void WriteRecord(CaptureEncoder *encoder, FILE *f, CaptureRecordType type, double timestamp,
+	const void *data, size_t size)
+{
+	CaptureRecordHeader header;
+	header.type = (unsigned short) type;
+	header.flags = 0;
+	header.size = (unsigned int) size;
+	header.timestamp = timestamp;
+	CaptureWriteRecord(encoder, f, header, data);
+}
+
+int main(int argc, char **argv)
+{
+	GeneratorConfig config;
+	const char *out_file = NULL;
+
+	GeneratorDefaults(&config);
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (arg[0] != '-') {
+			if (out_file != NULL)
+				Usage();
+			out_file = arg;
+			continue;
+		}
+		if (strlen(arg) != 2 || i + 1 >= argc)
+			Usage();
+
+		const char *value = argv[++i];
+		switch (arg[1]) {
+		case 'l': config.track_length = atof(value); break;
+		case 'n': config.laps = atoi(value); break;
+		case 'v': config.vehicles = atoi(value); break;
+		case 's': config.scoring_hz = atof(value); break;
+		case 't': config.telemetry_hz = atof(value); break;
+		case 'T': config.lap_time = atof(value); break;
+		case 'V': config.lap_variation = atof(value); break;
+		case 'P': config.position_noise = atof(value); break;
+		case 'S': config.speed_noise = atof(value); break;
+		case 'J': config.time_jitter = atof(value); break;
+		case 'L': config.line_deviation = atof(value); break;
+		case 'p': config.pit_every = atoi(value); break;
+		case 'r': config.reset_chance = atof(value); break;
+		case 'b': config.reverse_chance = atof(value); break;
+		case 'x': config.seed = atoi(value); break;
+		default: Usage();
+		}
+	}
+
+	if (out_file == NULL || config.track_length < 100 || config.laps == 0)
+		Usage();
+
+	FILE *f = fopen(out_file, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "Can't write '%s'\n", out_file);
+		return 2;
+	}
+
+	CaptureEncoder *encoder = new CaptureEncoder;
+	CaptureInfo info;
+	CaptureGetInfo(&info);
+	WriteRecord(encoder, f, CAPTURE_OPEN, 0, &info, sizeof(info));
+
+	SessionGenerator *gen = GeneratorCreate(config);
+	GeneratorEvent event;
+	std::vector<char> scoring;
+	CaptureTelemInfo telemetry;
+	unsigned long records = 1, scoring_records = 0, telemetry_records = 0;
+
+	while (GeneratorNext(gen, &event)) {
+		switch (event.type) {
+
+		case CAPTURE_SCORING:
+			CaptureEncodeScoring(*event.scoring, &scoring);
+			WriteRecord(encoder, f, event.type, event.et, &scoring[0], scoring.size());
+			scoring_records++;
+			break;
+
+		case CAPTURE_TELEMETRY:
+			CaptureEncodeTelemetry(*event.telemetry, &telemetry);
+			WriteRecord(encoder, f, event.type, event.et, &telemetry, sizeof(telemetry));
+			telemetry_records++;
+			break;
+
+		default:
+			WriteRecord(encoder, f, event.type, event.et, NULL, 0);
+			break;
+		}
+		records++;
+	}
+
+	long bytes = ftell(f);
+	printf("%s: %.0f m, %u cars, %.1f minutes, %lu records (%lu scoring, %lu telemetry), %.1f MB\n",
+		out_file, gen->config.track_length, (unsigned int) gen->cars.size(), gen->et / 60,
+		records, scoring_records, telemetry_records, bytes / (1024.0 * 1024.0));
+
+	GeneratorDestroy(gen);
+	delete encoder;
+	fclose(f);
+	return 0;
+}
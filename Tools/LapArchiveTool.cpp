@@ -0,0 +1,185 @@
+/*
+rF2 Delta Best Plugin
+
+Lap archive tool.
+
+Lists the laps of a lap archive (see LapArchive.hpp) from its index:
+lap time, sectors, date, session, weather, driver, and whether it
+ended at the line. The fastest valid lap, the one the plugin picks by
+default, is marked with a "*".
+
+With -m, appends all the laps of another archive, f.ex. the one of a
+teammate for the same track and class, keeping who drove them and in
+which conditions, so that "[Reference] Lap=2" can pick them.
+
+The archives are in "Userdata\player\Settings\DeltaBest", named after
+the track and the vehicle class, without the extension:
+
+  LapArchiveTool "Sebring_GT3"
+  LapArchiveTool -m "teammate/Sebring_GT3" "Sebring_GT3"
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -IInclude -ITools/Posix -D__cdecl= -o LapArchiveTool \
+      Tools/LapArchiveTool.cpp Source/LapArchive.cpp Source/DeltaEngine.cpp \
+      Source/DeltaGraph.cpp Source/TrackMap.cpp Source/OverlayGeometry.cpp \
+      Source/InputTrace.cpp Source/SegmentStats.cpp
+
+Usage:
+
+  LapArchiveTool [-l entry] [-m other] archive
+
+  -l  Load that lap out of the archive, and print its times and corners
+  -m  Append the laps of the other archive to this one
+
+*/
+
+#include "LapArchive.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: LapArchiveTool [-l entry] [-m other] archive\n");
+	exit(2);
+}
+
+static const char *SessionName(int session)
+{
+	if (session < 0)
+		return "?";
+	if (session == 0)
+		return "test";
+	if (session <= 4)
+		return "practice";
+	if (session <= 8)
+		return "qualify";
+	if (session == 9)
+		return "warmup";
+	return "race";
+}
+
+static void PrintEntry(const LapArchiveEntry &entry, long n, bool fastest)
+{
+	char date[32] = "?";
+	time_t t = (time_t) entry.date;
+	if (entry.date != 0)
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&t));
+
+	printf("%5ld%s %9.3f %8.3f %8.3f  %-16s %-8s", n, fastest ? "*" : " ", entry.lap_time,
+		entry.sector[0], entry.sector[1], date, SessionName(entry.session));
+	if (entry.flags & LAP_ARCHIVE_IMPORTED)
+		printf("  %-22s", "(imported)");
+	else
+		printf("  rain %.1f wet %.1f %3.0fC", entry.raining, entry.wetness, entry.track_temp);
+	printf("  %5um %2u corners  %-5s %s\n", entry.meters, entry.corners,
+		(entry.flags & LAP_ARCHIVE_VALID) ? "valid" : "-", entry.driver);
+}
+
+static bool List(const char *base)
+{
+	LapArchiveIndex index;
+	if (! LapArchiveOpenIndex(&index, base)) {
+		fprintf(stderr, "Can't open the archive '%s'\n", base);
+		return false;
+	}
+
+	LapArchiveQuery query;
+	memset(&query, 0, sizeof(query));
+	long fastest = LapArchiveFind(index, query);
+
+	printf("%u laps\n", index.count);
+	printf("  lap      time   sector1  sector2  date             session   conditions              length\n");
+	for (unsigned int i = 0; i < index.count; i++)
+		PrintEntry(index.entries[i], i, (long) i == fastest);
+
+	LapArchiveCloseIndex(&index);
+	return true;
+}
+
+static bool Load(const char *base, long n)
+{
+	LapArchiveIndex index;
+	if (! LapArchiveOpenIndex(&index, base)) {
+		fprintf(stderr, "Can't open the archive '%s'\n", base);
+		return false;
+	}
+
+	/* A few MB, off the stack */
+	LapTime *lap = new LapTime;
+	bool ok = LapArchiveLoad(base, index, n, lap);
+	if (ok) {
+		unsigned int meters = index.entries[n].meters;
+		printf("Lap %ld: %.3f, %u meters%s\n", n, lap->final, meters, lap->has_positions ? ", with positions" : "");
+		for (unsigned int m = 0; m < meters; m += 500)
+			printf("  %5um %8.3f\n", m, lap->elapsed[m]);
+		if (meters > 0)
+			printf("  %5um %8.3f\n", meters - 1, lap->elapsed[meters - 1]);
+		printf("  corners at");
+		for (unsigned int i = 0; i < lap->corners.count; i++)
+			printf(" %.0f", lap->corners.apex[i]);
+		printf("\n");
+	}
+	else
+		fprintf(stderr, "Can't load lap %ld of '%s'\n", n, base);
+
+	delete lap;
+	LapArchiveCloseIndex(&index);
+	return ok;
+}
+
+static bool Merge(const char *base, const char *other)
+{
+	LapArchiveIndex index;
+	if (! LapArchiveOpenIndex(&index, other)) {
+		fprintf(stderr, "Can't open the archive '%s'\n", other);
+		return false;
+	}
+
+	LapTime *lap = new LapTime;
+	unsigned int merged = 0;
+	bool ok = true;
+	for (unsigned int i = 0; i < index.count && ok; i++) {
+		if (! LapArchiveLoad(other, index, i, lap)) {
+			fprintf(stderr, "Can't load lap %u of '%s', skipped\n", i, other);
+			continue;
+		}
+		ok = LapArchiveAppend(base, *lap, index.entries[i]) >= 0;
+		if (ok)
+			merged++;
+		else
+			fprintf(stderr, "Can't append to '%s'\n", base);
+	}
+	printf("%u laps of %u appended\n", merged, index.count);
+
+	delete lap;
+	LapArchiveCloseIndex(&index);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	const char *base = NULL, *other = NULL;
+	long load = -1;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			load = atol(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			other = argv[++i];
+		else if (argv[i][0] == '-' || base != NULL)
+			Usage();
+		else
+			base = argv[i];
+	}
+	if (base == NULL)
+		Usage();
+
+	if (other != NULL && ! Merge(base, other))
+		return 1;
+	if (load >= 0)
+		return Load(base, load) ? 0 : 1;
+	return List(base) ? 0 : 1;
+}
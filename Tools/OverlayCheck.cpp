@@ -0,0 +1,368 @@
+/*
+rF2 Delta Best Plugin
+
+Overlay geometry check.
+
+Checks, without a graphics device, what the plugin draws:
+
+- the delta, lap time and distance gap texts turned into glyphs are
+  the same as what sprintf() prints, over a sweep of values, halfway
+  cases, -0.0 and tiny negatives included
+
+- the overlay key changes whenever the text does, so that a cached
+  batch is never drawn with a stale value
+
+- the quads of the bar, the time box and the delta text, for a fixed
+  layout and glyph atlas: how many, where, and which texels
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -IInclude -o OverlayCheck \
+      Tools/OverlayCheck.cpp Source/GlyphAtlas.cpp Source/OverlayGeometry.cpp
+
+Usage:
+
+  OverlayCheck [-v]
+
+  -v  Print every failed check, not only the first few
+
+Exits with 1 if any check fails.
+
+*/
+
+#include "GlyphAtlas.hpp"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Failures printed, unless -v */
+#define MAX_REPORTED            20
+
+static unsigned long checks = 0;
+static unsigned long failed = 0;
+static bool verbose = false;
+
+static void Check(bool ok, const char *format, ...)
+{
+	checks++;
+	if (ok)
+		return;
+
+	failed++;
+	if (! verbose && failed > MAX_REPORTED)
+		return;
+
+	va_list args;
+	va_start(args, format);
+	printf("FAIL ");
+	vprintf(format, args);
+	printf("\n");
+	va_end(args);
+}
+
+static void GlyphsToString(const int glyphs[], unsigned int count, char *text)
+{
+	for (unsigned int i = 0; i < count; i++)
+		text[i] = glyphs[i] >= 0 ? GLYPH_ATLAS_CHARS[glyphs[i]] : '?';
+	text[count] = '\0';
+}
+
+static void CheckDelta(double delta)
+{
+	char expected[32], text[DELTA_TEXT_MAXLEN + 1];
+	int glyphs[DELTA_TEXT_MAXLEN];
+
+	/* Clamped beyond that, the plugin clamps it to +/-99.0 anyway */
+	if (fabs(delta) > 99.99)
+		return;
+
+	sprintf(expected, "%+2.2f", delta);
+	GlyphsToString(glyphs, DeltaToGlyphs(delta, glyphs), text);
+	Check(strcmp(text, expected) == 0, "delta %.17g: \"%s\", sprintf \"%s\"", delta, text, expected);
+}
+
+static void CheckLapTime(double seconds)
+{
+	char rounded[32], expected[32], text[LAP_TIME_TEXT_MAXLEN + 1];
+	int glyphs[LAP_TIME_TEXT_MAXLEN];
+
+	/* Clamped to 0:00.00 and 99:59.99 */
+	if (seconds < 0 || seconds > 99 * 60 + 59.99)
+		return;
+
+	/* Rounded by sprintf, then split into minutes */
+	sprintf(rounded, "%.2f", seconds);
+	unsigned int hundredths = (unsigned int) (atof(rounded) * 100.0 + 0.5);
+	sprintf(expected, "%u:%02u.%02u", hundredths / 6000, (hundredths % 6000) / 100, hundredths % 100);
+
+	GlyphsToString(glyphs, LapTimeToGlyphs(seconds, glyphs), text);
+	Check(strcmp(text, expected) == 0, "lap time %.17g: \"%s\", sprintf \"%s\"", seconds, text, expected);
+}
+
+static void CheckGap(double meters)
+{
+	char expected[32], text[GAP_TEXT_MAXLEN + 1];
+	int glyphs[GAP_TEXT_MAXLEN];
+
+	/* Clamped to 9999m */
+	if (fabs(meters) > 9999)
+		return;
+
+	/* One decimal as long as it rounds below 100m */
+	sprintf(expected, "%+.1fm", meters);
+	if (fabs(atof(expected)) >= 100)
+		sprintf(expected, "%+.0fm", meters);
+
+	GlyphsToString(glyphs, GapToGlyphs(meters, glyphs), text);
+	Check(strcmp(text, expected) == 0, "gap %.17g: \"%s\", sprintf \"%s\"", meters, text, expected);
+}
+
+/* Every value near v: v itself, its neighbours, and its negative */
+static void CheckAround(double v, void (*check)(double))
+{
+	check(v);
+	check(nextafter(v, -1e9));
+	check(nextafter(v, 1e9));
+	check(-v);
+}
+
+static void CheckTexts()
+{
+	/* Every hundredth, and the halfway cases in between, where
+	   rounding from the binary value matters */
+	for (int k = 0; k < 10000; k++) {
+		CheckAround(k / 100.0, CheckDelta);
+		CheckAround((k + 0.5) / 100.0, CheckDelta);
+		CheckAround(k * 0.01 + 0.005, CheckDelta);
+	}
+
+	/* Exact halfway cases, that printf() rounds to even */
+	for (int k = 1; k < 800; k += 2)
+		CheckAround(k / 8.0, CheckDelta);
+
+	/* Sign of zero */
+	CheckDelta(0.0);
+	CheckDelta(-0.0);
+	CheckDelta(-1e-9);
+	CheckDelta(1e-300);
+	CheckDelta(-0.004999);
+
+	for (int k = 0; k < 360000; k += 7) {
+		CheckAround(k / 100.0, CheckLapTime);
+		CheckAround((k + 0.5) / 100.0, CheckLapTime);
+	}
+
+	for (int k = 0; k < 100000; k++) {
+		CheckAround(k / 10.0, CheckGap);
+		CheckAround((k + 0.5) / 10.0, CheckGap);
+	}
+	CheckGap(-0.0);
+	CheckGap(99.95);
+	CheckGap(-99.94999);
+
+	/* And anything in between */
+	srand(42);
+	for (int i = 0; i < 1000000; i++) {
+		double r = (double) rand() / RAND_MAX;
+		CheckDelta((r - 0.5) * 199.98);
+		CheckLapTime(r * 5999.99);
+		CheckGap((r - 0.5) * 19998);
+	}
+}
+
+static void MakeLayout(OverlayLayout *layout)
+{
+	memset(layout, 0, sizeof(*layout));
+	layout->screen_width = 1920;
+	layout->screen_height = 1080;
+	layout->bar_enabled = true;
+	layout->bar_top = 130;
+	layout->bar_width = 580;
+	layout->bar_height = 20;
+	layout->bar_gutter = 5;
+	layout->time_enabled = true;
+	layout->time_width = 128;
+	layout->time_height = 35;
+	layout->texture_width = 256;
+	layout->texture_height = 256;
+	layout->background_width = 64;
+	layout->background_height = 64;
+}
+
+/* 10 pixels wide digits and signs, narrower "." and ":", wider "m" */
+static void MakeAtlas(GlyphAtlas *atlas)
+{
+	unsigned int widths[GLYPH_ATLAS_NUM_CHARS];
+	for (unsigned int i = 0; i < GLYPH_ATLAS_NUM_CHARS; i++)
+		widths[i] = 10;
+	widths[GlyphAtlasIndex('.')] = 5;
+	widths[GlyphAtlasIndex(':')] = 5;
+	widths[GlyphAtlasIndex('m')] = 14;
+
+	memset(atlas, 0, sizeof(*atlas));
+	GlyphAtlasPack(atlas, widths, 20, 256, 64);
+	atlas->texture_width = 256;
+	atlas->texture_height = 256;
+	atlas->ready = true;
+}
+
+static bool Near(float a, float b)
+{
+	return fabs(a - b) < 1e-4f;
+}
+
+/* The 6 vertices of the quad, two triangles over (left, top, right, bottom) */
+static void CheckQuad(const OverlayBatch &batch, unsigned int quad, const char *name,
+	float left, float top, float right, float bottom, unsigned int color,
+	float u0, float v0, float u1, float v1)
+{
+	const float xs[OVERLAY_VERTS_PER_QUAD] = { left, right, left, left, right, right };
+	const float ys[OVERLAY_VERTS_PER_QUAD] = { top, top, bottom, bottom, top, bottom };
+	const float us[OVERLAY_VERTS_PER_QUAD] = { u0, u1, u0, u0, u1, u1 };
+	const float vs[OVERLAY_VERTS_PER_QUAD] = { v0, v0, v1, v1, v0, v1 };
+
+	if (quad * OVERLAY_VERTS_PER_QUAD + OVERLAY_VERTS_PER_QUAD > batch.num_vertices) {
+		Check(false, "%s: no quad %u", name, quad);
+		return;
+	}
+
+	for (unsigned int i = 0; i < OVERLAY_VERTS_PER_QUAD; i++) {
+		const OverlayVertex &v = batch.vertices[quad * OVERLAY_VERTS_PER_QUAD + i];
+		Check(Near(v.x, xs[i]) && Near(v.y, ys[i]), "%s vertex %u at (%g, %g), expected (%g, %g)",
+			name, i, v.x, v.y, xs[i], ys[i]);
+		Check(Near(v.u, us[i]) && Near(v.v, vs[i]), "%s vertex %u texel (%g, %g), expected (%g, %g)",
+			name, i, v.u, v.v, us[i], vs[i]);
+		Check(v.color == color && v.z == 0 && v.rhw == 1, "%s vertex %u color %08x z %g rhw %g",
+			name, i, v.color, v.z, v.rhw);
+	}
+}
+
+static void CheckQuads()
+{
+	const unsigned int BOX = 0xFF505050, BAR = 0xE000C800, TEXT = 0xE000FF00, SHADOW = 0xC0585858;
+
+	OverlayLayout layout;
+	GlyphAtlas atlas;
+	MakeLayout(&layout);
+	MakeAtlas(&atlas);
+
+	/* Cells of 10 + 2 pixels of padding: "-" is the second glyph, "5" the ninth */
+	const GlyphInfo &minus = atlas.glyphs[GlyphAtlasIndex('-')];
+	Check(minus.x == 13 && minus.y == 65 && minus.width == 10 && minus.height == 20,
+		"glyph \"-\" at (%g, %g) %gx%g", minus.x, minus.y, minus.width, minus.height);
+
+	static OverlayBatch batch;
+	OverlayBatchReset(&batch);
+	OverlayRect box;
+	BuildDeltaBar(&batch, layout, -0.5, BAR, BOX, &box);
+
+	/* Background, colored bar, time box */
+	Check(batch.num_vertices == 3 * OVERLAY_VERTS_PER_QUAD, "bar: %u vertices", batch.num_vertices);
+	Check(OverlayBatchPrimitives(&batch) == 6, "bar: %u primitives", OverlayBatchPrimitives(&batch));
+
+	/* Pre-transformed, so all offset by half a pixel. Plain quads are
+	   mapped on the 64x64 background, clamped to the quad size. */
+	CheckQuad(batch, 0, "bar background", 669.5f, 129.5f, 1249.5f, 149.5f, BOX, 0, 0, 0.25f, 20 / 256.0f);
+
+	/* -0.5s is a quarter of the right-hand half: 72 pixels from the center */
+	CheckQuad(batch, 1, "colored bar", 959.5f, 130.5f, 1031.5f, 148.5f, BAR, 0, 0, 0.25f, 18 / 256.0f);
+
+	/* Centered on the end of the colored bar, right below it */
+	Check(box.left == 968 && box.top == 155 && box.width == 128 && box.height == 35,
+		"time box at (%g, %g) %gx%g", box.left, box.top, box.width, box.height);
+	CheckQuad(batch, 2, "time box", 967.5f, 154.5f, 1095.5f, 189.5f, BOX, 0, 0, 0.25f, 35 / 256.0f);
+
+	/* "-0.50" is 45 pixels wide, centered in the box, shadow first */
+	OverlayBatchReset(&batch);
+	box.top -= 5;
+	LayoutDeltaText(&batch, atlas, -0.5, box, TEXT, SHADOW, 2);
+	Check(batch.num_vertices == 2 * 5 * OVERLAY_VERTS_PER_QUAD, "text: %u vertices", batch.num_vertices);
+
+	float u0 = 13 / 256.0f, v0 = 65 / 256.0f, u1 = 23 / 256.0f, v1 = 85 / 256.0f;
+	CheckQuad(batch, 0, "shadow \"-\"", 1010.5f, 151.5f, 1020.5f, 171.5f, SHADOW, u0, v0, u1, v1);
+	CheckQuad(batch, 5, "text \"-\"", 1008.5f, 149.5f, 1018.5f, 169.5f, TEXT, u0, v0, u1, v1);
+
+	/* "." is 5 pixels wide, after "-0" */
+	const GlyphInfo &dot = atlas.glyphs[GlyphAtlasIndex('.')];
+	CheckQuad(batch, 7, "text \".\"", 1028.5f, 149.5f, 1033.5f, 169.5f, TEXT,
+		dot.x / 256, dot.y / 256, (dot.x + 5) / 256, (dot.y + 20) / 256);
+
+	/* Lap time and gap, same layout */
+	OverlayBatchReset(&batch);
+	LayoutLapTimeText(&batch, atlas, 102.375, box, TEXT, SHADOW, 2);
+	Check(batch.num_vertices == 2 * 7 * OVERLAY_VERTS_PER_QUAD, "lap time: %u vertices", batch.num_vertices);
+	OverlayBatchReset(&batch);
+	LayoutGapText(&batch, atlas, -123.4, box, TEXT, SHADOW, 2);
+	Check(batch.num_vertices == 2 * 5 * OVERLAY_VERTS_PER_QUAD, "gap: %u vertices", batch.num_vertices);
+
+	/* Nothing without the atlas */
+	atlas.ready = false;
+	OverlayBatchReset(&batch);
+	LayoutDeltaText(&batch, atlas, -0.5, box, TEXT, SHADOW, 2);
+	Check(batch.num_vertices == 0, "text without atlas: %u vertices", batch.num_vertices);
+}
+
+/* The key of the previous value must differ whenever the text does */
+static void CheckKeys()
+{
+	OverlayLayout layout;
+	MakeLayout(&layout);
+
+	const int readouts[] = { READOUT_DELTA, READOUT_PREDICTED_LAP, READOUT_DISTANCE_GAP, READOUT_ROLLING_DELTA };
+	for (unsigned int r = 0; r < sizeof(readouts) / sizeof(readouts[0]); r++) {
+		int readout = readouts[r];
+		OverlayKey previous_key;
+		char previous_text[16] = "";
+
+		for (int k = -300000; k <= 300000; k++) {
+			double value = k / 2000.0;
+			char text[16];
+			int glyphs[16];
+			OverlayKey key;
+
+			/* The delta is always there, the readout only if asked for */
+			if (readout == READOUT_DELTA)
+				GlyphsToString(glyphs, DeltaToGlyphs(value / 10, glyphs), text);
+			else if (readout == READOUT_PREDICTED_LAP)
+				GlyphsToString(glyphs, LapTimeToGlyphs(value, glyphs), text);
+			else if (readout == READOUT_DISTANCE_GAP)
+				GlyphsToString(glyphs, GapToGlyphs(value, glyphs), text);
+			else
+				GlyphsToString(glyphs, DeltaToGlyphs(value / 10, glyphs), text);
+
+			if (readout == READOUT_DELTA)
+				MakeOverlayKey(&key, layout, value / 10, readout, 0, 0, 0, 0, 0);
+			else if (readout == READOUT_ROLLING_DELTA)
+				MakeOverlayKey(&key, layout, 0, readout, value / 10, 0, 0, 0, 0);
+			else
+				MakeOverlayKey(&key, layout, 0, readout, value, 0, 0, 0, 0);
+
+			if (k > -300000 && strcmp(text, previous_text) != 0)
+				Check(! OverlayKeyEquals(key, previous_key), "readout %d: same key for \"%s\" and \"%s\"",
+					readout, previous_text, text);
+			previous_key = key;
+			strcpy(previous_text, text);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-v") == 0)
+			verbose = true;
+		else {
+			fprintf(stderr, "Usage: OverlayCheck [-v]\n");
+			return 2;
+		}
+	}
+
+	CheckTexts();
+	CheckQuads();
+	CheckKeys();
+
+	printf("%lu checks, %lu failed\n", checks, failed);
+	return failed > 0 ? 1 : 0;
+}
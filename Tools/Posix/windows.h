@@ -0,0 +1,20 @@
+/*
+rF2 Delta Best Plugin
+
+Stand-in for <windows.h>, to build the tools outside Windows.
+
+The game headers (InternalsPlugin.hpp and PluginObjects.hpp) are used
+as shipped, and only need HWND from it. Build with -ITools/Posix, and
+with -D__cdecl= as PluginObjects.hpp uses it before this is included.
+
+The tools never use the game structures as laid out by the plugin:
+captures store them in a layout of their own (see CaptureScoringInfo).
+
+*/
+
+#ifndef _POSIX_WINDOWS_H
+#define _POSIX_WINDOWS_H
+
+typedef void *HWND;
+
+#endif /* _POSIX_WINDOWS_H */
@@ -0,0 +1,299 @@
+/*
+rF2 Delta Best Plugin
+
+Replay of recorded sessions through the DeltaEngine.
+
+*/
+
+#include "Replay.hpp"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool FindValue(const char *line, const char *key, double *value, const char **end)
+{
+	const char *p = strstr(line, key);
+	if (p == NULL)
+		return false;
+
+	char *value_end = NULL;
+	*value = strtod(p + strlen(key), &value_end);
+	if (end != NULL)
+		*end = value_end;
+	return value_end != p + strlen(key);
+}
+
+/* "mLapStartET=1.00 mCurrentET=2.00 ... mLapDist=3.00 / 1613.42", with or
+   without mLastLapTime and with or without blanks around the "/" */
+static bool ParseScoring(const char *line, ReplayEvent *event)
+{
+	const char *p = NULL;
+
+	if (! FindValue(line, "mLapStartET=", &event->lap_start_et, NULL)
+		|| ! FindValue(line, "mCurrentET=", &event->current_et, NULL)
+		|| ! FindValue(line, "mLapDist=", &event->lap_dist, &p))
+		return false;
+
+	while (*p == ' ' || *p == '/')
+		p++;
+	event->track_length = strtod(p, NULL);
+
+	if (! FindValue(line, "mLastLapTime=", &event->last_lap_time, NULL))
+		event->last_lap_time = 0;
+
+	event->type = REPLAY_SCORING;
+	return event->track_length > 0;
+}
+
+static bool ParseLifecycle(const char *line, ReplayEvent *event)
+{
+	if (line[0] != '-')
+		return false;
+
+	if (strstr(line, "-STARTSESSION-"))
+		event->type = REPLAY_START_SESSION;
+	else if (strstr(line, "-ENDSESSION-"))
+		event->type = REPLAY_END_SESSION;
+	else if (strstr(line, "-ENTERREALTIME-"))
+		event->type = REPLAY_ENTER_REALTIME;
+	else if (strstr(line, "-EXITREALTIME-"))
+		event->type = REPLAY_EXIT_REALTIME;
+	else
+		return false;
+
+	return true;
+}
+
+bool ReplayLoadLog(const char *path, std::vector<ReplayEvent> *events)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return false;
+
+	bool has_last_lap_time = false;
+	bool first_scoring = true;
+	double prev_lap_start = 0, last_lap_time = 0;
+	char line[1024];
+
+	events->clear();
+	while (fgets(line, sizeof(line), f) != NULL) {
+		ReplayEvent event;
+		memset(&event, 0, sizeof(event));
+
+		if (ParseLifecycle(line, &event)) {
+			events->push_back(event);
+			continue;
+		}
+
+		if (! ParseScoring(line, &event))
+			continue;
+
+		if (strstr(line, "mLastLapTime=") != NULL)
+			has_last_lap_time = true;
+
+		/* Not in the older logs. rF2 keeps the previous lap time for the
+		   whole lap, -1 when the lap wasn't timed (out of the pits). */
+		if (! has_last_lap_time) {
+			if (first_scoring)
+				last_lap_time = event.lap_start_et == 0.0 ? 0.0 : -1.0;
+			else if (event.lap_start_et != prev_lap_start)
+				last_lap_time = prev_lap_start > 0.0 ? event.lap_start_et - prev_lap_start : -1.0;
+			event.last_lap_time = last_lap_time;
+		}
+
+		first_scoring = false;
+		prev_lap_start = event.lap_start_et;
+		events->push_back(event);
+	}
+
+	fclose(f);
+	return true;
+}
+
+void ReplayRun(const std::vector<ReplayEvent> &events, const PluginConfig &config, ReplayResult *result)
+{
+	DeltaEngine *engine = DeltaEngineCreate();
+	ScoringInfoV01 scoring;
+	VehicleScoringInfoV01 vehicle;
+
+	memset(&scoring, 0, sizeof(scoring));
+	memset(&vehicle, 0, sizeof(vehicle));
+	scoring.mNumVehicles = 1;
+	scoring.mVehicle = &vehicle;
+	scoring.mGamePhase = GP_GREEN_FLAG;
+	vehicle.mIsPlayer = true;
+	vehicle.mControl = 0;
+
+	result->laps.clear();
+	result->callbacks = 0;
+
+	/* Logs may start in the middle of a session */
+	DeltaEngineStartSession(engine);
+	result->callbacks++;
+
+	bool lap_open = false;
+	double lap_start = 0;
+	ReplayLap lap;
+
+	for (size_t i = 0; i < events.size(); i++) {
+		const ReplayEvent &event = events[i];
+
+		switch (event.type) {
+
+		case REPLAY_START_SESSION:
+			DeltaEngineStartSession(engine);
+			break;
+
+		case REPLAY_END_SESSION:
+			DeltaEngineEndSession(engine);
+			break;
+
+		case REPLAY_ENTER_REALTIME:
+			DeltaEngineEnterRealtime(engine);
+			break;
+
+		case REPLAY_EXIT_REALTIME:
+			DeltaEngineExitRealtime(engine);
+			break;
+
+		case REPLAY_SCORING:
+
+			/* The plugin only logs scoring updates in realtime */
+			if (! engine->in_realtime) {
+				DeltaEngineEnterRealtime(engine);
+				result->callbacks++;
+			}
+
+			scoring.mCurrentET = event.current_et;
+			scoring.mLapDist = event.track_length;
+			vehicle.mLapStartET = event.lap_start_et;
+			vehicle.mLastLapTime = event.last_lap_time;
+			vehicle.mLapDist = event.lap_dist;
+			DeltaEngineUpdateScoring(engine, config, scoring);
+
+			if (lap_open && event.lap_start_et != lap_start) {
+				lap.final = event.last_lap_time;
+				lap.best = engine->best_lap.final;
+				result->laps.push_back(lap);
+				lap_open = false;
+			}
+
+			if (! lap_open) {
+				lap.number = (unsigned int) result->laps.size() + 1;
+				lap.final = 0;
+				lap.best = 0;
+				lap.samples.clear();
+				lap_start = event.lap_start_et;
+				lap_open = true;
+			}
+
+			if (DeltaEngineHasDelta(engine)) {
+				ReplaySample sample;
+				sample.meters = (float) engine->last_pos;
+				sample.delta = (float) DeltaEngineCalculateDelta(engine);
+				lap.samples.push_back(sample);
+			}
+			break;
+		}
+
+		result->callbacks++;
+	}
+
+	/* Lap in progress when the log ends */
+	if (lap_open) {
+		lap.best = engine->best_lap.final;
+		result->laps.push_back(lap);
+	}
+
+	DeltaEngineDestroy(engine);
+}
+
+bool ReplayWriteGolden(const char *path, const ReplayResult &result)
+{
+	FILE *f = fopen(path, "w");
+	if (f == NULL)
+		return false;
+
+	fprintf(f, "; DeltaBest replay output: lap times, then \"<meters> <delta>\" at each scoring update\n");
+	for (size_t i = 0; i < result.laps.size(); i++) {
+		const ReplayLap &lap = result.laps[i];
+		fprintf(f, "Lap=%u Final=%.3f Best=%.3f Samples=%u\n",
+			lap.number, lap.final, lap.best, (unsigned int) lap.samples.size());
+		for (size_t s = 0; s < lap.samples.size(); s++)
+			fprintf(f, "%.0f %+.3f\n", lap.samples[s].meters, lap.samples[s].delta);
+	}
+
+	fclose(f);
+	return true;
+}
+
+bool ReplayLoadGolden(const char *path, ReplayResult *result)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return false;
+
+	char line[256];
+	result->laps.clear();
+	result->callbacks = 0;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		ReplayLap lap;
+		unsigned int samples = 0;
+		ReplaySample sample;
+
+		if (line[0] == ';')
+			continue;
+
+		if (sscanf(line, "Lap=%u Final=%lf Best=%lf Samples=%u", &lap.number, &lap.final, &lap.best, &samples) == 4) {
+			result->laps.push_back(lap);
+			result->laps.back().samples.reserve(samples);
+		}
+		else if (! result->laps.empty() && sscanf(line, "%f %f", &sample.meters, &sample.delta) == 2) {
+			result->laps.back().samples.push_back(sample);
+		}
+	}
+
+	fclose(f);
+	return true;
+}
+
+bool ReplayCompare(const ReplayResult &expected, const ReplayResult &actual,
+	double delta_tolerance, double lap_time_tolerance, char *message, size_t size)
+{
+	if (expected.laps.size() != actual.laps.size()) {
+		snprintf(message, size, "%u laps, expected %u",
+			(unsigned int) actual.laps.size(), (unsigned int) expected.laps.size());
+		return false;
+	}
+
+	for (size_t i = 0; i < expected.laps.size(); i++) {
+		const ReplayLap &e = expected.laps[i];
+		const ReplayLap &a = actual.laps[i];
+
+		if (fabs(e.final - a.final) > lap_time_tolerance) {
+			snprintf(message, size, "lap %u: final %.3f, expected %.3f", e.number, a.final, e.final);
+			return false;
+		}
+		if (fabs(e.best - a.best) > lap_time_tolerance) {
+			snprintf(message, size, "lap %u: best %.3f, expected %.3f", e.number, a.best, e.best);
+			return false;
+		}
+		if (e.samples.size() != a.samples.size()) {
+			snprintf(message, size, "lap %u: %u delta samples, expected %u", e.number,
+				(unsigned int) a.samples.size(), (unsigned int) e.samples.size());
+			return false;
+		}
+
+		for (size_t s = 0; s < e.samples.size(); s++) {
+			if (fabs(e.samples[s].meters - a.samples[s].meters) > 0.5
+				|| fabs(e.samples[s].delta - a.samples[s].delta) > delta_tolerance) {
+				snprintf(message, size, "lap %u: delta %+.3f at %.0fm, expected %+.3f at %.0fm", e.number,
+					a.samples[s].delta, a.samples[s].meters, e.samples[s].delta, e.samples[s].meters);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,79 @@
+/*
+rF2 Delta Best Plugin
+
+Replay of recorded sessions through the DeltaEngine.
+
+Reads the text logs written by the plugin with ENABLE_LOG (see the
+Log/ folder), turns them back into the sequence of callbacks the
+plugin received, and feeds them to a DeltaEngine. What comes out is
+the delta at every scoring update of each lap, and the lap times,
+which can be saved as a "golden" file and compared later.
+
+Logs only have the scoring fields of the player car that were
+printed, so everything else (game phase, pits, position) is filled
+with plausible values. mLastLapTime, when missing, is taken from the
+difference of two consecutive mLapStartET.
+
+*/
+
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include "DeltaEngine.hpp"
+#include <vector>
+
+enum ReplayEventType {
+	REPLAY_START_SESSION,
+	REPLAY_END_SESSION,
+	REPLAY_ENTER_REALTIME,
+	REPLAY_EXIT_REALTIME,
+	REPLAY_SCORING
+};
+
+struct ReplayEvent {
+	ReplayEventType type;
+
+	/* Only for REPLAY_SCORING */
+	double lap_start_et;
+	double last_lap_time;
+	double current_et;
+	double lap_dist;
+	double track_length;
+};
+
+struct ReplaySample {
+	float meters;
+	float delta;
+};
+
+struct ReplayLap {
+	unsigned int number;          /* Counted from the start of the replay */
+	double final;                 /* Lap time, <= 0 if not timed or not completed */
+	double best;                  /* Best lap time once this lap is over */
+	std::vector<ReplaySample> samples;
+};
+
+struct ReplayResult {
+	std::vector<ReplayLap> laps;
+	unsigned long callbacks;      /* Engine calls made during the replay */
+};
+
+/* Tolerances used when comparing against a golden file */
+#define REPLAY_DELTA_TOLERANCE      0.0015
+#define REPLAY_LAP_TIME_TOLERANCE   0.0005
+
+/* Returns false if the log can't be read */
+bool ReplayLoadLog(const char *path, std::vector<ReplayEvent> *events);
+
+/* Runs the events through a new engine. No best lap is loaded or saved. */
+void ReplayRun(const std::vector<ReplayEvent> &events, const PluginConfig &config, ReplayResult *result);
+
+bool ReplayWriteGolden(const char *path, const ReplayResult &result);
+bool ReplayLoadGolden(const char *path, ReplayResult *result);
+
+/* Returns true if equal within tolerances. Otherwise, describes
+   the first difference in message. */
+bool ReplayCompare(const ReplayResult &expected, const ReplayResult &actual,
+	double delta_tolerance, double lap_time_tolerance, char *message, size_t size);
+
+#endif /* _REPLAY_H */
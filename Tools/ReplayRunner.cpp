@@ -0,0 +1,210 @@
+/*
+rF2 Delta Best Plugin
+
+Replay regression runner.
+
+Replays every "*.log" session found in the given folders through the
+DeltaEngine, using all the cores, and compares the delta at each
+scoring update and the lap times against the "*.golden" file next
+to each log. Reports the replay speed of each file, and overall.
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -pthread -IInclude -ITools -ITools/Posix -D__cdecl= -o ReplayRunner \
+      Tools/ReplayRunner.cpp Tools/Replay.cpp Source/DeltaEngine.cpp \
+      Source/PluginConfig.cpp Source/IniFile.cpp Source/DeltaGraph.cpp \
+      Source/TrackMap.cpp Source/OverlayGeometry.cpp Source/InputTrace.cpp \
+      Source/SegmentStats.cpp
+
+Usage:
+
+  ReplayRunner [-j threads] [-c DeltaBest.ini] [-u] folder...
+
+  -j  Number of threads, defaults to the number of cores
+  -c  Config to replay with, defaults to the built-in defaults
+  -u  Write the golden files from this run instead of comparing
+
+  ./ReplayRunner Log/ticks-based Log/position-based
+
+Exits with 1 if any replay doesn't match its golden file.
+
+*/
+
+#include "Replay.hpp"
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#define REPLAY_LOG_EXT      ".log"
+#define REPLAY_GOLDEN_EXT   ".golden"
+
+struct ReplayJob {
+	std::string log_path;
+	std::string golden_path;
+
+	/* Filled in by the worker threads */
+	bool passed;
+	char message[256];
+	unsigned int laps;
+	unsigned long callbacks;
+	double seconds;
+};
+
+static bool EndsWith(const std::string &s, const char *suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static void FindLogs(const char *folder, std::vector<ReplayJob> *jobs)
+{
+	DIR *dir = opendir(folder);
+	if (dir == NULL) {
+		fprintf(stderr, "Can't open folder '%s'\n", folder);
+		return;
+	}
+
+	std::vector<std::string> names;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (EndsWith(entry->d_name, REPLAY_LOG_EXT))
+			names.push_back(entry->d_name);
+	}
+	closedir(dir);
+
+	std::sort(names.begin(), names.end());
+	for (size_t i = 0; i < names.size(); i++) {
+		ReplayJob job;
+		job.log_path = std::string(folder) + "/" + names[i];
+		job.golden_path = job.log_path.substr(0, job.log_path.size() - strlen(REPLAY_LOG_EXT)) + REPLAY_GOLDEN_EXT;
+		job.passed = false;
+		job.message[0] = '\0';
+		job.laps = 0;
+		job.callbacks = 0;
+		job.seconds = 0;
+		jobs->push_back(job);
+	}
+}
+
+static void RunJob(ReplayJob *job, const PluginConfig &config, bool update)
+{
+	std::vector<ReplayEvent> events;
+	if (! ReplayLoadLog(job->log_path.c_str(), &events)) {
+		snprintf(job->message, sizeof(job->message), "can't read log");
+		return;
+	}
+
+	/* Only the replay itself is timed, not reading the log */
+	ReplayResult result;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	ReplayRun(events, config, &result);
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	job->laps = (unsigned int) result.laps.size();
+	job->callbacks = result.callbacks;
+	job->seconds = elapsed.count();
+
+	if (update) {
+		job->passed = ReplayWriteGolden(job->golden_path.c_str(), result);
+		if (! job->passed)
+			snprintf(job->message, sizeof(job->message), "can't write golden file");
+		return;
+	}
+
+	ReplayResult golden;
+	if (! ReplayLoadGolden(job->golden_path.c_str(), &golden)) {
+		snprintf(job->message, sizeof(job->message), "no golden file");
+		return;
+	}
+
+	job->passed = ReplayCompare(golden, result, REPLAY_DELTA_TOLERANCE, REPLAY_LAP_TIME_TOLERANCE,
+		job->message, sizeof(job->message));
+}
+
+static void Worker(std::vector<ReplayJob> *jobs, std::atomic<size_t> *next, const PluginConfig *config, bool update)
+{
+	for (;;) {
+		size_t i = next->fetch_add(1);
+		if (i >= jobs->size())
+			break;
+		RunJob(&(*jobs)[i], *config, update);
+	}
+}
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: ReplayRunner [-j threads] [-c DeltaBest.ini] [-u] folder...\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	const char *ini_file = NULL;
+	bool update = false;
+	std::vector<ReplayJob> jobs;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			ini_file = argv[++i];
+		else if (strcmp(argv[i], "-u") == 0)
+			update = true;
+		else if (argv[i][0] == '-')
+			Usage();
+		else
+			FindLogs(argv[i], &jobs);
+	}
+
+	if (jobs.empty())
+		Usage();
+	if (threads == 0)
+		threads = 1;
+
+	IniFile ini;
+	if (ini_file != NULL && ! IniLoad(&ini, ini_file)) {
+		fprintf(stderr, "Can't read config '%s'\n", ini_file);
+		return 2;
+	}
+	PluginConfig config;
+	LoadPluginConfig(config, ini);
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> pool;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	for (unsigned int t = 0; t < threads && t < jobs.size(); t++)
+		pool.push_back(std::thread(Worker, &jobs, &next, &config, update));
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+
+	std::chrono::duration<double> wall = std::chrono::high_resolution_clock::now() - start;
+
+	unsigned int failed = 0;
+	unsigned long callbacks = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const ReplayJob &job = jobs[i];
+		double rate = job.seconds > 0 ? job.callbacks / job.seconds : 0;
+
+		printf("%-4s %s: %u laps, %lu callbacks, %.2f ms, %.0f callbacks/s%s%s\n",
+			job.passed ? (update ? "UPD" : "OK") : "FAIL", job.log_path.c_str(),
+			job.laps, job.callbacks, job.seconds * 1000.0, rate,
+			job.message[0] ? ", " : "", job.message);
+
+		callbacks += job.callbacks;
+		if (! job.passed)
+			failed++;
+	}
+
+	printf("\n%u replays, %u failed, %u threads, %lu callbacks in %.2f ms, %.0f callbacks/s\n",
+		(unsigned int) jobs.size(), failed, (unsigned int) pool.size(), callbacks,
+		wall.count() * 1000.0, wall.count() > 0 ? callbacks / wall.count() : 0);
+
+	return failed > 0 ? 1 : 0;
+}
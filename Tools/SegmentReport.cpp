@@ -0,0 +1,121 @@
+/*
+rF2 Delta Best Plugin
+
+Segment statistics report.
+
+Prints the ".segments" file the plugin writes at the end of a session
+(see SegmentStats.hpp): for every SEGMENT_STATS_LENGTH meters of the
+track, the laps timed, mean time, standard deviation, fastest time, the
+time lost on average against the fastest, and the last laps. Then the
+lap made of the fastest segments, and the least consistent segments,
+where practice pays the most.
+
+The CapturePlayer writes the same file from a capture:
+
+  CapturePlayer -x session.segments DeltaBest.capture
+  SegmentReport session.segments
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -IInclude -o SegmentReport \
+      Tools/SegmentReport.cpp Source/SegmentStats.cpp
+
+Usage:
+
+  SegmentReport [-n count] file.segments
+
+  -n  Least consistent segments to list, 5 by default
+
+*/
+
+#include "SegmentStats.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: SegmentReport [-n count] file.segments\n");
+	exit(2);
+}
+
+static void PrintSegment(const SegmentStats &stats, unsigned int s, unsigned int kept)
+{
+	unsigned int from = s * SEGMENT_STATS_LENGTH;
+	unsigned int to = s + 1 < stats.segments ? from + SEGMENT_STATS_LENGTH : stats.track_length;
+
+	printf("%5u-%-5u %5lu %8.3f %7.3f %8.3f %+7.3f ", from, to, stats.count[s], stats.mean[s],
+		SegmentStatsStdDev(stats, s), stats.min[s], stats.mean[s] - stats.min[s]);
+	for (unsigned int k = 1; k <= kept; k++)
+		printf(" %7.3f", stats.last[(stats.laps - k) % SEGMENT_STATS_LAST][s]);
+	printf("\n");
+}
+
+/* Most spread out first */
+struct ByStdDev {
+	const SegmentStats *stats;
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		return SegmentStatsStdDev(*stats, a) > SegmentStatsStdDev(*stats, b);
+	}
+};
+
+int main(int argc, char **argv)
+{
+	unsigned int top = 5;
+	const char *path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			top = (unsigned int) atoi(argv[++i]);
+		else if (argv[i][0] != '-' && path == NULL)
+			path = argv[i];
+		else
+			Usage();
+	}
+	if (path == NULL)
+		Usage();
+
+	/* About 50KB, off the stack */
+	SegmentStats *stats = new SegmentStats;
+	char track[64], vehicle_class[64];
+	if (! SegmentStatsRead(stats, path, track, vehicle_class, sizeof(track))) {
+		fprintf(stderr, "Can't read '%s'\n", path);
+		delete stats;
+		return 1;
+	}
+
+	printf("%s, %s: %lu laps, %u meters\n\n", track, vehicle_class, stats->laps, stats->track_length);
+
+	unsigned int kept = stats->laps < SEGMENT_STATS_LAST ? (unsigned int) stats->laps : SEGMENT_STATS_LAST;
+	printf("   meters    laps     mean  stddev  fastest    lost   last, latest first\n");
+	double mean = 0, fastest = 0;
+	for (unsigned int s = 0; s < stats->segments; s++) {
+		PrintSegment(*stats, s, kept);
+		mean += stats->mean[s];
+		fastest += stats->min[s];
+	}
+	printf("\nMean lap %.3f, fastest segments %.3f (%.3f to find)\n", mean, fastest, mean - fastest);
+
+	if (stats->laps < 2 || top == 0) {
+		delete stats;
+		return 0;
+	}
+
+	std::vector<unsigned int> order;
+	for (unsigned int s = 0; s < stats->segments; s++)
+		order.push_back(s);
+	ByStdDev by_stddev = { stats };
+	std::sort(order.begin(), order.end(), by_stddev);
+	if (order.size() > top)
+		order.resize(top);
+
+	printf("\nLeast consistent:\n");
+	for (size_t i = 0; i < order.size(); i++)
+		PrintSegment(*stats, order[i], kept);
+
+	delete stats;
+	return 0;
+}
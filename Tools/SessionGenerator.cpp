@@ -0,0 +1,475 @@
+/*
+rF2 Delta Best Plugin
+
+Synthetic session generator.
+
+*/
+
+#include "SessionGenerator.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define GENERATOR_PI            3.14159265358979323846
+
+#define PIT_NONE                0      /* Same values as mPitState */
+#define PIT_ENTERING            2
+#define PIT_STOPPED             3
+#define PIT_EXITING             4
+
+#define PIT_LANE                250    /* Meters on each side of the line */
+#define PIT_SPEED               22     /* m/s, about 80 km/h */
+#define PIT_STOP_TIME           25     /* seconds */
+#define GARAGE_TIME             20
+#define REVERSE_SPEED           4
+#define GRID_SPACING            8
+#define SPEED_RESPONSE          0.5    /* seconds, how quickly cars reach their target speed */
+#define APEX_LATERAL            15     /* m/s^2, at the slowest point of the corners */
+#define APEX_STEERING           0.3
+
+void GeneratorDefaults(GeneratorConfig *config)
+{
+	config->track_length = 5000;
+	config->laps = 10;
+	config->vehicles = 20;
+	config->scoring_hz = 5;
+	config->telemetry_hz = 90;
+	config->lap_time = 0;
+	config->lap_variation = 0.005;
+	config->position_noise = 0;
+	config->speed_noise = 0;
+	config->time_jitter = 0;
+	config->line_deviation = 0;
+	config->pit_every = 0;
+	config->reset_chance = 0;
+	config->reverse_chance = 0;
+	config->seed = 1;
+}
+
+static void TrackPosition(const SessionGenerator *gen, double s, double *x, double *z)
+{
+	double r = gen->config.track_length / (2 * GENERATOR_PI);
+	double t = 2 * GENERATOR_PI * s / gen->config.track_length;
+
+	*x = r * cos(t) + 0.12 * r * cos(3 * t);
+	*z = r * sin(t) + 0.08 * r * sin(5 * t);
+}
+
+/* Flat out on the straights, 30% of that in the slowest corners */
+static double ProfileSpeed(const SessionGenerator *gen, double s)
+{
+	double phase = 2 * GENERATOR_PI * gen->corners * s / gen->config.track_length;
+	return gen->top_speed * (0.65 + 0.35 * cos(phase));
+}
+
+/* How much the track turns, 1 at the slowest point of the corners, 0 on
+   the straights, left and right in turn. Curvature is that over the
+   radius at the slowest point. */
+static double Turn(const SessionGenerator *gen, double s)
+{
+	double phase = 2 * GENERATOR_PI * gen->corners * s / gen->config.track_length;
+	double turn = pow((1 - cos(phase)) / 2, 4);
+	return ((long) floor(phase / (2 * GENERATOR_PI))) % 2 == 0 ? turn : -turn;
+}
+
+/* Meters of racing line per meter of lap distance, shorter in the corners */
+static double LineRatio(const SessionGenerator *gen, double s)
+{
+	double phase = 2 * GENERATOR_PI * gen->corners * s / gen->config.track_length;
+	return 1 - gen->config.line_deviation * (1 - cos(phase)) / 2;
+}
+
+static double Normal(SessionGenerator *gen)
+{
+	return gen->normal(gen->rng);
+}
+
+static double Uniform(SessionGenerator *gen)
+{
+	return gen->uniform(gen->rng);
+}
+
+static void Queue(SessionGenerator *gen, CaptureRecordType type)
+{
+	if (gen->queued < sizeof(gen->queue) / sizeof(gen->queue[0]))
+		gen->queue[gen->queued++] = type;
+}
+
+/* Where in the next lap the player will reset or reverse, if at all */
+static void PlanIncidents(SessionGenerator *gen, GeneratorCar *car)
+{
+	double length = gen->config.track_length;
+
+	car->reset_at = Uniform(gen) < gen->config.reset_chance ? length * (0.2 + 0.6 * Uniform(gen)) : -1;
+	car->reverse_at = Uniform(gen) < gen->config.reverse_chance ? length * (0.1 + 0.8 * Uniform(gen)) : -1;
+}
+
+static void CompleteLap(SessionGenerator *gen, unsigned int i, double crossed_et)
+{
+	GeneratorCar &car = gen->cars[i];
+	VehicleScoringInfoV01 &veh = gen->vehicles[i];
+
+	car.crossings++;
+
+	if (car.lap_timed) {
+		double lap_time = crossed_et - car.lap_start_et;
+		veh.mLastLapTime = lap_time;
+		veh.mLastSector1 = car.sector_et[0];
+		veh.mLastSector2 = car.sector_et[1];
+		if (veh.mBestLapTime <= 0 || lap_time < veh.mBestLapTime) {
+			veh.mBestLapTime = lap_time;
+			veh.mBestSector1 = car.sector_et[0];
+			veh.mBestSector2 = car.sector_et[1];
+		}
+	}
+	else {
+		/* Out of the grid or the garage, like rF2 */
+		veh.mLastLapTime = -1;
+		veh.mLastSector1 = -1;
+		veh.mLastSector2 = -1;
+	}
+
+	car.lap_start_et = crossed_et;
+	car.lap_timed = true;
+	car.sector_et[0] = car.sector_et[1] = -1;
+	car.lap_pace = 1 + gen->config.lap_variation * Normal(gen);
+	if (car.lap_pace < 0.5)
+		car.lap_pace = 0.5;
+
+	/* Pit box right after the line */
+	if (car.pit_state == PIT_ENTERING) {
+		car.pit_state = PIT_STOPPED;
+		car.pit_timer = PIT_STOP_TIME;
+		veh.mNumPitstops++;
+	}
+	car.pit_this_lap = gen->config.pit_every > 0 && (car.crossings + 1) % gen->config.pit_every == 0;
+
+	if (i == 0)
+		PlanIncidents(gen, &car);
+}
+
+static void MoveCar(SessionGenerator *gen, unsigned int i, double dt)
+{
+	GeneratorCar &car = gen->cars[i];
+	double length = gen->config.track_length;
+	bool player = i == 0;
+
+	double target = ProfileSpeed(gen, car.lap_dist) * car.pace * car.lap_pace;
+	double previous_speed = car.speed;
+
+	if (car.pit_state == PIT_STOPPED) {
+		car.pit_timer -= dt;
+		target = 0;
+		if (car.pit_timer <= 0) {
+			car.pit_state = PIT_EXITING;
+
+			/* Out of the garage, after a reset */
+			if (player && ! gen->in_realtime) {
+				gen->in_realtime = true;
+				Queue(gen, CAPTURE_ENTER_REALTIME);
+				car.lap_start_et = gen->et;
+				car.lap_timed = false;
+			}
+		}
+	}
+	else if (car.pit_state != PIT_NONE && target > PIT_SPEED) {
+		target = PIT_SPEED;
+	}
+
+	if (car.reverse_left > 0)
+		car.speed = -REVERSE_SPEED;
+	else if (car.pit_state == PIT_STOPPED)
+		car.speed = 0;
+	else
+		car.speed += (target - car.speed) * (1 - exp(-dt / SPEED_RESPONSE));
+	car.accel = (car.speed - previous_speed) / dt;
+
+	double previous = car.lap_dist;
+	car.lap_dist += car.speed * dt;
+
+	if (car.reverse_left > 0) {
+		car.reverse_left -= REVERSE_SPEED * dt;
+		if (car.lap_dist < 0) {
+			car.lap_dist = 0;
+			car.reverse_left = 0;
+		}
+	}
+
+	if (car.pit_this_lap && car.pit_state == PIT_NONE && car.lap_dist >= length - PIT_LANE)
+		car.pit_state = PIT_ENTERING;
+	else if (car.pit_state == PIT_EXITING && car.lap_dist >= PIT_LANE && car.lap_dist < length / 2)
+		car.pit_state = PIT_NONE;
+
+	for (unsigned int s = 0; s < 2; s++) {
+		double boundary = length * (s + 1) / 3;
+		if (previous < boundary && car.lap_dist >= boundary)
+			car.sector_et[s] = gen->et - car.lap_start_et;
+	}
+
+	if (player && car.pit_state == PIT_NONE) {
+		if (car.reset_at >= 0 && car.lap_dist >= car.reset_at) {
+			/* Back to the garage, in the pit lane */
+			car.reset_at = -1;
+			car.reverse_left = 0;
+			car.lap_dist = PIT_LANE / 2;
+			car.speed = 0;
+			car.pit_state = PIT_STOPPED;
+			car.pit_timer = GARAGE_TIME;
+			gen->in_realtime = false;
+			Queue(gen, CAPTURE_EXIT_REALTIME);
+			return;
+		}
+		if (car.reverse_at >= 0 && car.lap_dist >= car.reverse_at) {
+			car.reverse_at = -1;
+			car.reverse_left = 20 + 130 * Uniform(gen);
+		}
+	}
+
+	if (car.lap_dist >= length) {
+		double crossed_et = car.speed > 0 ? gen->et - (car.lap_dist - length) / car.speed : gen->et;
+		car.lap_dist -= length;
+		CompleteLap(gen, i, crossed_et);
+	}
+}
+
+static double Progress(const GeneratorCar &car)
+{
+	return car.crossings * 1e6 + car.lap_dist;
+}
+
+static void FillScoring(SessionGenerator *gen)
+{
+	ScoringInfoV01 &info = gen->scoring;
+	double length = gen->config.track_length;
+
+	info.mCurrentET = gen->et;
+	info.mInRealtime = gen->in_realtime;
+
+	/* Insertion sort, the order rarely changes between updates */
+	std::vector<unsigned int> &order = gen->order;
+	for (size_t k = 1; k < order.size(); k++) {
+		unsigned int i = order[k];
+		size_t j = k;
+		while (j > 0 && Progress(gen->cars[order[j - 1]]) < Progress(gen->cars[i])) {
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+	}
+
+	for (size_t k = 0; k < order.size(); k++) {
+		unsigned int i = order[k];
+		const GeneratorCar &car = gen->cars[i];
+		VehicleScoringInfoV01 &veh = gen->vehicles[i];
+
+		veh.mPlace = (unsigned char) (k + 1 < 255 ? k + 1 : 255);
+		veh.mTotalLaps = (short) (car.crossings > 0 ? car.crossings - 1 : 0);
+		veh.mLapDist = car.lap_dist;
+		if (gen->config.position_noise > 0)
+			veh.mLapDist += gen->config.position_noise * Normal(gen);
+		veh.mLapStartET = car.lap_start_et;
+		veh.mSector = (signed char) (car.lap_dist < length / 3 ? 1 : car.lap_dist < length * 2 / 3 ? 2 : 0);
+		veh.mCurSector1 = car.sector_et[0];
+		veh.mCurSector2 = car.sector_et[1];
+		veh.mInPits = car.pit_state != PIT_NONE;
+		veh.mPitState = (unsigned char) car.pit_state;
+		veh.mTimeIntoLap = gen->et - car.lap_start_et;
+
+		TrackPosition(gen, car.lap_dist, &veh.mPos.x, &veh.mPos.z);
+		veh.mLocalVel.z = -car.speed;
+		veh.mLocalAccel.z = -car.accel;
+	}
+}
+
+static void FillTelemetry(SessionGenerator *gen)
+{
+	TelemInfoV01 &telem = gen->telemetry;
+	const GeneratorCar &car = gen->cars[0];
+	double period = gen->dt * gen->telemetry_every;
+	double speed = car.speed * LineRatio(gen, car.lap_dist);
+	double turn = Turn(gen, car.lap_dist);
+	double apex_speed = 0.3 * gen->top_speed;
+
+	if (gen->config.speed_noise > 0)
+		speed *= 1 + gen->config.speed_noise * Normal(gen);
+
+	telem.mDeltaTime = period;
+	if (gen->config.time_jitter > 0)
+		telem.mDeltaTime *= 1 + gen->config.time_jitter * Normal(gen);
+	telem.mElapsedTime = gen->et;
+	telem.mLapNumber = car.crossings;
+	telem.mLapStartET = car.lap_start_et;
+
+	TrackPosition(gen, car.lap_dist, &telem.mPos.x, &telem.mPos.z);
+	telem.mLocalVel.z = -speed;
+	telem.mLocalAccel.z = -car.accel;
+	telem.mLocalAccel.x = turn * APEX_LATERAL * (speed * speed) / (apex_speed * apex_speed);
+
+	telem.mGear = car.speed < -0.1 ? -1 : car.speed < 1 ? 0 : 1 + (long) (car.speed / 15);
+	if (telem.mGear > 6)
+		telem.mGear = 6;
+	telem.mEngineRPM = telem.mGear > 0 ? 4000 + 5000 * fmod(car.speed, 15.0) / 15.0 : 1000;
+
+	/* Inputs that would give that speed profile */
+	telem.mUnfilteredThrottle = car.accel > 0 ? 0.3 + (car.accel > 7 ? 0.7 : car.accel * 0.1) : 0.1;
+	telem.mUnfilteredBrake = car.accel < -1 ? (car.accel < -15 ? 1.0 : -car.accel / 15) : 0;
+	telem.mUnfilteredSteering = APEX_STEERING * turn;
+	telem.mFilteredThrottle = telem.mUnfilteredThrottle;
+	telem.mFilteredBrake = telem.mUnfilteredBrake;
+	telem.mFilteredSteering = telem.mUnfilteredSteering;
+
+	/* Zero-based, unlike mSector, and at telemetry rate */
+	double length = gen->config.track_length;
+	telem.mCurrentSector = car.lap_dist < length / 3 ? 0 : car.lap_dist < length * 2 / 3 ? 1 : 2;
+	if (car.pit_state != PIT_NONE)
+		telem.mCurrentSector |= 0x80000000;
+	telem.mSpeedLimiter = car.pit_state != PIT_NONE;
+}
+
+static void Step(SessionGenerator *gen)
+{
+	gen->queued = gen->next = 0;
+	gen->tick++;
+	gen->et = gen->tick * gen->dt;
+
+	/* Other cars are only seen in the scoring updates, they
+	   can move in bigger steps. That's most of the work with
+	   many cars and a high telemetry rate. */
+	bool scoring = gen->tick % gen->scoring_every == 0;
+	MoveCar(gen, 0, gen->dt);
+	if (scoring) {
+		for (unsigned int i = 1; i < gen->cars.size(); i++)
+			MoveCar(gen, i, gen->dt * gen->scoring_every);
+	}
+
+	if (gen->telemetry_every > 0 && gen->tick % gen->telemetry_every == 0) {
+		FillTelemetry(gen);
+		Queue(gen, CAPTURE_TELEMETRY);
+	}
+
+	if (scoring) {
+		FillScoring(gen);
+		Queue(gen, CAPTURE_SCORING);
+	}
+
+	/* The first time across the line is the start of lap 1 */
+	if (gen->cars[0].crossings > gen->config.laps) {
+		if (gen->in_realtime)
+			Queue(gen, CAPTURE_EXIT_REALTIME);
+		Queue(gen, CAPTURE_END_SESSION);
+		gen->finished = true;
+	}
+}
+
+SessionGenerator *GeneratorCreate(const GeneratorConfig &config)
+{
+	SessionGenerator *gen = new SessionGenerator;
+	double length = config.track_length;
+	unsigned int n = config.vehicles > 0 ? config.vehicles : 1;
+
+	gen->config = config;
+	if (gen->config.track_length > MAX_TRACK_LENGTH - 2)
+		gen->config.track_length = length = MAX_TRACK_LENGTH - 2;
+	if (gen->config.scoring_hz <= 0)
+		gen->config.scoring_hz = 5;
+
+	gen->rng.seed(config.seed);
+	gen->normal = std::normal_distribution<double>(0, 1);
+	gen->uniform = std::uniform_real_distribution<double>(0, 1);
+
+	/* Ticks at the highest rate, the other rate is a whole number of ticks */
+	double tick_hz = config.telemetry_hz > gen->config.scoring_hz ? config.telemetry_hz : gen->config.scoring_hz;
+	gen->dt = 1.0 / tick_hz;
+	gen->tick = 0;
+	gen->et = 0;
+	gen->scoring_every = (unsigned int) (tick_hz / gen->config.scoring_hz + 0.5);
+	gen->telemetry_every = config.telemetry_hz > 0 ? (unsigned int) (tick_hz / config.telemetry_hz + 0.5) : 0;
+	gen->in_realtime = true;
+	gen->finished = false;
+
+	/* A corner every 700m or so, and top speed to match the lap time */
+	gen->corners = (unsigned int) (length / 700);
+	if (gen->corners < 3)
+		gen->corners = 3;
+	gen->top_speed = 1;
+	double unit_lap_time = 0;
+	for (unsigned int m = 0; m < (unsigned int) length; m++)
+		unit_lap_time += 1 / ProfileSpeed(gen, m);
+	double lap_time = config.lap_time > 0 ? config.lap_time : length / 45.0;
+	gen->top_speed = unit_lap_time / lap_time;
+
+	memset(&gen->scoring, 0, sizeof(gen->scoring));
+	memset(&gen->telemetry, 0, sizeof(gen->telemetry));
+	gen->cars.resize(n);
+	gen->vehicles.resize(n);
+	gen->order.resize(n);
+
+	snprintf(gen->scoring.mTrackName, sizeof(gen->scoring.mTrackName), "Synthetic %.1f km", length / 1000);
+	gen->scoring.mSession = 10;
+	gen->scoring.mMaxLaps = config.laps;
+	gen->scoring.mLapDist = length;
+	gen->scoring.mNumVehicles = n;
+	gen->scoring.mVehicle = &gen->vehicles[0];
+	gen->scoring.mGamePhase = GP_GREEN_FLAG;
+	gen->scoring.mEndET = 1e6;
+	snprintf(gen->scoring.mPlayerName, sizeof(gen->scoring.mPlayerName), "Player");
+
+	strncpy(gen->telemetry.mTrackName, gen->scoring.mTrackName, sizeof(gen->telemetry.mTrackName) - 1);
+	snprintf(gen->telemetry.mVehicleName, sizeof(gen->telemetry.mVehicleName), "Car 1");
+	gen->telemetry.mMaxGears = 6;
+	gen->telemetry.mEngineMaxRPM = 9000;
+	gen->telemetry.mFuel = 60;
+
+	for (unsigned int i = 0; i < n; i++) {
+		GeneratorCar &car = gen->cars[i];
+		VehicleScoringInfoV01 &veh = gen->vehicles[i];
+
+		memset(&car, 0, sizeof(car));
+		car.lap_dist = length - fmod(GRID_SPACING * (i + 1.0), length / 2);
+		car.pace = i == 0 ? 1 : 1 + 0.02 * Normal(gen);
+		car.lap_pace = 1;
+		car.sector_et[0] = car.sector_et[1] = -1;
+		car.reset_at = car.reverse_at = -1;
+		car.pit_state = PIT_NONE;
+		gen->order[i] = i;
+
+		memset(&veh, 0, sizeof(veh));
+		veh.mID = i;
+		snprintf(veh.mDriverName, sizeof(veh.mDriverName), i == 0 ? "Player" : "Driver %u", i + 1);
+		snprintf(veh.mVehicleName, sizeof(veh.mVehicleName), "Car %u", i + 1);
+		snprintf(veh.mVehicleClass, sizeof(veh.mVehicleClass), "Synthetic");
+		veh.mIsPlayer = i == 0;
+		veh.mControl = i == 0 ? 0 : 1;
+		veh.mLastLapTime = 0;
+		veh.mBestLapTime = -1;
+		veh.mCurSector1 = veh.mCurSector2 = -1;
+		veh.mEstimatedLapTime = lap_time;
+		veh.mServerScored = 1;
+	}
+	PlanIncidents(gen, &gen->cars[0]);
+
+	gen->queued = gen->next = 0;
+	Queue(gen, CAPTURE_START_SESSION);
+	Queue(gen, CAPTURE_ENTER_REALTIME);
+	return gen;
+}
+
+void GeneratorDestroy(SessionGenerator *gen)
+{
+	delete gen;
+}
+
+bool GeneratorNext(SessionGenerator *gen, GeneratorEvent *event)
+{
+	while (gen->next >= gen->queued) {
+		if (gen->finished)
+			return false;
+		Step(gen);
+	}
+
+	event->type = gen->queue[gen->next++];
+	event->et = gen->et;
+	event->scoring = event->type == CAPTURE_SCORING ? &gen->scoring : NULL;
+	event->telemetry = event->type == CAPTURE_TELEMETRY ? &gen->telemetry : NULL;
+	return true;
+}
@@ -0,0 +1,122 @@
+/*
+rF2 Delta Best Plugin
+
+Synthetic session generator.
+
+Makes up the callbacks rF2 would send the plugin for a session on a
+track of any length, with any number of cars, at any telemetry rate:
+the same ScoringInfoV01 and TelemInfoV01 structures, with the player
+car's telemetry only (what the plugin asks for). Meant to push the
+DeltaEngine and the tools well past what the recorded logs cover.
+
+The track is a closed loop with a number of corners proportional to
+its length. Every car follows the same speed profile, scaled by its
+own pace and a random factor for every lap, so the player's laps are
+all slightly different. On top of that:
+
+ - noise on the scoring lap distance, on the telemetry speed and on
+   the telemetry time step, like a real sim has some
+ - a racing line cutting the corners, so the telemetry speed is along
+   a shorter path than the lap distance
+ - pit stops every few laps, with mInPits set from the pit entry
+   to the pit exit
+ - the player going back to the garage mid lap ("reset"), which
+   exits and enters realtime, and makes the next lap untimed
+ - the player driving backwards for a while, mid lap
+
+Everything comes from one random seed, the same seed gives the same
+session.
+
+*/
+
+#ifndef _SESSION_GENERATOR_H
+#define _SESSION_GENERATOR_H
+
+#include "Capture.hpp"
+#include <random>
+#include <vector>
+
+struct GeneratorConfig {
+	double track_length;            /* Meters, up to MAX_TRACK_LENGTH */
+	unsigned int laps;              /* Player laps before the session ends */
+	unsigned int vehicles;          /* Including the player */
+	double scoring_hz;
+	double telemetry_hz;            /* 0 for no telemetry */
+	double lap_time;                /* Player typical lap time, 0 to make one up from the length */
+	double lap_variation;           /* Lap to lap pace variation, as a fraction */
+	double position_noise;          /* Standard deviation of the scoring mLapDist, meters */
+	double speed_noise;             /* Of the telemetry speed, as a fraction */
+	double time_jitter;             /* Of the telemetry mDeltaTime, as a fraction */
+	double line_deviation;          /* Racing line shorter than the centre of the track in the slowest corners, as a fraction */
+	unsigned int pit_every;         /* Pit stop every that many laps, 0 for none */
+	double reset_chance;            /* For each player lap, chance of going back to the garage */
+	double reverse_chance;          /* For each player lap, chance of driving backwards for a while */
+	unsigned int seed;
+};
+
+/* True state of a car, the structures only get a noisy view of it */
+struct GeneratorCar {
+	double lap_dist;
+	double speed;
+	double accel;
+	double pace;                    /* Of the car, around 1 */
+	double lap_pace;                /* Of this lap */
+	double lap_start_et;
+	bool lap_timed;
+	unsigned int crossings;         /* Times across the line */
+	double sector_et[2];            /* Into the lap, at the end of sectors 1 and 2 */
+	int pit_state;
+	double pit_timer;
+	bool pit_this_lap;
+	double reset_at;                /* Lap distance, < 0 if not this lap */
+	double reverse_at;
+	double reverse_left;            /* Meters still to go backwards */
+};
+
+struct SessionGenerator {
+	GeneratorConfig config;
+	std::mt19937 rng;
+	std::normal_distribution<double> normal;
+	std::uniform_real_distribution<double> uniform;
+
+	double et;                      /* Session time */
+	double dt;                      /* Of a tick */
+	unsigned long tick;
+	unsigned int scoring_every;     /* Ticks */
+	unsigned int telemetry_every;
+	double top_speed;
+	unsigned int corners;
+	bool in_realtime;
+	bool finished;
+
+	std::vector<GeneratorCar> cars;
+	std::vector<unsigned int> order;
+
+	ScoringInfoV01 scoring;
+	std::vector<VehicleScoringInfoV01> vehicles;
+	TelemInfoV01 telemetry;
+
+	/* Events of the current tick, not yet returned */
+	CaptureRecordType queue[8];
+	unsigned int queued;
+	unsigned int next;
+};
+
+struct GeneratorEvent {
+	CaptureRecordType type;         /* Lifecycle, CAPTURE_SCORING or CAPTURE_TELEMETRY */
+	double et;
+	const ScoringInfoV01 *scoring;  /* Only for CAPTURE_SCORING, mVehicle set */
+	const TelemInfoV01 *telemetry;  /* Only for CAPTURE_TELEMETRY */
+};
+
+void GeneratorDefaults(GeneratorConfig *config);
+
+/* Generators are big with many cars, always allocated on the heap */
+SessionGenerator *GeneratorCreate(const GeneratorConfig &config);
+void GeneratorDestroy(SessionGenerator *gen);
+
+/* Next callback of the session, in order. The structures pointed to are
+   only valid until the next call. Returns false when the session is over. */
+bool GeneratorNext(SessionGenerator *gen, GeneratorEvent *event);
+
+#endif /* _SESSION_GENERATOR_H */
@@ -0,0 +1,170 @@
+/*
+rF2 Delta Best Plugin
+
+Shared memory reader.
+
+Sample reader of the live state the plugin publishes with
+"[Shared] Enabled=1" (see SharedDelta.hpp). Polls the region, and
+once a second prints the latest snapshot, how many snapshots were
+published, and how long they took to be seen: the time between the
+writer publishing a snapshot and this reader copying it, including
+the polling interval. Also counts the reads that gave up because the
+writer was always busy.
+
+On Linux, the CapturePlayer can stand in for the game:
+
+  CapturePlayer -s 1 -p DeltaBest.capture &
+  SharedDeltaReader -t 60
+
+Build (Linux, from the repository root):
+
+  g++ -std=c++11 -O2 -pthread -IInclude -ITools -ITools/Posix -D__cdecl= -o SharedDeltaReader \
+      Tools/SharedDeltaReader.cpp Source/SharedDelta.cpp \
+      Source/InputTrace.cpp Source/SegmentStats.cpp \
+      Source/DeltaEngine.cpp \
+      Source/DeltaGraph.cpp Source/TrackMap.cpp Source/OverlayGeometry.cpp -lrt
+
+Usage:
+
+  SharedDeltaReader [-t seconds] [-i microseconds] [-n name]
+
+  -t  Stop after that many seconds, runs until interrupted by default
+  -i  Polling interval, 100us by default, 0 to spin
+  -n  Region name, instead of the plugin's
+
+*/
+
+#include "SharedDelta.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+/* Microseconds from publishing to reading */
+struct Latency {
+	std::vector<double> samples;
+	unsigned long failed;
+};
+
+static double Percentile(std::vector<double> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+static void PrintLatency(const char *label, Latency *latency, double seconds)
+{
+	std::vector<double> &s = latency->samples;
+	std::sort(s.begin(), s.end());
+	printf("%s%6lu updates %7.1f/s  latency us p50 %7.1f p99 %7.1f max %8.1f  busy %lu\n",
+		label, (unsigned long) s.size(), seconds > 0 ? s.size() / seconds : 0,
+		Percentile(s, 0.5), Percentile(s, 0.99), s.empty() ? 0 : s.back(), latency->failed);
+}
+
+static void PrintState(const SharedDeltaData &data)
+{
+	if (! (data.flags & SHARED_DELTA_REALTIME)) {
+		printf("  not driving\n");
+		return;
+	}
+
+	printf("  et %9.3f  lap %7.1f/%.0fm %8.3fs", data.session_et, data.lap_distance, data.track_length, data.lap_elapsed);
+	if (data.flags & SHARED_DELTA_VALID)
+		printf("  delta %+7.3f (%+.3f/s, %+.3f/100m)  gap %+6.1fm  predicted %.3f of %.3f",
+			data.delta, data.delta_rate, data.delta_slope, data.distance_gap, data.predicted_lap, data.best_lap);
+	if (data.split_sector == 3)
+		printf("  line %+7.3f", data.split_delta);
+	else if (data.split_sector != 0)
+		printf("  S%d %+7.3f%s", data.split_sector, data.split_delta, data.split_official ? "" : " (telemetry)");
+	if (data.flags & SHARED_DELTA_IN_PITS)
+		printf("  pits");
+	printf("\n");
+}
+
+static void Usage()
+{
+	fprintf(stderr, "Usage: SharedDeltaReader [-t seconds] [-i microseconds] [-n name]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	double run_seconds = 0;
+	int interval_us = 100;
+	const char *name = SHARED_DELTA_NAME;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			run_seconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+			interval_us = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			name = argv[++i];
+		else
+			Usage();
+	}
+
+	SharedDelta shared;
+	memset(&shared, 0, sizeof(shared));
+
+	Latency second, total;
+	second.failed = total.failed = 0;
+	SharedDeltaData data;
+	memset(&data, 0, sizeof(data));
+	uint32_t last_sequence = 0;
+	bool have_data = false, waiting = false;
+
+	uint64_t start = SharedDeltaClock(), report = start;
+	for (;;) {
+		uint64_t now = SharedDeltaClock();
+		if (run_seconds > 0 && now - start >= (uint64_t) (run_seconds * 1e9))
+			break;
+
+		/* The plugin may not be running yet */
+		if (shared.region == NULL && ! SharedDeltaOpen(&shared, name)) {
+			if (! waiting)
+				printf("Waiting for '%s'...\n", name);
+			waiting = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			continue;
+		}
+		waiting = false;
+
+		SharedDeltaData copy;
+		uint32_t sequence;
+		if (! SharedDeltaRead(&shared, &copy, &sequence)) {
+			second.failed++;
+			total.failed++;
+		}
+		else if (sequence != last_sequence) {
+			uint64_t seen = SharedDeltaClock();
+			double us = seen >= copy.publish_time ? (seen - copy.publish_time) / 1000.0 : 0;
+			second.samples.push_back(us);
+			total.samples.push_back(us);
+			last_sequence = sequence;
+			data = copy;
+			have_data = true;
+		}
+
+		if (now - report >= 1000000000ULL) {
+			PrintLatency("", &second, (now - report) / 1e9);
+			if (have_data)
+				PrintState(data);
+			second.samples.clear();
+			second.failed = 0;
+			report = now;
+		}
+
+		if (interval_us > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(interval_us));
+	}
+
+	PrintLatency("Total ", &total, (SharedDeltaClock() - start) / 1e9);
+	SharedDeltaClose(&shared);
+	return 0;
+}